@@ -25,6 +25,7 @@
 #include "radius/radius_client.h"
 #include "ap/wpa_auth.h"
 #include "ap/ap_config.h"
+#include "ap/acs_score.h"
 #include "config_file.h"
 
 
@@ -685,6 +686,46 @@ static int hostapd_parse_rates(int **rate_list, char *val)
 }
 
 
+#ifdef CONFIG_FULL_DYNAMIC_VLAN
+static int hostapd_config_parse_vlan_pool(struct hostapd_ssid *ssid,
+					  char *val)
+{
+	int *list, *n, count = 0, start, end;
+	char *pos;
+
+	os_free(ssid->vlan_pool);
+	ssid->vlan_pool = NULL;
+
+	list = os_zalloc(sizeof(int) * (MAX_VLAN_ID + 1));
+	if (list == NULL)
+		return -1;
+
+	pos = val;
+	while (*pos != '\0') {
+		start = end = strtol(pos, &pos, 10);
+		if (*pos == '-')
+			end = strtol(pos + 1, &pos, 10);
+		if (*pos != ' ' && *pos != '\0')
+			break;
+		if (start < 1 || end > MAX_VLAN_ID || start > end)
+			break;
+		while (start <= end && count < MAX_VLAN_ID)
+			list[count++] = start++;
+		while (*pos == ' ')
+			pos++;
+	}
+	if (*pos != '\0') {
+		os_free(list);
+		return -1;
+	}
+
+	n = os_realloc(list, sizeof(int) * (count + 1));
+	ssid->vlan_pool = n ? n : list;
+	return 0;
+}
+#endif /* CONFIG_FULL_DYNAMIC_VLAN */
+
+
 static int hostapd_config_bss(struct hostapd_config *conf, const char *ifname)
 {
 	struct hostapd_bss_config *bss;
@@ -1782,6 +1823,38 @@ struct hostapd_config * hostapd_config_read(const char *fname)
 					   "1..5000)", line, val);
 			} else
 				conf->acs_roc_duration_ms = val;
+		} else if (os_strcmp(buf, "acs_algo") == 0) {
+			int val = acs_algo_parse(pos);
+			if (val < 0) {
+				wpa_printf(MSG_ERROR, "Line %d: unknown "
+					   "acs_algo '%s'", line, pos);
+				errors++;
+			} else
+				conf->acs_algo = val;
+		} else if (os_strcmp(buf, "acs_stop_margin") == 0) {
+			conf->acs_stop_margin = atof(pos);
+		} else if (os_strcmp(buf, "acs_max_duration_ms") == 0) {
+			conf->acs_max_duration_ms = atoi(pos);
+		} else if (os_strcmp(buf, "acs_offchan_max_ms_per_sec") == 0) {
+			int val = atoi(pos);
+			if (val < 0 || val > 1000) {
+				wpa_printf(MSG_ERROR, "Line %d: invalid "
+					   "acs_offchan_max_ms_per_sec %d "
+					   "(expected 0..1000)", line, val);
+				errors++;
+			} else
+				conf->acs_offchan_max_ms_per_sec = val;
+		} else if (os_strcmp(buf, "acs_coord_dir") == 0) {
+			os_free(conf->acs_coord_dir);
+			conf->acs_coord_dir = os_strdup(pos);
+		} else if (os_strcmp(buf, "acs_coord_wait_ms") == 0) {
+			conf->acs_coord_wait_ms = atoi(pos);
+		} else if (os_strcmp(buf, "acs_chan_list") == 0) {
+			if (hostapd_parse_rates(&conf->acs_chan_list, pos)) {
+				wpa_printf(MSG_ERROR, "Line %d: invalid "
+					   "acs_chan_list", line);
+				errors++;
+			}
 #else
 		} else if (os_strcmp(buf, "acs_num_req_surveys") == 0) {
 			int val = atoi(pos);
@@ -1795,6 +1868,10 @@ struct hostapd_config * hostapd_config_read(const char *fname)
 				   "acs_roc_duration_ms %d (CONFIG_ACS disabled)"
 				   "1..5000)", line, val);
 			errors++;
+		} else if (os_strcmp(buf, "acs_algo") == 0) {
+			wpa_printf(MSG_ERROR, "Line %d: invalid acs_algo '%s' "
+				   "(CONFIG_ACS disabled)", line, pos);
+			errors++;
 #endif /* CONFIG_ACS */
 		} else if (os_strcmp(buf, "dtim_period") == 0) {
 			bss->dtim_period = atoi(pos);
@@ -1879,6 +1956,12 @@ struct hostapd_config * hostapd_config_read(const char *fname)
 #ifdef CONFIG_FULL_DYNAMIC_VLAN
 		} else if (os_strcmp(buf, "vlan_tagged_interface") == 0) {
 			bss->ssid.vlan_tagged_interface = os_strdup(pos);
+		} else if (os_strcmp(buf, "vlan_pool") == 0) {
+			if (hostapd_config_parse_vlan_pool(&bss->ssid, pos)) {
+				wpa_printf(MSG_ERROR, "Line %d: invalid "
+					   "vlan_pool '%s'", line, pos);
+				errors++;
+			}
 #endif /* CONFIG_FULL_DYNAMIC_VLAN */
 #endif /* CONFIG_NO_VLAN */
 		} else if (os_strcmp(buf, "ap_table_max_size") == 0) {
@@ -2041,6 +2124,16 @@ struct hostapd_config * hostapd_config_read(const char *fname)
 			}
 		} else if (os_strcmp(buf, "wps_cred_processing") == 0) {
 			bss->wps_cred_processing = atoi(pos);
+		} else if (os_strcmp(buf, "wps_dh_key_pool") == 0) {
+			bss->wps_dh_key_pool = atoi(pos);
+			if (bss->wps_dh_key_pool < 0 ||
+			    bss->wps_dh_key_pool > WPS_MAX_DH_KEY_POOL) {
+				wpa_printf(MSG_ERROR, "Line %d: Invalid "
+					   "wps_dh_key_pool=%d; allowed range "
+					   "0..%d", line, bss->wps_dh_key_pool,
+					   WPS_MAX_DH_KEY_POOL);
+				errors++;
+			}
 		} else if (os_strcmp(buf, "ap_settings") == 0) {
 			os_free(bss->ap_settings);
 			bss->ap_settings =
@@ -20,16 +20,14 @@
 
 #include "includes.h"
 #include "acs.h"
+#include "utils/eloop.h"
 #include "drivers/driver.h"
 #include "ap/ap_drv_ops.h"
 #include "ap/ap_config.h"
+#include "ap/sta_info.h"
 #include "ap/hw_features.h"
-
-/*
- * Until we get really bored and implement OS support for
- * others on os.[ch]
- */
-#include <math.h>
+#include "ap/acs_score.h"
+#include "ap/acs_coord.h"
 
 /*
  * Automatic Channel Selection
@@ -86,11 +84,16 @@ static void acs_clean_chan_surveys(struct hostapd_channel_data *chan)
 	}
 }
 
+static void acs_roc_timeout(void *eloop_ctx, void *timeout_ctx);
+
 static void acs_cleanup(struct hostapd_iface *iface)
 {
 	unsigned int i;
 	struct hostapd_channel_data *chan;
 
+	eloop_cancel_timeout(acs_roc_timeout, iface, NULL);
+	iface->acs_defer_count = 0;
+
 	for (i = 0; i < iface->current_mode->num_channels; i++) {
 		chan = &iface->current_mode->channels[i];
 
@@ -107,75 +110,116 @@ static void acs_cleanup(struct hostapd_iface *iface)
 	iface->acs_num_completed_surveys = 0;
 }
 
+void acs_deinit(struct hostapd_iface *iface)
+{
+	eloop_cancel_timeout(acs_roc_timeout, iface, NULL);
+	acs_coord_deinit(iface->acs_coord);
+	iface->acs_coord = NULL;
+}
+
 void acs_fail(struct hostapd_iface *iface)
 {
 	wpa_printf(MSG_ERROR, "ACS: failed to start");
 	acs_cleanup(iface);
 }
 
-/*
- * XXX: Use libm's pow thingy? If we can implement our own log2() then
- * we can keep this here and remove libm support from hostapd, not
- * sure if its worth it.
- */
-static u64 base_to_power(u64 base, u64 pow)
+static int acs_chan_num_bss(struct hostapd_iface *iface,
+			    struct hostapd_channel_data *chan)
 {
-	u64 result = base;
-
-	if (pow == 0)
-		return 1;
+	size_t i;
+	int num = 0;
 
-	pow--;
-	while (pow--)
-		result *= base;
-
-	return result;
-}
-
-static long double acs_survey_interference_factor(struct freq_survey *survey, s8 min_nf)
-{
-	long double factor;
+	if (iface->scan_res == NULL)
+		return 0;
 
-	factor = survey->channel_time_busy - survey->channel_time_tx;
-	factor /= (survey->channel_time - survey->channel_time_tx);
-	factor *= (base_to_power(2, survey->nf - min_nf));
-	factor = log2(factor);
+	for (i = 0; i < iface->scan_res->num; i++) {
+		if (iface->scan_res->res[i]->freq == chan->freq)
+			num++;
+	}
 
-	return factor;
+	return num;
 }
 
 static void acs_chan_interference_factor(struct hostapd_iface *iface,
-					 struct hostapd_channel_data *chan)
+					 struct hostapd_channel_data *chan,
+					 int num_bss)
 {
 	struct freq_survey *survey;
 	unsigned int i = 0;
 	long double int_factor = 0;
 
+	chan->survey_interference_factor = 0;
+
 	if (dl_list_empty(&chan->survey_list) || chan->flag & HOSTAPD_CHAN_DISABLED)
 		return;
 
 	dl_list_for_each(survey, &chan->survey_list, struct freq_survey, list_member) {
-		int_factor = acs_survey_interference_factor(survey, iface->lowest_nf);
+		int_factor = acs_survey_factor(iface->conf->acs_algo, survey,
+					       iface->lowest_nf);
 		chan->survey_interference_factor += int_factor;
 		wpa_printf(MSG_DEBUG, "\tsurvey_id: %d"
 			   "\tchan_min_nf: %d\tsurvey_interference_factor: %Lf",
 			   ++i, chan->min_nf, int_factor);
+		/* Machine readable trace for offline evaluation */
+		wpa_printf(MSG_DEBUG, "ACS: survey freq=%u nf=%d time=%llu "
+			   "busy=%llu rx=%llu tx=%llu bss=%d",
+			   survey->freq, survey->nf,
+			   (unsigned long long) survey->channel_time,
+			   (unsigned long long) survey->channel_time_busy,
+			   (unsigned long long) survey->channel_time_rx,
+			   (unsigned long long) survey->channel_time_tx,
+			   num_bss);
 	}
 
 	/* XXX: remove survey count */
 
 	chan->survey_interference_factor = chan->survey_interference_factor / chan->survey_count;
+	chan->survey_interference_factor +=
+		acs_chan_penalty(iface->conf->acs_algo, chan, num_bss);
 }
 
-static int acs_usable_chan(struct hostapd_channel_data *chan)
+/*
+ * Channels that could be selected: enabled, in acs_chan_list if one is
+ * configured, and when HT40 is configured, with the secondary channel being
+ * enabled, too. Only these are surveyed.
+ */
+static int acs_candidate_chan(struct hostapd_iface *iface,
+			      struct hostapd_channel_data *chan)
+{
+	struct hostapd_channel_data *sec;
+	int *list;
+
+	if (chan->flag & HOSTAPD_CHAN_DISABLED)
+		return 0;
+
+	if (iface->conf->acs_chan_list) {
+		for (list = iface->conf->acs_chan_list; *list >= 0; list++) {
+			if (*list == chan->chan)
+				break;
+		}
+		if (*list < 0)
+			return 0;
+	}
+
+	if (iface->conf->secondary_channel) {
+		sec = hostapd_hw_chan_to_chan_data(
+			iface, iface->current_mode,
+			chan->chan + iface->conf->secondary_channel * 4);
+		if (sec == NULL || (sec->flag & HOSTAPD_CHAN_DISABLED))
+			return 0;
+	}
+
+	return 1;
+}
+
+int acs_usable_chan(struct hostapd_iface *iface,
+		    struct hostapd_channel_data *chan)
 {
 	if (!chan->survey_count)
 		return 0;
 	if (dl_list_empty(&chan->survey_list))
 		return 0;
-	if (chan->flag & HOSTAPD_CHAN_DISABLED)
-		return 0;
-	return 1;
+	return acs_candidate_chan(iface, chan);
 }
 
 /*
@@ -186,11 +230,12 @@ struct hostapd_channel_data *acs_find_ideal_chan(struct hostapd_iface *iface)
 {
 	unsigned int i;
 	struct hostapd_channel_data *chan, *ideal_chan = NULL;
+	int num_bss, ideal_num_bss = 0;
 
 	for (i = 0; i < iface->current_mode->num_channels; i++) {
 		chan = &iface->current_mode->channels[i];
 
-		if (!acs_usable_chan(chan))
+		if (!acs_usable_chan(iface, chan))
 			continue;
 
 		wpa_printf(MSG_DEBUG, "------------------------- "
@@ -199,28 +244,171 @@ struct hostapd_channel_data *acs_find_ideal_chan(struct hostapd_iface *iface)
 			    chan->chan,
 			    chan->freq);
 
-		acs_chan_interference_factor(iface, chan);
+		num_bss = acs_chan_num_bss(iface, chan);
+		acs_chan_interference_factor(iface, chan, num_bss);
 
 		wpa_printf(MSG_DEBUG, "\tChannel survey interference factor average: %Lf",
 			   chan->survey_interference_factor);
 
-		if (!ideal_chan)
+		/* Number of BSSes from the initial scan breaks ties */
+		wpa_printf(MSG_DEBUG, "\tBSSes found in initial scan: %d",
+			   num_bss);
+
+		if (!ideal_chan ||
+		    chan->survey_interference_factor <
+		    ideal_chan->survey_interference_factor ||
+		    (chan->survey_interference_factor ==
+		     ideal_chan->survey_interference_factor &&
+		     num_bss < ideal_num_bss)) {
 			ideal_chan = chan;
-		else {
-			if (chan->survey_interference_factor < ideal_chan->survey_interference_factor)
-				ideal_chan = chan;
+			ideal_num_bss = num_bss;
 		}
 	}
 
 	return ideal_chan;
 }
 
+/*
+ * Off-channel scheduling
+ *
+ * While there are associated stations, off-channel dwells are kept shorter
+ * than the beacon interval and separated by at least one beacon interval on
+ * the operating channel, so that a dwell can overlap with at most every other
+ * TBTT and power saving stations can fetch their buffered frames after the
+ * others. Dwells are deferred (up to ACS_MAX_DEFER beacon intervals) while a
+ * station is completing its EAPOL/EAP handshake. In addition, the total
+ * off-channel time can be capped per second with acs_offchan_max_ms_per_sec.
+ */
+#define ACS_MAX_DEFER 10
+
+static int acs_serving_stas(struct hostapd_iface *iface)
+{
+	size_t i;
+
+	for (i = 0; i < iface->num_bss; i++) {
+		if (iface->bss[i]->num_sta)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int acs_handshake_ongoing(struct hostapd_iface *iface)
+{
+	struct sta_info *sta;
+	size_t i;
+
+	for (i = 0; i < iface->num_bss; i++) {
+		for (sta = iface->bss[i]->sta_list; sta; sta = sta->next) {
+			if ((sta->flags & WLAN_STA_ASSOC) &&
+			    !(sta->flags & WLAN_STA_AUTHORIZED))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+static unsigned int acs_ms_since(struct os_time *t)
+{
+	struct os_time now, diff;
+
+	os_get_time(&now);
+	os_time_sub(&now, t, &diff);
+	if (diff.sec < 0)
+		return 0;
+	return diff.sec * 1000 + diff.usec / 1000;
+}
+
+static unsigned int acs_roc_delay(struct hostapd_iface *iface,
+				  unsigned int dwell)
+{
+	unsigned int beacon_ms = iface->conf->beacon_int * 1024 / 1000;
+	unsigned int delay = 0, elapsed;
+	unsigned int cap = iface->conf->acs_offchan_max_ms_per_sec;
+
+	if (acs_serving_stas(iface)) {
+		elapsed = acs_ms_since(&iface->acs_last_roc_end);
+		if (elapsed < beacon_ms)
+			delay = beacon_ms - elapsed;
+		if (iface->acs_defer_count < ACS_MAX_DEFER &&
+		    acs_handshake_ongoing(iface)) {
+			iface->acs_defer_count++;
+			if (delay < beacon_ms)
+				delay = beacon_ms;
+		}
+	}
+
+	if (cap) {
+		elapsed = acs_ms_since(&iface->acs_offchan_window);
+		if (elapsed >= 1000) {
+			os_get_time(&iface->acs_offchan_window);
+			iface->acs_offchan_used_ms = 0;
+			elapsed = 0;
+		}
+		if (iface->acs_offchan_used_ms &&
+		    iface->acs_offchan_used_ms + dwell > cap &&
+		    delay < 1000 - elapsed)
+			delay = 1000 - elapsed;
+	}
+
+	return delay;
+}
+
+static int acs_schedule_roc(struct hostapd_iface *iface)
+{
+	struct hostapd_channel_data *chan;
+	unsigned int dwell, delay, max_dwell;
+
+	chan = &iface->current_mode->channels[iface->off_channel_freq_idx];
+
+	dwell = iface->conf->acs_roc_duration_ms;
+	if (acs_serving_stas(iface)) {
+		/* Fit between TBTTs with 25% guard time */
+		max_dwell = iface->conf->beacon_int * 1024 / 1000 * 3 / 4;
+		if (max_dwell == 0)
+			max_dwell = 1;
+		if (dwell > max_dwell)
+			dwell = max_dwell;
+	}
+	if (iface->conf->acs_offchan_max_ms_per_sec &&
+	    dwell > iface->conf->acs_offchan_max_ms_per_sec)
+		dwell = iface->conf->acs_offchan_max_ms_per_sec;
+
+	delay = acs_roc_delay(iface, dwell);
+	if (delay) {
+		wpa_printf(MSG_EXCESSIVE, "ACS: going offchannel on freq %d "
+			   "MHz in %u ms", chan->freq, delay);
+		eloop_register_timeout(delay / 1000, (delay % 1000) * 1000,
+				       acs_roc_timeout, iface, NULL);
+		return 0;
+	}
+
+	iface->acs_defer_count = 0;
+	if (hostapd_drv_remain_on_channel(iface->bss[0], chan->freq, dwell) <
+	    0) {
+		wpa_printf(MSG_ERROR, "ACS: request to go offchannel "
+			   "on freq %d MHz failed",
+			   chan->freq);
+		return -1;
+	}
+	iface->acs_offchan_used_ms += dwell;
+
+	return 0;
+}
+
+static void acs_roc_timeout(void *eloop_ctx, void *timeout_ctx)
+{
+	struct hostapd_iface *iface = eloop_ctx;
+
+	if (acs_schedule_roc(iface) < 0)
+		acs_fail(iface);
+}
+
 static enum hostapd_chan_status acs_study_next_freq(struct hostapd_iface *iface)
 {
-	int err;
 	unsigned int i;
 	struct hostapd_channel_data *chan;
-	struct hostapd_data *hapd = iface->bss[0];
 
 	if (iface->off_channel_freq_idx > iface->current_mode->num_channels) {
 		wpa_printf(MSG_ERROR, "ACS: channel index out of bounds");
@@ -229,19 +417,14 @@ static enum hostapd_chan_status acs_study_next_freq(struct hostapd_iface *iface)
 
 	for (i = iface->off_channel_freq_idx; i < iface->current_mode->num_channels; i++) {
 		chan = &iface->current_mode->channels[i];
-		if (chan->flag & HOSTAPD_CHAN_DISABLED)
+		if (!acs_candidate_chan(iface, chan))
 			continue;
 
-		err = hostapd_drv_remain_on_channel(hapd, chan->freq, iface->conf->acs_roc_duration_ms);
-		if (err < 0) {
-			wpa_printf(MSG_ERROR, "ACS: request to go offchannel "
-				   "on freq %d MHz failed",
-				   chan->freq);
-			return HOSTAPD_CHAN_INVALID;
-		}
-
 		iface->off_channel_freq_idx = i;
 
+		if (acs_schedule_roc(iface) < 0)
+			return HOSTAPD_CHAN_INVALID;
+
 		return HOSTAPD_CHAN_ACS;
 	}
 
@@ -253,13 +436,84 @@ static enum hostapd_chan_status acs_study_next_freq(struct hostapd_iface *iface)
 	return HOSTAPD_CHAN_VALID;
 }
 
+/*
+ * Check after a completed pass over all channels whether more passes are
+ * needed: not if the wall-clock budget is used up or the best channel is
+ * already clearly separated from the runner-up, i.e., the 95% confidence
+ * intervals of their scores are at least acs_stop_margin apart.
+ */
+static int acs_study_done(struct hostapd_iface *iface)
+{
+	struct hostapd_config *conf = iface->conf;
+	struct hostapd_channel_data *chan, *best = NULL, *second = NULL;
+	long double score, ci, best_score = 0, best_ci = 0;
+	long double second_score = 0, second_ci = 0;
+	struct os_time now, diff;
+	unsigned int i;
+
+	if (iface->acs_num_completed_surveys >= conf->acs_num_req_surveys)
+		return 1;
+
+	if (conf->acs_max_duration_ms) {
+		os_get_time(&now);
+		os_time_sub(&now, &iface->acs_start, &diff);
+		if (diff.sec * 1000 + diff.usec / 1000 >=
+		    (os_time_t) conf->acs_max_duration_ms) {
+			wpa_printf(MSG_DEBUG, "ACS: time budget of %u ms used "
+				   "after %u surveys per channel",
+				   conf->acs_max_duration_ms,
+				   iface->acs_num_completed_surveys);
+			return 1;
+		}
+	}
+
+	if (conf->acs_stop_margin < 0)
+		return 0;
+
+	for (i = 0; i < iface->current_mode->num_channels; i++) {
+		chan = &iface->current_mode->channels[i];
+		if (!acs_usable_chan(iface, chan))
+			continue;
+		if (acs_chan_score_ci(conf->acs_algo, chan, iface->lowest_nf,
+				      acs_chan_num_bss(iface, chan),
+				      &score, &ci) < 0)
+			return 0;
+		if (best == NULL || score < best_score) {
+			second = best;
+			second_score = best_score;
+			second_ci = best_ci;
+			best = chan;
+			best_score = score;
+			best_ci = ci;
+		} else if (second == NULL || score < second_score) {
+			second = chan;
+			second_score = score;
+			second_ci = ci;
+		}
+	}
+
+	if (best == NULL || second == NULL)
+		return best != NULL;
+
+	if (best_score + best_ci + conf->acs_stop_margin >
+	    second_score - second_ci)
+		return 0;
+
+	wpa_printf(MSG_DEBUG, "ACS: channel %d (%Lf +- %Lf) separated from "
+		   "channel %d (%Lf +- %Lf) after %u surveys per channel",
+		   best->chan, best_score, best_ci,
+		   second->chan, second_score, second_ci,
+		   iface->acs_num_completed_surveys);
+	return 1;
+}
+
 static void acs_study_complete(struct hostapd_iface *iface)
 {
 	struct hostapd_channel_data *ideal_chan;
 
 	iface->acs_num_completed_surveys++;
 
-	if (iface->acs_num_completed_surveys < iface->conf->acs_num_req_surveys) {
+	if (!acs_study_done(iface)) {
 		iface->off_channel_freq_idx = 0;
 
 		switch (acs_study_next_freq(iface)) {
@@ -290,11 +544,36 @@ static void acs_study_complete(struct hostapd_iface *iface)
 		goto fail;
 	}
 
+	if (iface->acs_coord) {
+		/* acs_chan_selected() is called once peers have been heard */
+		acs_coord_start(iface->acs_coord, ideal_chan);
+		return;
+	}
+
+	acs_chan_selected(iface, ideal_chan);
+	return;
+
+fail:
+	acs_fail(iface);
+}
+
+/**
+ * acs_chan_selected - Complete ACS with the selected channel
+ * @iface: Pointer to interface data
+ * @ideal_chan: Selected channel; one for which acs_usable_chan() is true
+ */
+void acs_chan_selected(struct hostapd_iface *iface,
+		       struct hostapd_channel_data *ideal_chan)
+{
 	wpa_printf(MSG_DEBUG, "-------------------------------------------------------------------------");
 	wpa_printf(MSG_INFO, "ACS: Ideal chan: %d (%d MHz) Average interference factor: %Lf",
 		   ideal_chan->chan,
 		   ideal_chan->freq,
 		   ideal_chan->survey_interference_factor);
+	wpa_printf(MSG_INFO, "ACS: algorithm %s: predicted airtime "
+		   "availability %.1f%%",
+		   acs_algo_txt(iface->conf->acs_algo),
+		   100.0 * acs_chan_airtime(ideal_chan));
 	wpa_printf(MSG_DEBUG, "-------------------------------------------------------------------------");
 
 	iface->conf->channel = ideal_chan->chan;
@@ -337,6 +616,8 @@ static void acs_roc_next(struct hostapd_iface *iface,
 
 	wpa_printf(MSG_EXCESSIVE, "ACS: offchannel on freq %d MHz", freq);
 
+	os_get_time(&iface->acs_last_roc_end);
+
 	err = hostapd_drv_survey_freq(hapd, freq);
 	if (err) {
 		/* XXX: figure out why we are not getting out of here */
@@ -392,6 +673,17 @@ void hostapd_notify_acs_roc_cancel(struct hostapd_iface *iface,
 
 static void acs_init_scan_complete(struct hostapd_iface *iface)
 {
+	struct wpa_scan_results *scan_res;
+
+	/*
+	 * Keep the results of the full scan around so that the 20/40 MHz
+	 * coexistence check after channel selection does not need to scan
+	 * again.
+	 */
+	scan_res = hostapd_driver_get_scan_results(iface->bss[0]);
+	if (scan_res)
+		hostapd_iface_set_scan_res(iface, scan_res);
+
 	wpa_printf(MSG_DEBUG, "ACS: using survey based algorithm "
 		   "(acs_num_req_surveys=%d acs_roc_duration_ms=%d)",
 		   iface->conf->acs_num_req_surveys,
@@ -415,7 +707,8 @@ static int acs_init_scan(struct hostapd_iface *iface)
 {
 	struct wpa_driver_scan_params params;
 
-	wpa_printf(MSG_DEBUG, "ACS: initial scan just to kick off the hw a bit...");
+	wpa_printf(MSG_DEBUG, "ACS: initial scan to kick off the hw and find "
+		   "neighboring BSSes");
 	os_memset(&params, 0, sizeof(params));
 
 	if (hostapd_driver_scan(iface->bss[0], &params) < 0) {
@@ -450,10 +743,19 @@ enum hostapd_chan_status acs_init(struct hostapd_iface *iface)
 
 	wpa_printf(MSG_INFO, "ACS: automatic channel selection started, this may take a bit");
 
+	os_get_time(&iface->acs_start);
+
 	err = acs_sanity_check(iface);
 	if (err < 0)
 		return HOSTAPD_CHAN_INVALID;
 
+	if (iface->conf->acs_coord_dir && iface->acs_coord == NULL) {
+		iface->acs_coord = acs_coord_init(iface,
+						  iface->conf->acs_coord_dir);
+		if (iface->acs_coord == NULL)
+			return HOSTAPD_CHAN_INVALID;
+	}
+
 	err = acs_init_scan(iface);
 	if (err < 0)
 		return HOSTAPD_CHAN_INVALID;
@@ -5,8 +5,16 @@
 #include "ap/hostapd.h"
 #include "list.h"
 
+struct hostapd_channel_data;
+
 #ifdef CONFIG_ACS
 enum hostapd_chan_status acs_init(struct hostapd_iface *iface);
+void acs_deinit(struct hostapd_iface *iface);
+void acs_fail(struct hostapd_iface *iface);
+int acs_usable_chan(struct hostapd_iface *iface,
+		    struct hostapd_channel_data *chan);
+void acs_chan_selected(struct hostapd_iface *iface,
+		       struct hostapd_channel_data *ideal_chan);
 void hostapd_notify_acs_roc(struct hostapd_iface *iface,
 			    unsigned int freq,
 			    unsigned int duration,
@@ -23,6 +31,9 @@ static inline enum hostapd_chan_status acs_init(struct hostapd_iface *iface)
 		   "rebuild hostapd with CONFIG_ACS=1");
 	return HOSTAPD_CHAN_INVALID;
 }
+static inline void acs_deinit(struct hostapd_iface *iface)
+{
+}
 static inline void hostapd_notify_acs_roc(struct hostapd_iface *iface,
 					  unsigned int freq,
 					  unsigned int duration,
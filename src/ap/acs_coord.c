@@ -0,0 +1,575 @@
+/*
+ * ACS - coordinated channel selection between APs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ */
+
+#include "utils/includes.h"
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "utils/common.h"
+#include "utils/eloop.h"
+#include "utils/list.h"
+#include "drivers/driver.h"
+#include "ap/hostapd.h"
+#include "ap/ap_config.h"
+#include "ap/acs.h"
+#include "ap/acs_coord.h"
+
+/*
+ * Coordinated channel selection
+ *
+ * APs that share acs_coord_dir have a UNIX domain datagram socket each in
+ * that directory (named after the interface) and send text messages to all
+ * the other sockets in the directory:
+ *
+ * ACS-COORD tentative <BSSID> <freq> <freq>:<score> ...
+ *	sent when the own survey is complete; <freq> is the channel the AP
+ *	would pick on its own and the list contains the score (x1000) of each
+ *	usable channel
+ * ACS-COORD final <BSSID> <freq>
+ *	sent when the AP has selected its channel and as a reply to tentative
+ *	messages after that
+ *
+ * The channels are assigned greedily like in graph coloring: the APs pick
+ * their channel one after another, each one adding a penalty to the channels
+ * already taken by the others. The AP that would lose most by not getting its
+ * best channel (largest score difference between its best and second best
+ * channel) picks first; ties are broken by the lower BSSID. Each AP waits for
+ * acs_coord_wait_ms to hear from the others after its own survey and then
+ * until all the APs ahead of it have announced their final channel. To avoid
+ * getting stuck on APs that disappear, the channel is picked anyway after five
+ * times acs_coord_wait_ms.
+ */
+
+#define ACS_COORD_DEADLINE_FACTOR 5
+#define ACS_COORD_SCORE_MAX 1000000
+#define ACS_COORD_MAX_CHAN 64
+
+enum acs_coord_state {
+	ACS_COORD_IDLE, ACS_COORD_WAIT, ACS_COORD_DONE
+};
+
+struct acs_coord_peer {
+	struct dl_list list;
+	u8 addr[ETH_ALEN];
+	char name[64]; /* socket file name in the directory */
+	int freq;
+	int final;
+	int regret;
+};
+
+struct acs_coord {
+	struct hostapd_iface *iface;
+	int sock;
+	char *dir;
+	char *path;
+	const char *name;
+	enum acs_coord_state state;
+	int window_over;
+	struct dl_list peers; /* struct acs_coord_peer */
+
+	/* own survey summary */
+	int num_chan;
+	int chan_freq[ACS_COORD_MAX_CHAN];
+	int chan_score[ACS_COORD_MAX_CHAN];
+	int regret;
+	int freq;
+};
+
+
+static int acs_coord_score(struct hostapd_channel_data *chan)
+{
+	long double score = chan->survey_interference_factor * 1000;
+
+	/* Surveys without any busy time give -inf */
+	if (!(score > -ACS_COORD_SCORE_MAX))
+		return -ACS_COORD_SCORE_MAX;
+	if (!(score < ACS_COORD_SCORE_MAX))
+		return ACS_COORD_SCORE_MAX;
+	return (int) score;
+}
+
+
+/* Score difference between the best and the second best channel */
+static int acs_coord_regret(const int *score, int num)
+{
+	int i, best = ACS_COORD_SCORE_MAX, second = ACS_COORD_SCORE_MAX;
+
+	if (num < 2)
+		return 2 * ACS_COORD_SCORE_MAX;
+
+	for (i = 0; i < num; i++) {
+		if (score[i] < best) {
+			second = best;
+			best = score[i];
+		} else if (score[i] < second)
+			second = score[i];
+	}
+
+	return second - best;
+}
+
+
+/* Whether the peer picks its channel before us */
+static int acs_coord_peer_first(struct acs_coord *coord,
+				struct acs_coord_peer *peer)
+{
+	if (peer->regret != coord->regret)
+		return peer->regret > coord->regret;
+	return os_memcmp(peer->addr, coord->iface->bss[0]->own_addr,
+			 ETH_ALEN) < 0;
+}
+
+
+static void acs_coord_send_to(struct acs_coord *coord, const char *name,
+			      const char *msg)
+{
+	struct sockaddr_un addr;
+
+	os_memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	os_snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s",
+		    coord->dir, name);
+	if (sendto(coord->sock, msg, os_strlen(msg), 0,
+		   (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		/* Left over socket from an AP that is not running */
+		wpa_printf(MSG_DEBUG, "ACS: coord: sendto(%s): %s",
+			   addr.sun_path, strerror(errno));
+	}
+}
+
+
+static void acs_coord_send(struct acs_coord *coord, const char *name,
+			   const char *msg)
+{
+	DIR *dir;
+	struct dirent *dent;
+
+	wpa_printf(MSG_DEBUG, "ACS: coord: send to %s: %s",
+		   name ? name : "all", msg);
+
+	if (name) {
+		acs_coord_send_to(coord, name, msg);
+		return;
+	}
+
+	dir = opendir(coord->dir);
+	if (dir == NULL) {
+		wpa_printf(MSG_ERROR, "ACS: coord: opendir(%s): %s",
+			   coord->dir, strerror(errno));
+		return;
+	}
+	while ((dent = readdir(dir))) {
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (dent->d_type != DT_SOCK && dent->d_type != DT_UNKNOWN)
+			continue;
+#endif /* _DIRENT_HAVE_D_TYPE */
+		if (os_strcmp(dent->d_name, ".") == 0 ||
+		    os_strcmp(dent->d_name, "..") == 0 ||
+		    os_strcmp(dent->d_name, coord->name) == 0)
+			continue;
+		acs_coord_send_to(coord, dent->d_name, msg);
+	}
+	closedir(dir);
+}
+
+
+static void acs_coord_send_state(struct acs_coord *coord, const char *name)
+{
+	char buf[1024], *pos, *end;
+	int i, ret;
+
+	pos = buf;
+	end = buf + sizeof(buf);
+	ret = os_snprintf(pos, end - pos, "ACS-COORD %s " MACSTR " %d",
+			  coord->state == ACS_COORD_DONE ? "final" :
+			  "tentative", MAC2STR(coord->iface->bss[0]->own_addr),
+			  coord->freq);
+	if (ret < 0 || ret >= end - pos)
+		return;
+	pos += ret;
+
+	for (i = 0; coord->state != ACS_COORD_DONE && i < coord->num_chan;
+	     i++) {
+		ret = os_snprintf(pos, end - pos, " %d:%d",
+				  coord->chan_freq[i], coord->chan_score[i]);
+		if (ret < 0 || ret >= end - pos)
+			return;
+		pos += ret;
+	}
+
+	acs_coord_send(coord, name, buf);
+}
+
+
+/* Number of channels (primary 20 MHz) overlapping with freq taken by peers */
+static int acs_coord_chan_taken(struct acs_coord *coord, int freq, int force)
+{
+	struct acs_coord_peer *peer;
+	int taken = 0;
+
+	dl_list_for_each(peer, &coord->peers, struct acs_coord_peer, list) {
+		if (!peer->final &&
+		    !(force && acs_coord_peer_first(coord, peer)))
+			continue;
+		if (abs(peer->freq - freq) < 20)
+			taken++;
+	}
+
+	return taken;
+}
+
+
+static void acs_coord_window_timeout(void *eloop_ctx, void *timeout_ctx);
+static void acs_coord_deadline_timeout(void *eloop_ctx, void *timeout_ctx);
+
+static void acs_coord_decide(struct acs_coord *coord, int force)
+{
+	struct hostapd_iface *iface = coord->iface;
+	struct hostapd_channel_data *chan, *best = NULL;
+	int i, taken, cost, best_cost = 0;
+
+	for (i = 0; i < iface->current_mode->num_channels; i++) {
+		chan = &iface->current_mode->channels[i];
+		if (!acs_usable_chan(iface, chan))
+			continue;
+
+		/*
+		 * Each AP less than 20 MHz away adds 1 to the interference
+		 * factor (1000 as score), i.e., counts as doubling the busy
+		 * time
+		 */
+		taken = acs_coord_chan_taken(coord, chan->freq, force);
+		cost = acs_coord_score(chan) + 1000 * taken;
+		wpa_printf(MSG_DEBUG, "ACS: coord: channel %d: score %d, "
+			   "taken by %d", chan->chan, acs_coord_score(chan),
+			   taken);
+		if (best == NULL || cost < best_cost ||
+		    (cost == best_cost && chan->freq == coord->freq)) {
+			best = chan;
+			best_cost = cost;
+		}
+	}
+
+	eloop_cancel_timeout(acs_coord_window_timeout, coord, NULL);
+	eloop_cancel_timeout(acs_coord_deadline_timeout, coord, NULL);
+
+	if (best == NULL) {
+		wpa_printf(MSG_ERROR, "ACS: coord: no usable channel left");
+		coord->state = ACS_COORD_IDLE;
+		acs_fail(iface);
+		return;
+	}
+
+	wpa_printf(MSG_INFO, "ACS: coordinated channel selection%s: channel %d "
+		   "(%d MHz), own choice %d MHz, %d peer(s)",
+		   force ? " (timeout)" : "", best->chan, best->freq,
+		   coord->freq, dl_list_len(&coord->peers));
+
+	coord->state = ACS_COORD_DONE;
+	coord->freq = best->freq;
+	acs_coord_send_state(coord, NULL);
+
+	acs_chan_selected(iface, best);
+}
+
+
+static void acs_coord_try_decide(struct acs_coord *coord)
+{
+	struct acs_coord_peer *peer;
+
+	if (coord->state != ACS_COORD_WAIT || !coord->window_over)
+		return;
+
+	dl_list_for_each(peer, &coord->peers, struct acs_coord_peer, list) {
+		if (!peer->final && acs_coord_peer_first(coord, peer)) {
+			wpa_printf(MSG_DEBUG, "ACS: coord: waiting for "
+				   MACSTR, MAC2STR(peer->addr));
+			return;
+		}
+	}
+
+	acs_coord_decide(coord, 0);
+}
+
+
+static void acs_coord_window_timeout(void *eloop_ctx, void *timeout_ctx)
+{
+	struct acs_coord *coord = eloop_ctx;
+
+	coord->window_over = 1;
+	acs_coord_try_decide(coord);
+}
+
+
+static void acs_coord_deadline_timeout(void *eloop_ctx, void *timeout_ctx)
+{
+	struct acs_coord *coord = eloop_ctx;
+
+	wpa_printf(MSG_INFO, "ACS: coord: no final channel from all peers");
+	acs_coord_decide(coord, 1);
+}
+
+
+static struct acs_coord_peer * acs_coord_get_peer(struct acs_coord *coord,
+						  const u8 *addr)
+{
+	struct acs_coord_peer *peer;
+
+	dl_list_for_each(peer, &coord->peers, struct acs_coord_peer, list) {
+		if (os_memcmp(peer->addr, addr, ETH_ALEN) == 0)
+			return peer;
+	}
+
+	return NULL;
+}
+
+
+static int acs_coord_parse_summary(struct acs_coord_peer *peer,
+				   const char *pos)
+{
+	int score[ACS_COORD_MAX_CHAN], num = 0, freq;
+	char *end;
+
+	while (*pos == ' ' && num < ACS_COORD_MAX_CHAN) {
+		pos++;
+		freq = strtol(pos, &end, 10);
+		if (end == pos || *end != ':')
+			return -1;
+		pos = end + 1;
+		score[num] = strtol(pos, &end, 10);
+		if (end == pos)
+			return -1;
+		wpa_printf(MSG_MSGDUMP, "ACS: coord: " MACSTR " %d MHz: %d",
+			   MAC2STR(peer->addr), freq, score[num]);
+		num++;
+		pos = end;
+	}
+
+	peer->regret = acs_coord_regret(score, num);
+	return 0;
+}
+
+
+static void acs_coord_receive(int sock, void *eloop_ctx, void *sock_ctx)
+{
+	struct acs_coord *coord = eloop_ctx;
+	struct acs_coord_peer *peer;
+	struct sockaddr_un from;
+	socklen_t fromlen = sizeof(from);
+	char buf[1024], *pos, *name;
+	u8 addr[ETH_ALEN];
+	int res, final, new_peer = 0;
+
+	os_memset(&from, 0, sizeof(from));
+	res = recvfrom(sock, buf, sizeof(buf) - 1, 0,
+		       (struct sockaddr *) &from, &fromlen);
+	if (res < 0) {
+		perror("recvfrom(acs_coord)");
+		return;
+	}
+	buf[res] = '\0';
+	wpa_printf(MSG_DEBUG, "ACS: coord: received: %s", buf);
+
+	if (os_strncmp(buf, "ACS-COORD ", 10) != 0)
+		return;
+	pos = buf + 10;
+	if (os_strncmp(pos, "final ", 6) == 0) {
+		final = 1;
+		pos += 6;
+	} else if (os_strncmp(pos, "tentative ", 10) == 0) {
+		final = 0;
+		pos += 10;
+	} else
+		return;
+	if (hwaddr_aton(pos, addr) < 0 || pos[17] != ' ' ||
+	    os_memcmp(addr, coord->iface->bss[0]->own_addr, ETH_ALEN) == 0)
+		return;
+	pos += 18;
+
+	name = os_strrchr(from.sun_path, '/');
+	name = name ? name + 1 : from.sun_path;
+
+	peer = acs_coord_get_peer(coord, addr);
+	if (peer == NULL) {
+		peer = os_zalloc(sizeof(*peer));
+		if (peer == NULL)
+			return;
+		os_memcpy(peer->addr, addr, ETH_ALEN);
+		dl_list_add(&coord->peers, &peer->list);
+		new_peer = 1;
+	}
+	os_strlcpy(peer->name, name, sizeof(peer->name));
+	peer->final = final;
+	peer->freq = atoi(pos);
+	pos = os_strchr(pos, ' ');
+	if (!final && pos && acs_coord_parse_summary(peer, pos) < 0)
+		wpa_printf(MSG_DEBUG, "ACS: coord: invalid survey summary");
+
+	/* Let APs that started late know about us */
+	if (!final && (coord->state == ACS_COORD_DONE ||
+		       (coord->state == ACS_COORD_WAIT && new_peer)))
+		acs_coord_send_state(coord, peer->name);
+
+	acs_coord_try_decide(coord);
+}
+
+
+/**
+ * acs_coord_start - Start coordination after own survey is complete
+ * @coord: Coordination data from acs_coord_init()
+ * @ideal_chan: Channel selected based on own survey only
+ *
+ * The surveys are kept (and chan->survey_interference_factor is used) until
+ * acs_chan_selected() is called with the channel selected in coordination
+ * with the other APs.
+ */
+void acs_coord_start(struct acs_coord *coord,
+		     struct hostapd_channel_data *ideal_chan)
+{
+	struct hostapd_iface *iface = coord->iface;
+	struct hostapd_channel_data *chan;
+	int i;
+
+	coord->num_chan = 0;
+	for (i = 0; i < iface->current_mode->num_channels &&
+		     coord->num_chan < ACS_COORD_MAX_CHAN; i++) {
+		chan = &iface->current_mode->channels[i];
+		if (!acs_usable_chan(iface, chan))
+			continue;
+		coord->chan_freq[coord->num_chan] = chan->freq;
+		coord->chan_score[coord->num_chan] = acs_coord_score(chan);
+		coord->num_chan++;
+	}
+	coord->regret = acs_coord_regret(coord->chan_score, coord->num_chan);
+	coord->freq = ideal_chan->freq;
+	coord->state = ACS_COORD_WAIT;
+	coord->window_over = 0;
+
+	wpa_printf(MSG_DEBUG, "ACS: coord: own choice %d MHz, regret %d; "
+		   "waiting for peers", coord->freq, coord->regret);
+	acs_coord_send_state(coord, NULL);
+
+	eloop_cancel_timeout(acs_coord_window_timeout, coord, NULL);
+	eloop_cancel_timeout(acs_coord_deadline_timeout, coord, NULL);
+	eloop_register_timeout(iface->conf->acs_coord_wait_ms / 1000,
+			       (iface->conf->acs_coord_wait_ms % 1000) * 1000,
+			       acs_coord_window_timeout, coord, NULL);
+	eloop_register_timeout((ACS_COORD_DEADLINE_FACTOR *
+				iface->conf->acs_coord_wait_ms) / 1000,
+			       ((ACS_COORD_DEADLINE_FACTOR *
+				 iface->conf->acs_coord_wait_ms) % 1000) * 1000,
+			       acs_coord_deadline_timeout, coord, NULL);
+}
+
+
+/**
+ * acs_coord_init - Open the coordination socket
+ * @iface: Pointer to interface data
+ * @dir: Directory for the sockets of the cooperating APs (acs_coord_dir)
+ * Returns: Pointer to coordination data or %NULL on failure
+ */
+struct acs_coord * acs_coord_init(struct hostapd_iface *iface,
+				  const char *dir)
+{
+	struct acs_coord *coord;
+	struct sockaddr_un addr;
+	size_t len;
+
+	coord = os_zalloc(sizeof(*coord));
+	if (coord == NULL)
+		return NULL;
+	coord->iface = iface;
+	coord->sock = -1;
+	dl_list_init(&coord->peers);
+	coord->name = iface->bss[0]->conf->iface;
+	coord->dir = os_strdup(dir);
+	len = os_strlen(dir) + 1 + os_strlen(coord->name) + 1;
+	coord->path = os_malloc(len);
+	if (coord->dir == NULL || coord->path == NULL ||
+	    len > sizeof(addr.sun_path))
+		goto fail;
+	os_snprintf(coord->path, len, "%s/%s", dir, coord->name);
+
+	if (mkdir(dir, S_IRWXU | S_IRWXG) < 0 && errno != EEXIST) {
+		perror("mkdir[acs_coord_dir]");
+		goto fail;
+	}
+
+	coord->sock = socket(PF_UNIX, SOCK_DGRAM, 0);
+	if (coord->sock < 0) {
+		perror("socket(PF_UNIX)");
+		goto fail;
+	}
+
+	os_memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	os_strlcpy(addr.sun_path, coord->path, sizeof(addr.sun_path));
+	if (bind(coord->sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		if (connect(coord->sock, (struct sockaddr *) &addr,
+			    sizeof(addr)) == 0) {
+			wpa_printf(MSG_ERROR, "ACS: coordination socket '%s' "
+				   "is in use", coord->path);
+			goto fail;
+		}
+		/* Left over from forced program termination */
+		if (unlink(coord->path) < 0 ||
+		    bind(coord->sock, (struct sockaddr *) &addr,
+			 sizeof(addr)) < 0) {
+			perror("bind(PF_UNIX)");
+			goto fail;
+		}
+	}
+
+	if (eloop_register_read_sock(coord->sock, acs_coord_receive, coord,
+				     NULL)) {
+		unlink(coord->path);
+		goto fail;
+	}
+
+	wpa_printf(MSG_DEBUG, "ACS: coordinating channel selection via %s",
+		   coord->path);
+	return coord;
+
+fail:
+	if (coord->sock >= 0)
+		close(coord->sock);
+	os_free(coord->path);
+	os_free(coord->dir);
+	os_free(coord);
+	return NULL;
+}
+
+
+void acs_coord_deinit(struct acs_coord *coord)
+{
+	struct acs_coord_peer *peer, *tmp;
+
+	if (coord == NULL)
+		return;
+
+	eloop_cancel_timeout(acs_coord_window_timeout, coord, NULL);
+	eloop_cancel_timeout(acs_coord_deadline_timeout, coord, NULL);
+	eloop_unregister_read_sock(coord->sock);
+	close(coord->sock);
+	unlink(coord->path);
+
+	dl_list_for_each_safe(peer, tmp, &coord->peers, struct acs_coord_peer,
+			      list) {
+		dl_list_del(&peer->list);
+		os_free(peer);
+	}
+	os_free(coord->path);
+	os_free(coord->dir);
+	os_free(coord);
+}
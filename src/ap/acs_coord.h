@@ -0,0 +1,27 @@
+/*
+ * ACS - coordinated channel selection between APs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ */
+
+#ifndef ACS_COORD_H
+#define ACS_COORD_H
+
+struct acs_coord;
+struct hostapd_iface;
+struct hostapd_channel_data;
+
+struct acs_coord * acs_coord_init(struct hostapd_iface *iface,
+				  const char *dir);
+void acs_coord_deinit(struct acs_coord *coord);
+void acs_coord_start(struct acs_coord *coord,
+		     struct hostapd_channel_data *ideal_chan);
+
+#endif /* ACS_COORD_H */
@@ -0,0 +1,286 @@
+/*
+ * ACS - channel scoring algorithms
+ * Copyright (C) 2011 Qualcomm Atheros
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "utils/includes.h"
+
+#include "utils/common.h"
+#include "drivers/driver.h"
+#include "acs_score.h"
+
+#include <math.h>
+
+/*
+ * The scoring code is kept separate from the rest of ACS so that it can also
+ * be used for offline evaluation of the algorithms over recorded surveys (see
+ * tests/test-acs.c).
+ */
+
+struct acs_scorer {
+	const char *name;
+	long double (*survey_factor)(const struct freq_survey *survey,
+				     s8 lowest_nf);
+	long double (*chan_penalty)(const struct hostapd_channel_data *chan,
+				    int num_bss);
+};
+
+
+/*
+ * XXX: Use libm's pow thingy? If we can implement our own log2() then
+ * we can keep this here and remove libm support from hostapd, not
+ * sure if its worth it.
+ */
+static u64 base_to_power(u64 base, u64 pow)
+{
+	u64 result = base;
+
+	if (pow == 0)
+		return 1;
+
+	pow--;
+	while (pow--)
+		result *= base;
+
+	return result;
+}
+
+
+static long double acs_interference_factor(const struct freq_survey *survey,
+					   s8 lowest_nf)
+{
+	long double factor;
+
+	factor = survey->channel_time_busy - survey->channel_time_tx;
+	factor /= (survey->channel_time - survey->channel_time_tx);
+	factor *= (base_to_power(2, survey->nf - lowest_nf));
+	factor = log2(factor);
+
+	return factor;
+}
+
+
+/*
+ * Time spent receiving frames means there is another active network on the
+ * channel, which is likely to keep the channel busy, unlike sporadic non-WLAN
+ * interference.
+ */
+static long double acs_rx_weighted_factor(const struct freq_survey *survey,
+					  s8 lowest_nf)
+{
+	long double factor;
+
+	factor = survey->channel_time_busy - survey->channel_time_tx +
+		survey->channel_time_rx;
+	factor /= (survey->channel_time - survey->channel_time_tx);
+	factor *= (base_to_power(2, survey->nf - lowest_nf));
+	factor = log2(factor);
+
+	return factor;
+}
+
+
+/*
+ * Each BSS found on the channel in the initial scan adds to the score. Since
+ * the survey factors are on log2 scale, doubling the number of BSSes costs as
+ * much as doubling the busy time.
+ */
+static long double acs_bss_count_penalty(const struct hostapd_channel_data *chan,
+					 int num_bss)
+{
+	return log2(1 + num_bss);
+}
+
+
+static const struct acs_scorer acs_scorers[NUM_ACS_ALGO] = {
+	{ "interference", acs_interference_factor, NULL },
+	{ "rx_weighted", acs_rx_weighted_factor, NULL },
+	{ "bss_count", acs_interference_factor, acs_bss_count_penalty },
+};
+
+
+/**
+ * acs_algo_parse - Parse ACS algorithm name
+ * @name: Algorithm name as used in acs_algo configuration parameter
+ * Returns: enum acs_algo value or -1 if the name is not known
+ */
+int acs_algo_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NUM_ACS_ALGO; i++) {
+		if (os_strcmp(name, acs_scorers[i].name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+
+const char * acs_algo_txt(enum acs_algo algo)
+{
+	if ((int) algo < 0 || algo >= NUM_ACS_ALGO)
+		return "unknown";
+	return acs_scorers[algo].name;
+}
+
+
+/**
+ * acs_survey_factor - Interference factor of a single survey
+ * @algo: Scoring algorithm
+ * @survey: Survey data for the channel
+ * @lowest_nf: Lowest noise floor seen on any channel
+ * Returns: Interference factor (lower is better)
+ */
+long double acs_survey_factor(enum acs_algo algo,
+			      const struct freq_survey *survey, s8 lowest_nf)
+{
+	if ((int) algo < 0 || algo >= NUM_ACS_ALGO)
+		algo = ACS_ALGO_INTERFERENCE;
+	return acs_scorers[algo].survey_factor(survey, lowest_nf);
+}
+
+
+/**
+ * acs_chan_penalty - Per-channel addition to the average survey factor
+ * @algo: Scoring algorithm
+ * @chan: Channel data
+ * @num_bss: Number of BSSes found on the channel
+ * Returns: Penalty to be added to the channel score
+ */
+long double acs_chan_penalty(enum acs_algo algo,
+			     const struct hostapd_channel_data *chan,
+			     int num_bss)
+{
+	if ((int) algo < 0 || algo >= NUM_ACS_ALGO ||
+	    acs_scorers[algo].chan_penalty == NULL)
+		return 0;
+	return acs_scorers[algo].chan_penalty(chan, num_bss);
+}
+
+
+/**
+ * acs_chan_score - Score a channel based on its surveys
+ * @algo: Scoring algorithm
+ * @chan: Channel data with chan->survey_list filled in
+ * @lowest_nf: Lowest noise floor seen on any channel
+ * @num_bss: Number of BSSes found on the channel
+ * Returns: Channel score (lower is better)
+ */
+long double acs_chan_score(enum acs_algo algo,
+			   const struct hostapd_channel_data *chan,
+			   s8 lowest_nf, int num_bss)
+{
+	struct freq_survey *survey;
+	long double sum = 0;
+	unsigned int count = 0;
+
+	dl_list_for_each(survey, &chan->survey_list, struct freq_survey,
+			 list_member) {
+		sum += acs_survey_factor(algo, survey, lowest_nf);
+		count++;
+	}
+	if (count == 0)
+		return 0;
+
+	return sum / count + acs_chan_penalty(algo, chan, num_bss);
+}
+
+
+/*
+ * Two-sided 95% quantiles of Student's t distribution for 1..10 degrees of
+ * freedom; the normal distribution value is used for more samples.
+ */
+#define ACS_T95_MAX_DF 10
+static const double acs_t95[ACS_T95_MAX_DF] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228
+};
+
+
+/**
+ * acs_chan_score_ci - Score a channel with confidence interval
+ * @algo: Scoring algorithm
+ * @chan: Channel data with chan->survey_list filled in
+ * @lowest_nf: Lowest noise floor seen on any channel
+ * @num_bss: Number of BSSes found on the channel
+ * @score: Buffer for the channel score (as returned by acs_chan_score())
+ * @ci: Buffer for the half width of the 95% confidence interval of the score
+ * Returns: 0 on success, -1 if there are less than two surveys or the survey
+ * factors are not finite (e.g., a survey without any busy time)
+ */
+int acs_chan_score_ci(enum acs_algo algo,
+		      const struct hostapd_channel_data *chan,
+		      s8 lowest_nf, int num_bss, long double *score,
+		      long double *ci)
+{
+	struct freq_survey *survey;
+	long double factor, sum = 0, sum_sq = 0, mean, var;
+	unsigned int count = 0;
+
+	dl_list_for_each(survey, &chan->survey_list, struct freq_survey,
+			 list_member) {
+		factor = acs_survey_factor(algo, survey, lowest_nf);
+		if (!isfinite(factor))
+			return -1;
+		sum += factor;
+		sum_sq += factor * factor;
+		count++;
+	}
+	if (count < 2)
+		return -1;
+
+	mean = sum / count;
+	var = (sum_sq - count * mean * mean) / (count - 1);
+	if (var < 0)
+		var = 0; /* rounding */
+
+	*score = mean + acs_chan_penalty(algo, chan, num_bss);
+	*ci = (count - 1 <= ACS_T95_MAX_DF ? acs_t95[count - 2] : 1.96) *
+		sqrtl(var / count);
+
+	return 0;
+}
+
+
+/**
+ * acs_chan_airtime - Airtime available on a channel based on its surveys
+ * @chan: Channel data with chan->survey_list filled in
+ * Returns: Fraction (0..1) of the surveyed time the channel was not kept busy
+ * by other devices
+ *
+ * This is used as the metric for comparing the decisions of the different
+ * algorithms.
+ */
+double acs_chan_airtime(const struct hostapd_channel_data *chan)
+{
+	struct freq_survey *survey;
+	u64 total = 0, busy = 0;
+
+	dl_list_for_each(survey, &chan->survey_list, struct freq_survey,
+			 list_member) {
+		if (survey->channel_time <= survey->channel_time_tx)
+			continue;
+		total += survey->channel_time - survey->channel_time_tx;
+		if (survey->channel_time_busy > survey->channel_time_tx)
+			busy += survey->channel_time_busy -
+				survey->channel_time_tx;
+	}
+	if (total == 0)
+		return 0;
+	if (busy > total)
+		busy = total;
+
+	return 1.0 - (double) busy / total;
+}
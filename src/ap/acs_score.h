@@ -0,0 +1,52 @@
+/*
+ * ACS - channel scoring algorithms
+ * Copyright (C) 2011 Qualcomm Atheros
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef ACS_SCORE_H
+#define ACS_SCORE_H
+
+struct freq_survey;
+struct hostapd_channel_data;
+
+/*
+ * Channel scoring algorithms; the score of a channel is the average of the
+ * per-survey factors plus a per-channel penalty, and the channel with the
+ * lowest score is selected.
+ */
+enum acs_algo {
+	ACS_ALGO_INTERFERENCE, /* default: busy time and noise floor */
+	ACS_ALGO_RX_WEIGHTED, /* like above, with rx time counted twice */
+	ACS_ALGO_BSS_COUNT, /* like above, penalizing neighboring BSSes */
+	NUM_ACS_ALGO
+};
+
+int acs_algo_parse(const char *name);
+const char * acs_algo_txt(enum acs_algo algo);
+long double acs_survey_factor(enum acs_algo algo,
+			      const struct freq_survey *survey, s8 lowest_nf);
+long double acs_chan_penalty(enum acs_algo algo,
+			     const struct hostapd_channel_data *chan,
+			     int num_bss);
+long double acs_chan_score(enum acs_algo algo,
+			   const struct hostapd_channel_data *chan,
+			   s8 lowest_nf, int num_bss);
+int acs_chan_score_ci(enum acs_algo algo,
+		      const struct hostapd_channel_data *chan,
+		      s8 lowest_nf, int num_bss, long double *score,
+		      long double *ci);
+double acs_chan_airtime(const struct hostapd_channel_data *chan);
+
+#endif /* ACS_SCORE_H */
@@ -101,6 +101,7 @@ static void hostapd_config_acs_defaults(struct hostapd_config *conf)
 {
 	conf->acs_num_req_surveys = 10;
 	conf->acs_roc_duration_ms = 5;
+	conf->acs_coord_wait_ms = 1000;
 }
 #else
 static void hostapd_config_acs_defaults(struct hostapd_config *conf)
@@ -395,6 +396,7 @@ static void hostapd_config_free_bss(struct hostapd_bss_config *conf)
 	hostapd_config_free_wep(&conf->ssid.wep);
 #ifdef CONFIG_FULL_DYNAMIC_VLAN
 	os_free(conf->ssid.vlan_tagged_interface);
+	os_free(conf->ssid.vlan_pool);
 #endif /* CONFIG_FULL_DYNAMIC_VLAN */
 
 	user = conf->eap_user;
@@ -501,6 +503,10 @@ void hostapd_config_free(struct hostapd_config *conf)
 	os_free(conf->bss);
 	os_free(conf->supported_rates);
 	os_free(conf->basic_rates);
+#ifdef CONFIG_ACS
+	os_free(conf->acs_chan_list);
+	os_free(conf->acs_coord_dir);
+#endif /* CONFIG_ACS */
 
 	os_free(conf);
 }
@@ -73,6 +73,7 @@ struct hostapd_ssid {
 	int dynamic_vlan;
 #ifdef CONFIG_FULL_DYNAMIC_VLAN
 	char *vlan_tagged_interface;
+	int *vlan_pool; /* VLAN IDs to set up at startup; 0 terminated */
 #endif /* CONFIG_FULL_DYNAMIC_VLAN */
 	struct hostapd_wep_keys **dyn_vlan_keys;
 	size_t max_dyn_vlan_keys;
@@ -309,6 +310,7 @@ struct hostapd_bss_config {
 	u8 *extra_cred;
 	size_t extra_cred_len;
 	int wps_cred_processing;
+	int wps_dh_key_pool;
 	u8 *ap_settings;
 	size_t ap_settings_len;
 	char *upnp_iface;
@@ -397,6 +399,13 @@ struct hostapd_config {
 #ifdef CONFIG_ACS
 	unsigned int acs_num_req_surveys;
 	unsigned int acs_roc_duration_ms;
+	int acs_algo; /* enum acs_algo */
+	double acs_stop_margin; /* < 0 = always do acs_num_req_surveys */
+	unsigned int acs_max_duration_ms; /* 0 = no limit */
+	int *acs_chan_list; /* -1 terminated; NULL = all channels */
+	unsigned int acs_offchan_max_ms_per_sec; /* 0 = no limit */
+	char *acs_coord_dir; /* NULL = no coordination with other APs */
+	unsigned int acs_coord_wait_ms;
 #endif
 };
 
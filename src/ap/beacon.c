@@ -22,7 +22,7 @@
 #include "common/ieee802_11_defs.h"
 #include "common/ieee802_11_common.h"
 #include "drivers/driver.h"
-#include "wps/wps_defs.h"
+#include "wps/wps.h"
 #include "p2p/p2p.h"
 #include "hostapd.h"
 #include "ieee802_11.h"
@@ -242,16 +242,16 @@ void handle_probe_req(struct hostapd_data *hapd,
 
 #ifdef CONFIG_P2P
 	if (hapd->p2p && elems.wps_ie) {
-		struct wpabuf *wps;
-		wps = ieee802_11_vendor_ie_concat(ie, ie_len, WPS_DEV_OUI_WFA);
-		if (wps && !p2p_group_match_dev_type(hapd->p2p_group, wps)) {
+		struct wps_probe_req_attr wps;
+		if (wps_parse_probe_req_ies(ie, ie_len, &wps) == 0 &&
+		    !p2p_group_match_dev_type(hapd->p2p_group,
+					      wps.req_dev_type,
+					      wps.num_req_dev_type)) {
 			wpa_printf(MSG_MSGDUMP, "P2P: Ignore Probe Request "
 				   "due to mismatch with Requested Device "
 				   "Type");
-			wpabuf_free(wps);
 			return;
 		}
-		wpabuf_free(wps);
 	}
 #endif /* CONFIG_P2P */
 
@@ -36,6 +36,7 @@
 #include "ap_drv_ops.h"
 #include "ap_config.h"
 #include "acs.h"
+#include "hw_features.h"
 
 
 int hostapd_notif_assoc(struct hostapd_data *hapd, const u8 *addr,
@@ -549,18 +550,7 @@ static void hostapd_event_roc_cancel(struct hostapd_data *hapd,
 struct hostapd_channel_data *hostapd_get_mode_channel(struct hostapd_iface *iface,
 						      unsigned int freq)
 {
-	unsigned int i;
-	struct hostapd_channel_data *chan;
-
-	for (i = 0; i < iface->current_mode->num_channels; i++) {
-		chan = &iface->current_mode->channels[i];
-		if (!chan)
-			return NULL;
-		if (chan->freq == freq)
-			return chan;
-	}
-
-	return NULL;
+	return hostapd_hw_freq_to_chan_data(iface, iface->current_mode, freq);
 }
 
 static void hostapd_update_nf(struct hostapd_iface *iface,
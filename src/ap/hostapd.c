@@ -36,6 +36,7 @@
 #include "ap_drv_ops.h"
 #include "ap_config.h"
 #include "p2p_hostapd.h"
+#include "acs.h"
 
 
 static int hostapd_flush_old_stations(struct hostapd_data *hapd);
@@ -285,9 +286,12 @@ static void hostapd_cleanup_iface(struct hostapd_iface *iface)
 {
 	hostapd_free_hw_features(iface->hw_features, iface->num_hw_features);
 	iface->hw_features = NULL;
+	os_free(iface->chan_map);
+	iface->chan_map = NULL;
 	os_free(iface->current_rates);
 	iface->current_rates = NULL;
 	ap_list_deinit(iface);
+	hostapd_iface_free_scan_res(iface);
 	hostapd_config_free(iface->conf);
 	iface->conf = NULL;
 
@@ -879,6 +883,7 @@ void hostapd_interface_deinit(struct hostapd_iface *iface)
 	if (iface == NULL)
 		return;
 
+	acs_deinit(iface);
 	hostapd_cleanup_iface_pre(iface);
 	for (j = 0; j < iface->num_bss; j++) {
 		struct hostapd_data *hapd = iface->bss[j];
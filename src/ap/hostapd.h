@@ -194,6 +194,8 @@ struct hostapd_iface {
 	unsigned int drv_flags;
 	struct hostapd_hw_modes *hw_features;
 	int num_hw_features;
+	/* Frequency/channel number lookup tables, one per hw_features entry */
+	struct hostapd_chan_map *chan_map;
 	struct hostapd_hw_modes *current_mode;
 	/* Rates that are currently used (i.e., filtered copy of
 	 * current_mode->channels */
@@ -244,10 +246,24 @@ struct hostapd_iface {
 	/* ACS helpers */
 	unsigned int acs_num_completed_surveys;
 	unsigned int acs_num_req_surveys;
+	struct os_time acs_start;
+	/* Off-channel scheduling */
+	struct os_time acs_last_roc_end;
+	struct os_time acs_offchan_window;
+	unsigned int acs_offchan_used_ms;
+	unsigned int acs_defer_count;
+	struct acs_coord *acs_coord;
 #endif
 
 	void (*scan_cb)(struct hostapd_iface *iface);
 
+	/*
+	 * Full scan results from ACS, reused for the 20/40 MHz coexistence
+	 * check while fresh enough (see hostapd_iface_get_scan_res())
+	 */
+	struct wpa_scan_results *scan_res;
+	struct os_time scan_res_time;
+
 	int (*ctrl_iface_init)(struct hostapd_data *hapd);
 	void (*ctrl_iface_deinit)(struct hostapd_data *hapd);
 
@@ -45,6 +45,163 @@ void hostapd_free_hw_features(struct hostapd_hw_modes *hw_features,
 }
 
 
+/*
+ * Direct-indexed lookup tables from frequency and channel number to an entry
+ * in hostapd_hw_modes::channels. Each slot holds the channel index + 1,
+ * HOSTAPD_CHAN_MAP_NONE if no channel maps to the slot, or
+ * HOSTAPD_CHAN_MAP_MULTI if more than one channel does (e.g., 2484 MHz shares
+ * a 5 MHz slot with 2480 MHz); in the latter case, and for frequencies outside
+ * the table, the channel list is searched instead.
+ */
+#define HOSTAPD_FREQ_MAP_START 2400
+#define HOSTAPD_FREQ_MAP_SIZE 720 /* 2400..5995 MHz in 5 MHz steps */
+#define HOSTAPD_CHAN_MAP_SIZE 256
+#define HOSTAPD_CHAN_MAP_NONE 0
+#define HOSTAPD_CHAN_MAP_MULTI 0xff
+
+struct hostapd_chan_map {
+	u8 freq[HOSTAPD_FREQ_MAP_SIZE];
+	u8 chan[HOSTAPD_CHAN_MAP_SIZE];
+};
+
+
+static void hostapd_chan_map_set(u8 *slot, int idx)
+{
+	if (*slot != HOSTAPD_CHAN_MAP_NONE || idx + 1 >= HOSTAPD_CHAN_MAP_MULTI)
+		*slot = HOSTAPD_CHAN_MAP_MULTI;
+	else
+		*slot = idx + 1;
+}
+
+
+static void hostapd_build_chan_map(struct hostapd_iface *iface)
+{
+	struct hostapd_hw_modes *mode;
+	struct hostapd_channel_data *chan;
+	int i, j, slot;
+
+	os_free(iface->chan_map);
+	iface->chan_map = os_zalloc(iface->num_hw_features *
+				    sizeof(struct hostapd_chan_map));
+	if (iface->chan_map == NULL)
+		return; /* lookups fall back to searching the channel list */
+
+	for (i = 0; i < iface->num_hw_features; i++) {
+		mode = &iface->hw_features[i];
+		for (j = 0; j < mode->num_channels; j++) {
+			chan = &mode->channels[j];
+			slot = (chan->freq - HOSTAPD_FREQ_MAP_START) / 5;
+			if (chan->freq >= HOSTAPD_FREQ_MAP_START &&
+			    slot < HOSTAPD_FREQ_MAP_SIZE)
+				hostapd_chan_map_set(
+					&iface->chan_map[i].freq[slot], j);
+			if (chan->chan >= 0 &&
+			    chan->chan < HOSTAPD_CHAN_MAP_SIZE)
+				hostapd_chan_map_set(
+					&iface->chan_map[i].chan[chan->chan],
+					j);
+		}
+	}
+}
+
+
+static u8 hostapd_chan_map_get(struct hostapd_iface *iface,
+			       struct hostapd_hw_modes *mode, int freq,
+			       int chan)
+{
+	struct hostapd_chan_map *map;
+	int slot;
+
+	if (iface->chan_map == NULL || mode < iface->hw_features ||
+	    mode >= iface->hw_features + iface->num_hw_features)
+		return HOSTAPD_CHAN_MAP_MULTI;
+	map = &iface->chan_map[mode - iface->hw_features];
+
+	if (freq) {
+		slot = (freq - HOSTAPD_FREQ_MAP_START) / 5;
+		if (freq < HOSTAPD_FREQ_MAP_START ||
+		    slot >= HOSTAPD_FREQ_MAP_SIZE)
+			return HOSTAPD_CHAN_MAP_MULTI;
+		return map->freq[slot];
+	}
+
+	if (chan < 0 || chan >= HOSTAPD_CHAN_MAP_SIZE)
+		return HOSTAPD_CHAN_MAP_MULTI;
+	return map->chan[chan];
+}
+
+
+/**
+ * hostapd_hw_freq_to_chan_data - Find channel data by frequency
+ * @iface: Pointer to interface data
+ * @mode: Hardware mode (an entry in iface->hw_features)
+ * @freq: Frequency in MHz
+ * Returns: Pointer to the channel in mode->channels or %NULL if not found
+ */
+struct hostapd_channel_data *
+hostapd_hw_freq_to_chan_data(struct hostapd_iface *iface,
+			     struct hostapd_hw_modes *mode, int freq)
+{
+	u8 idx;
+	int i;
+
+	if (mode == NULL || freq <= 0)
+		return NULL;
+
+	idx = hostapd_chan_map_get(iface, mode, freq, 0);
+	if (idx == HOSTAPD_CHAN_MAP_NONE)
+		return NULL;
+	if (idx != HOSTAPD_CHAN_MAP_MULTI) {
+		/*
+		 * The slot covers 5 MHz, so it may be a neighboring frequency
+		 * of the only channel in it.
+		 */
+		if (mode->channels[idx - 1].freq != freq)
+			return NULL;
+		return &mode->channels[idx - 1];
+	}
+
+	for (i = 0; i < mode->num_channels; i++) {
+		if (mode->channels[i].freq == freq)
+			return &mode->channels[i];
+	}
+
+	return NULL;
+}
+
+
+/**
+ * hostapd_hw_chan_to_chan_data - Find channel data by channel number
+ * @iface: Pointer to interface data
+ * @mode: Hardware mode (an entry in iface->hw_features)
+ * @chan: Channel number
+ * Returns: Pointer to the channel in mode->channels or %NULL if not found
+ */
+struct hostapd_channel_data *
+hostapd_hw_chan_to_chan_data(struct hostapd_iface *iface,
+			     struct hostapd_hw_modes *mode, int chan)
+{
+	u8 idx;
+	int i;
+
+	if (mode == NULL)
+		return NULL;
+
+	idx = hostapd_chan_map_get(iface, mode, 0, chan);
+	if (idx == HOSTAPD_CHAN_MAP_NONE)
+		return NULL;
+	if (idx != HOSTAPD_CHAN_MAP_MULTI)
+		return &mode->channels[idx - 1];
+
+	for (i = 0; i < mode->num_channels; i++) {
+		if (mode->channels[i].chan == chan)
+			return &mode->channels[i];
+	}
+
+	return NULL;
+}
+
+
 int hostapd_get_hw_features(struct hostapd_iface *iface)
 {
 	struct hostapd_data *hapd = iface->bss[0];
@@ -98,6 +255,8 @@ int hostapd_get_hw_features(struct hostapd_iface *iface)
 		}
 	}
 
+	hostapd_build_chan_map(iface);
+
 	return ret;
 }
 
@@ -175,10 +334,77 @@ int hostapd_prepare_rates(struct hostapd_data *hapd,
 }
 
 
+/* Maximum age of stored scan results for reuse in the 20/40 MHz check */
+#define HOSTAPD_SCAN_RES_MAX_AGE 60
+
+#ifdef CONFIG_IEEE80211N
+static void ieee80211n_check_stored_scan(void *eloop_ctx, void *timeout_ctx);
+#endif /* CONFIG_IEEE80211N */
+
+
+static void wpa_scan_results_free(struct wpa_scan_results *res)
+{
+	size_t i;
+
+	if (res == NULL)
+		return;
+
+	for (i = 0; i < res->num; i++)
+		os_free(res->res[i]);
+	os_free(res->res);
+	os_free(res);
+}
+
+
+/**
+ * hostapd_iface_set_scan_res - Store full scan results for later use
+ * @iface: Pointer to interface data
+ * @scan_res: Scan results covering all channels; ownership is transferred
+ */
+void hostapd_iface_set_scan_res(struct hostapd_iface *iface,
+				struct wpa_scan_results *scan_res)
+{
+	wpa_scan_results_free(iface->scan_res);
+	iface->scan_res = scan_res;
+	os_get_time(&iface->scan_res_time);
+}
+
+
+/**
+ * hostapd_iface_get_scan_res - Get stored scan results if fresh enough
+ * @iface: Pointer to interface data
+ * @max_age: Maximum age of the results in seconds
+ * Returns: Stored scan results or %NULL if none or too old
+ */
+struct wpa_scan_results *
+hostapd_iface_get_scan_res(struct hostapd_iface *iface, int max_age)
+{
+	struct os_time now;
+
+	if (iface->scan_res == NULL)
+		return NULL;
+	os_get_time(&now);
+	if (now.sec - iface->scan_res_time.sec > max_age)
+		return NULL;
+	return iface->scan_res;
+}
+
+
+void hostapd_iface_free_scan_res(struct hostapd_iface *iface)
+{
+#ifdef CONFIG_IEEE80211N
+	eloop_cancel_timeout(ieee80211n_check_stored_scan, iface, NULL);
+#endif /* CONFIG_IEEE80211N */
+	wpa_scan_results_free(iface->scan_res);
+	iface->scan_res = NULL;
+}
+
+
 #ifdef CONFIG_IEEE80211N
 static int ieee80211n_allowed_ht40_channel_pair(struct hostapd_iface *iface)
 {
-	int sec_chan, ok, j, first;
+	int sec_chan, ok, first;
+	struct hostapd_channel_data *chan;
 	int allowed[] = { 36, 44, 52, 60, 100, 108, 116, 124, 132, 149, 157,
 			  184, 192 };
 	size_t k;
@@ -193,17 +419,9 @@ static int ieee80211n_allowed_ht40_channel_pair(struct hostapd_iface *iface)
 
 	/* Verify that HT40 secondary channel is an allowed 20 MHz
 	 * channel */
-	ok = 0;
-	for (j = 0; j < iface->current_mode->num_channels; j++) {
-		struct hostapd_channel_data *chan =
-			&iface->current_mode->channels[j];
-		if (!(chan->flag & HOSTAPD_CHAN_DISABLED) &&
-		    chan->chan == sec_chan) {
-			ok = 1;
-			break;
-		}
-	}
-	if (!ok) {
+	chan = hostapd_hw_chan_to_chan_data(iface, iface->current_mode,
+					    sec_chan);
+	if (chan == NULL || (chan->flag & HOSTAPD_CHAN_DISABLED)) {
 		wpa_printf(MSG_ERROR, "HT40 secondary channel %d not allowed",
 			   sec_chan);
 		return 0;
@@ -408,42 +626,19 @@ static int ieee80211n_check_40mhz_2g4(struct hostapd_iface *iface,
 }
 
 
-static void wpa_scan_results_free(struct wpa_scan_results *res)
-{
-	size_t i;
-
-	if (res == NULL)
-		return;
-
-	for (i = 0; i < res->num; i++)
-		os_free(res->res[i]);
-	os_free(res->res);
-	os_free(res);
-}
-
-
-static void ieee80211n_check_scan(struct hostapd_iface *iface)
+static void ieee80211n_check_scan_res(struct hostapd_iface *iface,
+				      struct wpa_scan_results *scan_res)
 {
-	struct wpa_scan_results *scan_res;
 	int oper40;
 	int res;
 
 	/* Check list of neighboring BSSes (from scan) to see whether 40 MHz is
 	 * allowed per IEEE 802.11n/D7.0, 11.14.3.2 */
 
-	iface->scan_cb = NULL;
-
-	scan_res = hostapd_driver_get_scan_results(iface->bss[0]);
-	if (scan_res == NULL) {
-		hostapd_setup_interface_complete(iface, 1);
-		return;
-	}
-
 	if (iface->current_mode->mode == HOSTAPD_MODE_IEEE80211A)
 		oper40 = ieee80211n_check_40mhz_5g(iface, scan_res);
 	else
 		oper40 = ieee80211n_check_40mhz_2g4(iface, scan_res);
-	wpa_scan_results_free(scan_res);
 
 	if (!oper40) {
 		wpa_printf(MSG_INFO, "20/40 MHz operation not permitted on "
@@ -460,18 +655,107 @@ static void ieee80211n_check_scan(struct hostapd_iface *iface)
 }
 
 
+static void ieee80211n_check_scan(struct hostapd_iface *iface)
+{
+	struct wpa_scan_results *scan_res;
+
+	iface->scan_cb = NULL;
+
+	scan_res = hostapd_driver_get_scan_results(iface->bss[0]);
+	if (scan_res == NULL) {
+		hostapd_setup_interface_complete(iface, 1);
+		return;
+	}
+
+	ieee80211n_check_scan_res(iface, scan_res);
+	wpa_scan_results_free(scan_res);
+}
+
+
+static void ieee80211n_check_stored_scan(void *eloop_ctx, void *timeout_ctx)
+{
+	struct hostapd_iface *iface = eloop_ctx;
+
+	ieee80211n_check_scan_res(iface, iface->scan_res);
+}
+
+
+/*
+ * Build the list of frequencies that can have BSSes affecting the 20/40 MHz
+ * coexistence decision: the primary and secondary channel on 5 GHz; on
+ * 2.4 GHz, all channels within 20 MHz of the affected frequency range used in
+ * ieee80211n_check_40mhz_2g4() since a neighboring 40 MHz BSS may have only
+ * its secondary channel in that range.
+ */
+static int * ieee80211n_scan_freqs(struct hostapd_iface *iface)
+{
+	struct hostapd_hw_modes *mode = iface->current_mode;
+	int pri_freq, sec_freq, start, end;
+	int *freqs;
+	int i, num = 0;
+
+	pri_freq = hostapd_hw_get_freq(iface->bss[0], iface->conf->channel);
+	if (pri_freq <= 0)
+		return NULL;
+	if (iface->conf->secondary_channel > 0)
+		sec_freq = pri_freq + 20;
+	else
+		sec_freq = pri_freq - 20;
+
+	if (mode->mode == HOSTAPD_MODE_IEEE80211A) {
+		start = pri_freq < sec_freq ? pri_freq : sec_freq;
+		end = start + 20;
+	} else {
+		start = (pri_freq + sec_freq) / 2 - 25 - 20;
+		end = (pri_freq + sec_freq) / 2 + 25 + 20;
+	}
+
+	freqs = os_zalloc((mode->num_channels + 1) * sizeof(int));
+	if (freqs == NULL)
+		return NULL;
+	for (i = 0; i < mode->num_channels; i++) {
+		struct hostapd_channel_data *chan = &mode->channels[i];
+		if (chan->flag & HOSTAPD_CHAN_DISABLED)
+			continue;
+		if (chan->freq < start || chan->freq > end)
+			continue;
+		if (mode->mode == HOSTAPD_MODE_IEEE80211A &&
+		    chan->freq != pri_freq && chan->freq != sec_freq)
+			continue;
+		freqs[num++] = chan->freq;
+	}
+
+	return freqs;
+}
+
+
 static int ieee80211n_check_40mhz(struct hostapd_iface *iface)
 {
 	struct wpa_driver_scan_params params;
+	int ret;
 
 	if (!iface->conf->secondary_channel)
 		return 0; /* HT40 not used */
 
+	if (hostapd_iface_get_scan_res(iface, HOSTAPD_SCAN_RES_MAX_AGE)) {
+		wpa_printf(MSG_DEBUG, "Use scan results from ACS for checking "
+			   "neighboring BSSes prior to enabling 40 MHz "
+			   "channel");
+		/* Complete from eloop like with a new scan */
+		eloop_cancel_timeout(ieee80211n_check_stored_scan, iface,
+				     NULL);
+		eloop_register_timeout(0, 0, ieee80211n_check_stored_scan,
+				       iface, NULL);
+		return 1;
+	}
+
 	wpa_printf(MSG_DEBUG, "Scan for neighboring BSSes prior to enabling "
 		   "40 MHz channel");
 	os_memset(&params, 0, sizeof(params));
-	/* TODO: scan only the needed frequency */
-	if (hostapd_driver_scan(iface->bss[0], &params) < 0) {
+	params.freqs = ieee80211n_scan_freqs(iface);
+	ret = hostapd_driver_scan(iface->bss[0], &params);
+	os_free(params.freqs);
+	if (ret < 0) {
 		wpa_printf(MSG_ERROR, "Failed to request a scan of "
 			   "neighboring BSSes");
 		return -1;
@@ -604,25 +888,23 @@ static int hostapd_is_usable_chan(struct hostapd_iface *iface,
 				  int channel,
 				  int primary)
 {
-	unsigned int i;
 	struct hostapd_channel_data *chan;
 
-	for (i = 0; i < iface->current_mode->num_channels; i++) {
-		chan = &iface->current_mode->channels[i];
-		if (chan->chan == channel) {
-			if (chan->flag & HOSTAPD_CHAN_DISABLED) {
-				wpa_printf(MSG_ERROR,
-					   "%schannel [%i] (%i) is disabled for "
-					   "use in AP mode, flags: 0x%x",
-					   primary ? "" : "Configured HT40 secondary ",
-					   i, chan->chan, chan->flag);
-			} else {
-				return 1;
-			}
-		}
+	chan = hostapd_hw_chan_to_chan_data(iface, iface->current_mode,
+					    channel);
+	if (chan == NULL)
+		return 0;
+	if (chan->flag & HOSTAPD_CHAN_DISABLED) {
+		wpa_printf(MSG_ERROR,
+			   "%schannel [%i] (%i) is disabled for "
+			   "use in AP mode, flags: 0x%x",
+			   primary ? "" : "Configured HT40 secondary ",
+			   (int) (chan - iface->current_mode->channels),
+			   chan->chan, chan->flag);
+		return 0;
 	}
 
-	return 0;
+	return 1;
 }
 
 static int hostapd_is_usable_chans(struct hostapd_iface *iface)
@@ -665,8 +947,6 @@ static enum hostapd_chan_status hostapd_check_chans(struct hostapd_iface *iface)
 
 static void hostapd_notify_bad_chans(struct hostapd_iface *iface)
 {
-	iface->current_mode = NULL;
-
 	hostapd_logger(iface->bss[0], NULL,
 		       HOSTAPD_MODULE_IEEE80211,
 		       HOSTAPD_LEVEL_WARNING,
@@ -678,6 +958,7 @@ static void hostapd_notify_bad_chans(struct hostapd_iface *iface)
 	hostapd_logger(iface->bss[0], NULL, HOSTAPD_MODULE_IEEE80211,
 		       HOSTAPD_LEVEL_WARNING,
 		       "Hardware does not support configured channel");
+	iface->current_mode = NULL;
 }
 
 int hostapd_acs_completed(struct hostapd_iface *iface)
@@ -775,35 +1056,19 @@ const char * hostapd_hw_mode_txt(int mode)
 
 int hostapd_hw_get_freq(struct hostapd_data *hapd, int chan)
 {
-	int i;
+	struct hostapd_channel_data *ch;
 
-	if (!hapd->iface->current_mode)
-		return 0;
-
-	for (i = 0; i < hapd->iface->current_mode->num_channels; i++) {
-		struct hostapd_channel_data *ch =
-			&hapd->iface->current_mode->channels[i];
-		if (ch->chan == chan)
-			return ch->freq;
-	}
-
-	return 0;
+	ch = hostapd_hw_chan_to_chan_data(hapd->iface,
+					  hapd->iface->current_mode, chan);
+	return ch ? ch->freq : 0;
 }
 
 
 int hostapd_hw_get_channel(struct hostapd_data *hapd, int freq)
 {
-	int i;
+	struct hostapd_channel_data *ch;
 
-	if (!hapd->iface->current_mode)
-		return 0;
-
-	for (i = 0; i < hapd->iface->current_mode->num_channels; i++) {
-		struct hostapd_channel_data *ch =
-			&hapd->iface->current_mode->channels[i];
-		if (ch->freq == freq)
-			return ch->chan;
-	}
-
-	return 0;
+	ch = hostapd_hw_freq_to_chan_data(hapd->iface,
+					  hapd->iface->current_mode, freq);
+	return ch ? ch->chan : 0;
 }
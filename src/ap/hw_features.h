@@ -24,9 +24,20 @@ int hostapd_select_hw_mode(struct hostapd_iface *iface);
 const char * hostapd_hw_mode_txt(int mode);
 int hostapd_hw_get_freq(struct hostapd_data *hapd, int chan);
 int hostapd_hw_get_channel(struct hostapd_data *hapd, int freq);
+struct hostapd_channel_data *
+hostapd_hw_freq_to_chan_data(struct hostapd_iface *iface,
+			     struct hostapd_hw_modes *mode, int freq);
+struct hostapd_channel_data *
+hostapd_hw_chan_to_chan_data(struct hostapd_iface *iface,
+			     struct hostapd_hw_modes *mode, int chan);
 int hostapd_check_ht_capab(struct hostapd_iface *iface);
 int hostapd_prepare_rates(struct hostapd_data *hapd,
 			  struct hostapd_hw_modes *mode);
+void hostapd_iface_set_scan_res(struct hostapd_iface *iface,
+				struct wpa_scan_results *scan_res);
+struct wpa_scan_results *
+hostapd_iface_get_scan_res(struct hostapd_iface *iface, int max_age);
+void hostapd_iface_free_scan_res(struct hostapd_iface *iface);
 #else /* NEED_AP_MLME */
 static inline void
 hostapd_free_hw_features(struct hostapd_hw_modes *hw_features,
@@ -54,6 +65,13 @@ static inline int hostapd_hw_get_freq(struct hostapd_data *hapd, int chan)
 	return -1;
 }
 
+static inline struct hostapd_channel_data *
+hostapd_hw_freq_to_chan_data(struct hostapd_iface *iface,
+			     struct hostapd_hw_modes *mode, int freq)
+{
+	return NULL;
+}
+
 static inline int hostapd_check_ht_capab(struct hostapd_iface *iface)
 {
 	return 0;
@@ -65,6 +83,10 @@ static inline int hostapd_prepare_rates(struct hostapd_data *hapd,
 	return 0;
 }
 
+static inline void hostapd_iface_free_scan_res(struct hostapd_iface *iface)
+{
+}
+
 #endif /* NEED_AP_MLME */
 
 #endif /* HW_FEATURES_H */
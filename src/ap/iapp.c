@@ -37,6 +37,10 @@
  * - IEEE 802.11 context transfer
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE /* sendmmsg() */
+#endif /* __linux__ */
+
 #include "utils/includes.h"
 #include <net/if.h>
 #include <sys/ioctl.h>
@@ -55,11 +59,19 @@
 #include "sta_info.h"
 #include "iapp.h"
 
+#if defined(__GLIBC__) && \
+	(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 14))
+#define IAPP_SENDMMSG
+#endif
+
 
 #define IAPP_MULTICAST "224.0.1.178"
 #define IAPP_UDP_PORT 3517
 #define IAPP_TCP_PORT 3517
 
+/* Maximum number of stations notified with one sendmmsg() call */
+#define IAPP_MAX_BATCH 64
+
 struct iapp_hdr {
 	u8 version;
 	u8 command;
@@ -178,15 +190,21 @@ struct iapp_data {
 	struct in_addr own, multicast;
 	int udp_sock;
 	int packet_sock;
+
+	/* Stations waiting for iapp_flush() */
+	struct iapp_pending {
+		u8 addr[ETH_ALEN];
+		u16 seq_num;
+	} pending[IAPP_MAX_BATCH];
+	unsigned int num_pending;
 };
 
 
-static void iapp_send_add(struct iapp_data *iapp, u8 *mac_addr, u16 seq_num)
+static size_t iapp_build_add(struct iapp_data *iapp, u8 *buf,
+			     const struct iapp_pending *sta)
 {
-	char buf[128];
 	struct iapp_hdr *hdr;
 	struct iapp_add_notify *add;
-	struct sockaddr_in addr;
 
 	/* Send IAPP ADD-notify to remove possible association from other APs
 	 */
@@ -200,44 +218,119 @@ static void iapp_send_add(struct iapp_data *iapp, u8 *mac_addr, u16 seq_num)
 	add = (struct iapp_add_notify *) (hdr + 1);
 	add->addr_len = ETH_ALEN;
 	add->reserved = 0;
-	os_memcpy(add->mac_addr, mac_addr, ETH_ALEN);
+	os_memcpy(add->mac_addr, sta->addr, ETH_ALEN);
 
-	add->seq_num = host_to_be16(seq_num);
-	
-	os_memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = iapp->multicast.s_addr;
-	addr.sin_port = htons(IAPP_UDP_PORT);
-	if (sendto(iapp->udp_sock, buf, (char *) (add + 1) - buf, 0,
-		   (struct sockaddr *) &addr, sizeof(addr)) < 0)
-		perror("sendto[IAPP-ADD]");
+	add->seq_num = host_to_be16(sta->seq_num);
+
+	return (u8 *) (add + 1) - buf;
 }
 
 
-static void iapp_send_layer2_update(struct iapp_data *iapp, u8 *addr)
+static void iapp_build_layer2_update(struct iapp_layer2_update *msg,
+				     const u8 *addr)
 {
-	struct iapp_layer2_update msg;
-
 	/* Send Level 2 Update Frame to update forwarding tables in layer 2
 	 * bridge devices */
 
 	/* 802.2 Type 1 Logical Link Control (LLC) Exchange Identifier (XID)
 	 * Update response frame; IEEE Std 802.2-1998, 5.4.1.2.1 */
 
-	os_memset(msg.da, 0xff, ETH_ALEN);
-	os_memcpy(msg.sa, addr, ETH_ALEN);
-	msg.len = host_to_be16(6);
-	msg.dsap = 0; /* NULL DSAP address */
-	msg.ssap = 0x01; /* NULL SSAP address, CR Bit: Response */
-	msg.control = 0xaf; /* XID response lsb.1111F101.
-			     * F=0 (no poll command; unsolicited frame) */
-	msg.xid_info[0] = 0x81; /* XID format identifier */
-	msg.xid_info[1] = 1; /* LLC types/classes: Type 1 LLC */
-	msg.xid_info[2] = 1 << 1; /* XID sender's receive window size (RW)
-				   * FIX: what is correct RW with 802.11? */
-
-	if (send(iapp->packet_sock, &msg, sizeof(msg), 0) < 0)
-		perror("send[L2 Update]");
+	os_memset(msg->da, 0xff, ETH_ALEN);
+	os_memcpy(msg->sa, addr, ETH_ALEN);
+	msg->len = host_to_be16(6);
+	msg->dsap = 0; /* NULL DSAP address */
+	msg->ssap = 0x01; /* NULL SSAP address, CR Bit: Response */
+	msg->control = 0xaf; /* XID response lsb.1111F101.
+			      * F=0 (no poll command; unsolicited frame) */
+	msg->xid_info[0] = 0x81; /* XID format identifier */
+	msg->xid_info[1] = 1; /* LLC types/classes: Type 1 LLC */
+	msg->xid_info[2] = 1 << 1; /* XID sender's receive window size (RW)
+				    * FIX: what is correct RW with 802.11? */
+}
+
+
+/* Send num datagrams (one per iov entry) with as few syscalls as possible */
+static void iapp_send_batch(int sock, struct iovec *iov, unsigned int num,
+			    struct sockaddr_in *to, const char *txt)
+{
+#ifdef IAPP_SENDMMSG
+	struct mmsghdr msgs[IAPP_MAX_BATCH];
+	unsigned int i;
+	int res;
+
+	os_memset(msgs, 0, num * sizeof(msgs[0]));
+	for (i = 0; i < num; i++) {
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		if (to) {
+			msgs[i].msg_hdr.msg_name = to;
+			msgs[i].msg_hdr.msg_namelen = sizeof(*to);
+		}
+	}
+
+	for (i = 0; i < num; i += res) {
+		res = sendmmsg(sock, &msgs[i], num - i, 0);
+		if (res <= 0) {
+			/* Drop the failed message and go on with the rest */
+			perror(txt);
+			res = 1;
+		}
+	}
+#else /* IAPP_SENDMMSG */
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		if (sendto(sock, iov[i].iov_base, iov[i].iov_len, 0,
+			   (struct sockaddr *) to, to ? sizeof(*to) : 0) < 0)
+			perror(txt);
+	}
+#endif /* IAPP_SENDMMSG */
+}
+
+
+/*
+ * Send the Layer 2 Update frames and ADD-notify messages for all stations
+ * that have associated since the previous flush. This is run once per event
+ * loop iteration, so a burst of (re)associations, e.g., after another AP has
+ * failed, results in a couple of sendmmsg() calls instead of two syscalls per
+ * station.
+ */
+static void iapp_flush(void *eloop_ctx, void *timeout_ctx)
+{
+	struct iapp_data *iapp = eloop_ctx;
+	struct iapp_layer2_update l2[IAPP_MAX_BATCH];
+	u8 add[IAPP_MAX_BATCH][sizeof(struct iapp_hdr) +
+			       sizeof(struct iapp_add_notify)];
+	struct iovec iov[IAPP_MAX_BATCH];
+	struct sockaddr_in addr;
+	unsigned int i, num = iapp->num_pending;
+
+	iapp->num_pending = 0;
+	if (num == 0)
+		return;
+
+	for (i = 0; i < num; i++) {
+		iapp_build_layer2_update(&l2[i], iapp->pending[i].addr);
+		iov[i].iov_base = &l2[i];
+		iov[i].iov_len = sizeof(l2[i]);
+	}
+	iapp_send_batch(iapp->packet_sock, iov, num, NULL,
+			"sendmmsg[L2 Update]");
+
+	for (i = 0; i < num; i++) {
+		iov[i].iov_base = add[i];
+		iov[i].iov_len = iapp_build_add(iapp, add[i],
+						&iapp->pending[i]);
+	}
+	os_memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = iapp->multicast.s_addr;
+	addr.sin_port = htons(IAPP_UDP_PORT);
+	iapp_send_batch(iapp->udp_sock, iov, num, &addr,
+			"sendmmsg[IAPP-ADD]");
+
+	wpa_printf(MSG_DEBUG, "IAPP: Sent Layer 2 Update and ADD-notify for "
+		   "%u station(s)", num);
 }
 
 
@@ -250,6 +343,7 @@ void iapp_new_station(struct iapp_data *iapp, struct sta_info *sta)
 {
 	struct ieee80211_mgmt *assoc;
 	u16 seq;
+	unsigned int i;
 
 	if (iapp == NULL)
 		return;
@@ -260,8 +354,22 @@ void iapp_new_station(struct iapp_data *iapp, struct sta_info *sta)
 	/* IAPP-ADD.request(MAC Address, Sequence Number, Timeout) */
 	hostapd_logger(iapp->hapd, sta->addr, HOSTAPD_MODULE_IAPP,
 		       HOSTAPD_LEVEL_DEBUG, "IAPP-ADD.request(seq=%d)", seq);
-	iapp_send_layer2_update(iapp, sta->addr);
-	iapp_send_add(iapp, sta->addr, seq);
+	for (i = 0; i < iapp->num_pending; i++) {
+		/* Reassociated again before the previous one was notified */
+		if (os_memcmp(iapp->pending[i].addr, sta->addr, ETH_ALEN) == 0)
+			break;
+	}
+	if (i == iapp->num_pending) {
+		if (iapp->num_pending == IAPP_MAX_BATCH) {
+			eloop_cancel_timeout(iapp_flush, iapp, NULL);
+			iapp_flush(iapp, NULL);
+			i = 0;
+		}
+		os_memcpy(iapp->pending[i].addr, sta->addr, ETH_ALEN);
+		if (iapp->num_pending++ == 0)
+			eloop_register_timeout(0, 0, iapp_flush, iapp, NULL);
+	}
+	iapp->pending[i].seq_num = seq;
 
 	if (assoc && WLAN_FC_GET_STYPE(le_to_host16(assoc->frame_control)) ==
 	    WLAN_FC_STYPE_REASSOC_REQ) {
@@ -514,6 +622,10 @@ void iapp_deinit(struct iapp_data *iapp)
 	if (iapp == NULL)
 		return;
 
+	/* Do not leave the last associated stations unannounced */
+	eloop_cancel_timeout(iapp_flush, iapp, NULL);
+	iapp_flush(iapp, NULL);
+
 	if (iapp->udp_sock >= 0) {
 		os_memset(&mreq, 0, sizeof(mreq));
 		mreq.imr_multiaddr = iapp->multicast;
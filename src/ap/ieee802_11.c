@@ -1161,6 +1161,7 @@ static void handle_disassoc(struct hostapd_data *hapd,
 	}
 
 	sta->flags &= ~(WLAN_STA_ASSOC | WLAN_STA_ASSOC_REQ_OK);
+	ap_sta_cancel_vlan_bind(hapd, sta);
 	wpa_msg(hapd->msg_ctx, MSG_INFO, AP_STA_DISCONNECTED MACSTR,
 		MAC2STR(sta->addr));
 	wpa_auth_sm_event(sta->wpa_sm, WPA_DISASSOC);
@@ -1212,6 +1213,7 @@ static void handle_deauth(struct hostapd_data *hapd,
 
 	sta->flags &= ~(WLAN_STA_AUTH | WLAN_STA_ASSOC |
 			WLAN_STA_ASSOC_REQ_OK);
+	ap_sta_cancel_vlan_bind(hapd, sta);
 	wpa_msg(hapd->msg_ctx, MSG_INFO, AP_STA_DISCONNECTED MACSTR,
 		MAC2STR(sta->addr));
 	wpa_auth_sm_event(sta->wpa_sm, WPA_DEAUTH);
@@ -1620,13 +1622,32 @@ static void handle_auth_cb(struct hostapd_data *hapd,
 }
 
 
+/* Complete association once the station is bound to its VLAN */
+static void handle_assoc_vlan_bound(struct hostapd_data *hapd,
+				    struct sta_info *sta, int result)
+{
+	if (result < 0 || !(sta->flags & WLAN_STA_ASSOC))
+		return;
+
+	hostapd_set_sta_flags(hapd, sta);
+
+	if (sta->auth_alg == WLAN_AUTH_FT)
+		wpa_auth_sm_event(sta->wpa_sm, WPA_ASSOC_FT);
+	else
+		wpa_auth_sm_event(sta->wpa_sm, WPA_ASSOC);
+	hapd->new_assoc_sta_cb(hapd, sta, !sta->vlan_bind_new_assoc);
+
+	ieee802_1x_notify_port_enabled(sta->eapol_sm, 1);
+}
+
+
 static void handle_assoc_cb(struct hostapd_data *hapd,
 			    const struct ieee80211_mgmt *mgmt,
 			    size_t len, int reassoc, int ok)
 {
 	u16 status;
 	struct sta_info *sta;
-	int new_assoc = 1;
+	int new_assoc = 1, res = 0;
 	struct ieee80211_ht_capabilities ht_cap;
 
 	if (!ok) {
@@ -1715,29 +1736,27 @@ static void handle_assoc_cb(struct hostapd_data *hapd,
 	if (sta->flags & WLAN_STA_WDS)
 		hostapd_set_wds_sta(hapd, sta->addr, sta->aid, 1);
 
+	/*
+	 * The rest of the association processing is done in
+	 * handle_assoc_vlan_bound() once the STA is bound to its VLAN; that
+	 * may take place later if a new VLAN interface is needed.
+	 */
+	sta->vlan_bind_new_assoc = new_assoc;
 	if (sta->eapol_sm == NULL) {
 		/*
 		 * This STA does not use RADIUS server for EAP authentication,
 		 * so bind it to the selected VLAN interface now, since the
 		 * interface selection is not going to change anymore.
 		 */
-		if (ap_sta_bind_vlan(hapd, sta, 0) < 0)
-			goto fail;
+		res = ap_sta_bind_vlan_async(hapd, sta, 0,
+					     handle_assoc_vlan_bound);
 	} else if (sta->vlan_id) {
 		/* VLAN ID already set (e.g., by PMKSA caching), so bind STA */
-		if (ap_sta_bind_vlan(hapd, sta, 0) < 0)
-			goto fail;
+		res = ap_sta_bind_vlan_async(hapd, sta, 0,
+					     handle_assoc_vlan_bound);
 	}
-
-	hostapd_set_sta_flags(hapd, sta);
-
-	if (sta->auth_alg == WLAN_AUTH_FT)
-		wpa_auth_sm_event(sta->wpa_sm, WPA_ASSOC_FT);
-	else
-		wpa_auth_sm_event(sta->wpa_sm, WPA_ASSOC);
-	hapd->new_assoc_sta_cb(hapd, sta, !new_assoc);
-
-	ieee802_1x_notify_port_enabled(sta->eapol_sm, 1);
+	if (res <= 0)
+		handle_assoc_vlan_bound(hapd, sta, res);
 
  fail:
 	/* Copy of the association request is not needed anymore */
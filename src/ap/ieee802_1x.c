@@ -833,6 +833,23 @@ void ieee802_1x_receive(struct hostapd_data *hapd, const u8 *sa, const u8 *buf,
 }
 
 
+/* Complete PMKSA caching based authentication once the STA is bound to its
+ * VLAN */
+static void ieee802_1x_cached_vlan_bound(struct hostapd_data *hapd,
+					 struct sta_info *sta, int result)
+{
+	struct eapol_state_machine *sm = sta->eapol_sm;
+
+	if (sm == NULL || result < 0)
+		return;
+
+	sm->keyRun = TRUE;
+	sm->eap_if->eapKeyAvailable = TRUE;
+	sm->authSuccess = TRUE;
+	eapol_auth_step(sm);
+}
+
+
 /**
  * ieee802_1x_new_station - Start IEEE 802.1X authentication
  * @hapd: hostapd BSS data
@@ -920,25 +937,27 @@ void ieee802_1x_new_station(struct hostapd_data *hapd, struct sta_info *sta)
 
 	pmksa = wpa_auth_sta_get_pmksa(sta->wpa_sm);
 	if (pmksa) {
-		int old_vlanid;
+		int old_vlanid, res;
 
 		hostapd_logger(hapd, sta->addr, HOSTAPD_MODULE_IEEE8021X,
 			       HOSTAPD_LEVEL_DEBUG,
 			       "PMK from PMKSA cache - skip IEEE 802.1X/EAP");
 		/* Setup EAPOL state machines to already authenticated state
-		 * because of existing PMKSA information in the cache. */
-		sta->eapol_sm->keyRun = TRUE;
-		sta->eapol_sm->eap_if->eapKeyAvailable = TRUE;
+		 * because of existing PMKSA information in the cache. The
+		 * authentication completes in ieee802_1x_cached_vlan_bound()
+		 * once the STA is bound to its VLAN. */
 		sta->eapol_sm->auth_pae_state = AUTH_PAE_AUTHENTICATING;
 		sta->eapol_sm->be_auth_state = BE_AUTH_SUCCESS;
-		sta->eapol_sm->authSuccess = TRUE;
 		if (sta->eapol_sm->eap)
 			eap_sm_notify_cached(sta->eapol_sm->eap);
 		old_vlanid = sta->vlan_id;
 		pmksa_cache_to_eapol_data(pmksa, sta->eapol_sm);
 		if (sta->ssid->dynamic_vlan == DYNAMIC_VLAN_DISABLED)
 			sta->vlan_id = 0;
-		ap_sta_bind_vlan(hapd, sta, old_vlanid);
+		res = ap_sta_bind_vlan_async(hapd, sta, old_vlanid,
+					     ieee802_1x_cached_vlan_bound);
+		if (res <= 0)
+			ieee802_1x_cached_vlan_bound(hapd, sta, res);
 	} else {
 		if (reassoc) {
 			/*
@@ -1219,6 +1238,20 @@ ieee802_1x_search_radius_identifier(struct hostapd_data *hapd, u8 identifier)
 }
 
 
+/* Complete Access-Accept processing once the STA is bound to its VLAN */
+static void ieee802_1x_vlan_bound(struct hostapd_data *hapd,
+				  struct sta_info *sta, int result)
+{
+	struct eapol_state_machine *sm = sta->eapol_sm;
+
+	if (sm == NULL || result < 0)
+		return;
+
+	sm->eap_if->aaaSuccess = TRUE;
+	eapol_auth_step(sm);
+}
+
+
 /**
  * ieee802_1x_receive_auth - Process RADIUS frames from Authentication Server
  * @msg: RADIUS response message
@@ -1238,7 +1271,7 @@ ieee802_1x_receive_auth(struct radius_msg *msg, struct radius_msg *req,
 	u32 session_timeout = 0, termination_action, acct_interim_interval;
 	int session_timeout_set, old_vlanid = 0;
 	struct eapol_state_machine *sm;
-	int override_eapReq = 0;
+	int override_eapReq = 0, res;
 	struct radius_hdr *hdr = radius_msg_get_hdr(msg);
 
 	sm = ieee802_1x_search_radius_identifier(hapd, hdr->identifier);
@@ -1329,7 +1362,9 @@ ieee802_1x_receive_auth(struct radius_msg *msg, struct radius_msg *req,
 		}
 #endif /* CONFIG_NO_VLAN */
 
-		if (ap_sta_bind_vlan(hapd, sta, old_vlanid) < 0)
+		res = ap_sta_bind_vlan_async(hapd, sta, old_vlanid,
+					     ieee802_1x_vlan_bound);
+		if (res < 0)
 			break;
 
 		/* RFC 3580, Ch. 3.17 */
@@ -1339,7 +1374,12 @@ ieee802_1x_receive_auth(struct radius_msg *msg, struct radius_msg *req,
 		} else if (session_timeout_set)
 			ap_sta_session_timeout(hapd, sta, session_timeout);
 
-		sm->eap_if->aaaSuccess = TRUE;
+		/*
+		 * If a new VLAN interface is still being set up, EAP Success
+		 * is sent only once the STA has been bound to it.
+		 */
+		if (res == 0)
+			sm->eap_if->aaaSuccess = TRUE;
 		override_eapReq = 1;
 		ieee802_1x_get_keys(hapd, sta, msg, req, shared_secret,
 				    shared_secret_len);
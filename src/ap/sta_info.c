@@ -38,6 +38,7 @@
 static void ap_sta_remove_in_other_bss(struct hostapd_data *hapd,
 				       struct sta_info *sta);
 static void ap_handle_session_timer(void *eloop_ctx, void *timeout_ctx);
+static void ap_sta_vlan_bind_step(void *eloop_ctx, void *timeout_ctx);
 #ifdef CONFIG_IEEE80211W
 static void ap_sa_query_timer(void *eloop_ctx, void *timeout_ctx);
 #endif /* CONFIG_IEEE80211W */
@@ -198,6 +199,7 @@ void ap_free_sta(struct hostapd_data *hapd, struct sta_info *sta)
 
 	eloop_cancel_timeout(ap_handle_timer, hapd, sta);
 	eloop_cancel_timeout(ap_handle_session_timer, hapd, sta);
+	ap_sta_cancel_vlan_bind(hapd, sta);
 
 	ieee802_1x_free_station(sta);
 	wpa_auth_sta_deinit(sta->wpa_sm);
@@ -531,6 +533,7 @@ void ap_sta_disassociate(struct hostapd_data *hapd, struct sta_info *sta,
 	wpa_printf(MSG_DEBUG, "%s: disassociate STA " MACSTR,
 		   hapd->conf->iface, MAC2STR(sta->addr));
 	sta->flags &= ~WLAN_STA_ASSOC;
+	ap_sta_cancel_vlan_bind(hapd, sta);
 	ap_sta_remove(hapd, sta);
 	sta->timeout_next = STA_DEAUTH;
 	eloop_cancel_timeout(ap_handle_timer, hapd, sta);
@@ -549,6 +552,7 @@ void ap_sta_deauthenticate(struct hostapd_data *hapd, struct sta_info *sta,
 	wpa_printf(MSG_DEBUG, "%s: deauthenticate STA " MACSTR,
 		   hapd->conf->iface, MAC2STR(sta->addr));
 	sta->flags &= ~(WLAN_STA_AUTH | WLAN_STA_ASSOC);
+	ap_sta_cancel_vlan_bind(hapd, sta);
 	ap_sta_remove(hapd, sta);
 	sta->timeout_next = STA_REMOVE;
 	eloop_cancel_timeout(ap_handle_timer, hapd, sta);
@@ -676,6 +680,129 @@ int ap_sta_bind_vlan(struct hostapd_data *hapd, struct sta_info *sta,
 }
 
 
+/* Whether binding the station requires adding a dynamic VLAN interface */
+static int ap_sta_vlan_needs_add(struct hostapd_data *hapd,
+				 struct sta_info *sta)
+{
+#ifndef CONFIG_NO_VLAN
+	struct hostapd_vlan *vlan;
+
+	if (sta->ssid->dynamic_vlan == DYNAMIC_VLAN_DISABLED ||
+	    sta->vlan_id <= 0)
+		return 0;
+
+	for (vlan = hapd->conf->vlan; vlan; vlan = vlan->next) {
+		if (vlan->vlan_id == sta->vlan_id)
+			return 0;
+		if (vlan->vlan_id == VLAN_ID_WILDCARD)
+			return 1;
+	}
+#endif /* CONFIG_NO_VLAN */
+
+	return 0;
+}
+
+
+static int ap_sta_vlan_bind_complete(struct hostapd_data *hapd,
+				     struct sta_info *sta)
+{
+	void (*cb)(struct hostapd_data *hapd, struct sta_info *sta,
+		   int result);
+	struct os_time now, diff;
+	int ret;
+
+	cb = sta->vlan_bind_cb;
+	sta->vlan_bind_cb = NULL;
+	sta->flags &= ~WLAN_STA_VLAN_PENDING;
+
+	ret = ap_sta_bind_vlan(hapd, sta, sta->vlan_bind_old_id);
+
+	os_get_time(&now);
+	os_time_sub(&now, &sta->vlan_bind_start, &diff);
+	hostapd_logger(hapd, sta->addr, HOSTAPD_MODULE_IEEE80211,
+		       HOSTAPD_LEVEL_INFO, "VLAN %d %s after %u ms",
+		       sta->vlan_id, ret < 0 ? "binding failed" : "ready",
+		       (unsigned int) (diff.sec * 1000 + diff.usec / 1000));
+
+	if (cb)
+		cb(hapd, sta, ret);
+
+	return ret;
+}
+
+
+static void ap_sta_vlan_bind_step(void *eloop_ctx, void *timeout_ctx)
+{
+	struct hostapd_data *hapd = eloop_ctx;
+	struct sta_info *sta = timeout_ctx;
+
+	ap_sta_vlan_bind_complete(hapd, sta);
+}
+
+
+/**
+ * ap_sta_bind_vlan_async - Bind a station to its VLAN without blocking
+ * @hapd: Pointer to BSS data
+ * @sta: Station with sta->vlan_id set to the new VLAN ID
+ * @old_vlanid: Previous VLAN ID of the station
+ * @cb: Function to call with the result of ap_sta_bind_vlan() if the binding
+ *	is completed later, or %NULL
+ * Returns: 1 if the binding is pending, otherwise the result of
+ * ap_sta_bind_vlan() (cb is not called)
+ *
+ * Adding the interface for a new dynamic VLAN (and the bridge with full
+ * dynamic VLAN) is slow, so it is done in a separate step from the event loop
+ * after the frames and messages of the other stations that are already queued
+ * have been processed. Binding to an existing VLAN is done immediately.
+ */
+int ap_sta_bind_vlan_async(struct hostapd_data *hapd, struct sta_info *sta,
+			   int old_vlanid,
+			   void (*cb)(struct hostapd_data *hapd,
+				      struct sta_info *sta, int result))
+{
+	if (sta->flags & WLAN_STA_VLAN_PENDING) {
+		/*
+		 * The VLAN changed again before the earlier binding was
+		 * completed; complete it now with the new VLAN ID.
+		 */
+		eloop_cancel_timeout(ap_sta_vlan_bind_step, hapd, sta);
+		return ap_sta_vlan_bind_complete(hapd, sta);
+	}
+
+	if (sta->vlan_id == old_vlanid || !ap_sta_vlan_needs_add(hapd, sta))
+		return ap_sta_bind_vlan(hapd, sta, old_vlanid);
+
+	hostapd_logger(hapd, sta->addr, HOSTAPD_MODULE_IEEE80211,
+		       HOSTAPD_LEVEL_DEBUG, "binding to new VLAN %d pending",
+		       sta->vlan_id);
+	sta->flags |= WLAN_STA_VLAN_PENDING;
+	sta->vlan_bind_old_id = old_vlanid;
+	sta->vlan_bind_cb = cb;
+	os_get_time(&sta->vlan_bind_start);
+	eloop_register_timeout(0, 0, ap_sta_vlan_bind_step, hapd, sta);
+
+	return 1;
+}
+
+
+/**
+ * ap_sta_cancel_vlan_bind - Cancel pending ap_sta_bind_vlan_async()
+ * @hapd: Pointer to BSS data
+ * @sta: Station that is no longer associated
+ *
+ * The completion callback is not called.
+ */
+void ap_sta_cancel_vlan_bind(struct hostapd_data *hapd, struct sta_info *sta)
+{
+	if (!(sta->flags & WLAN_STA_VLAN_PENDING))
+		return;
+
+	eloop_cancel_timeout(ap_sta_vlan_bind_step, hapd, sta);
+	sta->flags &= ~WLAN_STA_VLAN_PENDING;
+	sta->vlan_bind_cb = NULL;
+}
+
+
 #ifdef CONFIG_IEEE80211W
 
 int ap_check_sa_query_timeout(struct hostapd_data *hapd, struct sta_info *sta)
@@ -15,6 +15,8 @@
 #ifndef STA_INFO_H
 #define STA_INFO_H
 
+struct hostapd_data;
+
 /* STA flags */
 #define WLAN_STA_AUTH BIT(0)
 #define WLAN_STA_ASSOC BIT(1)
@@ -32,6 +34,7 @@
 #define WLAN_STA_MAYBE_WPS BIT(13)
 #define WLAN_STA_WDS BIT(14)
 #define WLAN_STA_ASSOC_REQ_OK BIT(15)
+#define WLAN_STA_VLAN_PENDING BIT(16) /* VLAN binding in progress */
 #define WLAN_STA_NONERP BIT(31)
 
 /* Maximum number of supported rates (from both Supported Rates and Extended
@@ -92,6 +95,12 @@ struct sta_info {
 	struct hostapd_ssid *ssid_probe; /* SSID selection based on ProbeReq */
 
 	int vlan_id;
+	/* Pending ap_sta_bind_vlan_async() (WLAN_STA_VLAN_PENDING) */
+	int vlan_bind_old_id;
+	void (*vlan_bind_cb)(struct hostapd_data *hapd, struct sta_info *sta,
+			     int result);
+	struct os_time vlan_bind_start;
+	unsigned int vlan_bind_new_assoc:1; /* used by the association cb */
 
 	struct ieee80211_ht_capabilities *ht_capabilities;
 
@@ -149,6 +158,11 @@ void ap_sta_deauthenticate(struct hostapd_data *hapd, struct sta_info *sta,
 			   u16 reason);
 int ap_sta_bind_vlan(struct hostapd_data *hapd, struct sta_info *sta,
 		     int old_vlanid);
+int ap_sta_bind_vlan_async(struct hostapd_data *hapd, struct sta_info *sta,
+			   int old_vlanid,
+			   void (*cb)(struct hostapd_data *hapd,
+				      struct sta_info *sta, int result));
+void ap_sta_cancel_vlan_bind(struct hostapd_data *hapd, struct sta_info *sta);
 void ap_sta_start_sa_query(struct hostapd_data *hapd, struct sta_info *sta);
 void ap_sta_stop_sa_query(struct hostapd_data *hapd, struct sta_info *sta);
 int ap_check_sa_query_timeout(struct hostapd_data *hapd, struct sta_info *sta);
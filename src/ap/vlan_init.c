@@ -33,10 +33,15 @@
 
 #include "drivers/priv_netlink.h"
 #include "utils/eloop.h"
+#include "utils/list.h"
 
 
 struct full_dynamic_vlan {
 	int s; /* socket on which to listen for new/removed interfaces. */
+	struct hostapd_data *hapd;
+	u32 seq;
+	struct dl_list setups; /* struct vlan_setup; waiting for setup */
+	struct dl_list pool; /* struct vlan_setup; preprovisioned VLANs */
 };
 
 
@@ -94,13 +99,6 @@ static int ifconfig_down(const char *if_name)
 }
 
 
-/*
- * These are only available in recent linux headers (without the leading
- * underscore).
- */
-#define _GET_VLAN_REALDEV_NAME_CMD	8
-#define _GET_VLAN_VID_CMD		9
-
 /* This value should be 256 ONLY. If it is something else, then hostapd
  * might crash!, as this value has been hard-coded in 2.4.x kernel
  * bridging code.
@@ -151,62 +149,6 @@ static int br_delif(const char *br_name, const char *if_name)
 }
 
 
-/*
-	Add interface 'if_name' to the bridge 'br_name'
-
-	returns -1 on error
-	returns 1 if the interface is already part of the bridge
-	returns 0 otherwise
-*/
-static int br_addif(const char *br_name, const char *if_name)
-{
-	int fd;
-	struct ifreq ifr;
-	unsigned long args[2];
-	int if_index;
-
-	wpa_printf(MSG_DEBUG, "VLAN: br_addif(%s, %s)", br_name, if_name);
-	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		wpa_printf(MSG_ERROR, "VLAN: %s: socket(AF_INET,SOCK_STREAM) "
-			   "failed: %s", __func__, strerror(errno));
-		return -1;
-	}
-
-	if_index = if_nametoindex(if_name);
-
-	if (if_index == 0) {
-		wpa_printf(MSG_ERROR, "VLAN: %s: Failure determining "
-			   "interface index for '%s'",
-			   __func__, if_name);
-		close(fd);
-		return -1;
-	}
-
-	args[0] = BRCTL_ADD_IF;
-	args[1] = if_index;
-
-	os_strlcpy(ifr.ifr_name, br_name, sizeof(ifr.ifr_name));
-	ifr.ifr_data = (__caddr_t) args;
-
-	if (ioctl(fd, SIOCDEVPRIVATE, &ifr) < 0) {
-		if (errno == EBUSY) {
-			/* The interface is already added. */
-			close(fd);
-			return 1;
-		}
-
-		wpa_printf(MSG_ERROR, "VLAN: %s: ioctl[SIOCDEVPRIVATE,"
-			   "BRCTL_ADD_IF] failed for br_name=%s if_name=%s: "
-			   "%s", __func__, br_name, if_name, strerror(errno));
-		close(fd);
-		return -1;
-	}
-
-	close(fd);
-	return 0;
-}
-
-
 static int br_delbr(const char *br_name)
 {
 	int fd;
@@ -235,63 +177,6 @@ static int br_delbr(const char *br_name)
 }
 
 
-/*
-	Add a bridge with the name 'br_name'.
-
-	returns -1 on error
-	returns 1 if the bridge already exists
-	returns 0 otherwise
-*/
-static int br_addbr(const char *br_name)
-{
-	int fd;
-	unsigned long arg[4];
-	struct ifreq ifr;
-
-	wpa_printf(MSG_DEBUG, "VLAN: br_addbr(%s)", br_name);
-	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		wpa_printf(MSG_ERROR, "VLAN: %s: socket(AF_INET,SOCK_STREAM) "
-			   "failed: %s", __func__, strerror(errno));
-		return -1;
-	}
-
-	arg[0] = BRCTL_ADD_BRIDGE;
-	arg[1] = (unsigned long) br_name;
-
-	if (ioctl(fd, SIOCGIFBR, arg) < 0) {
- 		if (errno == EEXIST) {
-			/* The bridge is already added. */
-			close(fd);
-			return 1;
-		} else {
-			wpa_printf(MSG_ERROR, "VLAN: %s: BRCTL_ADD_BRIDGE "
-				   "failed for %s: %s",
-				   __func__, br_name, strerror(errno));
-			close(fd);
-			return -1;
-		}
-	}
-
-	/* Decrease forwarding delay to avoid EAPOL timeouts. */
-	os_memset(&ifr, 0, sizeof(ifr));
-	os_strlcpy(ifr.ifr_name, br_name, IFNAMSIZ);
-	arg[0] = BRCTL_SET_BRIDGE_FORWARD_DELAY;
-	arg[1] = 1;
-	arg[2] = 0;
-	arg[3] = 0;
-	ifr.ifr_data = (char *) &arg;
-	if (ioctl(fd, SIOCDEVPRIVATE, &ifr) < 0) {
-		wpa_printf(MSG_ERROR, "VLAN: %s: "
-			   "BRCTL_SET_BRIDGE_FORWARD_DELAY (1 sec) failed for "
-			   "%s: %s", __func__, br_name, strerror(errno));
-		/* Continue anyway */
-	}
-
-	close(fd);
-	return 0;
-}
-
-
 static int br_getnumports(const char *br_name)
 {
 	int fd;
@@ -371,149 +256,460 @@ static int vlan_rem(const char *if_name)
 
 
 /*
-	Add a vlan interface with VLAN ID 'vid' and tagged interface
-	'if_name'.
+ * Link setup with rtnetlink
+ *
+ * The bridge and the tagged VLAN interface for a VLAN are created and the
+ * interfaces are added to the bridge with rtnetlink requests on the same
+ * socket that is used for link events. The requests of all VLANs that are
+ * waiting for setup are sent as a single batch, so that a burst of new VLANs
+ * takes two round trips to the kernel (one to create the links and one to add
+ * the ports) instead of several ioctl calls per VLAN. The acknowledgements are
+ * processed from the event loop like the link events.
+ *
+ * The bridges and VLAN interfaces for the VLAN IDs in vlan_pool are created
+ * at startup, so that only the wireless interface needs to be added to the
+ * bridge when a station is assigned to one of these VLANs.
+ */
 
-	returns -1 on error
-	returns 1 if the interface already exists
-	returns 0 otherwise
-*/
-static int vlan_add(const char *if_name, int vid)
+#define VLAN_NL_TIMEOUT 5
+
+enum vlan_nl_op {
+	VLAN_NL_BR, VLAN_NL_VLAN, VLAN_NL_TAGGED_UP, VLAN_NL_BR_UP,
+	VLAN_NL_VLAN_PORT, VLAN_NL_WLAN_PORT, NUM_VLAN_NL_OP
+};
+
+struct vlan_setup {
+	struct dl_list list;
+	int vlan_id;
+	char ifname[IFNAMSIZ + 1]; /* wireless interface; empty for pool */
+	int ports; /* 0 = creating links, 1 = adding ports */
+	int br_exists;
+	int clean; /* DVLAN_CLEAN_* */
+	u32 seq[NUM_VLAN_NL_OP]; /* pending requests */
+	int pending;
+	struct os_time start;
+};
+
+
+static void vlan_nl_flush(void *eloop_ctx, void *timeout_ctx);
+static void vlan_nl_timeout(void *eloop_ctx, void *timeout_ctx);
+
+
+static void vlan_nl_schedule(struct full_dynamic_vlan *priv)
 {
-	int fd;
-	struct vlan_ioctl_args if_request;
+	eloop_cancel_timeout(vlan_nl_flush, priv, NULL);
+	eloop_register_timeout(0, 0, vlan_nl_flush, priv, NULL);
+}
 
-	wpa_printf(MSG_DEBUG, "VLAN: vlan_add(if_name=%s, vid=%d)",
-		   if_name, vid);
-	ifconfig_up(if_name);
 
-	if ((os_strlen(if_name) + 1) > sizeof(if_request.device1)) {
-		wpa_printf(MSG_ERROR, "VLAN: Interface name too long: '%s'",
-			   if_name);
-		return -1;
-	}
+static struct vlan_setup * vlan_setup_add(struct full_dynamic_vlan *priv,
+					  int vlan_id, const char *ifname)
+{
+	struct vlan_setup *setup;
 
-	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		wpa_printf(MSG_ERROR, "VLAN: %s: socket(AF_INET,SOCK_STREAM) "
-			   "failed: %s", __func__, strerror(errno));
-		return -1;
+	setup = os_zalloc(sizeof(*setup));
+	if (setup == NULL)
+		return NULL;
+	setup->vlan_id = vlan_id;
+	if (ifname)
+		os_strlcpy(setup->ifname, ifname, sizeof(setup->ifname));
+	os_get_time(&setup->start);
+	dl_list_add_tail(&priv->setups, &setup->list);
+	vlan_nl_schedule(priv);
+
+	return setup;
+}
+
+
+static struct vlan_setup * vlan_setup_get(struct dl_list *list, int vlan_id,
+					  const char *ifname)
+{
+	struct vlan_setup *setup;
+
+	dl_list_for_each(setup, list, struct vlan_setup, list) {
+		if (ifname ? os_strcmp(setup->ifname, ifname) == 0 :
+		    (setup->ifname[0] == '\0' && setup->vlan_id == vlan_id))
+			return setup;
 	}
 
-	os_memset(&if_request, 0, sizeof(if_request));
+	return NULL;
+}
 
-	/* Determine if a suitable vlan device already exists. */
 
-	os_snprintf(if_request.device1, sizeof(if_request.device1), "vlan%d",
-		    vid);
+static void vlan_nl_attr(struct wpabuf *buf, u16 type, const void *data,
+			 size_t len)
+{
+	struct rtattr *attr;
 
-	if_request.cmd = _GET_VLAN_VID_CMD;
+	attr = wpabuf_put(buf, RTA_LENGTH(0));
+	attr->rta_type = type;
+	attr->rta_len = RTA_LENGTH(len);
+	if (len)
+		wpabuf_put_data(buf, data, len);
+	os_memset(wpabuf_put(buf, RTA_ALIGN(len) - len), 0,
+		  RTA_ALIGN(len) - len);
+}
 
-	if (ioctl(fd, SIOCSIFVLAN, &if_request) == 0) {
 
-		if (if_request.u.VID == vid) {
-			if_request.cmd = _GET_VLAN_REALDEV_NAME_CMD;
+static size_t vlan_nl_nest_start(struct wpabuf *buf, u16 type)
+{
+	size_t start = wpabuf_len(buf);
+	vlan_nl_attr(buf, type, NULL, 0);
+	return start;
+}
 
-			if (ioctl(fd, SIOCSIFVLAN, &if_request) == 0 &&
-			    os_strncmp(if_request.u.device2, if_name,
-				       sizeof(if_request.u.device2)) == 0) {
-				close(fd);
-				wpa_printf(MSG_DEBUG, "VLAN: vlan_add: "
-					   "if_name %s exists already",
-					   if_request.device1);
-				return 1;
-			}
-		}
-	}
 
-	/* A suitable vlan device does not already exist, add one. */
+static void vlan_nl_nest_end(struct wpabuf *buf, size_t start)
+{
+	struct rtattr *attr = (struct rtattr *) (wpabuf_mhead_u8(buf) + start);
+	attr->rta_len = wpabuf_len(buf) - start;
+}
 
-	os_memset(&if_request, 0, sizeof(if_request));
-	os_strlcpy(if_request.device1, if_name, sizeof(if_request.device1));
-	if_request.u.VID = vid;
-	if_request.cmd = ADD_VLAN_CMD;
 
-	if (ioctl(fd, SIOCSIFVLAN, &if_request) < 0) {
-		wpa_printf(MSG_ERROR, "VLAN: %s: ADD_VLAN_CMD failed for %s: "
-			   "%s",
-			   __func__, if_request.device1, strerror(errno));
-		close(fd);
-		return -1;
+/*
+ * Add an RTM_NEWLINK request to the batch; the link is set up in any case and
+ * created (with type kind) if ifindex is zero.
+ */
+static size_t vlan_nl_newlink(struct full_dynamic_vlan *priv,
+			      struct wpabuf *buf, struct vlan_setup *setup,
+			      enum vlan_nl_op op, int ifindex,
+			      const char *ifname, const char *kind)
+{
+	struct nlmsghdr *h;
+	struct ifinfomsg *ifi;
+	size_t start = wpabuf_len(buf);
+
+	h = wpabuf_put(buf, NLMSG_HDRLEN);
+	h->nlmsg_type = RTM_NEWLINK;
+	h->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	if (ifindex == 0)
+		h->nlmsg_flags |= NLM_F_CREATE | NLM_F_EXCL;
+	h->nlmsg_seq = ++priv->seq;
+	setup->seq[op] = h->nlmsg_seq;
+	setup->pending++;
+
+	ifi = wpabuf_put(buf, NLMSG_ALIGN(sizeof(*ifi)));
+	ifi->ifi_family = AF_UNSPEC;
+	ifi->ifi_index = ifindex;
+	ifi->ifi_flags = IFF_UP;
+	ifi->ifi_change = IFF_UP;
+
+	if (ifname)
+		vlan_nl_attr(buf, IFLA_IFNAME, ifname, os_strlen(ifname) + 1);
+	if (kind) {
+		size_t linkinfo = vlan_nl_nest_start(buf, IFLA_LINKINFO);
+		vlan_nl_attr(buf, IFLA_INFO_KIND, kind, os_strlen(kind));
+		/* IFLA_INFO_DATA is added by the caller */
+		return linkinfo;
 	}
 
-	close(fd);
-	return 0;
+	return start;
 }
 
 
-static int vlan_set_name_type(unsigned int name_type)
+static void vlan_nl_msg_end(struct wpabuf *buf, size_t start)
 {
-	int fd;
-	struct vlan_ioctl_args if_request;
+	struct nlmsghdr *h = (struct nlmsghdr *) (wpabuf_mhead_u8(buf) +
+						  start);
+	h->nlmsg_len = wpabuf_len(buf) - start;
+}
 
-	wpa_printf(MSG_DEBUG, "VLAN: vlan_set_name_type(name_type=%u)",
-		   name_type);
-	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		wpa_printf(MSG_ERROR, "VLAN: %s: socket(AF_INET,SOCK_STREAM) "
-			   "failed: %s", __func__, strerror(errno));
-		return -1;
+
+static int vlan_nl_ifindex(const char *ifname)
+{
+	int ifindex = if_nametoindex(ifname);
+	if (ifindex == 0)
+		wpa_printf(MSG_ERROR, "VLAN: Failure determining interface "
+			   "index for '%s'", ifname);
+	return ifindex;
+}
+
+
+static void vlan_nl_add_port(struct full_dynamic_vlan *priv,
+			     struct wpabuf *buf, struct vlan_setup *setup,
+			     enum vlan_nl_op op, const char *ifname,
+			     const char *br_name, int br_ifindex)
+{
+	size_t start;
+	int ifindex;
+	u32 val;
+
+	ifindex = vlan_nl_ifindex(ifname);
+	if (ifindex == 0)
+		return;
+
+	wpa_printf(MSG_DEBUG, "VLAN: Add %s to %s", ifname, br_name);
+	start = wpabuf_len(buf);
+	vlan_nl_newlink(priv, buf, setup, op, ifindex, NULL, NULL);
+	val = br_ifindex;
+	vlan_nl_attr(buf, IFLA_MASTER, &val, sizeof(val));
+	vlan_nl_msg_end(buf, start);
+}
+
+
+/* Add the requests for the next step of the setup; returns number added */
+static int vlan_setup_requests(struct full_dynamic_vlan *priv,
+			       struct wpabuf *buf, struct vlan_setup *setup)
+{
+	char *tagged_interface =
+		priv->hapd->conf->ssid.vlan_tagged_interface;
+	char br_name[IFNAMSIZ], vlan_ifname[IFNAMSIZ];
+	size_t start, info, data;
+	int br_ifindex, ifindex;
+	u32 val;
+	u16 vid;
+
+	os_snprintf(br_name, sizeof(br_name), "brvlan%d", setup->vlan_id);
+	os_snprintf(vlan_ifname, sizeof(vlan_ifname), "vlan%d",
+		    setup->vlan_id);
+
+	if (!setup->ports) {
+		wpa_printf(MSG_DEBUG, "VLAN: Create %s%s%s", br_name,
+			   tagged_interface ? " and " : "",
+			   tagged_interface ? vlan_ifname : "");
+
+		start = wpabuf_len(buf);
+		info = vlan_nl_newlink(priv, buf, setup, VLAN_NL_BR, 0,
+				       br_name, "bridge");
+		/* Decrease forwarding delay to avoid EAPOL timeouts. */
+		data = vlan_nl_nest_start(buf, IFLA_INFO_DATA);
+		val = 100; /* 1 s in USER_HZ */
+		vlan_nl_attr(buf, IFLA_BR_FORWARD_DELAY, &val, sizeof(val));
+		vlan_nl_nest_end(buf, data);
+		vlan_nl_nest_end(buf, info);
+		vlan_nl_msg_end(buf, start);
+
+		if (tagged_interface) {
+			ifindex = vlan_nl_ifindex(tagged_interface);
+			if (ifindex == 0)
+				return setup->pending;
+
+			start = wpabuf_len(buf);
+			vlan_nl_newlink(priv, buf, setup, VLAN_NL_TAGGED_UP,
+					ifindex, NULL, NULL);
+			vlan_nl_msg_end(buf, start);
+
+			start = wpabuf_len(buf);
+			info = vlan_nl_newlink(priv, buf, setup, VLAN_NL_VLAN,
+					       0, vlan_ifname, "vlan");
+			data = vlan_nl_nest_start(buf, IFLA_INFO_DATA);
+			vid = setup->vlan_id;
+			vlan_nl_attr(buf, IFLA_VLAN_ID, &vid, sizeof(vid));
+			vlan_nl_nest_end(buf, data);
+			vlan_nl_nest_end(buf, info);
+			val = ifindex;
+			vlan_nl_attr(buf, IFLA_LINK, &val, sizeof(val));
+			vlan_nl_msg_end(buf, start);
+		}
+
+		return setup->pending;
 	}
 
-	os_memset(&if_request, 0, sizeof(if_request));
+	br_ifindex = vlan_nl_ifindex(br_name);
+	if (br_ifindex == 0)
+		return 0;
 
-	if_request.u.name_type = name_type;
-	if_request.cmd = SET_VLAN_NAME_TYPE_CMD;
-	if (ioctl(fd, SIOCSIFVLAN, &if_request) < 0) {
-		wpa_printf(MSG_ERROR, "VLAN: %s: SET_VLAN_NAME_TYPE_CMD "
-			   "name_type=%u failed: %s",
-			   __func__, name_type, strerror(errno));
-		close(fd);
-		return -1;
+	if (setup->br_exists) {
+		start = wpabuf_len(buf);
+		vlan_nl_newlink(priv, buf, setup, VLAN_NL_BR_UP, br_ifindex,
+				NULL, NULL);
+		vlan_nl_msg_end(buf, start);
 	}
 
-	close(fd);
-	return 0;
+	/*
+	 * The tagged VLAN interface of a pool VLAN is added to the bridge
+	 * when the pool is set up; only the wireless interface is added later.
+	 */
+	if (tagged_interface &&
+	    (!setup->ifname[0] ||
+	     vlan_setup_get(&priv->pool, setup->vlan_id, NULL) == NULL))
+		vlan_nl_add_port(priv, buf, setup, VLAN_NL_VLAN_PORT,
+				 vlan_ifname, br_name, br_ifindex);
+
+	if (setup->ifname[0])
+		vlan_nl_add_port(priv, buf, setup, VLAN_NL_WLAN_PORT,
+				 setup->ifname, br_name, br_ifindex);
+
+	return setup->pending;
 }
 
 
-static void vlan_newlink(char *ifname, struct hostapd_data *hapd)
+static void vlan_setup_done(struct full_dynamic_vlan *priv,
+			    struct vlan_setup *setup)
 {
-	char vlan_ifname[IFNAMSIZ];
-	char br_name[IFNAMSIZ];
-	struct hostapd_vlan *vlan = hapd->conf->vlan;
-	char *tagged_interface = hapd->conf->ssid.vlan_tagged_interface;
+	struct hostapd_vlan *vlan;
+	struct os_time now, diff;
 
-	wpa_printf(MSG_DEBUG, "VLAN: vlan_newlink(%s)", ifname);
+	os_get_time(&now);
+	os_time_sub(&now, &setup->start, &diff);
+	dl_list_del(&setup->list);
 
-	while (vlan) {
-		if (os_strcmp(ifname, vlan->ifname) == 0) {
+	if (!setup->ifname[0]) {
+		wpa_printf(MSG_DEBUG, "VLAN: Pool VLAN %d ready after %u ms",
+			   setup->vlan_id, (unsigned int) (diff.sec * 1000 +
+							   diff.usec / 1000));
+		dl_list_add_tail(&priv->pool, &setup->list);
+		return;
+	}
+
+	wpa_printf(MSG_DEBUG, "VLAN: %s ready in brvlan%d after %u ms",
+		   setup->ifname, setup->vlan_id,
+		   (unsigned int) (diff.sec * 1000 + diff.usec / 1000));
+	for (vlan = priv->hapd->conf->vlan; vlan; vlan = vlan->next) {
+		if (os_strcmp(vlan->ifname, setup->ifname) == 0) {
+			vlan->clean |= setup->clean;
+			break;
+		}
+	}
+	os_free(setup);
+}
+
+
+static void vlan_nl_flush(void *eloop_ctx, void *timeout_ctx)
+{
+	struct full_dynamic_vlan *priv = eloop_ctx;
+	struct vlan_setup *setup, *tmp;
+	struct sockaddr_nl dst;
+	struct wpabuf *buf;
+	int count = 0;
+
+	dl_list_for_each(setup, &priv->setups, struct vlan_setup, list) {
+		if (!setup->pending)
+			count++;
+	}
+	if (count == 0)
+		return;
 
-			os_snprintf(br_name, sizeof(br_name), "brvlan%d",
-				    vlan->vlan_id);
+	buf = wpabuf_alloc(count * NUM_VLAN_NL_OP * 128);
+	if (buf == NULL)
+		return;
 
-			if (!br_addbr(br_name))
-				vlan->clean |= DVLAN_CLEAN_BR;
+	count = 0;
+	dl_list_for_each_safe(setup, tmp, &priv->setups, struct vlan_setup,
+			      list) {
+		if (setup->pending)
+			continue;
+		if (vlan_setup_requests(priv, buf, setup) == 0) {
+			if (setup->ports) {
+				vlan_setup_done(priv, setup);
+				continue;
+			}
+			setup->ports = 1;
+			if (vlan_setup_requests(priv, buf, setup) == 0) {
+				vlan_setup_done(priv, setup);
+				continue;
+			}
+		}
+		count++;
+	}
 
-			ifconfig_up(br_name);
+	if (wpabuf_len(buf) > 0) {
+		wpa_printf(MSG_DEBUG, "VLAN: Sending %u byte rtnetlink batch "
+			   "for %d VLAN(s)", (unsigned int) wpabuf_len(buf),
+			   count);
+		os_memset(&dst, 0, sizeof(dst));
+		dst.nl_family = AF_NETLINK;
+		if (sendto(priv->s, wpabuf_head(buf), wpabuf_len(buf), 0,
+			   (struct sockaddr *) &dst, sizeof(dst)) < 0)
+			wpa_printf(MSG_ERROR, "VLAN: %s: sendto(netlink) "
+				   "failed: %s", __func__, strerror(errno));
+		eloop_cancel_timeout(vlan_nl_timeout, priv, NULL);
+		eloop_register_timeout(VLAN_NL_TIMEOUT, 0, vlan_nl_timeout,
+				       priv, NULL);
+	}
+	wpabuf_free(buf);
+}
 
-			if (tagged_interface) {
 
-				if (!vlan_add(tagged_interface, vlan->vlan_id))
-					vlan->clean |= DVLAN_CLEAN_VLAN;
+static void vlan_nl_timeout(void *eloop_ctx, void *timeout_ctx)
+{
+	struct full_dynamic_vlan *priv = eloop_ctx;
+	struct vlan_setup *setup, *tmp;
+
+	dl_list_for_each_safe(setup, tmp, &priv->setups, struct vlan_setup,
+			      list) {
+		if (!setup->pending)
+			continue;
+		wpa_printf(MSG_ERROR, "VLAN: No response from kernel to "
+			   "setup of VLAN %d", setup->vlan_id);
+		vlan_setup_done(priv, setup);
+	}
+}
 
-				os_snprintf(vlan_ifname, sizeof(vlan_ifname),
-					    "vlan%d", vlan->vlan_id);
 
-				if (!br_addif(br_name, vlan_ifname))
-					vlan->clean |= DVLAN_CLEAN_VLAN_PORT;
+static void vlan_nl_ack(struct full_dynamic_vlan *priv, struct nlmsghdr *h,
+			size_t len)
+{
+	struct nlmsgerr *err;
+	struct vlan_setup *setup;
+	int op;
 
-				ifconfig_up(vlan_ifname);
-			}
+	if (len < sizeof(*err))
+		return;
+	err = NLMSG_DATA(h);
 
-			if (!br_addif(br_name, ifname))
-				vlan->clean |= DVLAN_CLEAN_WLAN_PORT;
+	dl_list_for_each(setup, &priv->setups, struct vlan_setup, list) {
+		for (op = 0; op < NUM_VLAN_NL_OP; op++) {
+			if (setup->seq[op] == h->nlmsg_seq)
+				goto found;
+		}
+	}
+	return;
+
+found:
+	setup->seq[op] = 0;
+	setup->pending--;
+
+	if (err->error == -EEXIST && op == VLAN_NL_BR) {
+		setup->br_exists = 1;
+	} else if (err->error == -EEXIST && op == VLAN_NL_VLAN) {
+		/* Already there; not removed by us either */
+	} else if (err->error) {
+		wpa_printf(MSG_ERROR, "VLAN: rtnetlink request %d for VLAN %d "
+			   "failed: %s", op, setup->vlan_id,
+			   strerror(-err->error));
+	} else if (op == VLAN_NL_BR) {
+		setup->clean |= DVLAN_CLEAN_BR;
+	} else if (op == VLAN_NL_VLAN) {
+		setup->clean |= DVLAN_CLEAN_VLAN;
+	} else if (op == VLAN_NL_VLAN_PORT) {
+		/* Do not remove ports we did not add to the bridge */
+		if (setup->clean & DVLAN_CLEAN_VLAN)
+			setup->clean |= DVLAN_CLEAN_VLAN_PORT;
+	} else if (op == VLAN_NL_WLAN_PORT) {
+		setup->clean |= DVLAN_CLEAN_WLAN_PORT;
+	}
+
+	if (setup->pending == 0) {
+		if (setup->ports)
+			vlan_setup_done(priv, setup);
+		else {
+			setup->ports = 1;
+			vlan_nl_schedule(priv);
+		}
+	}
+}
 
-			ifconfig_up(ifname);
 
+static void vlan_newlink(char *ifname, struct hostapd_data *hapd)
+{
+	struct full_dynamic_vlan *priv = hapd->full_dynamic_vlan;
+	struct hostapd_vlan *vlan = hapd->conf->vlan;
+	struct vlan_setup *setup;
+
+	wpa_printf(MSG_DEBUG, "VLAN: vlan_newlink(%s)", ifname);
+
+	while (vlan) {
+		if (os_strcmp(ifname, vlan->ifname) == 0) {
+			/* Link events are also received for our own changes */
+			if ((vlan->clean & DVLAN_CLEAN_WLAN_PORT) ||
+			    vlan_setup_get(&priv->setups, 0, ifname))
+				break;
+
+			setup = vlan_setup_add(priv, vlan->vlan_id, ifname);
+			if (setup &&
+			    vlan_setup_get(&priv->pool, vlan->vlan_id, NULL))
+				setup->ports = 1;
 			break;
 		}
 		vlan = vlan->next;
@@ -521,41 +717,60 @@ static void vlan_newlink(char *ifname, struct hostapd_data *hapd)
 }
 
 
-static void vlan_dellink(char *ifname, struct hostapd_data *hapd)
+/* Remove the links that were created (clean) for the VLAN */
+static void vlan_clean_links(struct hostapd_data *hapd, int vlan_id,
+			     const char *ifname, int clean)
 {
 	char vlan_ifname[IFNAMSIZ];
 	char br_name[IFNAMSIZ];
-	struct hostapd_vlan *first, *prev, *vlan = hapd->conf->vlan;
 	char *tagged_interface = hapd->conf->ssid.vlan_tagged_interface;
 
+	os_snprintf(br_name, sizeof(br_name), "brvlan%d", vlan_id);
+
+	if (ifname && (clean & DVLAN_CLEAN_WLAN_PORT))
+		br_delif(br_name, ifname);
+
+	if (tagged_interface) {
+		os_snprintf(vlan_ifname, sizeof(vlan_ifname), "vlan%d",
+			    vlan_id);
+		if (clean & DVLAN_CLEAN_VLAN_PORT)
+			br_delif(br_name, vlan_ifname);
+		if (clean & DVLAN_CLEAN_VLAN) {
+			ifconfig_down(vlan_ifname);
+			vlan_rem(vlan_ifname);
+		}
+	}
+
+	if ((clean & DVLAN_CLEAN_BR) && br_getnumports(br_name) == 0) {
+		ifconfig_down(br_name);
+		br_delbr(br_name);
+	}
+}
+
+
+static void vlan_dellink(char *ifname, struct hostapd_data *hapd)
+{
+	struct full_dynamic_vlan *priv = hapd->full_dynamic_vlan;
+	struct hostapd_vlan *first, *prev, *vlan = hapd->conf->vlan;
+	struct vlan_setup *setup;
+
 	wpa_printf(MSG_DEBUG, "VLAN: vlan_dellink(%s)", ifname);
 
 	first = prev = vlan;
 
 	while (vlan) {
 		if (os_strcmp(ifname, vlan->ifname) == 0) {
-			os_snprintf(br_name, sizeof(br_name), "brvlan%d",
-				    vlan->vlan_id);
-
-			if (vlan->clean & DVLAN_CLEAN_WLAN_PORT)
-				br_delif(br_name, vlan->ifname);
-
-			if (tagged_interface) {
-				os_snprintf(vlan_ifname, sizeof(vlan_ifname),
-					    "vlan%d", vlan->vlan_id);
-				if (vlan->clean & DVLAN_CLEAN_VLAN_PORT)
-					br_delif(br_name, vlan_ifname);
-				ifconfig_down(vlan_ifname);
-
-				if (vlan->clean & DVLAN_CLEAN_VLAN)
-					vlan_rem(vlan_ifname);
+			setup = priv ? vlan_setup_get(&priv->setups, 0, ifname)
+				: NULL;
+			if (setup) {
+				/* Setup still in progress */
+				vlan->clean |= setup->clean;
+				dl_list_del(&setup->list);
+				os_free(setup);
 			}
 
-			if ((vlan->clean & DVLAN_CLEAN_BR) &&
-			    br_getnumports(br_name) == 0) {
-				ifconfig_down(br_name);
-				br_delbr(br_name);
-			}
+			vlan_clean_links(hapd, vlan->vlan_id, vlan->ifname,
+					 vlan->clean);
 
 			if (vlan == first) {
 				hapd->conf->vlan = vlan->next;
@@ -652,6 +867,9 @@ static void vlan_event_receive(int sock, void *eloop_ctx, void *sock_ctx)
 		}
 
 		switch (h->nlmsg_type) {
+		case NLMSG_ERROR:
+			vlan_nl_ack(hapd->full_dynamic_vlan, h, plen);
+			break;
 		case RTM_NEWLINK:
 			vlan_read_ifnames(h, plen, 0, hapd);
 			break;
@@ -678,11 +896,14 @@ full_dynamic_vlan_init(struct hostapd_data *hapd)
 	struct sockaddr_nl local;
 	struct full_dynamic_vlan *priv;
 
+	int *vlan_id;
+
 	priv = os_zalloc(sizeof(*priv));
 	if (priv == NULL)
 		return NULL;
-
-	vlan_set_name_type(VLAN_NAME_TYPE_PLUS_VID_NO_PAD);
+	priv->hapd = hapd;
+	dl_list_init(&priv->setups);
+	dl_list_init(&priv->pool);
 
 	priv->s = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
 	if (priv->s < 0) {
@@ -711,16 +932,40 @@ full_dynamic_vlan_init(struct hostapd_data *hapd)
 		return NULL;
 	}
 
+	for (vlan_id = hapd->conf->ssid.vlan_pool; vlan_id && *vlan_id;
+	     vlan_id++)
+		vlan_setup_add(priv, *vlan_id, NULL);
+
 	return priv;
 }
 
 
 static void full_dynamic_vlan_deinit(struct full_dynamic_vlan *priv)
 {
+	struct vlan_setup *setup, *tmp;
+
 	if (priv == NULL)
 		return;
+	eloop_cancel_timeout(vlan_nl_flush, priv, NULL);
+	eloop_cancel_timeout(vlan_nl_timeout, priv, NULL);
 	eloop_unregister_read_sock(priv->s);
 	close(priv->s);
+
+	dl_list_for_each_safe(setup, tmp, &priv->setups, struct vlan_setup,
+			      list) {
+		if (!setup->ifname[0])
+			vlan_clean_links(priv->hapd, setup->vlan_id, NULL,
+					 setup->clean);
+		dl_list_del(&setup->list);
+		os_free(setup);
+	}
+	dl_list_for_each_safe(setup, tmp, &priv->pool, struct vlan_setup,
+			      list) {
+		vlan_clean_links(priv->hapd, setup->vlan_id, NULL,
+				 setup->clean);
+		dl_list_del(&setup->list);
+		os_free(setup);
+	}
 	os_free(priv);
 }
 #endif /* CONFIG_FULL_DYNAMIC_VLAN */
@@ -859,6 +859,7 @@ int hostapd_init_wps(struct hostapd_data *hapd,
 		conf->skip_cred_build;
 	if (conf->ssid.security_policy == SECURITY_STATIC_WEP)
 		cfg.static_wep_only = 1;
+	cfg.dh_key_pool = conf->wps_dh_key_pool;
 	cfg.dualband = interface_count(hapd->iface) > 1;
 	if (cfg.dualband)
 		wpa_printf(MSG_DEBUG, "WPS: Dualband AP");
@@ -943,6 +944,7 @@ void hostapd_update_wps(struct hostapd_data *hapd)
 	hapd->wps->model_description = hapd->conf->model_description;
 	hapd->wps->model_url = hapd->conf->model_url;
 	hapd->wps->upc = hapd->conf->upc;
+	upnp_wps_device_update_desc(hapd->wps_upnp);
 #endif /* CONFIG_WPS_UPNP */
 
 	hostapd_wps_set_vendor_ext(hapd, hapd->wps);
@@ -1082,7 +1084,8 @@ static int hostapd_wps_probe_req_rx(void *ctx, const u8 *addr, const u8 *da,
 				    const u8 *ie, size_t ie_len)
 {
 	struct hostapd_data *hapd = ctx;
-	struct wpabuf *wps_ie;
+	struct wpabuf *wps_ie = NULL;
+	struct wps_probe_req_attr attr;
 	struct ieee802_11_elems elems;
 
 	if (hapd->wps == NULL)
@@ -1100,15 +1103,24 @@ static int hostapd_wps_probe_req_rx(void *ctx, const u8 *addr, const u8 *da,
 	     0))
 		return 0; /* Not for us */
 
-	wps_ie = ieee802_11_vendor_ie_concat(ie, ie_len, WPS_DEV_OUI_WFA);
-	if (wps_ie == NULL)
+	/*
+	 * Parse only the attributes needed here directly from the IEs to
+	 * avoid allocating and parsing a concatenated copy of the WPS IEs for
+	 * every Probe Request. The copy is needed only for strict validation
+	 * and UPnP events.
+	 */
+	if (wps_parse_probe_req_ies(ie, ie_len, &attr) < 0)
 		return 0;
-	if (wps_validate_probe_req(wps_ie, addr) < 0) {
+
+#ifdef CONFIG_WPS_STRICT
+	wps_ie = ieee802_11_vendor_ie_concat(ie, ie_len, WPS_DEV_OUI_WFA);
+	if (wps_ie == NULL || wps_validate_probe_req(wps_ie, addr) < 0) {
 		wpabuf_free(wps_ie);
 		return 0;
 	}
+#endif /* CONFIG_WPS_STRICT */
 
-	if (wpabuf_len(wps_ie) > 0) {
+	if (attr.len > 0) {
 		int p2p_wildcard = 0;
 #ifdef CONFIG_P2P
 		if (elems.ssid && elems.ssid_len == P2P_WILDCARD_SSID_LEN &&
@@ -1116,15 +1128,21 @@ static int hostapd_wps_probe_req_rx(void *ctx, const u8 *addr, const u8 *da,
 			      P2P_WILDCARD_SSID_LEN) == 0)
 			p2p_wildcard = 1;
 #endif /* CONFIG_P2P */
-		wps_registrar_probe_req_rx(hapd->wps->registrar, addr, wps_ie,
+		wps_registrar_probe_req_rx(hapd->wps->registrar, addr, &attr,
 					   p2p_wildcard);
 #ifdef CONFIG_WPS_UPNP
 		/* FIX: what exactly should be included in the WLANEvent?
 		 * WPS attributes? Full ProbeReq frame? */
-		if (!p2p_wildcard)
-			upnp_wps_device_send_wlan_event(
-				hapd->wps_upnp, addr,
-				UPNP_WPS_WLANEVENT_TYPE_PROBE, wps_ie);
+		if (!p2p_wildcard && hapd->wps_upnp &&
+		    upnp_wps_subscribers(hapd->wps_upnp)) {
+			if (wps_ie == NULL)
+				wps_ie = ieee802_11_vendor_ie_concat(
+					ie, ie_len, WPS_DEV_OUI_WFA);
+			if (wps_ie)
+				upnp_wps_device_send_wlan_event(
+					hapd->wps_upnp, addr,
+					UPNP_WPS_WLANEVENT_TYPE_PROBE, wps_ie);
+		}
 #endif /* CONFIG_WPS_UPNP */
 	}
 
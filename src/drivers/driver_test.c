@@ -2518,6 +2518,8 @@ static int wpa_driver_test_get_capa(void *priv, struct wpa_driver_capa *capa)
 	if (drv->p2p)
 		capa->flags |= WPA_DRIVER_FLAGS_P2P_MGMT;
 	capa->flags |= WPA_DRIVER_FLAGS_AP;
+	if (drv->ap)
+		capa->flags |= WPA_DRIVER_FLAGS_OFFCHANNEL_TX;
 	capa->flags |= WPA_DRIVER_FLAGS_P2P_CONCURRENT;
 	capa->flags |= WPA_DRIVER_FLAGS_P2P_DEDICATED_INTERFACE;
 	capa->flags |= WPA_DRIVER_FLAGS_P2P_CAPABLE;
@@ -2813,6 +2815,11 @@ static void test_remain_on_channel_timeout(void *eloop_ctx, void *timeout_ctx)
 	drv->remain_on_channel_freq = 0;
 
 	wpa_supplicant_event(drv->ctx, EVENT_CANCEL_REMAIN_ON_CHANNEL, &data);
+
+#ifdef CONFIG_P2P
+	if (drv->p2p)
+		p2p_listen_end(drv->p2p, data.remain_on_channel.freq);
+#endif /* CONFIG_P2P */
 }
 
 
@@ -2872,6 +2879,50 @@ static int wpa_driver_test_cancel_remain_on_channel(void *priv)
 }
 
 
+/*
+ * Synthetic survey data over the last 100 ms: the busy time (10..22%) depends
+ * only on the frequency, so that all hostapd instances see the same channel as
+ * the best one.
+ */
+static int wpa_driver_test_get_survey(void *priv, unsigned int freq)
+{
+	struct test_driver_bss *dbss = priv;
+	struct wpa_driver_test_data *drv = dbss->drv;
+	union wpa_event_data data;
+	struct freq_survey *survey, *tmp;
+
+	wpa_printf(MSG_DEBUG, "%s(freq=%u)", __func__, freq);
+	if (freq == 0)
+		return -1;
+
+	survey = os_zalloc(sizeof(*survey));
+	if (survey == NULL)
+		return -1;
+	survey->freq = freq;
+	survey->nf = -95;
+	survey->channel_time = 100;
+	survey->channel_time_busy =
+		survey->channel_time * (10 + (freq / 5) % 13) / 100;
+	survey->channel_time_rx = survey->channel_time_busy / 2;
+
+	os_memset(&data, 0, sizeof(data));
+	data.survey_results.freq_filter = freq;
+	dl_list_init(&data.survey_results.survey_list);
+	dl_list_add_tail(&data.survey_results.survey_list,
+			 &survey->list_member);
+	wpa_supplicant_event(drv->ctx, EVENT_SURVEY, &data);
+
+	/* Entries that were not taken by the event handler */
+	dl_list_for_each_safe(survey, tmp, &data.survey_results.survey_list,
+			      struct freq_survey, list_member) {
+		dl_list_del(&survey->list_member);
+		os_free(survey);
+	}
+
+	return 0;
+}
+
+
 static int wpa_driver_test_probe_req_report(void *priv, int report)
 {
 	struct test_driver_bss *dbss = priv;
@@ -2886,7 +2937,8 @@ static int wpa_driver_test_probe_req_report(void *priv, int report)
 
 static int wpa_driver_test_p2p_find(void *priv, unsigned int timeout, int type)
 {
-	struct wpa_driver_test_data *drv = priv;
+	struct test_driver_bss *dbss = priv;
+	struct wpa_driver_test_data *drv = dbss->drv;
 	wpa_printf(MSG_DEBUG, "%s(timeout=%u)", __func__, timeout);
 	if (!drv->p2p)
 		return -1;
@@ -2896,7 +2948,8 @@ static int wpa_driver_test_p2p_find(void *priv, unsigned int timeout, int type)
 
 static int wpa_driver_test_p2p_stop_find(void *priv)
 {
-	struct wpa_driver_test_data *drv = priv;
+	struct test_driver_bss *dbss = priv;
+	struct wpa_driver_test_data *drv = dbss->drv;
 	wpa_printf(MSG_DEBUG, "%s", __func__);
 	if (!drv->p2p)
 		return -1;
@@ -2907,7 +2960,8 @@ static int wpa_driver_test_p2p_stop_find(void *priv)
 
 static int wpa_driver_test_p2p_listen(void *priv, unsigned int timeout)
 {
-	struct wpa_driver_test_data *drv = priv;
+	struct test_driver_bss *dbss = priv;
+	struct wpa_driver_test_data *drv = dbss->drv;
 	wpa_printf(MSG_DEBUG, "%s(timeout=%u)", __func__, timeout);
 	if (!drv->p2p)
 		return -1;
@@ -2921,7 +2975,8 @@ static int wpa_driver_test_p2p_connect(void *priv, const u8 *peer_addr,
 				       unsigned int force_freq,
 				       int persistent_group)
 {
-	struct wpa_driver_test_data *drv = priv;
+	struct test_driver_bss *dbss = priv;
+	struct wpa_driver_test_data *drv = dbss->drv;
 	wpa_printf(MSG_DEBUG, "%s(peer_addr=" MACSTR " wps_method=%d "
 		   "go_intent=%d "
 		   "own_interface_addr=" MACSTR " force_freq=%u "
@@ -2937,7 +2992,8 @@ static int wpa_driver_test_p2p_connect(void *priv, const u8 *peer_addr,
 
 static int wpa_driver_test_wps_success_cb(void *priv, const u8 *peer_addr)
 {
-	struct wpa_driver_test_data *drv = priv;
+	struct test_driver_bss *dbss = priv;
+	struct wpa_driver_test_data *drv = dbss->drv;
 	wpa_printf(MSG_DEBUG, "%s(peer_addr=" MACSTR ")",
 		   __func__, MAC2STR(peer_addr));
 	if (!drv->p2p)
@@ -2949,7 +3005,8 @@ static int wpa_driver_test_wps_success_cb(void *priv, const u8 *peer_addr)
 
 static int wpa_driver_test_p2p_group_formation_failed(void *priv)
 {
-	struct wpa_driver_test_data *drv = priv;
+	struct test_driver_bss *dbss = priv;
+	struct wpa_driver_test_data *drv = dbss->drv;
 	wpa_printf(MSG_DEBUG, "%s", __func__);
 	if (!drv->p2p)
 		return -1;
@@ -2961,7 +3018,8 @@ static int wpa_driver_test_p2p_group_formation_failed(void *priv)
 static int wpa_driver_test_p2p_set_params(void *priv,
 					  const struct p2p_params *params)
 {
-	struct wpa_driver_test_data *drv = priv;
+	struct test_driver_bss *dbss = priv;
+	struct wpa_driver_test_data *drv = dbss->drv;
 	wpa_printf(MSG_DEBUG, "%s", __func__);
 	if (!drv->p2p)
 		return -1;
@@ -2979,6 +3037,7 @@ static int test_p2p_scan(void *ctx, enum p2p_scan_type type, int freq,
 			 const u8 *req_dev_types)
 {
 	struct wpa_driver_test_data *drv = ctx;
+	struct test_driver_bss *dbss;
 	struct wpa_driver_scan_params params;
 	int ret;
 	struct wpabuf *wps_ie, *ies;
@@ -3035,7 +3094,8 @@ static int test_p2p_scan(void *ctx, enum p2p_scan_type type, int freq,
 	}
 
 	drv->pending_p2p_scan = 1;
-	ret = wpa_driver_test_scan(drv, &params);
+	dbss = dl_list_first(&drv->bss, struct test_driver_bss, list);
+	ret = wpa_driver_test_scan(dbss, &params);
 
 	wpabuf_free(ies);
 
@@ -3048,6 +3108,7 @@ static int test_send_action(void *ctx, unsigned int freq, const u8 *dst,
 			    size_t len, unsigned int wait_time)
 {
 	struct wpa_driver_test_data *drv = ctx;
+	struct test_driver_bss *dbss;
 
 	wpa_printf(MSG_DEBUG, "%s(freq=%u dst=" MACSTR " src=" MACSTR
 		   " bssid=" MACSTR " len=%d",
@@ -3084,7 +3145,8 @@ static int test_send_action(void *ctx, unsigned int freq, const u8 *dst,
 
 	wpa_printf(MSG_DEBUG, "P2P: Schedule Action frame to be transmitted "
 		   "once the driver gets to the requested channel");
-	if (wpa_driver_test_remain_on_channel(drv, freq, wait_time) < 0) {
+	dbss = dl_list_first(&drv->bss, struct test_driver_bss, list);
+	if (wpa_driver_test_remain_on_channel(dbss, freq, wait_time) < 0) {
 		wpa_printf(MSG_DEBUG, "P2P: Failed to request driver "
 			   "to remain on channel (%u MHz) for Action "
 			   "Frame TX", freq);
@@ -3157,17 +3219,19 @@ static int test_start_listen(void *ctx, unsigned int freq,
 			     const struct wpabuf *probe_resp_ie)
 {
 	struct wpa_driver_test_data *drv = ctx;
+	struct test_driver_bss *dbss;
 
 	wpa_printf(MSG_DEBUG, "%s(freq=%u duration=%u)",
 		   __func__, freq, duration);
 
-	if (wpa_driver_test_probe_req_report(drv, 1) < 0)
+	dbss = dl_list_first(&drv->bss, struct test_driver_bss, list);
+	if (wpa_driver_test_probe_req_report(dbss, 1) < 0)
 		return -1;
 
 	drv->pending_listen_freq = freq;
 	drv->pending_listen_duration = duration;
 
-	if (wpa_driver_test_remain_on_channel(drv, freq, duration) < 0) {
+	if (wpa_driver_test_remain_on_channel(dbss, freq, duration) < 0) {
 		drv->pending_listen_freq = 0;
 		return -1;
 	}
@@ -3381,6 +3445,7 @@ const struct wpa_driver_ops wpa_driver_test_ops = {
 	.remain_on_channel = wpa_driver_test_remain_on_channel,
 	.cancel_remain_on_channel = wpa_driver_test_cancel_remain_on_channel,
 	.probe_req_report = wpa_driver_test_probe_req_report,
+	.get_survey = wpa_driver_test_get_survey,
 #ifdef CONFIG_P2P
 	.p2p_find = wpa_driver_test_p2p_find,
 	.p2p_stop_find = wpa_driver_test_p2p_stop_find,
@@ -30,6 +30,12 @@
 #ifndef IFLA_IFNAME
 #define IFLA_IFNAME 3
 #endif
+#ifndef IFLA_LINK
+#define IFLA_LINK 5
+#endif
+#ifndef IFLA_MASTER
+#define IFLA_MASTER 10
+#endif
 #ifndef IFLA_WIRELESS
 #define IFLA_WIRELESS 11
 #endif
@@ -41,8 +47,24 @@
 #define IF_OPER_DORMANT 5
 #define IF_OPER_UP 6
 #endif
+#ifndef IFLA_LINKINFO
+#define IFLA_LINKINFO 18
+#define IFLA_INFO_KIND 1
+#define IFLA_INFO_DATA 2
+#endif
+#ifndef IFLA_VLAN_ID
+#define IFLA_VLAN_ID 1
+#endif
+#ifndef IFLA_BR_FORWARD_DELAY
+#define IFLA_BR_FORWARD_DELAY 1
+#endif
 
 #define NLM_F_REQUEST 1
+#define NLM_F_ACK 4
+#define NLM_F_EXCL 0x200
+#define NLM_F_CREATE 0x400
+
+#define NLMSG_ERROR 2
 
 #define NETLINK_ROUTE 0
 #define RTMGRP_LINK 1
@@ -94,6 +116,12 @@ struct nlmsghdr
 	u32 nlmsg_pid;
 };
 
+struct nlmsgerr
+{
+	int error;
+	struct nlmsghdr msg;
+};
+
 struct ifinfomsg
 {
 	unsigned char ifi_family;
@@ -51,6 +51,12 @@ static void p2p_scan_timeout(void *eloop_ctx, void *timeout_ctx);
 
 #define P2P_PEER_EXPIRATION_INTERVAL (P2P_PEER_EXPIRATION_AGE / 2)
 
+/*
+ * Number of consecutive search rounds without new peers after which the
+ * environment is considered quiet and longer Listen states are preferred
+ */
+#define P2P_QUIET_SEARCH_ROUNDS 3
+
 static void p2p_expire_peers(struct p2p_data *p2p)
 {
 	struct p2p_device *dev, *n;
@@ -162,6 +168,7 @@ static void p2p_listen_in_find(struct p2p_data *p2p)
 {
 	unsigned int r, tu;
 	int freq;
+	int min_disc_int, max_disc_int;
 	struct wpabuf *ies;
 
 	wpa_msg(p2p->cfg->msg_ctx, MSG_DEBUG,
@@ -176,9 +183,23 @@ static void p2p_listen_in_find(struct p2p_data *p2p)
 		return;
 	}
 
+	/*
+	 * Keep the random Listen duration, but bias it based on recent
+	 * discovery yield: search more often while new peers keep showing up
+	 * and stay discoverable longer when nothing new has been found for a
+	 * while.
+	 */
+	min_disc_int = p2p->min_disc_int;
+	max_disc_int = p2p->max_disc_int;
+	if (max_disc_int > min_disc_int) {
+		if (p2p->quiet_search_rounds >= P2P_QUIET_SEARCH_ROUNDS)
+			min_disc_int = (min_disc_int + max_disc_int + 1) / 2;
+		else if (p2p->quiet_search_rounds == 0)
+			max_disc_int = (min_disc_int + max_disc_int) / 2;
+	}
+
 	os_get_random((u8 *) &r, sizeof(r));
-	tu = (r % ((p2p->max_disc_int - p2p->min_disc_int) + 1) +
-	      p2p->min_disc_int) * 100;
+	tu = (r % ((max_disc_int - min_disc_int) + 1) + min_disc_int) * 100;
 
 	p2p->pending_listen_freq = freq;
 	p2p->pending_listen_sec = 0;
@@ -480,6 +501,74 @@ static void p2p_copy_wps_info(struct p2p_device *dev, int probe_req,
 }
 
 
+static void p2p_disc_yield_add(struct p2p_data *p2p, int freq)
+{
+	struct p2p_disc_yield *y, *lowest = NULL;
+	int i;
+
+	for (i = 0; i < P2P_MAX_DISC_YIELD; i++) {
+		y = &p2p->disc_yield[i];
+		if (y->freq == freq)
+			break;
+		if (lowest == NULL || y->score < lowest->score)
+			lowest = y;
+	}
+	if (i == P2P_MAX_DISC_YIELD) {
+		y = lowest;
+		y->freq = freq;
+		y->score = 0;
+	}
+	y->score += P2P_DISC_YIELD_SCALE;
+}
+
+
+static unsigned int p2p_disc_yield_get(struct p2p_data *p2p, int freq)
+{
+	int i;
+
+	for (i = 0; i < P2P_MAX_DISC_YIELD; i++) {
+		if (p2p->disc_yield[i].freq == freq)
+			return p2p->disc_yield[i].score;
+	}
+	return 0;
+}
+
+
+static void p2p_search_round_done(struct p2p_data *p2p)
+{
+	int i;
+
+	for (i = 0; i < P2P_MAX_DISC_YIELD; i++)
+		p2p->disc_yield[i].score -= p2p->disc_yield[i].score / 8;
+
+	if (p2p->search_new_peers)
+		p2p->quiet_search_rounds = 0;
+	else if (p2p->quiet_search_rounds < P2P_QUIET_SEARCH_ROUNDS)
+		p2p->quiet_search_rounds++;
+	p2p->search_new_peers = 0;
+}
+
+
+static void p2p_peer_discovered(struct p2p_data *p2p, struct p2p_device *dev,
+				int freq)
+{
+	struct os_time now;
+
+	if (p2p->find_start.sec == 0 && p2p->find_start.usec == 0)
+		return; /* not in find */
+
+	p2p->search_new_peers++;
+	p2p_disc_yield_add(p2p, freq);
+
+	os_get_time(&now);
+	wpa_msg(p2p->cfg->msg_ctx, MSG_DEBUG, "P2P: Discovered peer " MACSTR
+		" on %d MHz %ld ms after start of find",
+		MAC2STR(dev->info.p2p_device_addr), freq,
+		(now.sec - p2p->find_start.sec) * 1000 +
+		(now.usec - p2p->find_start.usec) / 1000);
+}
+
+
 /**
  * p2p_add_device - Add peer entries based on scan results
  * @p2p: P2P module context from p2p_init()
@@ -612,6 +701,7 @@ int p2p_add_device(struct p2p_data *p2p, const u8 *addr, int freq, int level,
 			"P2P: Do not report rejected device");
 		return 0;
 	}
+	p2p_peer_discovered(p2p, dev, freq);
 
 	p2p->cfg->dev_found(p2p->cfg->cb_ctx, addr, &dev->info,
 			    !(dev->flags & P2P_DEV_REPORTED_ONCE));
@@ -648,6 +738,32 @@ static void p2p_device_free(struct p2p_data *p2p, struct p2p_device *dev)
 }
 
 
+static int p2p_get_best_prog_freq(struct p2p_data *p2p)
+{
+	struct p2p_disc_yield *y, *best = NULL;
+	u8 reg_class, channel;
+	int i;
+
+	for (i = 0; i < P2P_MAX_DISC_YIELD; i++) {
+		y = &p2p->disc_yield[i];
+		if (y->freq == 2412 || y->freq == 2437 || y->freq == 2462)
+			continue; /* social channels are always scanned */
+		if (y->score < P2P_DISC_YIELD_SCALE / 2)
+			continue;
+		if (best && y->score <= best->score)
+			continue;
+		if (p2p_freq_to_channel(p2p->cfg->country, y->freq,
+					&reg_class, &channel) < 0 ||
+		    !p2p_channels_includes(&p2p->cfg->channels, reg_class,
+					   channel))
+			continue;
+		best = y;
+	}
+
+	return best ? best->freq : 0;
+}
+
+
 static int p2p_get_next_prog_freq(struct p2p_data *p2p)
 {
 	struct p2p_channels *c;
@@ -658,6 +774,22 @@ static int p2p_get_next_prog_freq(struct p2p_data *p2p)
 	u8 channel;
 	int freq;
 
+	/*
+	 * Every other progressive search round revisits the non-social
+	 * channel with the best recent discovery yield (e.g., operating
+	 * channel of groups) instead of moving to the next channel.
+	 */
+	if (p2p->prog_scan_rounds++ & 1) {
+		freq = p2p_get_best_prog_freq(p2p);
+		if (freq > 0) {
+			wpa_msg(p2p->cfg->msg_ctx, MSG_DEBUG, "P2P: Revisit "
+				"productive progressive search channel %d MHz "
+				"(yield %u)",
+				freq, p2p_disc_yield_get(p2p, freq));
+			return freq;
+		}
+	}
+
 	c = &p2p->cfg->channels;
 	for (cl = 0; cl < c->reg_classes; cl++) {
 		cla = &c->reg_class[cl];
@@ -876,6 +1008,9 @@ int p2p_find(struct p2p_data *p2p, unsigned int timeout,
 	p2p_clear_timeout(p2p);
 	p2p->cfg->stop_listen(p2p->cfg->cb_ctx);
 	p2p->find_type = type;
+	p2p->prog_scan_rounds = 0;
+	p2p->search_new_peers = 0;
+	os_get_time(&p2p->find_start);
 	p2p_device_clear_reported(p2p);
 	p2p_set_state(p2p, P2P_SEARCH);
 	eloop_cancel_timeout(p2p_find_timeout, p2p, NULL);
@@ -920,6 +1055,7 @@ void p2p_stop_find_for_freq(struct p2p_data *p2p, int freq)
 	p2p_clear_timeout(p2p);
 	p2p_set_state(p2p, P2P_IDLE);
 	p2p_free_req_dev_types(p2p);
+	os_memset(&p2p->find_start, 0, sizeof(p2p->find_start));
 	p2p->start_after_scan = P2P_AFTER_SCAN_NOTHING;
 	p2p->go_neg_peer = NULL;
 	p2p->sd_peer = NULL;
@@ -1584,6 +1720,25 @@ int dev_type_list_match(const u8 *dev_type, const u8 *req_dev_type[],
 }
 
 
+int p2p_match_dev_type_list(struct p2p_data *p2p, const u8 *req_dev_type[],
+			    size_t num_req_dev_type)
+{
+	size_t i;
+
+	if (dev_type_list_match(p2p->cfg->pri_dev_type, req_dev_type,
+				num_req_dev_type))
+		return 1; /* Own Primary Device Type matches */
+
+	for (i = 0; i < p2p->cfg->num_sec_dev_types; i++)
+		if (dev_type_list_match(p2p->cfg->sec_dev_type[i],
+					req_dev_type, num_req_dev_type))
+			return 1; /* Own Secondary Device Type matches */
+
+	/* No matching device type found */
+	return 0;
+}
+
+
 /**
  * p2p_match_dev_type - Match local device type with requested type
  * @p2p: P2P module context from p2p_init()
@@ -1597,7 +1752,6 @@ int dev_type_list_match(const u8 *dev_type, const u8 *req_dev_type[],
 int p2p_match_dev_type(struct p2p_data *p2p, struct wpabuf *wps)
 {
 	struct wps_parse_attr attr;
-	size_t i;
 
 	if (wps_parse_msg(wps, &attr))
 		return 1; /* assume no Requested Device Type attributes */
@@ -1605,18 +1759,8 @@ int p2p_match_dev_type(struct p2p_data *p2p, struct wpabuf *wps)
 	if (attr.num_req_dev_type == 0)
 		return 1; /* no Requested Device Type attributes -> match */
 
-	if (dev_type_list_match(p2p->cfg->pri_dev_type, attr.req_dev_type,
-				attr.num_req_dev_type))
-		return 1; /* Own Primary Device Type matches */
-
-	for (i = 0; i < p2p->cfg->num_sec_dev_types; i++)
-		if (dev_type_list_match(p2p->cfg->sec_dev_type[i],
-					attr.req_dev_type,
-					attr.num_req_dev_type))
-		return 1; /* Own Secondary Device Type matches */
-
-	/* No matching device type found */
-	return 0;
+	return p2p_match_dev_type_list(p2p, attr.req_dev_type,
+				       attr.num_req_dev_type);
 }
 
 
@@ -2060,7 +2204,8 @@ void p2p_deinit(struct p2p_data *p2p)
 	os_free(p2p->cfg->model_number);
 	os_free(p2p->cfg->serial_number);
 	os_free(p2p->groups);
-	wpabuf_free(p2p->sd_resp);
+	p2p_sd_resp_unref(p2p->sd_resp);
+	p2p_sd_resp_cache_flush(p2p);
 	os_free(p2p->after_scan_tx);
 	p2p_remove_wps_vendor_extensions(p2p);
 	os_free(p2p);
@@ -2419,6 +2564,9 @@ void p2p_scan_res_handled(struct p2p_data *p2p)
 	p2p->p2p_scan_running = 0;
 	eloop_cancel_timeout(p2p_scan_timeout, p2p, NULL);
 
+	if (p2p->state == P2P_SEARCH)
+		p2p_search_round_done(p2p);
+
 	if (p2p_run_after_scan(p2p))
 		return;
 	if (p2p->state == P2P_SEARCH)
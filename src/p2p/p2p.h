@@ -935,13 +935,52 @@ int p2p_sd_cancel_request(struct p2p_data *p2p, void *req);
 void p2p_sd_response(struct p2p_data *p2p, int freq, const u8 *dst,
 		     u8 dialog_token, const struct wpabuf *resp_tlvs);
 
+/**
+ * p2p_sd_response_cached - Send a cached response to a service discovery query
+ * @p2p: P2P module context from p2p_init()
+ * @freq: Frequency from p2p_config::sd_request() callback
+ * @dst: Destination address from p2p_config::sd_request() callback
+ * @dialog_token: Dialog token from p2p_config::sd_request() callback
+ * @query: Service Query TLV(s) from p2p_config::sd_request() callback
+ * @query_len: Length of query in octets
+ * Returns: 0 if a cached response was sent, -1 if no cached response for the
+ * query was available
+ *
+ * The cached response is the one stored with p2p_sd_response_cache() for an
+ * identical query (Service Transaction IDs are allowed to differ and are
+ * updated to match the new query). Cached responses are dropped when
+ * p2p_sd_service_update() is called.
+ */
+int p2p_sd_response_cached(struct p2p_data *p2p, int freq, const u8 *dst,
+			   u8 dialog_token, const u8 *query, size_t query_len);
+
+/**
+ * p2p_sd_response_cache - Send and cache response to a service discovery query
+ * @p2p: P2P module context from p2p_init()
+ * @freq: Frequency from p2p_config::sd_request() callback
+ * @dst: Destination address from p2p_config::sd_request() callback
+ * @dialog_token: Dialog token from p2p_config::sd_request() callback
+ * @query: Service Query TLV(s) from p2p_config::sd_request() callback
+ * @query_len: Length of query in octets
+ * @resp_tlvs: P2P Service Response TLV(s)
+ *
+ * This function can be used instead of p2p_sd_response() when the response
+ * depends only on the query and the local services, i.e., not on the peer
+ * that sent the query. The response is stored so that later identical
+ * queries can be answered with p2p_sd_response_cached().
+ */
+void p2p_sd_response_cache(struct p2p_data *p2p, int freq, const u8 *dst,
+			   u8 dialog_token, const u8 *query, size_t query_len,
+			   const struct wpabuf *resp_tlvs);
+
 /**
  * p2p_sd_service_update - Indicate a change in local services
  * @p2p: P2P module context from p2p_init()
  *
  * This function needs to be called whenever there is a change in availability
  * of the local services. This will increment the Service Update Indicator
- * value which will be used in SD Request and Response frames.
+ * value which will be used in SD Request and Response frames and drop all
+ * cached service discovery responses.
  */
 void p2p_sd_service_update(struct p2p_data *p2p);
 
@@ -1277,15 +1316,18 @@ int p2p_group_notif_noa(struct p2p_group *group, const u8 *noa,
 /**
  * p2p_group_match_dev_type - Match device types in group with requested type
  * @group: P2P group context from p2p_group_init()
- * @wps: WPS TLVs from Probe Request frame (concatenated WPS IEs)
+ * @req_dev_type: Requested Device Type attributes from Probe Request frame
+ * @num_req_dev_type: Number of entries in req_dev_type
  * Returns: 1 on match, 0 on mismatch
  *
  * This function can be used to match the Requested Device Type attribute in
  * WPS IE with the device types of a group member for deciding whether a GO
  * should reply to a Probe Request frame. Match will be reported if the WPS IE
- * is not requested any specific device type.
+ * is not requested any specific device type. The Requested Device Type
+ * attributes can be fetched with wps_parse_probe_req_ies().
  */
-int p2p_group_match_dev_type(struct p2p_group *group, struct wpabuf *wps);
+int p2p_group_match_dev_type(struct p2p_group *group,
+			     const u8 *req_dev_type[], size_t num_req_dev_type);
 
 /**
  * p2p_group_go_discover - Send GO Discoverability Request to a group client
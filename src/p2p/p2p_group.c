@@ -408,7 +408,8 @@ void p2p_group_notif_disassoc(struct p2p_group *group, const u8 *addr)
 /**
  * p2p_match_dev_type_member - Match client device type with requested type
  * @m: Group member
- * @wps: WPS TLVs from Probe Request frame (concatenated WPS IEs)
+ * @req_dev_type: Requested Device Type attributes from Probe Request frame
+ * @num_req_dev_type: Number of entries in req_dev_type
  * Returns: 1 on match, 0 on mismatch
  *
  * This function can be used to match the Requested Device Type attribute in
@@ -416,13 +417,13 @@ void p2p_group_notif_disassoc(struct p2p_group *group, const u8 *addr)
  * should reply to a Probe Request frame.
  */
 static int p2p_match_dev_type_member(struct p2p_group_member *m,
-				     struct wpabuf *wps)
+				     const u8 *req_dev_type[],
+				     size_t num_req_dev_type)
 {
 	const u8 *pos, *end;
-	struct wps_parse_attr attr;
 	u8 num_sec;
 
-	if (m->client_info == NULL || wps == NULL)
+	if (m->client_info == NULL)
 		return 0;
 
 	pos = wpabuf_head(m->client_info);
@@ -432,13 +433,7 @@ static int p2p_match_dev_type_member(struct p2p_group_member *m,
 	if (end - pos < WPS_DEV_TYPE_LEN + 1)
 		return 0;
 
-	if (wps_parse_msg(wps, &attr))
-		return 1; /* assume no Requested Device Type attributes */
-
-	if (attr.num_req_dev_type == 0)
-		return 1; /* no Requested Device Type attributes -> match */
-
-	if (dev_type_list_match(pos, attr.req_dev_type, attr.num_req_dev_type))
+	if (dev_type_list_match(pos, req_dev_type, num_req_dev_type))
 		return 1; /* Match with client Primary Device Type */
 
 	pos += WPS_DEV_TYPE_LEN;
@@ -447,8 +442,7 @@ static int p2p_match_dev_type_member(struct p2p_group_member *m,
 		return 0;
 	while (num_sec > 0) {
 		num_sec--;
-		if (dev_type_list_match(pos, attr.req_dev_type,
-					attr.num_req_dev_type))
+		if (dev_type_list_match(pos, req_dev_type, num_req_dev_type))
 			return 1; /* Match with client Secondary Device Type */
 		pos += WPS_DEV_TYPE_LEN;
 	}
@@ -458,15 +452,21 @@ static int p2p_match_dev_type_member(struct p2p_group_member *m,
 }
 
 
-int p2p_group_match_dev_type(struct p2p_group *group, struct wpabuf *wps)
+int p2p_group_match_dev_type(struct p2p_group *group,
+			     const u8 *req_dev_type[], size_t num_req_dev_type)
 {
 	struct p2p_group_member *m;
 
-	if (p2p_match_dev_type(group->p2p, wps))
+	if (num_req_dev_type == 0)
+		return 1; /* no Requested Device Type attributes -> match */
+
+	if (p2p_match_dev_type_list(group->p2p, req_dev_type,
+				    num_req_dev_type))
 		return 1; /* Match with own device type */
 
 	for (m = group->members; m; m = m->next) {
-		if (p2p_match_dev_type_member(m, wps))
+		if (p2p_match_dev_type_member(m, req_dev_type,
+					      num_req_dev_type))
 			return 1; /* Match with group client device type */
 	}
 
@@ -103,6 +103,20 @@ struct p2p_device {
 	u8 client_timeout;
 };
 
+/**
+ * struct p2p_disc_yield - Recent peer discovery yield on a channel
+ * @freq: Frequency in MHz (0 = unused entry)
+ * @score: Decaying count of peers discovered on the channel during find,
+ *	scaled by P2P_DISC_YIELD_SCALE
+ */
+struct p2p_disc_yield {
+	int freq;
+	unsigned int score;
+};
+
+#define P2P_MAX_DISC_YIELD 16
+#define P2P_DISC_YIELD_SCALE 16
+
 struct p2p_sd_query {
 	struct p2p_sd_query *next;
 	u8 peer[ETH_ALEN];
@@ -110,6 +124,30 @@ struct p2p_sd_query {
 	struct wpabuf *tlvs;
 };
 
+/**
+ * struct p2p_sd_resp - Service Discovery response data
+ *
+ * The response TLVs are shared between the response cache and a pending
+ * fragmented (GAS Comeback) response, so the buffer is reference counted.
+ * Comeback fragments are sent directly from this buffer.
+ */
+struct p2p_sd_resp {
+	unsigned int refcnt;
+	struct wpabuf *tlvs;
+
+	/*
+	 * Query TLVs that this response was generated for (only for cached
+	 * responses); the Service Transaction IDs in the query match the ones
+	 * currently used in tlvs.
+	 */
+	u8 *query;
+	size_t query_len;
+	u32 query_hash;
+	unsigned int last_used;
+};
+
+#define P2P_SD_RESP_CACHE_SIZE 8
+
 struct p2p_pending_action_tx {
 	unsigned int freq;
 	u8 dst[ETH_ALEN];
@@ -325,12 +363,21 @@ struct p2p_data {
 	 */
 	u16 srv_update_indic;
 
-	struct wpabuf *sd_resp; /* Fragmented SD response */
+	struct p2p_sd_resp *sd_resp; /* Fragmented SD response */
 	u8 sd_resp_addr[ETH_ALEN];
 	u8 sd_resp_dialog_token;
 	size_t sd_resp_pos; /* Offset in sd_resp */
 	u8 sd_frag_id;
 
+	/**
+	 * sd_resp_cache - Cached responses to local service queries
+	 *
+	 * The cache is flushed whenever local services change, i.e., when
+	 * p2p_sd_service_update() is called.
+	 */
+	struct p2p_sd_resp *sd_resp_cache[P2P_SD_RESP_CACHE_SIZE];
+	unsigned int sd_resp_cache_seq;
+
 	struct wpabuf *sd_rx_resp; /* Reassembled SD response */
 	u16 sd_rx_update_indic;
 
@@ -351,6 +398,31 @@ struct p2p_data {
 	enum p2p_discovery_type find_type;
 	u8 last_prog_scan_class;
 	u8 last_prog_scan_chan;
+	unsigned int prog_scan_rounds;
+
+	/**
+	 * find_start - Time when the ongoing find operation was started
+	 */
+	struct os_time find_start;
+
+	/**
+	 * disc_yield - Per-channel peer discovery yield from recent finds
+	 *
+	 * This is used to adapt the Listen state duration during find and to
+	 * bias progressive search toward channels where peers were found.
+	 */
+	struct p2p_disc_yield disc_yield[P2P_MAX_DISC_YIELD];
+
+	/**
+	 * search_new_peers - Number of new peers during the current search
+	 */
+	unsigned int search_new_peers;
+
+	/**
+	 * quiet_search_rounds - Consecutive search rounds without new peers
+	 */
+	unsigned int quiet_search_rounds;
+
 	int p2p_scan_running;
 	enum p2p_after_scan {
 		P2P_AFTER_SCAN_NOTHING,
@@ -573,6 +645,8 @@ void p2p_build_wps_ie(struct p2p_data *p2p, struct wpabuf *buf, u16 pw_id,
 struct p2p_sd_query * p2p_pending_sd_req(struct p2p_data *p2p,
 					 struct p2p_device *dev);
 void p2p_free_sd_queries(struct p2p_data *p2p);
+void p2p_sd_resp_unref(struct p2p_sd_resp *r);
+void p2p_sd_resp_cache_flush(struct p2p_data *p2p);
 void p2p_rx_gas_initial_req(struct p2p_data *p2p, const u8 *sa,
 			    const u8 *data, size_t len, int rx_freq);
 void p2p_rx_gas_initial_resp(struct p2p_data *p2p, const u8 *sa,
@@ -644,6 +718,8 @@ void p2p_go_neg_failed(struct p2p_data *p2p, struct p2p_device *peer,
 		       int status);
 void p2p_go_complete(struct p2p_data *p2p, struct p2p_device *peer);
 int p2p_match_dev_type(struct p2p_data *p2p, struct wpabuf *wps);
+int p2p_match_dev_type_list(struct p2p_data *p2p, const u8 *req_dev_type[],
+			    size_t num_req_dev_type);
 int dev_type_list_match(const u8 *dev_type, const u8 *req_dev_type[],
 			size_t num_req_dev_type);
 struct wpabuf * p2p_build_probe_resp_ies(struct p2p_data *p2p);
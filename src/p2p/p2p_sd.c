@@ -411,8 +411,135 @@ void p2p_rx_gas_initial_req(struct p2p_data *p2p, const u8 *sa,
 }
 
 
-void p2p_sd_response(struct p2p_data *p2p, int freq, const u8 *dst,
-		     u8 dialog_token, const struct wpabuf *resp_tlvs)
+void p2p_sd_resp_unref(struct p2p_sd_resp *r)
+{
+	if (r == NULL || --r->refcnt > 0)
+		return;
+	wpabuf_free(r->tlvs);
+	os_free(r->query);
+	os_free(r);
+}
+
+
+static struct p2p_sd_resp * p2p_sd_resp_alloc(const struct wpabuf *tlvs)
+{
+	struct p2p_sd_resp *r;
+
+	r = os_zalloc(sizeof(*r));
+	if (r == NULL)
+		return NULL;
+	r->refcnt = 1;
+	r->tlvs = wpabuf_dup(tlvs);
+	if (r->tlvs == NULL) {
+		os_free(r);
+		return NULL;
+	}
+	return r;
+}
+
+
+void p2p_sd_resp_cache_flush(struct p2p_data *p2p)
+{
+	int i;
+
+	for (i = 0; i < P2P_SD_RESP_CACHE_SIZE; i++) {
+		p2p_sd_resp_unref(p2p->sd_resp_cache[i]);
+		p2p->sd_resp_cache[i] = NULL;
+	}
+}
+
+
+/*
+ * Hash the Service Query TLVs without the Service Transaction IDs so that
+ * the same query from different peers maps to the same cache entry.
+ */
+static int p2p_sd_query_hash(const u8 *query, size_t query_len, u32 *hash)
+{
+	const u8 *pos = query;
+	const u8 *end = query + query_len;
+	const u8 *tlv, *tlv_end;
+	u16 slen;
+	u32 h = 2166136261U; /* FNV-1a */
+
+	while (pos < end) {
+		if (end - pos < 4)
+			return -1;
+		slen = WPA_GET_LE16(pos);
+		if (slen < 2 || slen > end - pos - 2)
+			return -1;
+		tlv = pos;
+		tlv_end = pos + 2 + slen;
+		for (; pos < tlv_end; pos++) {
+			if (pos - tlv == 3)
+				continue; /* Service Transaction ID */
+			h = (h ^ *pos) * 16777619U;
+		}
+	}
+
+	*hash = h;
+	return 0;
+}
+
+
+/*
+ * Compare a cached query with a new one and build a mapping from the cached
+ * Service Transaction IDs to the ones used in the new query. Both queries
+ * have been validated with p2p_sd_query_hash().
+ */
+static int p2p_sd_query_match(const u8 *cached, const u8 *query,
+			      size_t query_len, int *map, int *changed)
+{
+	const u8 *pos = query;
+	const u8 *end = query + query_len;
+	const u8 *cpos = cached;
+	u8 old_id, new_id;
+	u16 slen;
+
+	*changed = 0;
+	while (pos < end) {
+		slen = WPA_GET_LE16(pos);
+		if (os_memcmp(pos, cpos, 3) != 0 ||
+		    os_memcmp(pos + 4, cpos + 4, slen - 2) != 0)
+			return -1;
+		old_id = cpos[3];
+		new_id = pos[3];
+		if (map[old_id] >= 0 && map[old_id] != new_id)
+			return -1; /* ambiguous mapping */
+		map[old_id] = new_id;
+		if (old_id != new_id)
+			*changed = 1;
+		pos += 2 + slen;
+		cpos += 2 + slen;
+	}
+
+	return 0;
+}
+
+
+static void p2p_sd_resp_set_trans_ids(struct p2p_sd_resp *r, const int *map,
+				      const u8 *query)
+{
+	u8 *pos = wpabuf_mhead_u8(r->tlvs);
+	u8 *end = pos + wpabuf_len(r->tlvs);
+	u16 slen;
+
+	while (end - pos >= 5) {
+		slen = WPA_GET_LE16(pos);
+		if (slen < 3 || slen > end - pos - 2)
+			break;
+		if (map[pos[3]] >= 0)
+			pos[3] = map[pos[3]];
+		pos += 2 + slen;
+	}
+
+	os_memcpy(r->query, query, r->query_len);
+}
+
+
+static void p2p_sd_send_response(struct p2p_data *p2p, int freq,
+				 const u8 *dst, u8 dialog_token,
+				 const struct wpabuf *resp_tlvs,
+				 struct p2p_sd_resp *r)
 {
 	struct wpabuf *resp;
 
@@ -430,11 +557,18 @@ void p2p_sd_response(struct p2p_data *p2p, int freq, const u8 *dst,
 			 */
 			wpa_msg(p2p->cfg->msg_ctx, MSG_DEBUG, "P2P: Drop "
 				"previous SD response");
-			wpabuf_free(p2p->sd_resp);
+			p2p_sd_resp_unref(p2p->sd_resp);
+			p2p->sd_resp = NULL;
 		}
+		if (r)
+			r->refcnt++;
+		else
+			r = p2p_sd_resp_alloc(resp_tlvs);
+		if (r == NULL)
+			return;
 		os_memcpy(p2p->sd_resp_addr, dst, ETH_ALEN);
 		p2p->sd_resp_dialog_token = dialog_token;
-		p2p->sd_resp = wpabuf_dup(resp_tlvs);
+		p2p->sd_resp = r;
 		p2p->sd_resp_pos = 0;
 		p2p->sd_frag_id = 0;
 		resp = p2p_build_sd_response(dialog_token, WLAN_STATUS_SUCCESS,
@@ -460,6 +594,101 @@ void p2p_sd_response(struct p2p_data *p2p, int freq, const u8 *dst,
 }
 
 
+void p2p_sd_response(struct p2p_data *p2p, int freq, const u8 *dst,
+		     u8 dialog_token, const struct wpabuf *resp_tlvs)
+{
+	p2p_sd_send_response(p2p, freq, dst, dialog_token, resp_tlvs, NULL);
+}
+
+
+int p2p_sd_response_cached(struct p2p_data *p2p, int freq, const u8 *dst,
+			   u8 dialog_token, const u8 *query, size_t query_len)
+{
+	struct p2p_sd_resp *r;
+	u32 hash;
+	int i, changed;
+	int map[256];
+
+	if (p2p_sd_query_hash(query, query_len, &hash) < 0)
+		return -1;
+
+	for (i = 0; i < P2P_SD_RESP_CACHE_SIZE; i++) {
+		r = p2p->sd_resp_cache[i];
+		if (r == NULL || r->query_hash != hash ||
+		    r->query_len != query_len)
+			continue;
+		os_memset(map, -1, sizeof(map));
+		if (p2p_sd_query_match(r->query, query, query_len, map,
+				       &changed) < 0)
+			continue;
+
+		wpa_msg(p2p->cfg->msg_ctx, MSG_DEBUG, "P2P: Use cached SD "
+			"response (len=%u)",
+			(unsigned int) wpabuf_len(r->tlvs));
+		if (changed) {
+			if (p2p->sd_resp == r) {
+				/*
+				 * Will be replaced with the new response
+				 * below; do not change the Service
+				 * Transaction IDs under a pending transfer.
+				 */
+				p2p_sd_resp_unref(p2p->sd_resp);
+				p2p->sd_resp = NULL;
+			}
+			p2p_sd_resp_set_trans_ids(r, map, query);
+		}
+		r->last_used = ++p2p->sd_resp_cache_seq;
+		p2p_sd_send_response(p2p, freq, dst, dialog_token, r->tlvs, r);
+		return 0;
+	}
+
+	return -1;
+}
+
+
+void p2p_sd_response_cache(struct p2p_data *p2p, int freq, const u8 *dst,
+			   u8 dialog_token, const u8 *query, size_t query_len,
+			   const struct wpabuf *resp_tlvs)
+{
+	struct p2p_sd_resp *r;
+	u32 hash;
+	int i, slot = 0;
+
+	if (p2p_sd_query_hash(query, query_len, &hash) < 0) {
+		p2p_sd_response(p2p, freq, dst, dialog_token, resp_tlvs);
+		return;
+	}
+
+	r = p2p_sd_resp_alloc(resp_tlvs);
+	if (r)
+		r->query = os_malloc(query_len ? query_len : 1);
+	if (r == NULL || r->query == NULL) {
+		p2p_sd_resp_unref(r);
+		p2p_sd_response(p2p, freq, dst, dialog_token, resp_tlvs);
+		return;
+	}
+	os_memcpy(r->query, query, query_len);
+	r->query_len = query_len;
+	r->query_hash = hash;
+	r->last_used = ++p2p->sd_resp_cache_seq;
+
+	/* Replace an empty or the least recently used entry */
+	for (i = 0; i < P2P_SD_RESP_CACHE_SIZE; i++) {
+		if (p2p->sd_resp_cache[i] == NULL) {
+			slot = i;
+			break;
+		}
+		if (p2p->sd_resp_cache[i]->last_used <
+		    p2p->sd_resp_cache[slot]->last_used)
+			slot = i;
+	}
+	p2p_sd_resp_unref(p2p->sd_resp_cache[slot]);
+	p2p->sd_resp_cache[slot] = r;
+
+	p2p_sd_send_response(p2p, freq, dst, dialog_token, r->tlvs, r);
+}
+
+
 void p2p_rx_gas_initial_resp(struct p2p_data *p2p, const u8 *sa,
 			     const u8 *data, size_t len, int rx_freq)
 {
@@ -657,17 +886,17 @@ void p2p_rx_gas_comeback_req(struct p2p_data *p2p, const u8 *sa,
 		return;
 	}
 
-	frag_len = wpabuf_len(p2p->sd_resp) - p2p->sd_resp_pos;
+	frag_len = wpabuf_len(p2p->sd_resp->tlvs) - p2p->sd_resp_pos;
 	if (frag_len > 1400) {
 		frag_len = 1400;
 		more = 1;
 	}
 	resp = p2p_build_gas_comeback_resp(dialog_token, WLAN_STATUS_SUCCESS,
 					   p2p->srv_update_indic,
-					   wpabuf_head_u8(p2p->sd_resp) +
+					   wpabuf_head_u8(p2p->sd_resp->tlvs) +
 					   p2p->sd_resp_pos, frag_len,
 					   p2p->sd_frag_id, more,
-					   wpabuf_len(p2p->sd_resp));
+					   wpabuf_len(p2p->sd_resp->tlvs));
 	if (resp == NULL)
 		return;
 	wpa_msg(p2p->cfg->msg_ctx, MSG_DEBUG, "P2P: Send GAS Comeback "
@@ -679,11 +908,12 @@ void p2p_rx_gas_comeback_req(struct p2p_data *p2p, const u8 *sa,
 	if (more) {
 		wpa_msg(p2p->cfg->msg_ctx, MSG_DEBUG, "P2P: %d more bytes "
 			"remain to be sent",
-			(int) (wpabuf_len(p2p->sd_resp) - p2p->sd_resp_pos));
+			(int) (wpabuf_len(p2p->sd_resp->tlvs) -
+			       p2p->sd_resp_pos));
 	} else {
 		wpa_msg(p2p->cfg->msg_ctx, MSG_DEBUG, "P2P: All fragments of "
 			"SD response sent");
-		wpabuf_free(p2p->sd_resp);
+		p2p_sd_resp_unref(p2p->sd_resp);
 		p2p->sd_resp = NULL;
 	}
 
@@ -936,6 +1166,7 @@ void * p2p_sd_request(struct p2p_data *p2p, const u8 *dst,
 void p2p_sd_service_update(struct p2p_data *p2p)
 {
 	p2p->srv_update_indic++;
+	p2p_sd_resp_cache_flush(p2p);
 }
 
 
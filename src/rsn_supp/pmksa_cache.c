@@ -25,9 +25,23 @@
 
 static const int pmksa_cache_max_entries = 32;
 
+/*
+ * In addition to the list ordered by expiration time, the entries are indexed
+ * by AA, by PMKID, and by network context (for opportunistic PMKSA caching)
+ * so that the lookups done when (re)associating do not need to go through
+ * the whole cache.
+ */
+#define PMKSA_HASH_SIZE 64
+#define PMKSA_HASH_AA(aa) ((unsigned int) ((aa)[5] & 0x3f))
+#define PMKSA_HASH_PMKID(pmkid) ((unsigned int) ((pmkid)[0] & 0x3f))
+#define PMKSA_HASH_CTX(ctx) ((unsigned int) (((size_t) (ctx) >> 4) & 0x3f))
+
 struct rsn_pmksa_cache {
 	struct rsn_pmksa_cache_entry *pmksa; /* PMKSA cache */
 	int pmksa_count; /* number of entries in PMKSA cache */
+	struct rsn_pmksa_cache_entry *aa_hash[PMKSA_HASH_SIZE];
+	struct rsn_pmksa_cache_entry *pmkid_hash[PMKSA_HASH_SIZE];
+	struct rsn_pmksa_cache_entry *ctx_hash[PMKSA_HASH_SIZE];
 	struct wpa_sm *sm; /* TODO: get rid of this reference(?) */
 
 	void (*free_cb)(struct rsn_pmksa_cache_entry *entry, void *ctx,
@@ -45,11 +59,66 @@ static void _pmksa_cache_free_entry(struct rsn_pmksa_cache_entry *entry)
 }
 
 
+static void pmksa_cache_hash_add(struct rsn_pmksa_cache *pmksa,
+				 struct rsn_pmksa_cache_entry *entry)
+{
+	unsigned int h;
+
+	h = PMKSA_HASH_AA(entry->aa);
+	entry->hnext_aa = pmksa->aa_hash[h];
+	pmksa->aa_hash[h] = entry;
+
+	h = PMKSA_HASH_PMKID(entry->pmkid);
+	entry->hnext_pmkid = pmksa->pmkid_hash[h];
+	pmksa->pmkid_hash[h] = entry;
+
+	if (entry->network_ctx) {
+		h = PMKSA_HASH_CTX(entry->network_ctx);
+		entry->hnext_ctx = pmksa->ctx_hash[h];
+		pmksa->ctx_hash[h] = entry;
+	}
+}
+
+
+static void pmksa_cache_hash_del(struct rsn_pmksa_cache *pmksa,
+				 struct rsn_pmksa_cache_entry *entry)
+{
+	struct rsn_pmksa_cache_entry **pos;
+
+	for (pos = &pmksa->aa_hash[PMKSA_HASH_AA(entry->aa)]; *pos;
+	     pos = &(*pos)->hnext_aa) {
+		if (*pos == entry) {
+			*pos = entry->hnext_aa;
+			break;
+		}
+	}
+
+	for (pos = &pmksa->pmkid_hash[PMKSA_HASH_PMKID(entry->pmkid)]; *pos;
+	     pos = &(*pos)->hnext_pmkid) {
+		if (*pos == entry) {
+			*pos = entry->hnext_pmkid;
+			break;
+		}
+	}
+
+	if (entry->network_ctx == NULL)
+		return;
+	for (pos = &pmksa->ctx_hash[PMKSA_HASH_CTX(entry->network_ctx)]; *pos;
+	     pos = &(*pos)->hnext_ctx) {
+		if (*pos == entry) {
+			*pos = entry->hnext_ctx;
+			break;
+		}
+	}
+}
+
+
 static void pmksa_cache_free_entry(struct rsn_pmksa_cache *pmksa,
 				   struct rsn_pmksa_cache_entry *entry,
 				   int replace)
 {
 	pmksa->pmksa_count--;
+	pmksa_cache_hash_del(pmksa, entry);
 	pmksa->free_cb(entry, pmksa->ctx, replace);
 	_pmksa_cache_free_entry(entry);
 }
@@ -109,86 +178,51 @@ static void pmksa_cache_set_expiration(struct rsn_pmksa_cache *pmksa)
 }
 
 
-/**
- * pmksa_cache_add - Add a PMKSA cache entry
- * @pmksa: Pointer to PMKSA cache data from pmksa_cache_init()
- * @pmk: The new pairwise master key
- * @pmk_len: PMK length in bytes, usually PMK_LEN (32)
- * @aa: Authenticator address
- * @spa: Supplicant address
- * @network_ctx: Network configuration context for this PMK
- * @akmp: WPA_KEY_MGMT_* used in key derivation
- * Returns: Pointer to the added PMKSA cache entry or %NULL on error
- *
- * This function create a PMKSA entry for a new PMK and adds it to the PMKSA
- * cache. If an old entry is already in the cache for the same Authenticator,
- * this entry will be replaced with the new entry. PMKID will be calculated
- * based on the PMK and the driver interface is notified of the new PMKID.
+/*
+ * Insert a new entry into the cache, replacing an old entry for the same
+ * Authenticator and removing the oldest entry if the cache is full.
  */
-struct rsn_pmksa_cache_entry *
-pmksa_cache_add(struct rsn_pmksa_cache *pmksa, const u8 *pmk, size_t pmk_len,
-		const u8 *aa, const u8 *spa, void *network_ctx, int akmp)
+static struct rsn_pmksa_cache_entry *
+pmksa_cache_add_entry(struct rsn_pmksa_cache *pmksa,
+		      struct rsn_pmksa_cache_entry *entry)
 {
-	struct rsn_pmksa_cache_entry *entry, *pos, *prev;
-	struct os_time now;
-
-	if (pmk_len > PMK_LEN)
-		return NULL;
-
-	entry = os_zalloc(sizeof(*entry));
-	if (entry == NULL)
-		return NULL;
-	os_memcpy(entry->pmk, pmk, pmk_len);
-	entry->pmk_len = pmk_len;
-	rsn_pmkid(pmk, pmk_len, aa, spa, entry->pmkid,
-		  wpa_key_mgmt_sha256(akmp));
-	os_get_time(&now);
-	entry->expiration = now.sec + pmksa->sm->dot11RSNAConfigPMKLifetime;
-	entry->reauth_time = now.sec + pmksa->sm->dot11RSNAConfigPMKLifetime *
-		pmksa->sm->dot11RSNAConfigPMKReauthThreshold / 100;
-	entry->akmp = akmp;
-	os_memcpy(entry->aa, aa, ETH_ALEN);
-	entry->network_ctx = network_ctx;
+	struct rsn_pmksa_cache_entry *pos, *prev;
 
 	/* Replace an old entry for the same Authenticator (if found) with the
 	 * new entry */
-	pos = pmksa->pmksa;
-	prev = NULL;
-	while (pos) {
-		if (os_memcmp(aa, pos->aa, ETH_ALEN) == 0) {
-			if (pos->pmk_len == pmk_len &&
-			    os_memcmp(pos->pmk, pmk, pmk_len) == 0 &&
-			    os_memcmp(pos->pmkid, entry->pmkid, PMKID_LEN) ==
-			    0) {
-				wpa_printf(MSG_DEBUG, "WPA: reusing previous "
-					   "PMKSA entry");
-				os_free(entry);
-				return pos;
-			}
-			if (prev == NULL)
-				pmksa->pmksa = pos->next;
-			else
-				prev->next = pos->next;
-			if (pos == pmksa->sm->cur_pmksa) {
-				/* We are about to replace the current PMKSA
-				 * cache entry. This happens when the PMKSA
-				 * caching attempt fails, so we don't want to
-				 * force pmksa_cache_free_entry() to disconnect
-				 * at this point. Let's just make sure the old
-				 * PMKSA cache entry will not be used in the
-				 * future.
-				 */
-				wpa_printf(MSG_DEBUG, "RSN: replacing current "
-					   "PMKSA entry");
-				pmksa->sm->cur_pmksa = NULL;
-			}
-			wpa_printf(MSG_DEBUG, "RSN: Replace PMKSA entry for "
-				   "the current AP");
-			pmksa_cache_free_entry(pmksa, pos, 1);
-			break;
+	pos = pmksa_cache_get(pmksa, entry->aa, NULL);
+	if (pos) {
+		if (pos->pmk_len == entry->pmk_len &&
+		    os_memcmp(pos->pmk, entry->pmk, entry->pmk_len) == 0 &&
+		    os_memcmp(pos->pmkid, entry->pmkid, PMKID_LEN) == 0) {
+			wpa_printf(MSG_DEBUG, "WPA: reusing previous PMKSA "
+				   "entry");
+			os_free(entry);
+			return pos;
 		}
-		prev = pos;
-		pos = pos->next;
+		if (pmksa->pmksa == pos)
+			pmksa->pmksa = pos->next;
+		else {
+			for (prev = pmksa->pmksa; prev->next != pos;
+			     prev = prev->next)
+				;
+			prev->next = pos->next;
+		}
+		if (pos == pmksa->sm->cur_pmksa) {
+			/* We are about to replace the current PMKSA cache
+			 * entry. This happens when the PMKSA caching attempt
+			 * fails, so we don't want to force
+			 * pmksa_cache_free_entry() to disconnect at this
+			 * point. Let's just make sure the old PMKSA cache
+			 * entry will not be used in the future.
+			 */
+			wpa_printf(MSG_DEBUG, "RSN: replacing current PMKSA "
+				   "entry");
+			pmksa->sm->cur_pmksa = NULL;
+		}
+		wpa_printf(MSG_DEBUG, "RSN: Replace PMKSA entry for the "
+			   "current AP");
+		pmksa_cache_free_entry(pmksa, pos, 1);
 	}
 
 	if (pmksa->pmksa_count >= pmksa_cache_max_entries && pmksa->pmksa) {
@@ -202,6 +236,8 @@ pmksa_cache_add(struct rsn_pmksa_cache *pmksa, const u8 *pmk, size_t pmk_len,
 		pmksa_cache_free_entry(pmksa, pos, 0);
 	}
 
+	pmksa_cache_hash_add(pmksa, entry);
+
 	/* Add the new entry; order by expiration time */
 	pos = pmksa->pmksa;
 	prev = NULL;
@@ -228,6 +264,51 @@ pmksa_cache_add(struct rsn_pmksa_cache *pmksa, const u8 *pmk, size_t pmk_len,
 }
 
 
+/**
+ * pmksa_cache_add - Add a PMKSA cache entry
+ * @pmksa: Pointer to PMKSA cache data from pmksa_cache_init()
+ * @pmk: The new pairwise master key
+ * @pmk_len: PMK length in bytes, usually PMK_LEN (32)
+ * @aa: Authenticator address
+ * @spa: Supplicant address
+ * @network_ctx: Network configuration context for this PMK
+ * @akmp: WPA_KEY_MGMT_* used in key derivation
+ * Returns: Pointer to the added PMKSA cache entry or %NULL on error
+ *
+ * This function create a PMKSA entry for a new PMK and adds it to the PMKSA
+ * cache. If an old entry is already in the cache for the same Authenticator,
+ * this entry will be replaced with the new entry. PMKID will be calculated
+ * based on the PMK and the driver interface is notified of the new PMKID.
+ */
+struct rsn_pmksa_cache_entry *
+pmksa_cache_add(struct rsn_pmksa_cache *pmksa, const u8 *pmk, size_t pmk_len,
+		const u8 *aa, const u8 *spa, void *network_ctx, int akmp)
+{
+	struct rsn_pmksa_cache_entry *entry;
+	struct os_time now;
+
+	if (pmk_len > PMK_LEN)
+		return NULL;
+
+	entry = os_zalloc(sizeof(*entry));
+	if (entry == NULL)
+		return NULL;
+	os_memcpy(entry->pmk, pmk, pmk_len);
+	entry->pmk_len = pmk_len;
+	rsn_pmkid(pmk, pmk_len, aa, spa, entry->pmkid,
+		  wpa_key_mgmt_sha256(akmp));
+	os_get_time(&now);
+	entry->expiration = now.sec + pmksa->sm->dot11RSNAConfigPMKLifetime;
+	entry->reauth_time = now.sec + pmksa->sm->dot11RSNAConfigPMKLifetime *
+		pmksa->sm->dot11RSNAConfigPMKReauthThreshold / 100;
+	entry->akmp = akmp;
+	os_memcpy(entry->aa, aa, ETH_ALEN);
+	entry->network_ctx = network_ctx;
+
+	return pmksa_cache_add_entry(pmksa, entry);
+}
+
+
 /**
  * pmksa_cache_deinit - Free all entries in PMKSA cache
  * @pmksa: Pointer to PMKSA cache data from pmksa_cache_init()
@@ -261,15 +342,29 @@ void pmksa_cache_deinit(struct rsn_pmksa_cache *pmksa)
 struct rsn_pmksa_cache_entry * pmksa_cache_get(struct rsn_pmksa_cache *pmksa,
 					       const u8 *aa, const u8 *pmkid)
 {
-	struct rsn_pmksa_cache_entry *entry = pmksa->pmksa;
-	while (entry) {
-		if ((aa == NULL || os_memcmp(entry->aa, aa, ETH_ALEN) == 0) &&
-		    (pmkid == NULL ||
-		     os_memcmp(entry->pmkid, pmkid, PMKID_LEN) == 0))
-			return entry;
-		entry = entry->next;
+	struct rsn_pmksa_cache_entry *entry;
+
+	if (aa) {
+		for (entry = pmksa->aa_hash[PMKSA_HASH_AA(aa)]; entry;
+		     entry = entry->hnext_aa) {
+			if (os_memcmp(entry->aa, aa, ETH_ALEN) == 0 &&
+			    (pmkid == NULL ||
+			     os_memcmp(entry->pmkid, pmkid, PMKID_LEN) == 0))
+				return entry;
+		}
+		return NULL;
 	}
-	return NULL;
+
+	if (pmkid) {
+		for (entry = pmksa->pmkid_hash[PMKSA_HASH_PMKID(pmkid)]; entry;
+		     entry = entry->hnext_pmkid) {
+			if (os_memcmp(entry->pmkid, pmkid, PMKID_LEN) == 0)
+				return entry;
+		}
+		return NULL;
+	}
+
+	return pmksa->pmksa;
 }
 
 
@@ -284,8 +379,10 @@ void pmksa_cache_notify_reconfig(struct rsn_pmksa_cache *pmksa)
 	struct rsn_pmksa_cache_entry *entry = pmksa->pmksa;
 	while (entry) {
 		entry->network_ctx = NULL;
+		entry->hnext_ctx = NULL;
 		entry = entry->next;
 	}
+	os_memset(pmksa->ctx_hash, 0, sizeof(pmksa->ctx_hash));
 }
 
 
@@ -296,17 +393,22 @@ pmksa_cache_clone_entry(struct rsn_pmksa_cache *pmksa,
 {
 	struct rsn_pmksa_cache_entry *new_entry;
 
-	new_entry = pmksa_cache_add(pmksa, old_entry->pmk, old_entry->pmk_len,
-				    aa, pmksa->sm->own_addr,
-				    old_entry->network_ctx, old_entry->akmp);
+	new_entry = os_zalloc(sizeof(*new_entry));
 	if (new_entry == NULL)
 		return NULL;
-
-	/* TODO: reorder entries based on expiration time? */
+	os_memcpy(new_entry->pmk, old_entry->pmk, old_entry->pmk_len);
+	new_entry->pmk_len = old_entry->pmk_len;
+	rsn_pmkid(new_entry->pmk, new_entry->pmk_len, aa, pmksa->sm->own_addr,
+		  new_entry->pmkid, wpa_key_mgmt_sha256(old_entry->akmp));
+	/* The PMK is the same, so it does not live any longer for this AP */
 	new_entry->expiration = old_entry->expiration;
+	new_entry->reauth_time = old_entry->reauth_time;
+	new_entry->akmp = old_entry->akmp;
+	os_memcpy(new_entry->aa, aa, ETH_ALEN);
+	new_entry->network_ctx = old_entry->network_ctx;
 	new_entry->opportunistic = 1;
 
-	return new_entry;
+	return pmksa_cache_add_entry(pmksa, new_entry);
 }
 
 
@@ -325,10 +427,12 @@ struct rsn_pmksa_cache_entry *
 pmksa_cache_get_opportunistic(struct rsn_pmksa_cache *pmksa, void *network_ctx,
 			      const u8 *aa)
 {
-	struct rsn_pmksa_cache_entry *entry = pmksa->pmksa;
+	struct rsn_pmksa_cache_entry *entry;
 
 	if (network_ctx == NULL)
 		return NULL;
+	/* The most recently added entry for the network is tried first */
+	entry = pmksa->ctx_hash[PMKSA_HASH_CTX(network_ctx)];
 	while (entry) {
 		if (entry->network_ctx == network_ctx) {
 			entry = pmksa_cache_clone_entry(pmksa, entry, aa);
@@ -339,7 +443,7 @@ pmksa_cache_get_opportunistic(struct rsn_pmksa_cache *pmksa, void *network_ctx,
 			}
 			return entry;
 		}
-		entry = entry->next;
+		entry = entry->hnext_ctx;
 	}
 	return NULL;
 }
@@ -19,7 +19,10 @@
  * struct rsn_pmksa_cache_entry - PMKSA cache entry
  */
 struct rsn_pmksa_cache_entry {
-	struct rsn_pmksa_cache_entry *next;
+	struct rsn_pmksa_cache_entry *next; /* ordered by expiration time */
+	struct rsn_pmksa_cache_entry *hnext_aa; /* hash table chains */
+	struct rsn_pmksa_cache_entry *hnext_pmkid;
+	struct rsn_pmksa_cache_entry *hnext_ctx;
 	u8 pmkid[PMKID_LEN];
 	u8 pmk[PMK_LEN];
 	size_t pmk_len;
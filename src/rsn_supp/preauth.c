@@ -28,14 +28,141 @@
 #if defined(IEEE8021X_EAPOL) && !defined(CONFIG_NO_WPA2)
 
 #define PMKID_CANDIDATE_PRIO_SCAN 1000
+/* Candidates for which pre-authentication failed once are retried last */
+#define PMKID_CANDIDATE_PRIO_RETRY (PMKID_CANDIDATE_PRIO_SCAN + 1)
+
+/* Minimum time between starting pre-authentication with new candidates */
+#define RSN_PREAUTH_INTERVAL 1
+
+#define PMKSA_CAND_HASH_SIZE 32
+#define PMKSA_CAND_HASH(bssid) ((unsigned int) ((bssid)[5] & 0x1f))
 
 
 struct rsn_pmksa_candidate {
-	struct dl_list list;
+	struct rsn_pmksa_candidate *hnext; /* BSSID hash table chain */
 	u8 bssid[ETH_ALEN];
 	int priority;
+	unsigned int seq; /* order of candidates with the same priority */
+	size_t heap_idx;
 };
 
+/*
+ * The PMKSA candidates are kept in a binary heap ordered by priority (and the
+ * order in which they were added) with a hash table for finding the entry for
+ * a BSSID. The set is updated incrementally based on BSS table changes
+ * instead of being rebuilt from all scan results after each scan.
+ */
+struct rsn_pmksa_candidates {
+	struct rsn_pmksa_candidate **heap;
+	size_t count, size;
+	struct rsn_pmksa_candidate *hash[PMKSA_CAND_HASH_SIZE];
+	unsigned int seq;
+	u8 ssid[32]; /* ESS for which the candidates have been collected */
+	size_t ssid_len;
+	int cur_prio; /* priority of the candidate being pre-authenticated */
+	struct os_time last_start;
+};
+
+
+static int pmksa_cand_before(const struct rsn_pmksa_candidate *a,
+			     const struct rsn_pmksa_candidate *b)
+{
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+	return (int) (a->seq - b->seq) < 0;
+}
+
+
+static void pmksa_cand_heap_set(struct rsn_pmksa_candidates *c, size_t i,
+				struct rsn_pmksa_candidate *cand)
+{
+	c->heap[i] = cand;
+	cand->heap_idx = i;
+}
+
+
+static void pmksa_cand_sift(struct rsn_pmksa_candidates *c, size_t i)
+{
+	struct rsn_pmksa_candidate *cand = c->heap[i];
+	size_t child;
+
+	while (i > 0 && pmksa_cand_before(cand, c->heap[(i - 1) / 2])) {
+		pmksa_cand_heap_set(c, i, c->heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= c->count)
+			break;
+		if (child + 1 < c->count &&
+		    pmksa_cand_before(c->heap[child + 1], c->heap[child]))
+			child++;
+		if (!pmksa_cand_before(c->heap[child], cand))
+			break;
+		pmksa_cand_heap_set(c, i, c->heap[child]);
+		i = child;
+	}
+
+	pmksa_cand_heap_set(c, i, cand);
+}
+
+
+static struct rsn_pmksa_candidate *
+pmksa_cand_get(struct rsn_pmksa_candidates *c, const u8 *bssid)
+{
+	struct rsn_pmksa_candidate *cand;
+
+	for (cand = c->hash[PMKSA_CAND_HASH(bssid)]; cand; cand = cand->hnext) {
+		if (os_memcmp(cand->bssid, bssid, ETH_ALEN) == 0)
+			return cand;
+	}
+
+	return NULL;
+}
+
+
+static void pmksa_cand_del(struct rsn_pmksa_candidates *c,
+			   struct rsn_pmksa_candidate *cand)
+{
+	struct rsn_pmksa_candidate **pos;
+	size_t i = cand->heap_idx;
+
+	for (pos = &c->hash[PMKSA_CAND_HASH(cand->bssid)]; *pos;
+	     pos = &(*pos)->hnext) {
+		if (*pos == cand) {
+			*pos = cand->hnext;
+			break;
+		}
+	}
+
+	c->count--;
+	if (i < c->count) {
+		pmksa_cand_heap_set(c, i, c->heap[c->count]);
+		pmksa_cand_sift(c, i);
+	}
+	os_free(cand);
+}
+
+
+static struct rsn_pmksa_candidates * pmksa_cand_init(struct wpa_sm *sm)
+{
+	if (sm->pmksa_candidates == NULL) {
+		sm->pmksa_candidates = os_zalloc(sizeof(*sm->pmksa_candidates));
+		if (sm->pmksa_candidates == NULL)
+			return NULL;
+		sm->pmksa_candidates->cur_prio = PMKID_CANDIDATE_PRIO_RETRY;
+	}
+	return sm->pmksa_candidates;
+}
+
+
+static void rsn_preauth_candidate_timer(void *eloop_ctx, void *timeout_ctx)
+{
+	struct wpa_sm *sm = eloop_ctx;
+	rsn_preauth_candidate_process(sm);
+}
+
 
 /**
  * pmksa_candidate_free - Free all entries in PMKSA candidate list
@@ -43,16 +170,43 @@ struct rsn_pmksa_candidate {
  */
 void pmksa_candidate_free(struct wpa_sm *sm)
 {
-	struct rsn_pmksa_candidate *entry, *n;
+	struct rsn_pmksa_candidates *c;
+	size_t i;
 
-	if (sm == NULL)
+	if (sm == NULL || sm->pmksa_candidates == NULL)
 		return;
 
-	dl_list_for_each_safe(entry, n, &sm->pmksa_candidates,
-			      struct rsn_pmksa_candidate, list) {
-		dl_list_del(&entry->list);
-		os_free(entry);
-	}
+	eloop_cancel_timeout(rsn_preauth_candidate_timer, sm, NULL);
+	c = sm->pmksa_candidates;
+	for (i = 0; i < c->count; i++)
+		os_free(c->heap[i]);
+	os_free(c->heap);
+	os_free(c);
+	sm->pmksa_candidates = NULL;
+}
+
+
+/**
+ * pmksa_candidate_remove - Remove a PMKSA candidate found from scan results
+ * @sm: Pointer to WPA state machine data from wpa_sm_init()
+ * @bssid: BSSID of the candidate
+ *
+ * This function is used to remove a candidate when the BSS is removed from
+ * the scan results. Candidates reported by the driver are not removed.
+ */
+void pmksa_candidate_remove(struct wpa_sm *sm, const u8 *bssid)
+{
+	struct rsn_pmksa_candidate *cand;
+
+	if (sm == NULL || sm->pmksa_candidates == NULL)
+		return;
+
+	cand = pmksa_cand_get(sm->pmksa_candidates, bssid);
+	if (cand == NULL || cand->priority < PMKID_CANDIDATE_PRIO_SCAN)
+		return;
+	wpa_printf(MSG_DEBUG, "RSN: removed PMKSA cache candidate " MACSTR,
+		   MAC2STR(bssid));
+	pmksa_cand_del(sm->pmksa_candidates, cand);
 }
 
 
@@ -77,6 +231,27 @@ static void rsn_preauth_receive(void *ctx, const u8 *src_addr,
 }
 
 
+/* Terminate pre-authentication; a failed candidate is retried once */
+static void rsn_preauth_done(struct wpa_sm *sm, int success)
+{
+	struct rsn_pmksa_candidates *c = sm->pmksa_candidates;
+	u8 bssid[ETH_ALEN];
+	int prio;
+
+	os_memcpy(bssid, sm->preauth_bssid, ETH_ALEN);
+	rsn_preauth_deinit(sm);
+
+	if (c == NULL)
+		return;
+	prio = c->cur_prio;
+	c->cur_prio = PMKID_CANDIDATE_PRIO_RETRY;
+	if (success || prio >= PMKID_CANDIDATE_PRIO_RETRY ||
+	    is_zero_ether_addr(bssid))
+		return;
+	pmksa_candidate_add(sm, bssid, PMKID_CANDIDATE_PRIO_RETRY, 1);
+}
+
+
 static void rsn_preauth_eapol_cb(struct eapol_sm *eapol, int success,
 				 void *ctx)
 {
@@ -115,7 +290,7 @@ static void rsn_preauth_eapol_cb(struct eapol_sm *eapol, int success,
 		MACSTR " %s", MAC2STR(sm->preauth_bssid),
 		success ? "completed successfully" : "failed");
 
-	rsn_preauth_deinit(sm);
+	rsn_preauth_done(sm, success);
 	rsn_preauth_candidate_process(sm);
 }
 
@@ -126,7 +301,7 @@ static void rsn_preauth_timeout(void *eloop_ctx, void *timeout_ctx)
 
 	wpa_msg(sm->ctx->msg_ctx, MSG_INFO, "RSN: pre-authentication with "
 		MACSTR " timed out", MAC2STR(sm->preauth_bssid));
-	rsn_preauth_deinit(sm);
+	rsn_preauth_done(sm, 0);
 	rsn_preauth_candidate_process(sm);
 }
 
@@ -290,9 +465,12 @@ void rsn_preauth_deinit(struct wpa_sm *sm)
  */
 void rsn_preauth_candidate_process(struct wpa_sm *sm)
 {
-	struct rsn_pmksa_candidate *candidate, *n;
+	struct rsn_pmksa_candidates *c = sm->pmksa_candidates;
+	struct rsn_pmksa_candidate *candidate;
+	struct os_time now;
+	int sec;
 
-	if (dl_list_empty(&sm->pmksa_candidates))
+	if (c == NULL || c->count == 0)
 		return;
 
 	/* TODO: drop priority for old candidate entries */
@@ -309,20 +487,37 @@ void rsn_preauth_candidate_process(struct wpa_sm *sm)
 		return; /* invalid state for new pre-auth */
 	}
 
-	dl_list_for_each_safe(candidate, n, &sm->pmksa_candidates,
-			      struct rsn_pmksa_candidate, list) {
+	while (c->count > 0) {
 		struct rsn_pmksa_cache_entry *p = NULL;
+		candidate = c->heap[0];
 		p = pmksa_cache_get(sm->pmksa, candidate->bssid, NULL);
 		if (os_memcmp(sm->bssid, candidate->bssid, ETH_ALEN) != 0 &&
 		    (p == NULL || p->opportunistic)) {
+			/*
+			 * Do not start pre-authentication exchanges back to
+			 * back to leave the medium for data traffic.
+			 */
+			os_get_time(&now);
+			sec = c->last_start.sec + RSN_PREAUTH_INTERVAL -
+				now.sec;
+			if (c->last_start.sec && sec > 0 &&
+			    sec <= RSN_PREAUTH_INTERVAL) {
+				eloop_cancel_timeout(
+					rsn_preauth_candidate_timer, sm, NULL);
+				eloop_register_timeout(
+					sec, 0, rsn_preauth_candidate_timer,
+					sm, NULL);
+				return;
+			}
 			wpa_msg(sm->ctx->msg_ctx, MSG_DEBUG, "RSN: PMKSA "
 				"candidate " MACSTR
 				" selected for pre-authentication",
 				MAC2STR(candidate->bssid));
-			dl_list_del(&candidate->list);
+			c->last_start = now;
+			c->cur_prio = candidate->priority;
 			rsn_preauth_init(sm, candidate->bssid,
 					 sm->eap_conf_ctx);
-			os_free(candidate);
+			pmksa_cand_del(c, candidate);
 			return;
 		}
 		wpa_msg(sm->ctx->msg_ctx, MSG_DEBUG, "RSN: PMKSA candidate "
@@ -334,8 +529,7 @@ void rsn_preauth_candidate_process(struct wpa_sm *sm)
 			wpa_sm_add_pmkid(sm, candidate->bssid, p->pmkid);
 		}
 
-		dl_list_del(&candidate->list);
-		os_free(candidate);
+		pmksa_cand_del(c, candidate);
 	}
 	wpa_msg(sm->ctx->msg_ctx, MSG_DEBUG, "RSN: no more pending PMKSA "
 		"candidates");
@@ -356,7 +550,10 @@ void rsn_preauth_candidate_process(struct wpa_sm *sm)
 void pmksa_candidate_add(struct wpa_sm *sm, const u8 *bssid,
 			 int prio, int preauth)
 {
-	struct rsn_pmksa_candidate *cand, *pos;
+	struct rsn_pmksa_candidates *c;
+	struct rsn_pmksa_candidate *cand, **nheap;
+	size_t nsize;
+	unsigned int h;
 
 	if (sm->network_ctx && sm->proactive_key_caching)
 		pmksa_cache_get_opportunistic(sm->pmksa, sm->network_ctx,
@@ -368,42 +565,40 @@ void pmksa_candidate_add(struct wpa_sm *sm, const u8 *bssid,
 		return;
 	}
 
+	c = pmksa_cand_init(sm);
+	if (c == NULL)
+		return;
+
 	/* If BSSID already on candidate list, update the priority of the old
 	 * entry. Do not override priority based on normal scan results. */
-	cand = NULL;
-	dl_list_for_each(pos, &sm->pmksa_candidates,
-			 struct rsn_pmksa_candidate, list) {
-		if (os_memcmp(pos->bssid, bssid, ETH_ALEN) == 0) {
-			cand = pos;
-			break;
-		}
-	}
-
+	cand = pmksa_cand_get(c, bssid);
 	if (cand) {
-		dl_list_del(&cand->list);
 		if (prio < PMKID_CANDIDATE_PRIO_SCAN)
 			cand->priority = prio;
+		cand->seq = c->seq++;
+		pmksa_cand_sift(c, cand->heap_idx);
 	} else {
+		if (c->count == c->size) {
+			nsize = c->size ? 2 * c->size : 16;
+			nheap = os_realloc(c->heap, nsize * sizeof(*nheap));
+			if (nheap == NULL)
+				return;
+			c->heap = nheap;
+			c->size = nsize;
+		}
 		cand = os_zalloc(sizeof(*cand));
 		if (cand == NULL)
 			return;
 		os_memcpy(cand->bssid, bssid, ETH_ALEN);
 		cand->priority = prio;
+		cand->seq = c->seq++;
+		h = PMKSA_CAND_HASH(bssid);
+		cand->hnext = c->hash[h];
+		c->hash[h] = cand;
+		pmksa_cand_heap_set(c, c->count++, cand);
+		pmksa_cand_sift(c, cand->heap_idx);
 	}
 
-	/* Add candidate to the list; order by increasing priority value. i.e.,
-	 * highest priority (smallest value) first. */
-	dl_list_for_each(pos, &sm->pmksa_candidates,
-			 struct rsn_pmksa_candidate, list) {
-		if (cand->priority <= pos->priority) {
-			dl_list_add(pos->list.prev, &cand->list);
-			cand = NULL;
-			break;
-		}
-	}
-	if (cand)
-		dl_list_add_tail(&sm->pmksa_candidates, &cand->list);
-
 	wpa_msg(sm->ctx->msg_ctx, MSG_DEBUG, "RSN: added PMKSA cache "
 		"candidate " MACSTR " prio %d", MAC2STR(bssid), prio);
 	rsn_preauth_candidate_process(sm);
@@ -419,18 +614,33 @@ void pmksa_candidate_add(struct wpa_sm *sm, const u8 *bssid,
  *
  * This functions is used to notify RSN code about start of new scan results
  * processing. The actual scan results will be provided by calling
- * rsn_preauth_scan_result() for each BSS if this function returned 0.
+ * rsn_preauth_scan_result() for each BSS if this function returned 0. This is
+ * needed only when the candidates for the current ESS have not yet been
+ * collected.
  */
 int rsn_preauth_scan_results(struct wpa_sm *sm)
 {
+	struct rsn_pmksa_candidates *c = sm->pmksa_candidates;
+
 	if (sm->ssid_len == 0)
 		return -1;
 
 	/*
-	 * TODO: is it ok to free all candidates? What about the entries
-	 * received from EVENT_PMKID_CANDIDATE?
+	 * The candidates are kept up to date with rsn_preauth_scan_result()
+	 * and pmksa_candidate_remove() calls as BSSes are added, changed, and
+	 * removed, so all scan results need to be processed only when the
+	 * ESS changes.
 	 */
+	if (c && c->ssid_len == sm->ssid_len &&
+	    os_memcmp(c->ssid, sm->ssid, sm->ssid_len) == 0)
+		return -1;
+
 	pmksa_candidate_free(sm);
+	c = pmksa_cand_init(sm);
+	if (c == NULL)
+		return -1;
+	os_memcpy(c->ssid, sm->ssid, sm->ssid_len);
+	c->ssid_len = sm->ssid_len;
 
 	return 0;
 }
@@ -441,7 +651,9 @@ int rsn_preauth_scan_results(struct wpa_sm *sm)
  * @sm: Pointer to WPA state machine data from wpa_sm_init()
  *
  * Add all suitable APs (Authenticators) from scan results into PMKSA
- * candidate list.
+ * candidate list. This is called for all BSSes after
+ * rsn_preauth_scan_results() and whenever a BSS is added or its RSN IE
+ * changes.
  */
 void rsn_preauth_scan_result(struct wpa_sm *sm, const u8 *bssid,
 			     const u8 *ssid, const u8 *rsn)
@@ -449,6 +661,9 @@ void rsn_preauth_scan_result(struct wpa_sm *sm, const u8 *bssid,
 	struct wpa_ie_data ie;
 	struct rsn_pmksa_cache_entry *pmksa;
 
+	if (sm == NULL || sm->ssid_len == 0)
+		return;
+
 	if (ssid[1] != sm->ssid_len ||
 	    os_memcmp(ssid + 2, sm->ssid, sm->ssid_len) != 0)
 		return; /* Not for the current SSID */
@@ -20,6 +20,7 @@ struct wpa_scan_results;
 #if defined(IEEE8021X_EAPOL) && !defined(CONFIG_NO_WPA2)
 
 void pmksa_candidate_free(struct wpa_sm *sm);
+void pmksa_candidate_remove(struct wpa_sm *sm, const u8 *bssid);
 int rsn_preauth_init(struct wpa_sm *sm, const u8 *dst,
 		     struct eap_peer_config *eap_conf);
 void rsn_preauth_deinit(struct wpa_sm *sm);
@@ -39,6 +40,10 @@ static inline void pmksa_candidate_free(struct wpa_sm *sm)
 {
 }
 
+static inline void pmksa_candidate_remove(struct wpa_sm *sm, const u8 *bssid)
+{
+}
+
 static inline void rsn_preauth_candidate_process(struct wpa_sm *sm)
 {
 }
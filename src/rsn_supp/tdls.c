@@ -40,6 +40,9 @@
 #define TDLS_TESTING_DECLINE_RESP BIT(9)
 #define TDLS_TESTING_IGNORE_AP_PROHIBIT BIT(10)
 unsigned int tdls_testing = 0;
+
+/* Extra octets added to the FTIE with TDLS_TESTING_LONG_FRAME */
+#define TDLS_TESTING_LONG_FRAME_LEN 170
 #endif /* CONFIG_TDLS_TESTING */
 
 #define TPK_LIFETIME 43200 /* 12 hours */
@@ -84,12 +87,33 @@ struct wpa_tdls_frame {
 
 static u8 * wpa_add_tdls_timeoutie(u8 *pos, u8 *ie, size_t ie_len, u32 tsecs);
 static void wpa_tdls_tpk_retry_timeout(void *eloop_ctx, void *timeout_ctx);
+static void wpa_tdls_tpk_timeout(void *eloop_ctx, void *timeout_ctx);
 static void wpa_tdls_peer_free(struct wpa_sm *sm, struct wpa_tdls_peer *peer);
 
 
 #define TDLS_MAX_IE_LEN 80
+
+#ifdef CONFIG_TDLS_TESTING
+/* FTIE padding and the extra Link Identifier IE for TDLS_TESTING_DIFF_BSSID */
+#define TDLS_TESTING_MAX_EXTRA_LEN \
+	(TDLS_TESTING_LONG_FRAME_LEN + sizeof(struct wpa_tdls_lnkid))
+#else /* CONFIG_TDLS_TESTING */
+#define TDLS_TESTING_MAX_EXTRA_LEN 0
+#endif /* CONFIG_TDLS_TESTING */
+
+/*
+ * Longest TPK handshake message that is retransmitted (TPK M1/M2): RSN IE,
+ * FTIE, and Timeout Interval IE
+ */
+#define TDLS_MAX_RETRY_LEN (TDLS_MAX_IE_LEN + sizeof(struct wpa_tdls_ftie) + \
+			    sizeof(struct wpa_tdls_timeoutie) + \
+			    TDLS_TESTING_MAX_EXTRA_LEN)
+
+#define TDLS_PEER_HASH(a) ((a)[5] % TDLS_PEER_HASH_SIZE)
+
 struct wpa_tdls_peer {
 	struct wpa_tdls_peer *next;
+	struct wpa_tdls_peer *hnext; /* next entry in hash table list */
 	int initiator; /* whether this end was initiator for TDLS setup */
 	u8 addr[ETH_ALEN]; /* other end MAC address */
 	u8 inonce[WPA_NONCE_LEN]; /* Initiator Nonce */
@@ -108,8 +132,11 @@ struct wpa_tdls_peer {
 	} tpk;
 	int tpk_set;
 	int tpk_success;
+	struct os_time tpk_expire; /* TPK lifetime expiration; 0 = none */
 
 	struct tpk_timer {
+		struct dl_list list; /* sm->tdls_retry; next == NULL if idle */
+		struct os_time expire; /* time of the next retransmission */
 		u8 dest[ETH_ALEN];
 		int count;      /* Retry Count */
 		int timer;      /* Timeout in milliseconds */
@@ -117,7 +144,7 @@ struct wpa_tdls_peer {
 		u8 dialog_token;
 		u16 status_code;
 		int buf_len;    /* length of TPK message for retransmission */
-		u8 *buf;        /* buffer for TPK message */
+		u8 buf[TDLS_MAX_RETRY_LEN]; /* buffer for TPK message */
 	} sm_tmr;
 };
 
@@ -133,6 +160,40 @@ static int wpa_tdls_get_privacy(struct wpa_sm *sm)
 }
 
 
+static struct wpa_tdls_peer * wpa_tdls_get_peer(struct wpa_sm *sm,
+						const u8 *addr)
+{
+	struct wpa_tdls_peer *peer;
+
+	peer = sm->tdls_hash[TDLS_PEER_HASH(addr)];
+	while (peer && os_memcmp(peer->addr, addr, ETH_ALEN) != 0)
+		peer = peer->hnext;
+	return peer;
+}
+
+
+static struct wpa_tdls_peer * wpa_tdls_add_peer(struct wpa_sm *sm,
+						const u8 *addr)
+{
+	struct wpa_tdls_peer *peer;
+
+	wpa_printf(MSG_INFO, "TDLS: No matching entry found for peer, "
+		   "creating one for " MACSTR, MAC2STR(addr));
+
+	peer = os_zalloc(sizeof(*peer));
+	if (peer == NULL)
+		return NULL;
+
+	os_memcpy(peer->addr, addr, ETH_ALEN);
+	peer->next = sm->tdls;
+	sm->tdls = peer;
+	peer->hnext = sm->tdls_hash[TDLS_PEER_HASH(addr)];
+	sm->tdls_hash[TDLS_PEER_HASH(addr)] = peer;
+
+	return peer;
+}
+
+
 static u8 * wpa_add_ie(u8 *pos, const u8 *ie, size_t ie_len)
 {
 	os_memcpy(pos, ie, ie_len);
@@ -195,6 +256,58 @@ static int wpa_tdls_send_tpk_msg(struct wpa_sm *sm, const u8 *dst,
 }
 
 
+/*
+ * TPK handshake messages are retransmitted from a single timer per interface
+ * instead of one eloop timeout per peer. All peers use the same retry
+ * interval, so sm->tdls_retry is kept in expiration order by adding entries
+ * to the tail and every timer run handles all the peers that are due.
+ */
+static void wpa_tdls_retry_register(struct wpa_sm *sm,
+				    struct wpa_tdls_peer *peer,
+				    struct os_time *now)
+{
+	struct os_time diff;
+
+	if (os_time_before(now, &peer->sm_tmr.expire))
+		os_time_sub(&peer->sm_tmr.expire, now, &diff);
+	else
+		diff.sec = diff.usec = 0;
+	eloop_register_timeout(diff.sec, diff.usec,
+			       wpa_tdls_tpk_retry_timeout, sm, NULL);
+	sm->tdls_retry_timer = 1;
+}
+
+
+static void wpa_tdls_retry_dequeue(struct wpa_sm *sm,
+				   struct wpa_tdls_peer *peer)
+{
+	/* The timer is left running; it reschedules itself for the new head */
+	if (peer->sm_tmr.list.next)
+		dl_list_del(&peer->sm_tmr.list);
+}
+
+
+static void wpa_tdls_retry_enqueue(struct wpa_sm *sm,
+				   struct wpa_tdls_peer *peer)
+{
+	struct os_time now;
+
+	wpa_tdls_retry_dequeue(sm, peer);
+
+	os_get_time(&now);
+	peer->sm_tmr.expire.sec = now.sec + peer->sm_tmr.timer / 1000;
+	peer->sm_tmr.expire.usec = now.usec + (peer->sm_tmr.timer % 1000) * 1000;
+	if (peer->sm_tmr.expire.usec >= 1000000) {
+		peer->sm_tmr.expire.sec++;
+		peer->sm_tmr.expire.usec -= 1000000;
+	}
+
+	dl_list_add_tail(&sm->tdls_retry, &peer->sm_tmr.list);
+	if (!sm->tdls_retry_timer)
+		wpa_tdls_retry_register(sm, peer, &now);
+}
+
+
 static int wpa_tdls_tpk_send(struct wpa_sm *sm, const u8 *dest, u8 action_code,
 			     u8 dialog_token, u16 status_code,
 			     const u8 *msg, size_t msg_len)
@@ -217,18 +330,20 @@ static int wpa_tdls_tpk_send(struct wpa_sm *sm, const u8 *dest, u8 action_code,
 	    action_code == WLAN_TDLS_TEARDOWN)
 		return 0; /* No retries */
 
-	for (peer = sm->tdls; peer; peer = peer->next) {
-		if (os_memcmp(peer->addr, dest, ETH_ALEN) == 0)
-			break;
-	}
-
+	peer = wpa_tdls_get_peer(sm, dest);
 	if (peer == NULL) {
 		wpa_printf(MSG_INFO, "TDLS: No matching entry found for "
 			   "retry " MACSTR, MAC2STR(dest));
 		return 0;
 	}
 
-	eloop_cancel_timeout(wpa_tdls_tpk_retry_timeout, sm, peer);
+	if (msg_len > sizeof(peer->sm_tmr.buf)) {
+		wpa_printf(MSG_INFO, "TDLS: Too long message for retry "
+			   "(action_code=%u msg_len=%u)", action_code,
+			   (unsigned int) msg_len);
+		wpa_tdls_retry_dequeue(sm, peer);
+		return -1;
+	}
 
 	peer->sm_tmr.count = TPK_RETRY_COUNT;
 	peer->sm_tmr.timer = TPK_TIMEOUT;
@@ -239,26 +354,17 @@ static int wpa_tdls_tpk_send(struct wpa_sm *sm, const u8 *dest, u8 action_code,
 	peer->sm_tmr.dialog_token = dialog_token;
 	peer->sm_tmr.status_code = status_code;
 	peer->sm_tmr.buf_len = msg_len;
-	os_free(peer->sm_tmr.buf);
-	peer->sm_tmr.buf = os_malloc(msg_len);
-	if (peer->sm_tmr.buf == NULL)
-		return -1;
 	os_memcpy(peer->sm_tmr.buf, msg, msg_len);
 
 	wpa_printf(MSG_DEBUG, "TDLS: Retry timeout registered "
 		   "(action_code=%u)", action_code);
-	eloop_register_timeout(peer->sm_tmr.timer / 1000, 0,
-			       wpa_tdls_tpk_retry_timeout, sm, peer);
+	wpa_tdls_retry_enqueue(sm, peer);
 	return 0;
 }
 
 
-static void wpa_tdls_tpk_retry_timeout(void *eloop_ctx, void *timeout_ctx)
+static void wpa_tdls_tpk_retry(struct wpa_sm *sm, struct wpa_tdls_peer *peer)
 {
-
-	struct wpa_sm *sm = eloop_ctx;
-	struct wpa_tdls_peer *peer = timeout_ctx;
-
 	if (peer->sm_tmr.count) {
 		peer->sm_tmr.count--;
 		peer->sm_tmr.timer = TPK_TIMEOUT;
@@ -267,15 +373,6 @@ static void wpa_tdls_tpk_retry_timeout(void *eloop_ctx, void *timeout_ctx)
 			   "(action_code=%u)",
 			   peer->sm_tmr.action_code);
 
-		if (peer->sm_tmr.buf == NULL) {
-			wpa_printf(MSG_INFO, "TDLS: No retry buffer available "
-				   "for action_code=%u",
-				   peer->sm_tmr.action_code);
-			eloop_cancel_timeout(wpa_tdls_tpk_retry_timeout, sm,
-					     peer);
-			return;
-		}
-
 		/* resend TPK Handshake Message to Peer */
 		if (wpa_tdls_send_tpk_msg(sm, peer->sm_tmr.dest,
 					  peer->sm_tmr.action_code,
@@ -287,16 +384,13 @@ static void wpa_tdls_tpk_retry_timeout(void *eloop_ctx, void *timeout_ctx)
 				   "transmission");
 		}
 
-		eloop_cancel_timeout(wpa_tdls_tpk_retry_timeout, sm, peer);
-		eloop_register_timeout(peer->sm_tmr.timer / 1000, 0,
-				       wpa_tdls_tpk_retry_timeout, sm, peer);
+		wpa_tdls_retry_enqueue(sm, peer);
 	} else {
 		wpa_printf(MSG_INFO, "Sending Tear_Down Request");
 		wpa_sm_tdls_oper(sm, TDLS_TEARDOWN, peer->addr);
 
 		wpa_printf(MSG_INFO, "Clearing SM: Peerkey(" MACSTR ")",
 			   MAC2STR(peer->addr));
-		eloop_cancel_timeout(wpa_tdls_tpk_retry_timeout, sm, peer);
 
 		/* clear the Peerkey statemachine */
 		wpa_tdls_peer_free(sm, peer);
@@ -304,6 +398,39 @@ static void wpa_tdls_tpk_retry_timeout(void *eloop_ctx, void *timeout_ctx)
 }
 
 
+static void wpa_tdls_tpk_retry_timeout(void *eloop_ctx, void *timeout_ctx)
+{
+	struct wpa_sm *sm = eloop_ctx;
+	struct wpa_tdls_peer *peer;
+	struct dl_list expired;
+	struct os_time now;
+
+	/*
+	 * Move all expired entries out of the queue first so that the timer
+	 * can be registered for the next pending entry before the retries
+	 * requeue the peers.
+	 */
+	sm->tdls_retry_timer = 0;
+	dl_list_init(&expired);
+	os_get_time(&now);
+	while ((peer = dl_list_first(&sm->tdls_retry, struct wpa_tdls_peer,
+				     sm_tmr.list))) {
+		if (os_time_before(&now, &peer->sm_tmr.expire)) {
+			wpa_tdls_retry_register(sm, peer, &now);
+			break;
+		}
+		dl_list_del(&peer->sm_tmr.list);
+		dl_list_add_tail(&expired, &peer->sm_tmr.list);
+	}
+
+	while ((peer = dl_list_first(&expired, struct wpa_tdls_peer,
+				     sm_tmr.list))) {
+		dl_list_del(&peer->sm_tmr.list);
+		wpa_tdls_tpk_retry(sm, peer);
+	}
+}
+
+
 static void wpa_tdls_tpk_retry_timeout_cancel(struct wpa_sm *sm,
 					      struct wpa_tdls_peer *peer,
 					      u8 action_code)
@@ -312,12 +439,8 @@ static void wpa_tdls_tpk_retry_timeout_cancel(struct wpa_sm *sm,
 		wpa_printf(MSG_DEBUG, "TDLS: Retry timeout cancelled for "
 			   "action_code=%u", action_code);
 
-		/* Cancel Timeout registered */
-		eloop_cancel_timeout(wpa_tdls_tpk_retry_timeout, sm, peer);
-
-		/* free all resources meant for retry */
-		os_free(peer->sm_tmr.buf);
-		peer->sm_tmr.buf = NULL;
+		/* Remove from the retry queue */
+		wpa_tdls_retry_dequeue(sm, peer);
 
 		peer->sm_tmr.count = 0;
 		peer->sm_tmr.timer = 0;
@@ -556,11 +679,8 @@ static int wpa_supplicant_verify_tdls_mic_teardown(
 }
 
 
-static void wpa_tdls_tpk_timeout(void *eloop_ctx, void *timeout_ctx)
+static void wpa_tdls_tpk_expired(struct wpa_sm *sm, struct wpa_tdls_peer *peer)
 {
-	struct wpa_sm *sm = eloop_ctx;
-	struct wpa_tdls_peer *peer = timeout_ctx;
-
 	/*
 	 * On TPK lifetime expiration, we have an option of either tearing down
 	 * the direct link or trying to re-initiate it. The selection of what
@@ -581,15 +701,65 @@ static void wpa_tdls_tpk_timeout(void *eloop_ctx, void *timeout_ctx)
 }
 
 
+/*
+ * TPK lifetimes are tracked with a single timer per interface, too. The timer
+ * is registered for the earliest expiration (sm->tdls_tpk_next) and it handles
+ * all the peers whose TPK has expired at that point. Peers that are cleared
+ * before their TPK expires do not need to touch the timer.
+ */
+static void wpa_tdls_tpk_timer(struct wpa_sm *sm, struct os_time *expire,
+			       struct os_time *now)
+{
+	struct os_time diff;
+
+	if (sm->tdls_tpk_next.sec &&
+	    !os_time_before(expire, &sm->tdls_tpk_next))
+		return;
+
+	if (sm->tdls_tpk_next.sec)
+		eloop_cancel_timeout(wpa_tdls_tpk_timeout, sm, NULL);
+	if (os_time_before(now, expire))
+		os_time_sub(expire, now, &diff);
+	else
+		diff.sec = diff.usec = 0;
+	eloop_register_timeout(diff.sec, diff.usec, wpa_tdls_tpk_timeout, sm,
+			       NULL);
+	sm->tdls_tpk_next = *expire;
+}
+
+
+static void wpa_tdls_tpk_timeout(void *eloop_ctx, void *timeout_ctx)
+{
+	struct wpa_sm *sm = eloop_ctx;
+	struct wpa_tdls_peer *peer;
+	struct os_time now;
+
+	sm->tdls_tpk_next.sec = sm->tdls_tpk_next.usec = 0;
+	os_get_time(&now);
+
+	for (peer = sm->tdls; peer; peer = peer->next) {
+		if (peer->tpk_expire.sec == 0 ||
+		    os_time_before(&now, &peer->tpk_expire))
+			continue;
+		peer->tpk_expire.sec = peer->tpk_expire.usec = 0;
+		wpa_tdls_tpk_expired(sm, peer);
+	}
+
+	for (peer = sm->tdls; peer; peer = peer->next) {
+		if (peer->tpk_expire.sec)
+			wpa_tdls_tpk_timer(sm, &peer->tpk_expire, &now);
+	}
+}
+
+
 static void wpa_tdls_peer_free(struct wpa_sm *sm, struct wpa_tdls_peer *peer)
 {
 	wpa_printf(MSG_DEBUG, "TDLS: Clear state for peer " MACSTR,
 		   MAC2STR(peer->addr));
-	eloop_cancel_timeout(wpa_tdls_tpk_timeout, sm, peer);
-	eloop_cancel_timeout(wpa_tdls_tpk_retry_timeout, sm, peer);
+	wpa_tdls_retry_dequeue(sm, peer);
+	peer->tpk_expire.sec = peer->tpk_expire.usec = 0;
 	peer->initiator = 0;
-	os_free(peer->sm_tmr.buf);
-	peer->sm_tmr.buf = NULL;
+	peer->sm_tmr.buf_len = 0;
 	peer->rsnie_i_len = peer->rsnie_p_len = 0;
 	peer->cipher = 0;
 	peer->tpk_set = peer->tpk_success = 0;
@@ -629,10 +799,7 @@ int wpa_tdls_recv_teardown_notify(struct wpa_sm *sm, const u8 *addr,
 		return -1;
 
 	/* Find the node and free from the list */
-	for (peer = sm->tdls; peer; peer = peer->next) {
-		if (os_memcmp(peer->addr, addr, ETH_ALEN) == 0)
-			break;
-	}
+	peer = wpa_tdls_get_peer(sm, addr);
 
 	if (peer == NULL) {
 		wpa_printf(MSG_INFO, "TDLS: No matching entry found for "
@@ -651,7 +818,7 @@ int wpa_tdls_recv_teardown_notify(struct wpa_sm *sm, const u8 *addr,
 		ielen += sizeof(*ftie);
 #ifdef CONFIG_TDLS_TESTING
 		if (tdls_testing & TDLS_TESTING_LONG_FRAME)
-			ielen += 170;
+			ielen += TDLS_TESTING_LONG_FRAME_LEN;
 #endif /* CONFIG_TDLS_TESTING */
 	}
 
@@ -674,7 +841,7 @@ int wpa_tdls_recv_teardown_notify(struct wpa_sm *sm, const u8 *addr,
 	if (tdls_testing & TDLS_TESTING_LONG_FRAME) {
 		wpa_printf(MSG_DEBUG, "TDLS: Testing - add extra subelem to "
 			   "FTIE");
-		ftie->ie_len += 170;
+		ftie->ie_len += TDLS_TESTING_LONG_FRAME_LEN;
 		*pos++ = 255; /* FTIE subelem */
 		*pos++ = 168; /* FTIE subelem length */
 	}
@@ -717,10 +884,7 @@ static int wpa_tdls_recv_teardown(struct wpa_sm *sm, const u8 *src_addr,
 	int ielen;
 
 	/* Find the node and free from the list */
-	for (peer = sm->tdls; peer; peer = peer->next) {
-		if (os_memcmp(peer->addr, src_addr, ETH_ALEN) == 0)
-			break;
-	}
+	peer = wpa_tdls_get_peer(sm, src_addr);
 
 	if (peer == NULL) {
 		wpa_printf(MSG_INFO, "TDLS: No matching entry found for "
@@ -889,7 +1053,7 @@ skip_rsnie:
 #ifdef CONFIG_TDLS_TESTING
 	if (wpa_tdls_get_privacy(sm) &&
 	    (tdls_testing & TDLS_TESTING_LONG_FRAME))
-		buf_len += 170;
+		buf_len += TDLS_TESTING_LONG_FRAME_LEN;
 	if (tdls_testing & TDLS_TESTING_DIFF_BSSID)
 		buf_len += sizeof(struct wpa_tdls_lnkid);
 #endif /* CONFIG_TDLS_TESTING */
@@ -930,7 +1094,7 @@ skip_rsnie:
 	if (tdls_testing & TDLS_TESTING_LONG_FRAME) {
 		wpa_printf(MSG_DEBUG, "TDLS: Testing - add extra subelem to "
 			   "FTIE");
-		ftie->ie_len += 170;
+		ftie->ie_len += TDLS_TESTING_LONG_FRAME_LEN;
 		*pos++ = 255; /* FTIE subelem */
 		*pos++ = 168; /* FTIE subelem length */
 		pos += 168;
@@ -999,7 +1163,7 @@ static int wpa_tdls_send_tpk_m2(struct wpa_sm *sm,
 			sizeof(struct wpa_tdls_timeoutie);
 #ifdef CONFIG_TDLS_TESTING
 		if (tdls_testing & TDLS_TESTING_LONG_FRAME)
-			buf_len += 170;
+			buf_len += TDLS_TESTING_LONG_FRAME_LEN;
 #endif /* CONFIG_TDLS_TESTING */
 	}
 
@@ -1029,7 +1193,7 @@ static int wpa_tdls_send_tpk_m2(struct wpa_sm *sm,
 	if (tdls_testing & TDLS_TESTING_LONG_FRAME) {
 		wpa_printf(MSG_DEBUG, "TDLS: Testing - add extra subelem to "
 			   "FTIE");
-		ftie->ie_len += 170;
+		ftie->ie_len += TDLS_TESTING_LONG_FRAME_LEN;
 		*pos++ = 255; /* FTIE subelem */
 		*pos++ = 168; /* FTIE subelem length */
 		pos += 168;
@@ -1082,7 +1246,7 @@ static int wpa_tdls_send_tpk_m3(struct wpa_sm *sm,
 			sizeof(struct wpa_tdls_timeoutie);
 #ifdef CONFIG_TDLS_TESTING
 		if (tdls_testing & TDLS_TESTING_LONG_FRAME)
-			buf_len += 170;
+			buf_len += TDLS_TESTING_LONG_FRAME_LEN;
 #endif /* CONFIG_TDLS_TESTING */
 	}
 
@@ -1110,7 +1274,7 @@ static int wpa_tdls_send_tpk_m3(struct wpa_sm *sm,
 	if (tdls_testing & TDLS_TESTING_LONG_FRAME) {
 		wpa_printf(MSG_DEBUG, "TDLS: Testing - add extra subelem to "
 			   "FTIE");
-		ftie->ie_len += 170;
+		ftie->ie_len += TDLS_TESTING_LONG_FRAME_LEN;
 		*pos++ = 255; /* FTIE subelem */
 		*pos++ = 168; /* FTIE subelem length */
 		pos += 168;
@@ -1205,17 +1369,11 @@ static int wpa_tdls_process_tpk_m1(struct wpa_sm *sm, const u8 *src_addr,
 
 #ifdef CONFIG_TDLS_TESTING
 	if (tdls_testing & TDLS_TESTING_CONCURRENT_INIT) {
-		for (peer = sm->tdls; peer; peer = peer->next) {
-			if (os_memcmp(peer->addr, src_addr, ETH_ALEN) == 0)
-				break;
-		}
+		peer = wpa_tdls_get_peer(sm, src_addr);
 		if (peer == NULL) {
-			peer = os_zalloc(sizeof(*peer));
+			peer = wpa_tdls_add_peer(sm, src_addr);
 			if (peer == NULL)
 				goto error;
-			os_memcpy(peer->addr, src_addr, ETH_ALEN);
-			peer->next = sm->tdls;
-			sm->tdls = peer;
 		}
 		wpa_printf(MSG_DEBUG, "TDLS: Testing concurrent initiation of "
 			   "TDLS setup - send own request");
@@ -1305,22 +1463,12 @@ skip_rsn:
 	/* Find existing entry and if found, use that instead of adding
 	 * a new one; how to handle the case where both ends initiate at the
 	 * same time? */
-	for (peer = sm->tdls; peer; peer = peer->next) {
-		if (os_memcmp(peer->addr, src_addr, ETH_ALEN) == 0)
-			break;
-	}
+	peer = wpa_tdls_get_peer(sm, src_addr);
 
 	if (peer == NULL) {
-		wpa_printf(MSG_INFO, "TDLS: No matching entry found for "
-			   "peer, creating one for " MACSTR,
-			   MAC2STR(src_addr));
-		peer = os_malloc(sizeof(*peer));
+		peer = wpa_tdls_add_peer(sm, src_addr);
 		if (peer == NULL)
 			goto error;
-		os_memset(peer, 0, sizeof(*peer));
-		os_memcpy(peer->addr, src_addr, ETH_ALEN);
-		peer->next = sm->tdls;
-		sm->tdls = peer;
 	} else {
 		if (peer->tpk_success) {
 			wpa_printf(MSG_DEBUG, "TDLS: TDLS Setup Request while "
@@ -1448,22 +1596,25 @@ error:
 static void wpa_tdls_enable_link(struct wpa_sm *sm, struct wpa_tdls_peer *peer)
 {
 	peer->tpk_success = 1;
-	eloop_cancel_timeout(wpa_tdls_tpk_timeout, sm, peer);
+	peer->tpk_expire.sec = peer->tpk_expire.usec = 0;
 	if (wpa_tdls_get_privacy(sm)) {
 		u32 lifetime = peer->lifetime;
+		struct os_time now;
 		/*
 		 * Start the initiator process a bit earlier to avoid race
 		 * condition with the responder sending teardown request.
 		 */
 		if (lifetime > 3 && peer->initiator)
 			lifetime -= 3;
-		eloop_register_timeout(lifetime, 0, wpa_tdls_tpk_timeout,
-				       sm, peer);
+		os_get_time(&now);
+		peer->tpk_expire.sec = now.sec + lifetime;
+		peer->tpk_expire.usec = now.usec;
+		wpa_tdls_tpk_timer(sm, &peer->tpk_expire, &now);
 #ifdef CONFIG_TDLS_TESTING
 	if (tdls_testing & TDLS_TESTING_NO_TPK_EXPIRATION) {
 		wpa_printf(MSG_DEBUG, "TDLS: Testing - disable TPK "
 			   "expiration");
-		eloop_cancel_timeout(wpa_tdls_tpk_timeout, sm, peer);
+		peer->tpk_expire.sec = peer->tpk_expire.usec = 0;
 	}
 #endif /* CONFIG_TDLS_TESTING */
 	}
@@ -1489,10 +1640,7 @@ static int wpa_tdls_process_tpk_m2(struct wpa_sm *sm, const u8 *src_addr,
 
 	wpa_printf(MSG_DEBUG, "TDLS: Received TDLS Setup Response / TPK M2 "
 		   "(Peer " MACSTR ")", MAC2STR(src_addr));
-	for (peer = sm->tdls; peer; peer = peer->next) {
-		if (os_memcmp(peer->addr, src_addr, ETH_ALEN) == 0)
-			break;
-	}
+	peer = wpa_tdls_get_peer(sm, src_addr);
 	if (peer == NULL) {
 		wpa_printf(MSG_INFO, "TDLS: No matching peer found for "
 			   "TPK M2: " MACSTR, MAC2STR(src_addr));
@@ -1682,10 +1830,7 @@ static int wpa_tdls_process_tpk_m3(struct wpa_sm *sm, const u8 *src_addr,
 
 	wpa_printf(MSG_DEBUG, "TDLS: Received TDLS Setup Confirm / TPK M3 "
 		   "(Peer " MACSTR ")", MAC2STR(src_addr));
-	for (peer = sm->tdls; peer; peer = peer->next) {
-		if (os_memcmp(peer->addr, src_addr, ETH_ALEN) == 0)
-			break;
-	}
+	peer = wpa_tdls_get_peer(sm, src_addr);
 	if (peer == NULL) {
 		wpa_printf(MSG_INFO, "TDLS: No matching peer found for "
 			   "TPK M3: " MACSTR, MAC2STR(src_addr));
@@ -1843,21 +1988,12 @@ int wpa_tdls_start(struct wpa_sm *sm, const u8 *addr)
 
 	/* Find existing entry and if found, use that instead of adding
 	 * a new one */
-	for (peer = sm->tdls; peer; peer = peer->next) {
-		if (os_memcmp(peer->addr, addr, ETH_ALEN) == 0)
-			break;
-	}
+	peer = wpa_tdls_get_peer(sm, addr);
 
 	if (peer == NULL) {
-		wpa_printf(MSG_INFO, "TDLS: No matching entry found for "
-			   "peer, creating one for " MACSTR, MAC2STR(addr));
-		peer = os_malloc(sizeof(*peer));
+		peer = wpa_tdls_add_peer(sm, addr);
 		if (peer == NULL)
 			return -1;
-		os_memset(peer, 0, sizeof(*peer));
-		os_memcpy(peer->addr, addr, ETH_ALEN);
-		peer->next = sm->tdls;
-		sm->tdls = peer;
 	}
 
 	peer->initiator = 1;
@@ -1873,10 +2009,7 @@ int wpa_tdls_reneg(struct wpa_sm *sm, const u8 *addr)
 	if (sm->tdls_disabled)
 		return -1;
 
-	for (peer = sm->tdls; peer; peer = peer->next) {
-		if (os_memcmp(peer->addr, addr, ETH_ALEN) == 0)
-			break;
-	}
+	peer = wpa_tdls_get_peer(sm, addr);
 
 	if (peer == NULL || !peer->tpk_success)
 		return -1;
@@ -1969,6 +2102,8 @@ int wpa_tdls_init(struct wpa_sm *sm)
 		return -1;
 	}
 
+	dl_list_init(&sm->tdls_retry);
+
 	return 0;
 }
 
@@ -1979,6 +2114,7 @@ static void wpa_tdls_remove_peers(struct wpa_sm *sm)
 
 	peer = sm->tdls;
 	sm->tdls = NULL;
+	os_memset(sm->tdls_hash, 0, sizeof(sm->tdls_hash));
 
 	while (peer) {
 		int res;
@@ -1990,6 +2126,11 @@ static void wpa_tdls_remove_peers(struct wpa_sm *sm)
 		os_free(peer);
 		peer = tmp;
 	}
+
+	eloop_cancel_timeout(wpa_tdls_tpk_retry_timeout, sm, NULL);
+	sm->tdls_retry_timer = 0;
+	eloop_cancel_timeout(wpa_tdls_tpk_timeout, sm, NULL);
+	sm->tdls_tpk_next.sec = sm->tdls_tpk_next.usec = 0;
 }
 
 
@@ -2042,7 +2042,6 @@ struct wpa_sm * wpa_sm_init(struct wpa_sm_ctx *ctx)
 	sm = os_zalloc(sizeof(*sm));
 	if (sm == NULL)
 		return NULL;
-	dl_list_init(&sm->pmksa_candidates);
 	sm->renew_snonce = 1;
 	sm->ctx = ctx;
 
@@ -2146,11 +2145,14 @@ void wpa_sm_notify_assoc(struct wpa_sm *sm, const u8 *bssid)
  * @sm: Pointer to WPA state machine data from wpa_sm_init()
  *
  * This function is called to let WPA state machine know that the connection
- * was lost. This will abort any existing pre-authentication session.
+ * was lost. This will abort any existing pre-authentication session and clear
+ * the PMKSA candidates so that they are collected again for the next
+ * association.
  */
 void wpa_sm_notify_disassoc(struct wpa_sm *sm)
 {
 	rsn_preauth_deinit(sm);
+	pmksa_candidate_free(sm);
 	if (wpa_sm_get_state(sm) == WPA_4WAY_HANDSHAKE)
 		sm->dot11RSNA4WayHandshakeFailures++;
 #ifdef CONFIG_TDLS
@@ -2243,9 +2245,12 @@ void wpa_sm_set_scard_ctx(struct wpa_sm *sm, void *scard_ctx)
  */
 void wpa_sm_set_config(struct wpa_sm *sm, struct rsn_supp_config *config)
 {
+	void *old_network_ctx;
+
 	if (!sm)
 		return;
 
+	old_network_ctx = sm->network_ctx;
 	if (config) {
 		sm->network_ctx = config->network_ctx;
 		sm->peerkey_enabled = config->peerkey_enabled;
@@ -2271,6 +2276,8 @@ void wpa_sm_set_config(struct wpa_sm *sm, struct rsn_supp_config *config)
 	}
 	if (config == NULL || config->network_ctx != sm->network_ctx)
 		pmksa_cache_notify_reconfig(sm->pmksa);
+	if (sm->network_ctx != old_network_ctx)
+		pmksa_candidate_free(sm);
 }
 
 
@@ -18,9 +18,12 @@
 #include "utils/list.h"
 
 struct wpa_peerkey;
+struct rsn_pmksa_candidates;
 struct wpa_tdls_peer;
 struct wpa_eapol_key;
 
+#define TDLS_PEER_HASH_SIZE 256
+
 /**
  * struct wpa_sm - Internal WPA state machine data
  */
@@ -40,7 +43,7 @@ struct wpa_sm {
 
 	struct rsn_pmksa_cache *pmksa; /* PMKSA cache */
 	struct rsn_pmksa_cache_entry *cur_pmksa; /* current PMKSA entry */
-	struct dl_list pmksa_candidates;
+	struct rsn_pmksa_candidates *pmksa_candidates; /* preauth.c */
 
 	struct l2_packet_data *l2_preauth;
 	struct l2_packet_data *l2_preauth_br;
@@ -96,6 +99,10 @@ struct wpa_sm {
 #endif /* CONFIG_PEERKEY */
 #ifdef CONFIG_TDLS
 	struct wpa_tdls_peer *tdls;
+	struct wpa_tdls_peer *tdls_hash[TDLS_PEER_HASH_SIZE];
+	struct dl_list tdls_retry; /* peers waiting for TPK M1/M2 response */
+	int tdls_retry_timer; /* retry timer registered */
+	struct os_time tdls_tpk_next; /* next TPK lifetime expiration */
 	int tdls_prohibited;
 	int tdls_disabled;
 #endif /* CONFIG_TDLS */
@@ -343,7 +343,7 @@ static int tls_process_certificate(struct tlsv1_client *conn, u8 ct,
 			}
 		}
 
-		cert = x509_certificate_parse(pos, cert_len);
+		cert = x509_certificate_parse_cached(pos, cert_len);
 		if (cert == NULL) {
 			wpa_printf(MSG_DEBUG, "TLSv1: Failed to parse "
 				   "the certificate");
@@ -155,7 +155,7 @@ int tls_parse_cert(const u8 *buf, size_t len, struct crypto_public_key **pk)
 	if (*pk)
 		return 0;
 
-	cert = x509_certificate_parse(buf, len);
+	cert = x509_certificate_parse_cached(buf, len);
 	if (cert == NULL) {
 		wpa_printf(MSG_DEBUG, "TLSv1: Failed to parse X.509 "
 			   "certificate");
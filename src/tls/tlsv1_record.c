@@ -134,27 +134,37 @@ int tlsv1_record_change_read_cipher(struct tlsv1_record_layer *rl)
 }
 
 
+/*
+ * Block cipher records are processed in chunks that stay in the CPU cache
+ * between adding the plaintext to the HMAC and encrypting it in place.
+ */
+#define TLS_RECORD_CHUNK_LEN 1024
+
+
 /**
  * tlsv1_record_send - TLS record layer: Send a message
  * @rl: Pointer to TLS record layer data
  * @content_type: Content type (TLS_CONTENT_TYPE_*)
  * @buf: Buffer to send (with TLS_RECORD_HEADER_LEN octets reserved in the
  * beginning for record layer to fill in; payload filled in after this and
- * extra space in the end for HMAC).
+ * extra space in the end for HMAC and padding).
  * @buf_size: Maximum buf size
  * @payload_len: Length of the payload
  * @out_len: Buffer for returning the used buf length
  * Returns: 0 on success, -1 on failure
  *
  * This function fills in the TLS record layer header, adds HMAC, and encrypts
- * the data using the current write cipher.
+ * the data using the current write cipher. The record is built in place in
+ * buf, so the caller should write the payload directly after the reserved
+ * header instead of copying it there. With a block cipher, the payload is
+ * added to the HMAC and encrypted in a single pass.
  */
 int tlsv1_record_send(struct tlsv1_record_layer *rl, u8 content_type, u8 *buf,
 		      size_t buf_size, size_t payload_len, size_t *out_len)
 {
 	u8 *pos, *ct_start, *length, *payload;
 	struct crypto_hash *hmac;
-	size_t clen;
+	size_t clen, done, chunk, pad = 0;
 
 	pos = buf;
 	/* ContentType type */
@@ -173,6 +183,22 @@ int tlsv1_record_send(struct tlsv1_record_layer *rl, u8 content_type, u8 *buf,
 	pos += payload_len;
 
 	if (rl->write_cipher_suite != TLS_NULL_WITH_NULL_NULL) {
+		if ((size_t) (buf + buf_size - pos) < rl->hash_size) {
+			wpa_printf(MSG_DEBUG, "TLSv1: Record Layer - Not "
+				   "enough room for MAC");
+			return -1;
+		}
+		if (rl->iv_size) {
+			pad = (payload_len + rl->hash_size + 1) % rl->iv_size;
+			if (pad)
+				pad = rl->iv_size - pad;
+			if (pos + rl->hash_size + pad + 1 > buf + buf_size) {
+				wpa_printf(MSG_DEBUG, "TLSv1: No room for "
+					   "block cipher padding");
+				return -1;
+			}
+		}
+
 		hmac = crypto_hash_init(rl->hash_alg, rl->write_mac_secret,
 					rl->hash_size);
 		if (hmac == NULL) {
@@ -182,15 +208,33 @@ int tlsv1_record_send(struct tlsv1_record_layer *rl, u8 content_type, u8 *buf,
 		}
 		crypto_hash_update(hmac, rl->write_seq_num, TLS_SEQ_NUM_LEN);
 		/* type + version + length + fragment */
-		crypto_hash_update(hmac, ct_start, pos - ct_start);
-		clen = buf + buf_size - pos;
-		if (clen < rl->hash_size) {
-			wpa_printf(MSG_DEBUG, "TLSv1: Record Layer - Not "
-				   "enough room for MAC");
-			crypto_hash_finish(hmac, NULL, NULL);
-			return -1;
+		crypto_hash_update(hmac, ct_start, payload - ct_start);
+
+		/*
+		 * Stream ciphers are run in a single call below since some
+		 * implementations (e.g., the internal RC4) regenerate the key
+		 * stream from the beginning on each call.
+		 */
+		done = 0;
+		while (rl->iv_size) {
+			chunk = payload_len - done;
+			if (chunk > TLS_RECORD_CHUNK_LEN)
+				chunk = TLS_RECORD_CHUNK_LEN;
+			chunk -= chunk % rl->iv_size;
+			if (chunk == 0)
+				break;
+			crypto_hash_update(hmac, payload + done, chunk);
+			if (crypto_cipher_encrypt(rl->write_cbc,
+						  payload + done,
+						  payload + done, chunk) < 0) {
+				crypto_hash_finish(hmac, NULL, NULL);
+				return -1;
+			}
+			done += chunk;
 		}
+		crypto_hash_update(hmac, payload + done, payload_len - done);
 
+		clen = rl->hash_size;
 		if (crypto_hash_finish(hmac, pos, &clen) < 0) {
 			wpa_printf(MSG_DEBUG, "TLSv1: Record Layer - Failed "
 				   "to calculate HMAC");
@@ -200,22 +244,13 @@ int tlsv1_record_send(struct tlsv1_record_layer *rl, u8 content_type, u8 *buf,
 			    pos, clen);
 		pos += clen;
 		if (rl->iv_size) {
-			size_t len = pos - payload;
-			size_t pad;
-			pad = (len + 1) % rl->iv_size;
-			if (pad)
-				pad = rl->iv_size - pad;
-			if (pos + pad + 1 > buf + buf_size) {
-				wpa_printf(MSG_DEBUG, "TLSv1: No room for "
-					   "block cipher padding");
-				return -1;
-			}
 			os_memset(pos, pad, pad + 1);
 			pos += pad + 1;
 		}
 
-		if (crypto_cipher_encrypt(rl->write_cbc, payload,
-					  payload, pos - payload) < 0)
+		if (crypto_cipher_encrypt(rl->write_cbc, payload + done,
+					  payload + done,
+					  pos - payload - done) < 0)
 			return -1;
 	}
 
@@ -240,7 +275,9 @@ int tlsv1_record_send(struct tlsv1_record_layer *rl, u8 content_type, u8 *buf,
  * Returns: 0 on success, -1 on failure
  *
  * This function decrypts the received message, verifies HMAC and TLS record
- * layer header.
+ * layer header. The record is decrypted directly into out_data. If the caller
+ * owns a writable copy of the record, out_data can point to in_data +
+ * TLS_RECORD_HEADER_LEN to process the record in place.
  */
 int tlsv1_record_receive(struct tlsv1_record_layer *rl,
 			 const u8 *in_data, size_t in_len,
@@ -312,11 +349,14 @@ int tlsv1_record_receive(struct tlsv1_record_layer *rl,
 		return -1;
 	}
 
-	os_memcpy(out_data, in_data, in_len);
 	*out_len = in_len;
 
-	if (rl->read_cipher_suite != TLS_NULL_WITH_NULL_NULL) {
-		if (crypto_cipher_decrypt(rl->read_cbc, out_data,
+	if (rl->read_cipher_suite == TLS_NULL_WITH_NULL_NULL) {
+		if (out_data != in_data)
+			os_memmove(out_data, in_data, in_len);
+	} else {
+		/* Decrypt directly from the received record */
+		if (crypto_cipher_decrypt(rl->read_cbc, in_data,
 					  out_data, in_len) < 0) {
 			*alert = TLS_ALERT_DECRYPTION_FAILED;
 			return -1;
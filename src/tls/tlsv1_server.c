@@ -17,6 +17,7 @@
 #include "common.h"
 #include "crypto/sha1.h"
 #include "crypto/tls.h"
+#include "x509v3.h"
 #include "tlsv1_common.h"
 #include "tlsv1_record.h"
 #include "tlsv1_server.h"
@@ -296,6 +297,7 @@ int tlsv1_server_global_init(void)
  */
 void tlsv1_server_global_deinit(void)
 {
+	x509_certificate_cache_flush();
 	crypto_global_deinit();
 }
 
@@ -15,6 +15,7 @@
 #include "includes.h"
 
 #include "common.h"
+#include "utils/list.h"
 #include "crypto/crypto.h"
 #include "asn1.h"
 #include "x509v3.h"
@@ -1469,16 +1470,8 @@ static int x509_sha256_oid(struct asn1_oid *oid)
 }
 
 
-/**
- * x509_certificate_parse - Parse a X.509 certificate in DER format
- * @buf: Pointer to the X.509 certificate in DER format
- * @len: Buffer length
- * Returns: Pointer to the parsed certificate or %NULL on failure
- *
- * Caller is responsible for freeing the returned certificate by calling
- * x509_certificate_free().
- */
-struct x509_certificate * x509_certificate_parse(const u8 *buf, size_t len)
+static struct x509_certificate *
+x509_certificate_parse_der(const u8 *buf, size_t len, const u8 *hash)
 {
 	struct asn1_hdr hdr;
 	const u8 *pos, *end, *hash_start;
@@ -1490,6 +1483,7 @@ struct x509_certificate * x509_certificate_parse(const u8 *buf, size_t len)
 	os_memcpy(cert + 1, buf, len);
 	cert->cert_start = (u8 *) (cert + 1);
 	cert->cert_len = len;
+	os_memcpy(cert->hash, hash, X509_CERT_HASH_LEN);
 
 	pos = buf;
 	end = buf + len;
@@ -1577,6 +1571,266 @@ struct x509_certificate * x509_certificate_parse(const u8 *buf, size_t len)
 }
 
 
+/**
+ * x509_certificate_parse - Parse a X.509 certificate in DER format
+ * @buf: Pointer to the X.509 certificate in DER format
+ * @len: Buffer length
+ * Returns: Pointer to the parsed certificate or %NULL on failure
+ *
+ * Caller is responsible for freeing the returned certificate by calling
+ * x509_certificate_free().
+ */
+struct x509_certificate * x509_certificate_parse(const u8 *buf, size_t len)
+{
+	u8 hash[X509_CERT_HASH_LEN];
+
+	sha256_vector(1, &buf, &len, hash);
+	return x509_certificate_parse_der(buf, len, hash);
+}
+
+
+static int x509_copy_str(char **dst, const char *src)
+{
+	if (src == NULL)
+		return 0;
+	*dst = os_strdup(src);
+	return *dst == NULL ? -1 : 0;
+}
+
+
+static int x509_copy_bin(u8 **dst, const u8 *src, size_t len)
+{
+	if (src == NULL)
+		return 0;
+	*dst = os_malloc(len);
+	if (*dst == NULL)
+		return -1;
+	os_memcpy(*dst, src, len);
+	return 0;
+}
+
+
+/* dst must have been cleared; on failure, x509_free_name() frees the copy */
+static int x509_copy_name(struct x509_name *dst, const struct x509_name *src)
+{
+	size_t i;
+
+	for (i = 0; i < src->num_attr; i++) {
+		dst->attr[i].type = src->attr[i].type;
+		dst->num_attr++;
+		if (x509_copy_str(&dst->attr[i].value, src->attr[i].value))
+			return -1;
+	}
+	dst->ip_len = src->ip_len;
+	os_memcpy(&dst->rid, &src->rid, sizeof(dst->rid));
+
+	if (x509_copy_str(&dst->email, src->email) ||
+	    x509_copy_str(&dst->alt_email, src->alt_email) ||
+	    x509_copy_str(&dst->dns, src->dns) ||
+	    x509_copy_str(&dst->uri, src->uri) ||
+	    x509_copy_bin(&dst->ip, src->ip, src->ip_len))
+		return -1;
+
+	return 0;
+}
+
+
+static struct x509_certificate *
+x509_certificate_copy(const struct x509_certificate *src)
+{
+	struct x509_certificate *cert;
+
+	cert = os_malloc(sizeof(*cert) + src->cert_len);
+	if (cert == NULL)
+		return NULL;
+	os_memcpy(cert, src, sizeof(*cert) + src->cert_len);
+	cert->next = NULL;
+	cert->cert_start = (u8 *) (cert + 1);
+	cert->tbs_cert_start = cert->cert_start +
+		(src->tbs_cert_start - src->cert_start);
+
+	/* Replace the pointers to the memory owned by src with copies */
+	os_memset(&cert->issuer, 0, sizeof(cert->issuer));
+	os_memset(&cert->subject, 0, sizeof(cert->subject));
+	cert->public_key = NULL;
+	cert->sign_value = NULL;
+	if (x509_copy_name(&cert->issuer, &src->issuer) ||
+	    x509_copy_name(&cert->subject, &src->subject) ||
+	    x509_copy_bin(&cert->public_key, src->public_key,
+			  src->public_key_len) ||
+	    x509_copy_bin(&cert->sign_value, src->sign_value,
+			  src->sign_value_len)) {
+		x509_certificate_free(cert);
+		return NULL;
+	}
+
+	return cert;
+}
+
+
+/*
+ * Cache of parsed certificates
+ *
+ * The same CA certificates are received in practically every handshake, so
+ * the parsed certificates are kept here together with the issuer (if any)
+ * that has already been verified to have signed the certificate. Entries are
+ * identified by the SHA-256 hash of the DER encoding and are used only within
+ * the validity period of the certificates.
+ */
+
+#define X509_CACHE_MAX_ENTRIES 20
+
+struct x509_cache_entry {
+	struct dl_list list; /* most recently used entry first */
+	struct x509_certificate *cert;
+
+	/* Issuer whose signature on cert has been verified */
+	int issuer_verified;
+	u8 issuer_hash[X509_CERT_HASH_LEN];
+	os_time_t issuer_not_after;
+};
+
+static struct dl_list x509_cache = { &x509_cache, &x509_cache };
+static unsigned int x509_cache_entries;
+static unsigned int x509_cache_hits, x509_cache_misses, x509_cache_sig_hits;
+
+
+static int x509_time_valid(const struct x509_certificate *cert,
+			   struct os_time *now)
+{
+	return (unsigned long) now->sec >= (unsigned long) cert->not_before &&
+		(unsigned long) now->sec <= (unsigned long) cert->not_after;
+}
+
+
+static void x509_cache_entry_free(struct x509_cache_entry *e)
+{
+	dl_list_del(&e->list);
+	x509_certificate_free(e->cert);
+	os_free(e);
+	x509_cache_entries--;
+}
+
+
+static struct x509_cache_entry * x509_cache_get(const u8 *hash,
+						struct os_time *now)
+{
+	struct x509_cache_entry *e;
+
+	dl_list_for_each(e, &x509_cache, struct x509_cache_entry, list) {
+		if (os_memcmp(e->cert->hash, hash, X509_CERT_HASH_LEN) != 0)
+			continue;
+		if (!x509_time_valid(e->cert, now)) {
+			wpa_printf(MSG_DEBUG, "X509: Remove cached certificate "
+				   "that is not within its validity period");
+			x509_cache_entry_free(e);
+			return NULL;
+		}
+		dl_list_del(&e->list);
+		dl_list_add(&x509_cache, &e->list);
+		return e;
+	}
+
+	return NULL;
+}
+
+
+static void x509_cache_add(struct x509_certificate *cert)
+{
+	struct x509_cache_entry *e, *victim = NULL;
+
+	if (x509_cache_entries >= X509_CACHE_MAX_ENTRIES) {
+		/*
+		 * Evict the least recently used end entity certificate, if
+		 * any, so that a stream of different client certificates does
+		 * not push out the CA certificates shared by all of them.
+		 */
+		dl_list_for_each_reverse(e, &x509_cache,
+					 struct x509_cache_entry, list) {
+			if (!e->cert->ca) {
+				victim = e;
+				break;
+			}
+		}
+		if (victim == NULL)
+			victim = dl_list_last(&x509_cache,
+					      struct x509_cache_entry, list);
+		x509_cache_entry_free(victim);
+	}
+
+	e = os_zalloc(sizeof(*e));
+	if (e == NULL) {
+		x509_certificate_free(cert);
+		return;
+	}
+	e->cert = cert;
+	dl_list_add(&x509_cache, &e->list);
+	x509_cache_entries++;
+}
+
+
+/**
+ * x509_certificate_parse_cached - Parse a X.509 certificate using the cache
+ * @buf: Pointer to the X.509 certificate in DER format
+ * @len: Buffer length
+ * Returns: Pointer to the parsed certificate or %NULL on failure
+ *
+ * This is like x509_certificate_parse(), but a copy of a previously parsed
+ * certificate is returned if the same certificate is found in the cache. A
+ * certificate parsed within its validity period is added to the cache.
+ * x509_certificate_chain_validate() uses the cache entries to avoid verifying
+ * the same signature again. Caller is responsible for freeing the returned
+ * certificate by calling x509_certificate_free().
+ */
+struct x509_certificate * x509_certificate_parse_cached(const u8 *buf,
+							size_t len)
+{
+	u8 hash[X509_CERT_HASH_LEN];
+	struct x509_cache_entry *e;
+	struct x509_certificate *cert, *copy;
+	struct os_time now;
+
+	sha256_vector(1, &buf, &len, hash);
+	os_get_time(&now);
+
+	e = x509_cache_get(hash, &now);
+	if (e) {
+		x509_cache_hits++;
+		return x509_certificate_copy(e->cert);
+	}
+	x509_cache_misses++;
+
+	cert = x509_certificate_parse_der(buf, len, hash);
+	if (cert == NULL || !x509_time_valid(cert, &now))
+		return cert;
+
+	copy = x509_certificate_copy(cert);
+	if (copy)
+		x509_cache_add(copy);
+
+	return cert;
+}
+
+
+/**
+ * x509_certificate_cache_flush - Remove all entries from the certificate cache
+ */
+void x509_certificate_cache_flush(void)
+{
+	struct x509_cache_entry *e, *n;
+
+	if (x509_cache_hits || x509_cache_misses)
+		wpa_printf(MSG_DEBUG, "X509: Certificate cache: %u hits, %u "
+			   "misses, %u signature verifications skipped",
+			   x509_cache_hits, x509_cache_misses,
+			   x509_cache_sig_hits);
+
+	dl_list_for_each_safe(e, n, &x509_cache, struct x509_cache_entry,
+			      list)
+		x509_cache_entry_free(e);
+	x509_cache_hits = x509_cache_misses = x509_cache_sig_hits = 0;
+}
+
 /**
  * x509_certificate_check_signature - Verify certificate signature
  * @issuer: Issuer certificate
@@ -1797,6 +2051,35 @@ skip_digest_oid:
 }
 
 
+static int x509_check_signature_cached(struct x509_certificate *issuer,
+				       struct x509_certificate *cert,
+				       struct os_time *now)
+{
+	struct x509_cache_entry *e;
+
+	e = x509_cache_get(cert->hash, now);
+	if (e && e->issuer_verified &&
+	    (unsigned long) now->sec <= (unsigned long) e->issuer_not_after &&
+	    os_memcmp(e->issuer_hash, issuer->hash, X509_CERT_HASH_LEN) == 0) {
+		wpa_printf(MSG_DEBUG, "X509: Certificate signature already "
+			   "verified with the same issuer certificate");
+		x509_cache_sig_hits++;
+		return 0;
+	}
+
+	if (x509_certificate_check_signature(issuer, cert) < 0)
+		return -1;
+
+	if (e && x509_time_valid(issuer, now)) {
+		e->issuer_verified = 1;
+		os_memcpy(e->issuer_hash, issuer->hash, X509_CERT_HASH_LEN);
+		e->issuer_not_after = issuer->not_after;
+	}
+
+	return 0;
+}
+
+
 static int x509_valid_issuer(const struct x509_certificate *cert)
 {
 	if ((cert->extensions_present & X509_EXT_BASIC_CONSTRAINTS) &&
@@ -1831,6 +2114,9 @@ static int x509_valid_issuer(const struct x509_certificate *cert)
  * signed by the second certificate in the chain and so on)
  * @reason: Buffer for returning failure reason (X509_VALIDATE_*)
  * Returns: 0 if chain is valid, -1 if not
+ *
+ * Signatures that have already been verified for certificates in the cache
+ * (see x509_certificate_parse_cached()) are not verified again.
  */
 int x509_certificate_chain_validate(struct x509_certificate *trusted,
 				    struct x509_certificate *chain,
@@ -1899,8 +2185,8 @@ int x509_certificate_chain_validate(struct x509_certificate *trusted,
 				return -1;
 			}
 
-			if (x509_certificate_check_signature(cert->next, cert)
-			    < 0) {
+			if (x509_check_signature_cached(cert->next, cert,
+							&now) < 0) {
 				wpa_printf(MSG_DEBUG, "X509: Invalid "
 					   "certificate signature within "
 					   "chain");
@@ -1923,8 +2209,8 @@ int x509_certificate_chain_validate(struct x509_certificate *trusted,
 				return -1;
 			}
 
-			if (x509_certificate_check_signature(trust, cert) < 0)
-			{
+			if (x509_check_signature_cached(trust, cert, &now) <
+			    0) {
 				wpa_printf(MSG_DEBUG, "X509: Invalid "
 					   "certificate signature");
 				*reason = X509_VALIDATE_BAD_CERTIFICATE;
@@ -36,6 +36,7 @@ struct x509_name_attr {
 };
 
 #define X509_MAX_NAME_ATTRIBUTES 20
+#define X509_CERT_HASH_LEN 32
 
 struct x509_name {
 	struct x509_name_attr attr[X509_MAX_NAME_ATTRIBUTES];
@@ -99,6 +100,9 @@ struct x509_certificate {
 	size_t cert_len;
 	const u8 *tbs_cert_start;
 	size_t tbs_cert_len;
+
+	/* SHA-256 hash of the DER format certificate */
+	u8 hash[X509_CERT_HASH_LEN];
 };
 
 enum {
@@ -113,6 +117,9 @@ enum {
 
 void x509_certificate_free(struct x509_certificate *cert);
 struct x509_certificate * x509_certificate_parse(const u8 *buf, size_t len);
+struct x509_certificate * x509_certificate_parse_cached(const u8 *buf,
+							size_t len);
+void x509_certificate_cache_flush(void);
 void x509_name_string(struct x509_name *name, char *buf, size_t len);
 int x509_name_compare(struct x509_name *a, struct x509_name *b);
 void x509_certificate_chain_free(struct x509_certificate *cert);
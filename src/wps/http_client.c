@@ -28,6 +28,7 @@ struct http_client {
 	struct sockaddr_in dst;
 	int sd;
 	struct wpabuf *req;
+	const struct wpabuf *req_body; /* optional, not owned */
 	size_t req_pos;
 	size_t max_response;
 
@@ -90,16 +91,41 @@ static void http_client_got_response(struct httpread *handle, void *cookie,
 static void http_client_tx_ready(int sock, void *eloop_ctx, void *sock_ctx)
 {
 	struct http_client *c = eloop_ctx;
-	int res;
+	struct iovec iov[2];
+	int iovcnt = 0;
+	size_t req_len, len, pos;
+	ssize_t res;
+
+	req_len = wpabuf_len(c->req);
+	len = req_len;
+	if (c->req_body)
+		len += wpabuf_len(c->req_body);
 
 	wpa_printf(MSG_DEBUG, "HTTP: Send client request to %s:%d (%lu of %lu "
 		   "bytes remaining)",
 		   inet_ntoa(c->dst.sin_addr), ntohs(c->dst.sin_port),
-		   (unsigned long) wpabuf_len(c->req),
-		   (unsigned long) wpabuf_len(c->req) - c->req_pos);
+		   (unsigned long) len - c->req_pos, (unsigned long) len);
+
+	/*
+	 * The request body (if separate) is sent directly from the caller's
+	 * buffer to avoid having to copy shared data into each request.
+	 */
+	pos = c->req_pos;
+	if (pos < req_len) {
+		iov[iovcnt].iov_base = (u8 *) wpabuf_head_u8(c->req) + pos;
+		iov[iovcnt].iov_len = req_len - pos;
+		iovcnt++;
+		pos = 0;
+	} else
+		pos -= req_len;
+	if (c->req_body && pos < wpabuf_len(c->req_body)) {
+		iov[iovcnt].iov_base = (u8 *) wpabuf_head_u8(c->req_body) +
+			pos;
+		iov[iovcnt].iov_len = wpabuf_len(c->req_body) - pos;
+		iovcnt++;
+	}
 
-	res = send(c->sd, wpabuf_head(c->req) + c->req_pos,
-		   wpabuf_len(c->req) - c->req_pos, 0);
+	res = writev(c->sd, iov, iovcnt);
 	if (res < 0) {
 		wpa_printf(MSG_DEBUG, "HTTP: Failed to send buffer: %s",
 			   strerror(errno));
@@ -108,12 +134,11 @@ static void http_client_tx_ready(int sock, void *eloop_ctx, void *sock_ctx)
 		return;
 	}
 
-	if ((size_t) res < wpabuf_len(c->req) - c->req_pos) {
+	if ((size_t) res < len - c->req_pos) {
 		wpa_printf(MSG_DEBUG, "HTTP: Sent %d of %lu bytes; %lu bytes "
 			   "remaining",
-			   res, (unsigned long) wpabuf_len(c->req),
-			   (unsigned long) wpabuf_len(c->req) - c->req_pos -
-			   res);
+			   (int) res, (unsigned long) len,
+			   (unsigned long) len - c->req_pos - res);
 		c->req_pos += res;
 		return;
 	}
@@ -123,6 +148,7 @@ static void http_client_tx_ready(int sock, void *eloop_ctx, void *sock_ctx)
 	eloop_unregister_sock(c->sd, EVENT_TYPE_WRITE);
 	wpabuf_free(c->req);
 	c->req = NULL;
+	c->req_body = NULL;
 
 	c->hread = httpread_create(c->sd, http_client_got_response, c,
 				   c->max_response, HTTP_CLIENT_TIMEOUT_SEC);
@@ -196,6 +222,94 @@ struct http_client * http_client_addr(struct sockaddr_in *dst,
 }
 
 
+/**
+ * http_client_set_req_body - Send request body from a separate buffer
+ * @c: HTTP client from http_client_addr() or http_client_reuse()
+ * @body: Request body to send after the request buffer
+ *
+ * This can be used to send the same data to multiple destinations without
+ * copying it into each request. The buffer is not freed by the HTTP client
+ * and it must remain valid until the callback function has been called or
+ * the client has been freed.
+ */
+void http_client_set_req_body(struct http_client *c,
+			      const struct wpabuf *body)
+{
+	c->req_body = body;
+}
+
+
+/**
+ * http_client_keep_alive - Check whether the connection can be reused
+ * @c: HTTP client that has reported HTTP_CLIENT_OK
+ * Returns: 1 if another request can be sent with http_client_reuse(), 0 if not
+ *
+ * The connection can be reused if the HTTP/1.1 reply did not request the
+ * connection to be closed and the end of the reply body was determined
+ * without the peer closing the connection.
+ */
+int http_client_keep_alive(struct http_client *c)
+{
+	char *hdr, *pos;
+
+	if (c->hread == NULL || c->sd < 0)
+		return 0;
+	hdr = httpread_hdr_get(c->hread);
+	if (os_strncmp(hdr, "HTTP/1.1", 8) != 0)
+		return 0;
+	pos = httpread_hdr_line_get(c->hread, "CONNECTION:");
+	if (pos && os_strncasecmp(pos, "close", 5) == 0)
+		return 0;
+	if (httpread_hdr_line_get(c->hread, "CONTENT-LENGTH:") == NULL &&
+	    httpread_hdr_line_get(c->hread, "TRANSFER-ENCODING:") == NULL)
+		return 0;
+	return 1;
+}
+
+
+/**
+ * http_client_reuse - Send a new request over an existing connection
+ * @c: HTTP client for which http_client_keep_alive() returned 1
+ * @req: HTTP request; this is freed by the HTTP client
+ * @max_response: Maximum length of the response body
+ * @cb: Callback function for the new request
+ * @cb_ctx: Context data for the callback function
+ * Returns: 0 on success, -1 on failure (req is freed on failure, too)
+ */
+int http_client_reuse(struct http_client *c, struct wpabuf *req,
+		      size_t max_response,
+		      void (*cb)(void *ctx, struct http_client *c,
+				 enum http_client_event event),
+		      void *cb_ctx)
+{
+	httpread_destroy(c->hread);
+	c->hread = NULL;
+	wpabuf_free(c->req);
+	c->req = req;
+	c->req_body = NULL;
+	c->req_pos = 0;
+	c->max_response = max_response;
+	c->cb = cb;
+	c->cb_ctx = cb_ctx;
+
+	wpa_printf(MSG_DEBUG, "HTTP: Reuse connection to %s:%d",
+		   inet_ntoa(c->dst.sin_addr), ntohs(c->dst.sin_port));
+
+	eloop_cancel_timeout(http_client_timeout, c, NULL);
+	if (eloop_register_sock(c->sd, EVENT_TYPE_WRITE, http_client_tx_ready,
+				c, NULL) ||
+	    eloop_register_timeout(HTTP_CLIENT_TIMEOUT_SEC, 0,
+				   http_client_timeout, c, NULL)) {
+		eloop_unregister_sock(c->sd, EVENT_TYPE_WRITE);
+		wpabuf_free(c->req);
+		c->req = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+
 char * http_client_url_parse(const char *url, struct sockaddr_in *dst,
 			     char **ret_path)
 {
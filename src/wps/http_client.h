@@ -38,6 +38,14 @@ struct http_client * http_client_url(const char *url,
 						struct http_client *c,
 						enum http_client_event event),
 				     void *cb_ctx);
+void http_client_set_req_body(struct http_client *c,
+			      const struct wpabuf *body);
+int http_client_keep_alive(struct http_client *c);
+int http_client_reuse(struct http_client *c, struct wpabuf *req,
+		      size_t max_response,
+		      void (*cb)(void *ctx, struct http_client *c,
+				 enum http_client_event event),
+		      void *cb_ctx);
 void http_client_free(struct http_client *c);
 struct wpabuf * http_client_get_body(struct http_client *c);
 char * http_client_get_hdr_line(struct http_client *c, const char *tag);
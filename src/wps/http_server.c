@@ -166,6 +166,43 @@ void http_request_send_and_deinit(struct http_request *req,
 }
 
 
+/**
+ * http_request_sendv_and_deinit - Send a response from multiple buffers
+ * @req: HTTP request
+ * @iov: Response data buffers; these are not freed
+ * @iovcnt: Number of buffers in iov
+ *
+ * The response is sent with a single writev() call so that static parts of the
+ * response can be sent without first copying them into a combined buffer.
+ */
+void http_request_sendv_and_deinit(struct http_request *req,
+				   const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0;
+	ssize_t res;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	wpa_printf(MSG_DEBUG, "HTTP: Send %lu byte response to %s:%d",
+		   (unsigned long) len, inet_ntoa(req->cli.sin_addr),
+		   ntohs(req->cli.sin_port));
+
+	res = writev(req->fd, iov, iovcnt);
+	if (res < 0) {
+		wpa_printf(MSG_DEBUG, "HTTP: Send failed: %s",
+			   strerror(errno));
+	} else if ((size_t) res < len) {
+		wpa_printf(MSG_DEBUG, "HTTP: Sent only %d of %lu bytes",
+			   (int) res, (unsigned long) len);
+		/* TODO: add eloop handler for sending rest of the data */
+	}
+
+	http_request_deinit(req);
+}
+
+
 enum httpread_hdr_type http_request_get_type(struct http_request *req)
 {
 	return httpread_hdr_type_get(req->hread);
@@ -22,6 +22,8 @@ void http_request_deinit(struct http_request *req);
 void http_request_send(struct http_request *req, struct wpabuf *resp);
 void http_request_send_and_deinit(struct http_request *req,
 				  struct wpabuf *resp);
+void http_request_sendv_and_deinit(struct http_request *req,
+				   const struct iovec *iov, int iovcnt);
 enum httpread_hdr_type http_request_get_type(struct http_request *req);
 char * http_request_get_uri(struct http_request *req);
 char * http_request_get_hdr(struct http_request *req);
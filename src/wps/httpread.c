@@ -20,15 +20,18 @@
  * This does not attempt to be an optimally efficient implementation, but does
  * attempt to be of reasonably small size and memory consumption; assuming that
  * only small files are to be read. A maximum file size is provided by
- * application and enforced.
+ * application and enforced. Data is handled in blocks rather than a character
+ * at a time: the end of the header is searched for in the received data and
+ * a body with known Content-Length is allocated once and read directly into
+ * the buffer that is returned to the application by httpread_data_get().
  *
  * It is assumed that the application does not expect any of the following:
  * -- transfer encoding other than chunked
  * -- trailer fields
- * It is assumed that, even if the other side requested that the connection be
- * kept open, that we will close it (thus HTTP messages sent by application
- * should have the connection closed field); this is allowed by HTTP/1.1 and
- * simplifies things for us.
+ * An httpread instance reads a single HTTP message. A connection can be kept
+ * open for more messages (see http_client_keep_alive()) as long as the peer
+ * does not pipeline them: a new httpread instance is used for each message
+ * and any data received past the end of the current message is ignored.
  *
  * Other limitations:
  * -- HTTP header may not exceed a hard-coded size.
@@ -392,24 +395,129 @@ bad:
 }
 
 
+/* httpread_body_alloc -- make room for at least len more body bytes
+ * plus a null termination character
+ */
+static int httpread_body_alloc(struct httpread *h, int len)
+{
+	char *new_body;
+	int new_alloc_nbytes;
+
+	if (h->body_alloc_nbytes >= h->body_nbytes + len + 1)
+		return 0;
+	if (h->body_nbytes >= h->max_bytes)
+		return -1;
+	if (h->got_content_length) {
+		/* The whole body is allocated at once */
+		new_alloc_nbytes = h->content_length + 1;
+	} else {
+		/* Grow geometrically to avoid repeated reallocation */
+		new_alloc_nbytes = h->body_alloc_nbytes * 2;
+		if (new_alloc_nbytes < h->body_alloc_nbytes +
+		    HTTPREAD_BODYBUF_DELTA)
+			new_alloc_nbytes = h->body_alloc_nbytes +
+				HTTPREAD_BODYBUF_DELTA;
+	}
+	if (new_alloc_nbytes < h->body_nbytes + len + 1)
+		new_alloc_nbytes = h->body_nbytes + len + 1;
+	new_body = os_realloc(h->body, new_alloc_nbytes);
+	if (new_body == NULL)
+		return -1;
+	h->body = new_body;
+	h->body_alloc_nbytes = new_alloc_nbytes;
+	return 0;
+}
+
+
+/* httpread_hdr_add -- add received data to the header buffer
+ * Returns the number of bytes consumed from rbp, or -1 on error. Sets got_hdr
+ * once the empty line ending the header has been found; any bytes after that
+ * are left for the body.
+ */
+static int httpread_hdr_add(struct httpread *h, const char *rbp, int nread)
+{
+	int ncopy, start;
+	char *end;
+
+	ncopy = HTTPREAD_HEADER_MAX_SIZE - h->hdr_nbytes;
+	if (ncopy == 0)
+		return -1;
+	if (ncopy > nread)
+		ncopy = nread;
+	os_memcpy(h->hdr + h->hdr_nbytes, rbp, ncopy);
+	h->hdr[h->hdr_nbytes + ncopy] = 0;
+
+	/* The terminating CR LF CR LF may have started in earlier data */
+	start = h->hdr_nbytes > 3 ? h->hdr_nbytes - 3 : 0;
+	end = os_strstr(h->hdr + start, "\r\n\r\n");
+	if (end == NULL) {
+		h->hdr_nbytes += ncopy;
+		return ncopy;
+	}
+
+	end += 4;
+	ncopy = end - (h->hdr + h->hdr_nbytes);
+	h->hdr_nbytes = end - h->hdr;
+	*end = 0;       /* null terminate */
+	h->got_hdr = 1;
+	return ncopy;
+}
+
+
+/* httpread_read_body -- read content-length body directly into place
+ * This avoids the extra copy through the read buffer and never reads past the
+ * end of the body.
+ */
+static int httpread_read_body(struct httpread *h)
+{
+	int nread;
+
+	nread = read(h->sd, h->body + h->body_nbytes,
+		     h->content_length - h->body_nbytes);
+	if (nread < 0)
+		return -1;
+	if (nread == 0) {
+		/* Premature EOF; e.g. dropped connection */
+		wpa_printf(MSG_DEBUG, "httpread premature eof(%p) %d/%d",
+			   h, h->body_nbytes, h->content_length);
+		return -1;
+	}
+	h->body_nbytes += nread;
+	if (h->body_nbytes >= h->content_length) {
+		h->got_body = 1;
+		if (httpread_debug >= 10)
+			wpa_printf(MSG_DEBUG, "httpread got content(%p)", h);
+	}
+	return 0;
+}
+
+
 /* httpread_read_handler -- called when socket ready to read
  *
- * Note: any extra data we read past end of transmitted file is ignored;
- * if we were to support keeping connections open for multiple files then
- * this would have to be addressed.
+ * Note: any extra data we read past end of transmitted file is ignored, so
+ * connections that are kept open must not be used for pipelined messages. A
+ * body with known content length is read directly into the body buffer and
+ * never past its end.
  */
 static void httpread_read_handler(int sd, void *eloop_ctx, void *sock_ctx)
 {
 	struct httpread *h = sock_ctx;
 	int nread;
 	char *rbp;      /* pointer into read buffer */
-	char *hbp;      /* pointer into header buffer */
 	char *bbp;      /* pointer into body buffer */
 	char readbuf[HTTPREAD_READBUF_SIZE];  /* temp use to read into */
 
 	if (httpread_debug >= 20)
 		wpa_printf(MSG_DEBUG, "ENTER httpread_read_handler(%p)", h);
 
+	if (h->got_hdr && !h->got_body && h->got_content_length) {
+		if (httpread_read_body(h))
+			goto bad;
+		if (h->got_body)
+			goto got_file;
+		goto get_more;
+	}
+
 	/* read some at a time, then search for the interal
 	 * boundaries between header and data and etc.
 	 */
@@ -440,8 +548,8 @@ static void httpread_read_handler(int sd, void *eloop_ctx, void *sock_ctx)
 		 */
 		if (httpread_debug >= 10)
 			wpa_printf(MSG_DEBUG, "httpread ok eof(%p)", h);
-			h->got_body = 1;
-			goto got_file;
+		h->got_body = 1;
+		goto got_file;
 	}
 	rbp = readbuf;
 
@@ -449,31 +557,13 @@ static void httpread_read_handler(int sd, void *eloop_ctx, void *sock_ctx)
 	 * and an empty line (CR LF only).
 	 */
 	if (!h->got_hdr) {
-		hbp = h->hdr + h->hdr_nbytes;
-		/* add to headers until:
-		 *      -- we run out of data in read buffer
-		 *      -- or, we run out of header buffer room
-		 *      -- or, we get double CRLF in headers
-		 */
-		for (;;) {
-			if (nread == 0)
-				goto get_more;
-			if (h->hdr_nbytes == HTTPREAD_HEADER_MAX_SIZE) {
-				goto bad;
-			}
-			*hbp++ = *rbp++;
-			nread--;
-			h->hdr_nbytes++;
-			if (h->hdr_nbytes >= 4 &&
-			    hbp[-1] == '\n' &&
-			    hbp[-2] == '\r' &&
-			    hbp[-3] == '\n' &&
-			    hbp[-4] == '\r' ) {
-				h->got_hdr = 1;
-				*hbp = 0;       /* null terminate */
-				break;
-			}
-		}
+		int used = httpread_hdr_add(h, rbp, nread);
+		if (used < 0)
+			goto bad;
+		rbp += used;
+		nread -= used;
+		if (!h->got_hdr)
+			goto get_more;
 		/* here we've just finished reading the header */
 		if (httpread_hdr_analyze(h)) {
 			wpa_printf(MSG_DEBUG, "httpread bad hdr(%p)", h);
@@ -492,6 +582,13 @@ static void httpread_read_handler(int sd, void *eloop_ctx, void *sock_ctx)
 					   h);
 			goto got_file;
 		}
+		if (h->got_content_length &&
+		    (h->content_length < 0 ||
+		     h->content_length > h->max_bytes)) {
+			wpa_printf(MSG_DEBUG, "httpread too long body (%d "
+				   "bytes) (%p)", h->content_length, h);
+			goto bad;
+		}
 	}
 
 	/* Certain types of requests never have data and so
@@ -510,39 +607,40 @@ static void httpread_read_handler(int sd, void *eloop_ctx, void *sock_ctx)
 		goto got_file;
 	}
 
+	if (h->got_content_length) {
+		/* Allocate the full body at once; the part of the body that
+		 * was received together with the header is copied here and
+		 * the rest is read directly into the body buffer.
+		 */
+		if (httpread_body_alloc(h, h->content_length - h->body_nbytes))
+			goto bad;
+		if (nread > h->content_length - h->body_nbytes)
+			nread = h->content_length - h->body_nbytes;
+		os_memcpy(h->body + h->body_nbytes, rbp, nread);
+		h->body_nbytes += nread;
+		if (h->body_nbytes >= h->content_length) {
+			h->got_body = 1;
+			if (httpread_debug >= 10)
+				wpa_printf(MSG_DEBUG,
+					   "httpread got content(%p)", h);
+			goto got_file;
+		}
+		goto get_more;
+	}
+
 	/* Data can be just plain binary data, or if "chunked"
 	 * consists of chunks each with a header, ending with
 	 * an ending header.
 	 */
 	if (nread == 0)
 		goto get_more;
-	if (!h->got_body) {
+	if (!h->got_body && !h->in_trailer) {
 		/* Here to get (more of) body */
 		/* ensure we have enough room for worst case for body
 		 * plus a null termination character
 		 */
-		if (h->body_alloc_nbytes < (h->body_nbytes + nread + 1)) {
-			char *new_body;
-			int new_alloc_nbytes;
-
-			if (h->body_nbytes >= h->max_bytes)
-				goto bad;
-			new_alloc_nbytes = h->body_alloc_nbytes +
-				HTTPREAD_BODYBUF_DELTA;
-			/* For content-length case, the first time
-			 * through we allocate the whole amount
-			 * we need.
-			 */
-			if (h->got_content_length &&
-			    new_alloc_nbytes < (h->content_length + 1))
-				new_alloc_nbytes = h->content_length + 1;
-			if ((new_body = os_realloc(h->body, new_alloc_nbytes))
-			    == NULL)
-				goto bad;
-
-			h->body = new_body;
-			h->body_alloc_nbytes = new_alloc_nbytes;
-		}
+		if (httpread_body_alloc(h, nread))
+			goto bad;
 		/* add bytes */
 		bbp = h->body + h->body_nbytes;
 		for (;;) {
@@ -560,6 +658,9 @@ static void httpread_read_handler(int sd, void *eloop_ctx, void *sock_ctx)
 					if (!isxdigit(*cbp))
 						goto bad;
 					h->chunk_size = strtoul(cbp, NULL, 16);
+					if (h->chunk_size < 0 ||
+					    h->chunk_size > h->max_bytes)
+						goto bad;
 					/* throw away chunk header
 					 * so we have only real data
 					 */
@@ -598,14 +699,6 @@ static void httpread_read_handler(int sd, void *eloop_ctx, void *sock_ctx)
 					h->in_chunk_data = 0;
 					h->chunk_size = 0; /* just in case */
 				}
-			} else if (h->got_content_length &&
-				   h->body_nbytes >= h->content_length) {
-				h->got_body = 1;
-				if (httpread_debug >= 10)
-					wpa_printf(
-						MSG_DEBUG,
-						"httpread got content(%p)", h);
-				goto got_file;
 			}
 			if (nread <= 0)
 				break;
@@ -617,13 +710,13 @@ static void httpread_read_handler(int sd, void *eloop_ctx, void *sock_ctx)
 				ncopy = (h->chunk_start + h->chunk_size + 2) -
 					h->body_nbytes;
 			} else if (h->chunked) {
-				/*in chunk header -- don't optimize */
-				*bbp++ = *rbp++;
-				nread--;
-				h->body_nbytes++;
-				continue;
-			} else if (h->got_content_length) {
-				ncopy = h->content_length - h->body_nbytes;
+				/* in chunk header -- copy up to end of line */
+				for (ncopy = 0; ncopy < nread; ncopy++) {
+					if (rbp[ncopy] == '\n') {
+						ncopy++;
+						break;
+					}
+				}
 			} else {
 				ncopy = nread;
 			}
@@ -705,9 +798,8 @@ got_file:
 	if (h->body)
 		h->body[h->body_nbytes] = 0; /* null terminate */
 	h->got_file = 1;
-	/* Assume that we do NOT support keeping connection alive,
-	 * and just in case somehow we don't get destroyed right away,
-	 * unregister now.
+	/* Stop reading; if the connection is kept alive, the next message
+	 * is read with a new httpread instance.
 	 */
 	if (h->sd_registered)
 		eloop_unregister_sock(h->sd, EVENT_TYPE_READ);
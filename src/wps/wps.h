@@ -70,6 +70,8 @@ struct wps_credential {
 #define WPS_MAX_VENDOR_EXT_LEN 1024
 /* maximum number of parsed WPS vendor extension attributes */
 #define MAX_WPS_PARSE_VENDOR_EXT 10
+/* maximum number of pre-generated Registrar DH key pairs */
+#define WPS_MAX_DH_KEY_POOL 64
 
 /**
  * struct wps_device_data - WPS Device Data
@@ -240,6 +242,38 @@ int wps_is_addr_authorized(const struct wpabuf *msg, const u8 *addr,
 			   int ver1_compat);
 const u8 * wps_get_uuid_e(const struct wpabuf *msg);
 
+#define MAX_REQ_DEV_TYPE_COUNT 10
+
+/**
+ * struct wps_probe_req_attr - WPS attributes used for Probe Request processing
+ *
+ * This is filled in by wps_parse_probe_req_ies() or wps_parse_probe_req_msg().
+ * The pointers refer either to the parsed data or, for attributes that are
+ * split between two WPS IEs, to the buf member.
+ */
+struct wps_probe_req_attr {
+	size_t len; /* total length of the WPS attributes */
+	const u8 *uuid_e; /* WPS_UUID_LEN (16) octets */
+	const u8 *config_methods; /* 2 octets */
+	const u8 *dev_password_id; /* 2 octets */
+	const u8 *request_type; /* 1 octet */
+	const u8 *primary_dev_type; /* 8 octets */
+	const u8 *dev_name;
+	size_t dev_name_len;
+	const u8 *req_dev_type[MAX_REQ_DEV_TYPE_COUNT];
+	size_t num_req_dev_type;
+
+	/* scratch buffer for split attributes (room for one of each) */
+	u8 buf[WPS_UUID_LEN + 2 + 2 + 1 + WPS_DEV_NAME_MAX_LEN +
+	       WPS_DEV_TYPE_LEN * (1 + MAX_REQ_DEV_TYPE_COUNT)];
+	size_t buf_used;
+};
+
+int wps_parse_probe_req_ies(const u8 *ies, size_t ies_len,
+			    struct wps_probe_req_attr *attr);
+int wps_parse_probe_req_msg(const struct wpabuf *msg,
+			    struct wps_probe_req_attr *attr);
+
 struct wpabuf * wps_build_assoc_req_ie(enum wps_request_type req_type);
 struct wpabuf * wps_build_assoc_resp_ie(void);
 struct wpabuf * wps_build_probe_req_ie(int pbc, struct wps_device_data *dev,
@@ -390,6 +424,19 @@ struct wps_registrar_config {
 	 * dualband - Whether this is a concurrent dualband AP
 	 */
 	int dualband;
+
+	/**
+	 * dh_key_pool - Number of DH key pairs to generate in advance
+	 *
+	 * Generating the Registrar's DH key pair is one of the two modular
+	 * exponentiations needed for M2. With a non-zero value, this many key
+	 * pairs are generated in advance from the event loop while the
+	 * Registrar is otherwise idle, so that M1 can be replied to with
+	 * only the shared secret derivation. Each key pair is used only once.
+	 * 0 = generate the key pair when building M2 (default); at most
+	 * WPS_MAX_DH_KEY_POOL.
+	 */
+	unsigned int dh_key_pool;
 };
 
 
@@ -783,7 +830,7 @@ int wps_registrar_unlock_pin(struct wps_registrar *reg, const u8 *uuid);
 int wps_registrar_button_pushed(struct wps_registrar *reg,
 				const u8 *p2p_dev_addr);
 void wps_registrar_probe_req_rx(struct wps_registrar *reg, const u8 *addr,
-				const struct wpabuf *wps_data,
+				const struct wps_probe_req_attr *attr,
 				int p2p_wildcard);
 int wps_registrar_update_ie(struct wps_registrar *reg);
 int wps_registrar_get_info(struct wps_registrar *reg, const u8 *addr,
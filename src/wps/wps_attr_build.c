@@ -27,6 +27,7 @@
 int wps_build_public_key(struct wps_data *wps, struct wpabuf *msg)
 {
 	struct wpabuf *pubkey;
+	void *dh_ctx;
 
 	wpa_printf(MSG_DEBUG, "WPS:  * Public Key");
 	wpabuf_free(wps->dh_privkey);
@@ -36,6 +37,12 @@ int wps_build_public_key(struct wps_data *wps, struct wpabuf *msg)
 		wps->dh_ctx = wps->wps->dh_ctx;
 		wps->wps->dh_ctx = NULL;
 		pubkey = wpabuf_dup(wps->wps->dh_pubkey);
+	} else if (wps->registrar &&
+		   wps_registrar_get_dh_key(wps->wps->registrar, &dh_ctx,
+					    &wps->dh_privkey, &pubkey) == 0) {
+		wpa_printf(MSG_DEBUG, "WPS: Using pre-generated DH keys");
+		dh5_free(wps->dh_ctx);
+		wps->dh_ctx = dh_ctx;
 	} else {
 		wpa_printf(MSG_DEBUG, "WPS: Generate new DH keys");
 		wps->dh_privkey = NULL;
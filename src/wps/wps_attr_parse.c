@@ -15,6 +15,7 @@
 #include "includes.h"
 
 #include "common.h"
+#include "common/ieee802_11_defs.h"
 #include "wps_i.h"
 
 #ifndef CONFIG_WPS_STRICT
@@ -628,3 +629,259 @@ int wps_parse_msg(const struct wpabuf *msg, struct wps_parse_attr *attr)
 
 	return 0;
 }
+
+
+/*
+ * Probe Request WPS attribute scanner
+ *
+ * The WPS attributes in a Probe Request may be split over multiple WPS IEs.
+ * Instead of concatenating the IEs into a new buffer and parsing all the
+ * attributes with wps_parse_msg(), the following functions go through the
+ * attribute data in place and pick only the attributes needed on the Probe
+ * Request path. An attribute that is split between two IEs is copied into
+ * the scratch buffer in struct wps_probe_req_attr.
+ */
+
+struct wps_attr_iter {
+	const u8 *ies, *ies_end; /* remaining IEs after the current fragment */
+	const u8 *pos, *end; /* remaining data in the current fragment */
+};
+
+
+/* Move to the next WPS IE if the current fragment has been consumed */
+static int wps_attr_iter_more(struct wps_attr_iter *iter)
+{
+	while (iter->pos == iter->end) {
+		const u8 *ie;
+
+		for (;;) {
+			if (iter->ies_end - iter->ies < 2 ||
+			    iter->ies_end - iter->ies < 2 + iter->ies[1])
+				return 0;
+			ie = iter->ies;
+			iter->ies += 2 + ie[1];
+			if (ie[0] == WLAN_EID_VENDOR_SPECIFIC && ie[1] >= 4 &&
+			    WPA_GET_BE32(&ie[2]) == WPS_DEV_OUI_WFA)
+				break;
+		}
+		iter->pos = ie + 6;
+		iter->end = ie + 2 + ie[1];
+	}
+
+	return 1;
+}
+
+
+/* Copy len octets to buf (or skip them if buf is NULL) */
+static int wps_attr_iter_copy(struct wps_attr_iter *iter, u8 *buf,
+			      size_t len)
+{
+	size_t clen;
+
+	while (len > 0) {
+		if (!wps_attr_iter_more(iter))
+			return -1;
+		clen = iter->end - iter->pos;
+		if (clen > len)
+			clen = len;
+		if (buf) {
+			os_memcpy(buf, iter->pos, clen);
+			buf += clen;
+		}
+		iter->pos += clen;
+		len -= clen;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Get a pointer to len contiguous octets of attribute data. *data is set to
+ * %NULL if the attribute is split between IEs and does not fit in the scratch
+ * buffer.
+ */
+static int wps_attr_iter_get(struct wps_attr_iter *iter,
+			     struct wps_probe_req_attr *attr, size_t len,
+			     const u8 **data)
+{
+	if ((size_t) (iter->end - iter->pos) >= len) {
+		*data = iter->pos;
+		iter->pos += len;
+		return 0;
+	}
+
+	if (len > sizeof(attr->buf) - attr->buf_used) {
+		wpa_printf(MSG_DEBUG, "WPS: Skipped split attribute (no room "
+			   "in scratch buffer)");
+		*data = NULL;
+		return wps_attr_iter_copy(iter, NULL, len);
+	}
+
+	*data = attr->buf + attr->buf_used;
+	if (wps_attr_iter_copy(iter, attr->buf + attr->buf_used, len) < 0)
+		return -1;
+	attr->buf_used += len;
+	return 0;
+}
+
+
+static int wps_parse_probe_req(struct wps_attr_iter *iter,
+			       struct wps_probe_req_attr *attr)
+{
+	u8 hdr[4];
+	u16 type, len, expected;
+	const u8 *data;
+	int prev_zero = 0;
+
+	os_memset(attr, 0, sizeof(*attr));
+
+	while (wps_attr_iter_more(iter)) {
+		os_memset(hdr, 0, sizeof(hdr));
+		if (wps_attr_iter_copy(iter, hdr, sizeof(hdr)) < 0) {
+#ifdef WPS_WORKAROUNDS
+			/* Trailing 0x00 padding; see wps_parse_msg() */
+			if (prev_zero && WPA_GET_BE32(hdr) == 0)
+				break;
+#endif /* WPS_WORKAROUNDS */
+			wpa_printf(MSG_DEBUG, "WPS: Invalid message - "
+				   "truncated attribute header");
+			return -1;
+		}
+		type = WPA_GET_BE16(hdr);
+		len = WPA_GET_BE16(&hdr[2]);
+		prev_zero = type == 0 && len == 0;
+
+		switch (type) {
+		case ATTR_UUID_E:
+			expected = WPS_UUID_LEN;
+			break;
+		case ATTR_CONFIG_METHODS:
+		case ATTR_DEV_PASSWORD_ID:
+			expected = 2;
+			break;
+		case ATTR_REQUEST_TYPE:
+			expected = 1;
+			break;
+		case ATTR_PRIMARY_DEV_TYPE:
+		case ATTR_REQUESTED_DEV_TYPE:
+			expected = WPS_DEV_TYPE_LEN;
+			break;
+		case ATTR_DEV_NAME:
+			expected = len;
+			break;
+		default:
+			expected = len;
+			type = 0; /* not needed on the Probe Request path */
+			break;
+		}
+
+		if (len != expected) {
+			wpa_printf(MSG_DEBUG, "WPS: Invalid attribute 0x%x "
+				   "length %u", type, len);
+			return -1;
+		}
+
+		if (type == 0 ||
+		    (type == ATTR_REQUESTED_DEV_TYPE &&
+		     attr->num_req_dev_type >= MAX_REQ_DEV_TYPE_COUNT)) {
+			data = NULL;
+			if (wps_attr_iter_copy(iter, NULL, len) < 0)
+				goto overflow;
+		} else if (wps_attr_iter_get(iter, attr, len, &data) < 0)
+			goto overflow;
+		attr->len += sizeof(hdr) + len;
+		if (data == NULL)
+			continue;
+
+		switch (type) {
+		case ATTR_UUID_E:
+			attr->uuid_e = data;
+			break;
+		case ATTR_CONFIG_METHODS:
+			attr->config_methods = data;
+			break;
+		case ATTR_DEV_PASSWORD_ID:
+			attr->dev_password_id = data;
+			break;
+		case ATTR_REQUEST_TYPE:
+			attr->request_type = data;
+			break;
+		case ATTR_PRIMARY_DEV_TYPE:
+			attr->primary_dev_type = data;
+			break;
+		case ATTR_REQUESTED_DEV_TYPE:
+			attr->req_dev_type[attr->num_req_dev_type++] = data;
+			break;
+		case ATTR_DEV_NAME:
+			attr->dev_name = data;
+			attr->dev_name_len = len;
+			break;
+		}
+	}
+
+	return 0;
+
+overflow:
+	wpa_printf(MSG_DEBUG, "WPS: Attribute overflow");
+	return -1;
+}
+
+
+/**
+ * wps_parse_probe_req_ies - Parse WPS attributes from Probe Request IEs
+ * @ies: Information elements from the Probe Request frame
+ * @ies_len: Length of ies in octets
+ * @attr: Buffer for the parsed attributes
+ * Returns: 0 on success, -1 if no WPS IE was found or parsing failed
+ *
+ * This is a lightweight alternative to concatenating the WPS IEs with
+ * ieee802_11_vendor_ie_concat() and parsing them with wps_parse_msg(). It does
+ * not allocate memory and it extracts only the attributes that are needed for
+ * processing Probe Request frames; other attributes are not validated. The
+ * pointers in attr refer to ies or attr->buf.
+ */
+int wps_parse_probe_req_ies(const u8 *ies, size_t ies_len,
+			    struct wps_probe_req_attr *attr)
+{
+	struct wps_attr_iter iter;
+	const u8 *pos = ies, *end = ies + ies_len;
+
+	/* Find the first WPS IE to match ieee802_11_vendor_ie_concat() */
+	while (end - pos >= 2) {
+		if (end - pos < 2 + pos[1])
+			return -1;
+		if (pos[0] == WLAN_EID_VENDOR_SPECIFIC && pos[1] >= 4 &&
+		    WPA_GET_BE32(&pos[2]) == WPS_DEV_OUI_WFA)
+			break;
+		pos += 2 + pos[1];
+	}
+	if (end - pos < 2)
+		return -1; /* No WPS IE */
+
+	iter.ies = pos;
+	iter.ies_end = end;
+	iter.pos = iter.end = NULL;
+	return wps_parse_probe_req(&iter, attr);
+}
+
+
+/**
+ * wps_parse_probe_req_msg - Parse WPS attributes from Probe Request TLVs
+ * @msg: WPS attributes from a Probe Request (e.g., from UPnP WLANEvent)
+ * @attr: Buffer for the parsed attributes
+ * Returns: 0 on success, -1 on failure
+ *
+ * This is like wps_parse_probe_req_ies(), but for WPS attributes that have
+ * already been extracted from the IEs. The pointers in attr refer to msg.
+ */
+int wps_parse_probe_req_msg(const struct wpabuf *msg,
+			    struct wps_probe_req_attr *attr)
+{
+	struct wps_attr_iter iter;
+
+	iter.ies = iter.ies_end = NULL;
+	iter.pos = wpabuf_head(msg);
+	iter.end = iter.pos + wpabuf_len(msg);
+	return wps_parse_probe_req(&iter, attr);
+}
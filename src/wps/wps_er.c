@@ -817,6 +817,7 @@ static void wps_er_process_wlanevent_probe_req(struct wps_er_ap *ap,
 					       struct wpabuf *msg)
 {
 	struct wps_parse_attr attr;
+	struct wps_probe_req_attr probe_attr;
 
 	wpa_printf(MSG_DEBUG, "WPS ER: WLANEvent - Probe Request - from "
 		   MACSTR, MAC2STR(addr));
@@ -836,7 +837,9 @@ static void wps_er_process_wlanevent_probe_req(struct wps_er_ap *ap,
 	}
 
 	wps_er_add_sta_data(ap, addr, &attr, 1);
-	wps_registrar_probe_req_rx(ap->er->wps->registrar, addr, msg, 0);
+	if (wps_parse_probe_req_msg(msg, &probe_attr) == 0)
+		wps_registrar_probe_req_rx(ap->er->wps->registrar, addr,
+					   &probe_attr, 0);
 }
 
 
@@ -205,7 +205,6 @@ struct wps_parse_attr {
 	size_t cred_len[MAX_CRED_COUNT];
 	size_t num_cred;
 
-#define MAX_REQ_DEV_TYPE_COUNT 10
 	const u8 *req_dev_type[MAX_REQ_DEV_TYPE_COUNT];
 	size_t num_req_dev_type;
 
@@ -291,6 +290,8 @@ int wps_build_cred(struct wps_data *wps, struct wpabuf *msg);
 int wps_device_store(struct wps_registrar *reg,
 		     struct wps_device_data *dev, const u8 *uuid);
 void wps_registrar_selected_registrar_changed(struct wps_registrar *reg);
+int wps_registrar_get_dh_key(struct wps_registrar *reg, void **dh_ctx,
+			     struct wpabuf **privkey, struct wpabuf **pubkey);
 const u8 * wps_authorized_macs(struct wps_registrar *reg, size_t *count);
 int wps_registrar_pbc_overlap(struct wps_registrar *reg,
 			      const u8 *addr, const u8 *uuid_e);
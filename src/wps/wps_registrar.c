@@ -20,6 +20,7 @@
 #include "utils/uuid.h"
 #include "utils/list.h"
 #include "crypto/crypto.h"
+#include "crypto/dh_group5.h"
 #include "crypto/sha256.h"
 #include "crypto/random.h"
 #include "common/ieee802_11_defs.h"
@@ -32,8 +33,18 @@
 #define WPS_WORKAROUNDS
 #endif /* CONFIG_WPS_STRICT */
 
+/*
+ * PINs and PBC sessions are kept in small hash tables to avoid walking all
+ * entries for each lookup on the probe request and registration paths. The
+ * table sizes must be powers of two.
+ */
+#define WPS_PIN_HASH_SIZE 16
+#define WPS_PBC_HASH_SIZE 32
+
 struct wps_uuid_pin {
-	struct dl_list list;
+	struct dl_list list; /* all PINs, most recently added first */
+	struct dl_list hash; /* reg->pin_hash[] or reg->wildcard_pins */
+	struct dl_list expiry; /* reg->pin_expiry in expiration order */
 	u8 uuid[WPS_UUID_LEN];
 	int wildcard_uuid;
 	u8 *pin;
@@ -46,6 +57,17 @@ struct wps_uuid_pin {
 };
 
 
+static unsigned int wps_hash(const u8 *data, size_t len, unsigned int size)
+{
+	unsigned int hash = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		hash = hash * 31 + data[i];
+	return hash & (size - 1);
+}
+
+
 static void wps_free_pin(struct wps_uuid_pin *pin)
 {
 	os_free(pin->pin);
@@ -56,6 +78,9 @@ static void wps_free_pin(struct wps_uuid_pin *pin)
 static void wps_remove_pin(struct wps_uuid_pin *pin)
 {
 	dl_list_del(&pin->list);
+	dl_list_del(&pin->hash);
+	if (pin->flags & PIN_EXPIRES)
+		dl_list_del(&pin->expiry);
 	wps_free_pin(pin);
 }
 
@@ -69,23 +94,21 @@ static void wps_free_pins(struct dl_list *pins)
 
 
 struct wps_pbc_session {
-	struct wps_pbc_session *next;
+	struct dl_list list; /* reg->pbc_sessions, most recent first */
+	struct dl_list addr_hash; /* reg->pbc_addr_hash[] */
+	struct dl_list uuid_hash; /* reg->pbc_uuid_hash[] */
 	u8 addr[ETH_ALEN];
 	u8 uuid_e[WPS_UUID_LEN];
 	struct os_time timestamp;
 };
 
 
-static void wps_free_pbc_sessions(struct wps_pbc_session *pbc)
-{
-	struct wps_pbc_session *prev;
-
-	while (pbc) {
-		prev = pbc;
-		pbc = pbc->next;
-		os_free(prev);
-	}
-}
+struct wps_dh_key {
+	struct dl_list list;
+	void *dh_ctx;
+	struct wpabuf *privkey;
+	struct wpabuf *pubkey;
+};
 
 
 struct wps_registrar_device {
@@ -118,7 +141,17 @@ struct wps_registrar {
 	void *cb_ctx;
 
 	struct dl_list pins;
-	struct wps_pbc_session *pbc_sessions;
+	struct dl_list pin_hash[WPS_PIN_HASH_SIZE];
+	struct dl_list wildcard_pins; /* wildcard PINs not yet assigned */
+	struct dl_list pin_expiry;
+	struct dl_list pbc_sessions;
+	struct dl_list pbc_addr_hash[WPS_PBC_HASH_SIZE];
+	struct dl_list pbc_uuid_hash[WPS_PBC_HASH_SIZE];
+	unsigned int pbc_num_uuids; /* distinct UUID-Es in pbc_sessions */
+
+	struct dl_list dh_keys; /* pre-generated DH keys (struct wps_dh_key) */
+	unsigned int num_dh_keys;
+	unsigned int dh_key_pool;
 
 	int skip_cred_build;
 	struct wpabuf *extra_cred;
@@ -258,80 +291,132 @@ int wps_device_store(struct wps_registrar *reg,
 }
 
 
+static struct dl_list * wps_pin_bucket(struct wps_registrar *reg,
+				       const u8 *uuid)
+{
+	return &reg->pin_hash[wps_hash(uuid, WPS_UUID_LEN, WPS_PIN_HASH_SIZE)];
+}
+
+
+static struct dl_list * wps_pbc_uuid_bucket(struct wps_registrar *reg,
+					    const u8 *uuid_e)
+{
+	return &reg->pbc_uuid_hash[wps_hash(uuid_e, WPS_UUID_LEN,
+					    WPS_PBC_HASH_SIZE)];
+}
+
+
+static struct wps_pbc_session *
+wps_registrar_get_pbc_uuid(struct wps_registrar *reg, const u8 *uuid_e)
+{
+	struct wps_pbc_session *pbc;
+
+	dl_list_for_each(pbc, wps_pbc_uuid_bucket(reg, uuid_e),
+			 struct wps_pbc_session, uuid_hash) {
+		if (os_memcmp(pbc->uuid_e, uuid_e, WPS_UUID_LEN) == 0)
+			return pbc;
+	}
+	return NULL;
+}
+
+
+static void wps_registrar_free_pbc_session(struct wps_registrar *reg,
+					   struct wps_pbc_session *pbc)
+{
+	dl_list_del(&pbc->list);
+	dl_list_del(&pbc->addr_hash);
+	dl_list_del(&pbc->uuid_hash);
+	if (wps_registrar_get_pbc_uuid(reg, pbc->uuid_e) == NULL)
+		reg->pbc_num_uuids--;
+	os_free(pbc);
+}
+
+
+static void wps_free_pbc_sessions(struct wps_registrar *reg)
+{
+	struct wps_pbc_session *pbc, *prev;
+
+	dl_list_for_each_safe(pbc, prev, &reg->pbc_sessions,
+			      struct wps_pbc_session, list)
+		wps_registrar_free_pbc_session(reg, pbc);
+}
+
+
+/* Remove sessions that have timed out; the list is in timestamp order */
+static void wps_registrar_expire_pbc_sessions(struct wps_registrar *reg,
+					      struct os_time *now)
+{
+	struct wps_pbc_session *pbc;
+
+	while ((pbc = dl_list_last(&reg->pbc_sessions, struct wps_pbc_session,
+				   list)) != NULL) {
+		if (now->sec <= pbc->timestamp.sec + WPS_PBC_WALK_TIME)
+			break;
+		wps_registrar_free_pbc_session(reg, pbc);
+	}
+}
+
+
 static void wps_registrar_add_pbc_session(struct wps_registrar *reg,
 					  const u8 *addr, const u8 *uuid_e)
 {
-	struct wps_pbc_session *pbc, *prev = NULL;
+	struct wps_pbc_session *pbc;
+	struct dl_list *bucket;
+	u8 zero_uuid[WPS_UUID_LEN];
 	struct os_time now;
 
 	os_get_time(&now);
 
-	pbc = reg->pbc_sessions;
-	while (pbc) {
+	if (uuid_e == NULL) {
+		os_memset(zero_uuid, 0, WPS_UUID_LEN);
+		uuid_e = zero_uuid;
+	}
+
+	bucket = &reg->pbc_addr_hash[wps_hash(addr, ETH_ALEN,
+					      WPS_PBC_HASH_SIZE)];
+	dl_list_for_each(pbc, bucket, struct wps_pbc_session, addr_hash) {
 		if (os_memcmp(pbc->addr, addr, ETH_ALEN) == 0 &&
 		    os_memcmp(pbc->uuid_e, uuid_e, WPS_UUID_LEN) == 0) {
-			if (prev)
-				prev->next = pbc->next;
-			else
-				reg->pbc_sessions = pbc->next;
+			/* Move to the head of the time ordered list */
+			dl_list_del(&pbc->list);
 			break;
 		}
-		prev = pbc;
-		pbc = pbc->next;
 	}
 
-	if (!pbc) {
+	if (&pbc->addr_hash == bucket) {
 		pbc = os_zalloc(sizeof(*pbc));
 		if (pbc == NULL)
 			return;
 		os_memcpy(pbc->addr, addr, ETH_ALEN);
-		if (uuid_e)
-			os_memcpy(pbc->uuid_e, uuid_e, WPS_UUID_LEN);
+		os_memcpy(pbc->uuid_e, uuid_e, WPS_UUID_LEN);
+		if (wps_registrar_get_pbc_uuid(reg, uuid_e) == NULL)
+			reg->pbc_num_uuids++;
+		dl_list_add(bucket, &pbc->addr_hash);
+		dl_list_add(wps_pbc_uuid_bucket(reg, uuid_e), &pbc->uuid_hash);
 	}
 
-	pbc->next = reg->pbc_sessions;
-	reg->pbc_sessions = pbc;
+	dl_list_add(&reg->pbc_sessions, &pbc->list);
 	pbc->timestamp = now;
 
 	/* remove entries that have timed out */
-	prev = pbc;
-	pbc = pbc->next;
-
-	while (pbc) {
-		if (now.sec > pbc->timestamp.sec + WPS_PBC_WALK_TIME) {
-			prev->next = NULL;
-			wps_free_pbc_sessions(pbc);
-			break;
-		}
-		prev = pbc;
-		pbc = pbc->next;
-	}
+	wps_registrar_expire_pbc_sessions(reg, &now);
 }
 
 
 static void wps_registrar_remove_pbc_session(struct wps_registrar *reg,
 					     const u8 *uuid_e)
 {
-	struct wps_pbc_session *pbc, *prev = NULL, *tmp;
+	struct wps_pbc_session *pbc, *tmp;
 
-	pbc = reg->pbc_sessions;
-	while (pbc) {
+	dl_list_for_each_safe(pbc, tmp, wps_pbc_uuid_bucket(reg, uuid_e),
+			      struct wps_pbc_session, uuid_hash) {
 		if (os_memcmp(pbc->uuid_e, uuid_e, WPS_UUID_LEN) == 0) {
-			if (prev)
-				prev->next = pbc->next;
-			else
-				reg->pbc_sessions = pbc->next;
-			tmp = pbc;
-			pbc = pbc->next;
 			wpa_printf(MSG_DEBUG, "WPS: Removing PBC session for "
-				   "addr=" MACSTR, MAC2STR(tmp->addr));
+				   "addr=" MACSTR, MAC2STR(pbc->addr));
 			wpa_hexdump(MSG_DEBUG, "WPS: Removed UUID-E",
-				    tmp->uuid_e, WPS_UUID_LEN);
-			os_free(tmp);
-			continue;
+				    pbc->uuid_e, WPS_UUID_LEN);
+			wps_registrar_free_pbc_session(reg, pbc);
 		}
-		prev = pbc;
-		pbc = pbc->next;
 	}
 }
 
@@ -341,7 +426,6 @@ int wps_registrar_pbc_overlap(struct wps_registrar *reg,
 {
 	int count = 0;
 	struct wps_pbc_session *pbc;
-	struct wps_pbc_session *first = NULL;
 	struct os_time now;
 
 	os_get_time(&now);
@@ -355,28 +439,25 @@ int wps_registrar_pbc_overlap(struct wps_registrar *reg,
 		count++;
 	}
 
-	for (pbc = reg->pbc_sessions; pbc; pbc = pbc->next) {
-		wpa_printf(MSG_DEBUG, "WPS: Consider PBC session with " MACSTR,
-			   MAC2STR(pbc->addr));
-		wpa_hexdump(MSG_DEBUG, "WPS: UUID-E",
-			    pbc->uuid_e, WPS_UUID_LEN);
-		if (now.sec > pbc->timestamp.sec + WPS_PBC_WALK_TIME) {
-			wpa_printf(MSG_DEBUG, "WPS: PBC walk time has "
-				   "expired");
-			break;
-		}
-		if (first &&
-		    os_memcmp(pbc->uuid_e, first->uuid_e, WPS_UUID_LEN) == 0) {
-			wpa_printf(MSG_DEBUG, "WPS: Same Enrollee");
-			continue; /* same Enrollee */
-		}
+	/*
+	 * Only the sessions within the walk time are considered. The number
+	 * of distinct UUID-Es among them is maintained when sessions are added
+	 * and removed, so there is no need to go through the sessions here.
+	 */
+	wps_registrar_expire_pbc_sessions(reg, &now);
+	if (reg->pbc_num_uuids > 1) {
+		wpa_printf(MSG_DEBUG, "WPS: %u different UUID-Es in active "
+			   "PBC sessions", reg->pbc_num_uuids);
+		count += reg->pbc_num_uuids;
+	} else if (reg->pbc_num_uuids == 1) {
+		pbc = dl_list_first(&reg->pbc_sessions,
+				    struct wps_pbc_session, list);
 		if (uuid_e == NULL ||
 		    os_memcmp(uuid_e, pbc->uuid_e, WPS_UUID_LEN)) {
-			wpa_printf(MSG_DEBUG, "WPS: New Enrollee");
+			wpa_printf(MSG_DEBUG, "WPS: New Enrollee " MACSTR,
+				   MAC2STR(pbc->addr));
 			count++;
 		}
-		if (first == NULL)
-			first = pbc;
 	}
 
 	wpa_printf(MSG_DEBUG, "WPS: %u active PBC session(s) found", count);
@@ -577,6 +658,100 @@ const u8 * wps_authorized_macs(struct wps_registrar *reg, size_t *count)
 }
 
 
+static void wps_free_dh_key(struct wps_dh_key *key)
+{
+	dh5_free(key->dh_ctx);
+	wpabuf_free(key->privkey);
+	wpabuf_free(key->pubkey);
+	os_free(key);
+}
+
+
+static void wps_free_dh_keys(struct wps_registrar *reg)
+{
+	struct wps_dh_key *key, *prev;
+
+	dl_list_for_each_safe(key, prev, &reg->dh_keys, struct wps_dh_key,
+			      list) {
+		dl_list_del(&key->list);
+		wps_free_dh_key(key);
+	}
+	reg->num_dh_keys = 0;
+}
+
+
+/*
+ * Generate one DH key pair per call so that other events get processed
+ * between the modular exponentiations.
+ */
+static void wps_registrar_dh_key_refill(void *eloop_ctx, void *timeout_ctx)
+{
+	struct wps_registrar *reg = eloop_ctx;
+	struct wps_dh_key *key;
+
+	if (reg->num_dh_keys >= reg->dh_key_pool)
+		return;
+
+	key = os_zalloc(sizeof(*key));
+	if (key == NULL)
+		return;
+	key->dh_ctx = dh5_init(&key->privkey, &key->pubkey);
+	key->pubkey = wpabuf_zeropad(key->pubkey, 192);
+	if (key->dh_ctx == NULL || key->privkey == NULL ||
+	    key->pubkey == NULL) {
+		wpa_printf(MSG_DEBUG, "WPS: Failed to generate DH key pair");
+		wps_free_dh_key(key);
+		return;
+	}
+	dl_list_add_tail(&reg->dh_keys, &key->list);
+	reg->num_dh_keys++;
+
+	if (reg->num_dh_keys < reg->dh_key_pool)
+		eloop_register_timeout(0, 0, wps_registrar_dh_key_refill, reg,
+				       NULL);
+}
+
+
+/**
+ * wps_registrar_get_dh_key - Get a pre-generated DH key pair
+ * @reg: Registrar data from wps_registrar_init()
+ * @dh_ctx: Buffer for returning the DH context
+ * @privkey: Buffer for returning the private key
+ * @pubkey: Buffer for returning the public key (zero padded to 192 octets)
+ * Returns: 0 on success, -1 if no pre-generated key pair is available
+ *
+ * The caller takes ownership of the returned data. The pool is refilled from
+ * the event loop.
+ */
+int wps_registrar_get_dh_key(struct wps_registrar *reg, void **dh_ctx,
+			     struct wpabuf **privkey, struct wpabuf **pubkey)
+{
+	struct wps_dh_key *key;
+
+	if (reg == NULL)
+		return -1;
+
+	key = dl_list_first(&reg->dh_keys, struct wps_dh_key, list);
+	if (key == NULL) {
+		if (reg->dh_key_pool)
+			wpa_printf(MSG_DEBUG, "WPS: DH key pool empty");
+		return -1;
+	}
+	dl_list_del(&key->list);
+	reg->num_dh_keys--;
+
+	*dh_ctx = key->dh_ctx;
+	*privkey = key->privkey;
+	*pubkey = key->pubkey;
+	os_free(key);
+
+	eloop_cancel_timeout(wps_registrar_dh_key_refill, reg, NULL);
+	eloop_register_timeout(0, 0, wps_registrar_dh_key_refill, reg, NULL);
+
+	return 0;
+}
+
+
 /**
  * wps_registrar_init - Initialize WPS Registrar data
  * @wps: Pointer to longterm WPS context
@@ -594,10 +769,21 @@ wps_registrar_init(struct wps_context *wps,
 		   const struct wps_registrar_config *cfg)
 {
 	struct wps_registrar *reg = os_zalloc(sizeof(*reg));
+	int i;
+
 	if (reg == NULL)
 		return NULL;
 
 	dl_list_init(&reg->pins);
+	for (i = 0; i < WPS_PIN_HASH_SIZE; i++)
+		dl_list_init(&reg->pin_hash[i]);
+	dl_list_init(&reg->wildcard_pins);
+	dl_list_init(&reg->pin_expiry);
+	dl_list_init(&reg->pbc_sessions);
+	for (i = 0; i < WPS_PBC_HASH_SIZE; i++) {
+		dl_list_init(&reg->pbc_addr_hash[i]);
+		dl_list_init(&reg->pbc_uuid_hash[i]);
+	}
 	reg->wps = wps;
 	reg->new_psk_cb = cfg->new_psk_cb;
 	reg->set_ie_cb = cfg->set_ie_cb;
@@ -620,6 +806,11 @@ wps_registrar_init(struct wps_context *wps,
 	reg->sel_reg_config_methods_override = -1;
 	reg->static_wep_only = cfg->static_wep_only;
 	reg->dualband = cfg->dualband;
+	dl_list_init(&reg->dh_keys);
+	reg->dh_key_pool = cfg->dh_key_pool;
+	if (reg->dh_key_pool)
+		eloop_register_timeout(0, 0, wps_registrar_dh_key_refill, reg,
+				       NULL);
 
 	if (wps_set_ie(reg)) {
 		wps_registrar_deinit(reg);
@@ -640,8 +831,10 @@ void wps_registrar_deinit(struct wps_registrar *reg)
 		return;
 	eloop_cancel_timeout(wps_registrar_pbc_timeout, reg, NULL);
 	eloop_cancel_timeout(wps_registrar_set_selected_timeout, reg, NULL);
+	eloop_cancel_timeout(wps_registrar_dh_key_refill, reg, NULL);
+	wps_free_dh_keys(reg);
 	wps_free_pins(&reg->pins);
-	wps_free_pbc_sessions(reg->pbc_sessions);
+	wps_free_pbc_sessions(reg);
 	wpabuf_free(reg->extra_cred);
 	wps_free_devices(reg->devices);
 	os_free(reg);
@@ -682,12 +875,26 @@ int wps_registrar_add_pin(struct wps_registrar *reg, const u8 *addr,
 	p->pin_len = pin_len;
 
 	if (timeout) {
+		struct wps_uuid_pin *e;
+
 		p->flags |= PIN_EXPIRES;
 		os_get_time(&p->expiration);
 		p->expiration.sec += timeout;
+
+		/* Keep pin_expiry sorted; new PINs usually expire last */
+		dl_list_for_each_reverse(e, &reg->pin_expiry,
+					 struct wps_uuid_pin, expiry) {
+			if (!os_time_before(&p->expiration, &e->expiration))
+				break;
+		}
+		dl_list_add(&e->expiry, &p->expiry);
 	}
 
 	dl_list_add(&reg->pins, &p->list);
+	if (p->wildcard_uuid)
+		dl_list_add(&reg->wildcard_pins, &p->hash);
+	else
+		dl_list_add(wps_pin_bucket(reg, p->uuid), &p->hash);
 
 	wpa_printf(MSG_DEBUG, "WPS: A new PIN configured (timeout=%d)",
 		   timeout);
@@ -728,19 +935,33 @@ static void wps_registrar_remove_pin(struct wps_registrar *reg,
 
 static void wps_registrar_expire_pins(struct wps_registrar *reg)
 {
-	struct wps_uuid_pin *pin, *prev;
+	struct wps_uuid_pin *pin;
 	struct os_time now;
 
 	os_get_time(&now);
-	dl_list_for_each_safe(pin, prev, &reg->pins, struct wps_uuid_pin, list)
-	{
-		if ((pin->flags & PIN_EXPIRES) &&
-		    os_time_before(&pin->expiration, &now)) {
-			wpa_hexdump(MSG_DEBUG, "WPS: Expired PIN for UUID",
-				    pin->uuid, WPS_UUID_LEN);
-			wps_registrar_remove_pin(reg, pin);
-		}
+	while ((pin = dl_list_first(&reg->pin_expiry, struct wps_uuid_pin,
+				    expiry)) != NULL) {
+		if (!os_time_before(&pin->expiration, &now))
+			break;
+		wpa_hexdump(MSG_DEBUG, "WPS: Expired PIN for UUID",
+			    pin->uuid, WPS_UUID_LEN);
+		wps_registrar_remove_pin(reg, pin);
+	}
+}
+
+
+static struct wps_uuid_pin * wps_registrar_find_pin(struct wps_registrar *reg,
+						    const u8 *uuid)
+{
+	struct wps_uuid_pin *pin;
+
+	dl_list_for_each(pin, wps_pin_bucket(reg, uuid), struct wps_uuid_pin,
+			 hash) {
+		if (os_memcmp(pin->uuid, uuid, WPS_UUID_LEN) == 0)
+			return pin;
 	}
+
+	return NULL;
 }
 
 
@@ -775,19 +996,16 @@ static int wps_registrar_invalidate_wildcard_pin(struct wps_registrar *reg)
  */
 int wps_registrar_invalidate_pin(struct wps_registrar *reg, const u8 *uuid)
 {
-	struct wps_uuid_pin *pin, *prev;
+	struct wps_uuid_pin *pin;
 
-	dl_list_for_each_safe(pin, prev, &reg->pins, struct wps_uuid_pin, list)
-	{
-		if (os_memcmp(pin->uuid, uuid, WPS_UUID_LEN) == 0) {
-			wpa_hexdump(MSG_DEBUG, "WPS: Invalidated PIN for UUID",
-				    pin->uuid, WPS_UUID_LEN);
-			wps_registrar_remove_pin(reg, pin);
-			return 0;
-		}
-	}
+	pin = wps_registrar_find_pin(reg, uuid);
+	if (pin == NULL)
+		return -1;
 
-	return -1;
+	wpa_hexdump(MSG_DEBUG, "WPS: Invalidated PIN for UUID",
+		    pin->uuid, WPS_UUID_LEN);
+	wps_registrar_remove_pin(reg, pin);
+	return 0;
 }
 
 
@@ -798,7 +1016,8 @@ static const u8 * wps_registrar_get_pin(struct wps_registrar *reg,
 
 	wps_registrar_expire_pins(reg);
 
-	dl_list_for_each(pin, &reg->pins, struct wps_uuid_pin, list) {
+	dl_list_for_each(pin, wps_pin_bucket(reg, uuid), struct wps_uuid_pin,
+			 hash) {
 		if (!pin->wildcard_uuid &&
 		    os_memcmp(pin->uuid, uuid, WPS_UUID_LEN) == 0) {
 			found = pin;
@@ -809,15 +1028,16 @@ static const u8 * wps_registrar_get_pin(struct wps_registrar *reg,
 	if (!found) {
 		/* Check for wildcard UUIDs since none of the UUID-specific
 		 * PINs matched */
-		dl_list_for_each(pin, &reg->pins, struct wps_uuid_pin, list) {
-			if (pin->wildcard_uuid == 1) {
-				wpa_printf(MSG_DEBUG, "WPS: Found a wildcard "
-					   "PIN. Assigned it for this UUID-E");
-				pin->wildcard_uuid = 2;
-				os_memcpy(pin->uuid, uuid, WPS_UUID_LEN);
-				found = pin;
-				break;
-			}
+		pin = dl_list_first(&reg->wildcard_pins, struct wps_uuid_pin,
+				    hash);
+		if (pin) {
+			wpa_printf(MSG_DEBUG, "WPS: Found a wildcard "
+				   "PIN. Assigned it for this UUID-E");
+			pin->wildcard_uuid = 2;
+			os_memcpy(pin->uuid, uuid, WPS_UUID_LEN);
+			dl_list_del(&pin->hash);
+			dl_list_add(wps_pin_bucket(reg, uuid), &pin->hash);
+			found = pin;
 		}
 	}
 
@@ -853,19 +1073,16 @@ int wps_registrar_unlock_pin(struct wps_registrar *reg, const u8 *uuid)
 {
 	struct wps_uuid_pin *pin;
 
-	dl_list_for_each(pin, &reg->pins, struct wps_uuid_pin, list) {
-		if (os_memcmp(pin->uuid, uuid, WPS_UUID_LEN) == 0) {
-			if (pin->wildcard_uuid == 2) {
-				wpa_printf(MSG_DEBUG, "WPS: Invalidating used "
-					   "wildcard PIN");
-				return wps_registrar_invalidate_pin(reg, uuid);
-			}
-			pin->flags &= ~PIN_LOCKED;
-			return 0;
-		}
-	}
+	pin = wps_registrar_find_pin(reg, uuid);
+	if (pin == NULL)
+		return -1;
 
-	return -1;
+	if (pin->wildcard_uuid == 2) {
+		wpa_printf(MSG_DEBUG, "WPS: Invalidating used wildcard PIN");
+		return wps_registrar_invalidate_pin(reg, uuid);
+	}
+	pin->flags &= ~PIN_LOCKED;
+	return 0;
 }
 
 
@@ -972,70 +1189,65 @@ int wps_registrar_wps_cancel(struct wps_registrar *reg)
  * wps_registrar_probe_req_rx - Notify Registrar of Probe Request
  * @reg: Registrar data from wps_registrar_init()
  * @addr: MAC address of the Probe Request sender
- * @wps_data: WPS IE contents
+ * @attr: WPS attributes from wps_parse_probe_req_ies()
+ * @p2p_wildcard: Whether the Probe Request was for the P2P Wildcard SSID
  *
  * This function is called on an AP when a Probe Request with WPS IE is
  * received. This is used to track PBC mode use and to detect possible overlap
  * situation with other WPS APs.
  */
 void wps_registrar_probe_req_rx(struct wps_registrar *reg, const u8 *addr,
-				const struct wpabuf *wps_data,
+				const struct wps_probe_req_attr *attr,
 				int p2p_wildcard)
 {
-	struct wps_parse_attr attr;
-
-	wpa_hexdump_buf(MSG_MSGDUMP,
-			"WPS: Probe Request with WPS data received",
-			wps_data);
+	wpa_printf(MSG_MSGDUMP, "WPS: Probe Request with WPS data received "
+		   "from " MACSTR, MAC2STR(addr));
 
-	if (wps_parse_msg(wps_data, &attr) < 0)
-		return;
-
-	if (attr.config_methods == NULL) {
+	if (attr->config_methods == NULL) {
 		wpa_printf(MSG_DEBUG, "WPS: No Config Methods attribute in "
 			   "Probe Request");
 		return;
 	}
 
-	if (attr.dev_password_id == NULL) {
+	if (attr->dev_password_id == NULL) {
 		wpa_printf(MSG_DEBUG, "WPS: No Device Password Id attribute "
 			   "in Probe Request");
 		return;
 	}
 
-	if (reg->enrollee_seen_cb && attr.uuid_e &&
-	    attr.primary_dev_type && attr.request_type && !p2p_wildcard) {
-		char *dev_name = NULL;
-		if (attr.dev_name) {
-			dev_name = os_zalloc(attr.dev_name_len + 1);
-			if (dev_name) {
-				os_memcpy(dev_name, attr.dev_name,
-					  attr.dev_name_len);
-			}
+	if (reg->enrollee_seen_cb && attr->uuid_e &&
+	    attr->primary_dev_type && attr->request_type && !p2p_wildcard) {
+		char dev_name[WPS_DEV_NAME_MAX_LEN + 1], *name = NULL;
+		if (attr->dev_name) {
+			size_t len = attr->dev_name_len;
+			if (len > WPS_DEV_NAME_MAX_LEN)
+				len = WPS_DEV_NAME_MAX_LEN;
+			os_memcpy(dev_name, attr->dev_name, len);
+			dev_name[len] = '\0';
+			name = dev_name;
 		}
-		reg->enrollee_seen_cb(reg->cb_ctx, addr, attr.uuid_e,
-				      attr.primary_dev_type,
-				      WPA_GET_BE16(attr.config_methods),
-				      WPA_GET_BE16(attr.dev_password_id),
-				      *attr.request_type, dev_name);
-		os_free(dev_name);
+		reg->enrollee_seen_cb(reg->cb_ctx, addr, attr->uuid_e,
+				      attr->primary_dev_type,
+				      WPA_GET_BE16(attr->config_methods),
+				      WPA_GET_BE16(attr->dev_password_id),
+				      *attr->request_type, name);
 	}
 
-	if (WPA_GET_BE16(attr.dev_password_id) != DEV_PW_PUSHBUTTON)
+	if (WPA_GET_BE16(attr->dev_password_id) != DEV_PW_PUSHBUTTON)
 		return; /* Not PBC */
 
 	wpa_printf(MSG_DEBUG, "WPS: Probe Request for PBC received from "
 		   MACSTR, MAC2STR(addr));
-	if (attr.uuid_e == NULL) {
+	if (attr->uuid_e == NULL) {
 		wpa_printf(MSG_DEBUG, "WPS: Invalid Probe Request WPS IE: No "
 			   "UUID-E included");
 		return;
 	}
-	wpa_hexdump(MSG_DEBUG, "WPS: UUID-E from Probe Request", attr.uuid_e,
+	wpa_hexdump(MSG_DEBUG, "WPS: UUID-E from Probe Request", attr->uuid_e,
 		    WPS_UUID_LEN);
 
-	wps_registrar_add_pbc_session(reg, addr, attr.uuid_e);
-	if (wps_registrar_pbc_overlap(reg, addr, attr.uuid_e)) {
+	wps_registrar_add_pbc_session(reg, addr, attr->uuid_e);
+	if (wps_registrar_pbc_overlap(reg, addr, attr->uuid_e)) {
 		wpa_printf(MSG_DEBUG, "WPS: PBC session overlap detected");
 		reg->force_pbc_overlap = 1;
 		wps_pbc_overlap_event(reg->wps);
@@ -216,8 +216,8 @@
 static struct upnp_wps_device_sm *shared_upnp_device = NULL;
 
 
-/* Write the current date/time per RFC */
-void format_date(struct wpabuf *buf)
+/* Write the current date/time per RFC into a nul terminated string */
+void format_date_str(char *buf, size_t len)
 {
 	const char *weekday_str = "Sun\0Mon\0Tue\0Wed\0Thu\0Fri\0Sat";
 	const char *month_str = "Jan\0Feb\0Mar\0Apr\0May\0Jun\0"
@@ -227,10 +227,20 @@ void format_date(struct wpabuf *buf)
 
 	t = time(NULL);
 	date = gmtime(&t);
-	wpabuf_printf(buf, "%s, %02d %s %d %02d:%02d:%02d GMT",
-		      &weekday_str[date->tm_wday * 4], date->tm_mday,
-		      &month_str[date->tm_mon * 4], date->tm_year + 1900,
-		      date->tm_hour, date->tm_min, date->tm_sec);
+	os_snprintf(buf, len, "%s, %02d %s %d %02d:%02d:%02d GMT",
+		    &weekday_str[date->tm_wday * 4], date->tm_mday,
+		    &month_str[date->tm_mon * 4], date->tm_year + 1900,
+		    date->tm_hour, date->tm_min, date->tm_sec);
+}
+
+
+/* Write the current date/time per RFC */
+void format_date(struct wpabuf *buf)
+{
+	char date[40];
+
+	format_date_str(date, sizeof(date));
+	wpabuf_put_str(buf, date);
 }
 
 
@@ -278,6 +288,7 @@ static void uuid_make(u8 uuid[UUID_LEN])
  */
 void subscr_addr_delete(struct subscr_addr *a)
 {
+	event_addr_conn_close(a);
 	/*
 	 * Note: do NOT free domain_and_port or path because they point to
 	 * memory within the allocation of "a".
@@ -473,6 +484,7 @@ static void upnp_wps_device_send_event(struct upnp_wps_device_sm *sm)
 {
 	/* Enqueue event message for all subscribers */
 	struct wpabuf *buf; /* holds event message */
+	struct upnp_event_data *data;
 	int buf_size = 0;
 	struct subscription *s, *tmp;
 	/* Actually, utf-8 is the default, but it doesn't hurt to specify it */
@@ -529,13 +541,18 @@ static void upnp_wps_device_send_event(struct upnp_wps_device_sm *sm)
 	wpa_printf(MSG_MSGDUMP, "WPS UPnP: WLANEvent message:\n%s",
 		   (char *) wpabuf_head(buf));
 
+	/* The same message body is shared by all subscribers */
+	data = event_data_alloc(buf);
+	if (data == NULL)
+		return;
+
 	dl_list_for_each_safe(s, tmp, &sm->subscriptions, struct subscription,
 			      list) {
-		event_add(s, buf,
-			  sm->wlanevent_type == UPNP_WPS_WLANEVENT_TYPE_PROBE);
+		event_add_shared(s, data, sm->wlanevent_type ==
+				 UPNP_WPS_WLANEVENT_TYPE_PROBE);
 	}
 
-	wpabuf_free(buf);
+	event_data_unref(data);
 }
 
 
@@ -550,7 +567,8 @@ static void upnp_wps_device_send_event(struct upnp_wps_device_sm *sm)
  */
 void subscription_destroy(struct subscription *s)
 {
-	wpa_printf(MSG_DEBUG, "WPS UPnP: Destroy subscription %p", s);
+	wpa_printf(MSG_DEBUG, "WPS UPnP: Destroy subscription %p (%u events "
+		   "dropped)", s, s->num_events_dropped);
 	subscr_addr_free_all(s);
 	event_delete_all(s);
 	upnp_er_remove_notification(s);
@@ -1106,6 +1124,9 @@ void upnp_wps_device_deinit(struct upnp_wps_device_sm *sm, void *priv)
 	os_free(iface->ctx);
 	os_free(iface);
 
+	if (sm->started && !dl_list_empty(&sm->interfaces))
+		web_files_update(sm);
+
 	if (dl_list_empty(&sm->interfaces)) {
 		os_free(sm->root_dir);
 		os_free(sm->desc_url);
@@ -1162,6 +1183,7 @@ upnp_wps_device_init(struct upnp_wps_device_ctx *ctx, struct wps_context *wps,
 
 		dl_list_init(&sm->msearch_replies);
 		dl_list_init(&sm->subscriptions);
+		dl_list_init(&sm->event_delivery_queue);
 		dl_list_init(&sm->interfaces);
 		start = 1;
 	}
@@ -1173,11 +1195,31 @@ upnp_wps_device_init(struct upnp_wps_device_ctx *ctx, struct wps_context *wps,
 		return NULL;
 	}
 
+	/* The new instance is now the first one that describes the device */
+	if (!start && sm->started)
+		web_files_update(sm);
+
 
 	return sm;
 }
 
 
+/**
+ * upnp_wps_device_update_desc - Update device description
+ * @sm: WPS UPnP state machine from upnp_wps_device_init()
+ * Returns: 0 on success, -1 on failure
+ *
+ * This function needs to be called when the WPS configuration used in the
+ * device description (e.g., friendly_name) has been changed.
+ */
+int upnp_wps_device_update_desc(struct upnp_wps_device_sm *sm)
+{
+	if (sm == NULL || !sm->started)
+		return 0;
+	return web_files_update(sm);
+}
+
+
 /**
  * upnp_wps_subscribers - Check whether there are any event subscribers
  * @sm: WPS UPnP state machine from upnp_wps_device_init()
@@ -22,16 +22,24 @@
 /*
  * Event message generation (to subscribers)
  *
- * We make a separate copy for each message for each subscriber. This memory
- * wasted could be limited (adding code complexity) by sharing copies, keeping
- * a usage count and freeing when zero.
+ * The message body is formatted once and shared (with a usage count) by all
+ * the subscribers; only the NOTIFY header is built separately for each
+ * subscriber when the message is being sent.
  *
  * Sending a message requires using a HTTP over TCP NOTIFY
- * (like a PUT) which requires a number of states..
+ * (like a PUT) which requires a number of states.. The connection is kept
+ * open after a successful transaction if the subscriber allows it, so that
+ * the following events can be sent without new TCP connection setup.
+ *
+ * The number of NOTIFY transactions in progress is limited. Subscriptions
+ * with queued events wait for a free slot in a FIFO delivery queue so that
+ * all subscribers get their turn.
  */
 
 #define MAX_EVENTS_QUEUED 20   /* How far behind queued events */
 #define MAX_FAILURES 10 /* Drop subscription after this many failures */
+#define MAX_EVENT_DELIVERIES 8 /* max simultaneous NOTIFY transactions */
+#define EVENT_CONN_IDLE_SEC 30 /* close idle persistent connection */
 
 /* How long to wait before sending event */
 #define EVENT_DELAY_SECONDS 0
@@ -42,8 +50,6 @@
  * struct. The event cannot be sent by simple UDP; it has to be sent by a HTTP
  * over TCP transaction which requires various states.. It may also need to be
  * retried at a different address (if more than one is available).
- *
- * TODO: As an optimization we could share data between subscribers.
  */
 struct wps_event_ {
 	struct dl_list list;
@@ -51,20 +57,112 @@ struct wps_event_ {
 	unsigned subscriber_sequence;   /* which event for this subscription*/
 	unsigned int retry;             /* which retry */
 	struct subscr_addr *addr;       /* address to connect to */
-	struct wpabuf *data;            /* event data to send */
+	struct upnp_event_data *data;   /* event data to send (shared) */
 	struct http_client *http_event;
+	int conn_reused;                /* sending over persistent connection */
+};
+
+/* Event message body shared by all the subscribers */
+struct upnp_event_data {
+	unsigned int refcnt;
+	struct wpabuf *body;
 };
 
 
+/**
+ * event_data_alloc - Allocate shared event data
+ * @body: Event message body; this is freed by event_data_unref() or on failure
+ * Returns: Event data with one reference or %NULL on failure
+ */
+struct upnp_event_data * event_data_alloc(struct wpabuf *body)
+{
+	struct upnp_event_data *data;
+
+	if (body == NULL)
+		return NULL;
+	data = os_zalloc(sizeof(*data));
+	if (data == NULL) {
+		wpabuf_free(body);
+		return NULL;
+	}
+	data->refcnt = 1;
+	data->body = body;
+	return data;
+}
+
+
+/**
+ * event_data_unref - Release a reference to shared event data
+ * @data: Event data from event_data_alloc()
+ */
+void event_data_unref(struct upnp_event_data *data)
+{
+	if (data == NULL || --data->refcnt > 0)
+		return;
+	wpabuf_free(data->body);
+	os_free(data);
+}
+
+
+/* event_delivery_queue -- queue subscription for a free delivery slot */
+static void event_delivery_queue(struct subscription *s)
+{
+	struct upnp_wps_device_sm *sm = s->sm;
+
+	if (!s->delivery_queued) {
+		dl_list_add_tail(&sm->event_delivery_queue, &s->delivery_list);
+		s->delivery_queued = 1;
+	}
+	event_send_all_later(sm);
+}
+
+
+static void event_delivery_dequeue(struct subscription *s)
+{
+	if (s->delivery_queued) {
+		dl_list_del(&s->delivery_list);
+		s->delivery_queued = 0;
+	}
+}
+
+
+static void event_conn_idle_timeout(void *eloop_data, void *user_ctx)
+{
+	struct subscr_addr *a = eloop_data;
+
+	wpa_printf(MSG_DEBUG, "WPS UPnP: Close idle event connection to %s",
+		   a->domain_and_port);
+	http_client_free(a->conn);
+	a->conn = NULL;
+}
+
+
+/**
+ * event_addr_conn_close - Close persistent connection to subscriber address
+ * @a: Subscriber address
+ */
+void event_addr_conn_close(struct subscr_addr *a)
+{
+	if (a->conn == NULL)
+		return;
+	eloop_cancel_timeout(event_conn_idle_timeout, a, NULL);
+	http_client_free(a->conn);
+	a->conn = NULL;
+}
+
+
 /* event_clean -- clean sockets etc. of event
  * Leaves data, retry count etc. alone.
  */
 static void event_clean(struct wps_event_ *e)
 {
-	if (e->s->current_event == e)
+	if (e->s->current_event == e) {
 		e->s->current_event = NULL;
+		e->s->sm->num_event_deliveries--;
+	}
 	http_client_free(e->http_event);
 	e->http_event = NULL;
+	e->conn_reused = 0;
 }
 
 
@@ -75,7 +173,7 @@ static void event_delete(struct wps_event_ *e)
 {
 	wpa_printf(MSG_DEBUG, "WPS UPnP: Delete event %p", e);
 	event_clean(e);
-	wpabuf_free(e->data);
+	event_data_unref(e->data);
 	os_free(e);
 }
 
@@ -100,6 +198,7 @@ static struct wps_event_ *event_dequeue(struct subscription *s)
 void event_delete_all(struct subscription *s)
 {
 	struct wps_event_ *e;
+	event_delivery_dequeue(s);
 	while ((e = event_dequeue(s)) != NULL)
 		event_delete(e);
 	if (s->current_event) {
@@ -133,21 +232,24 @@ static void event_retry(struct wps_event_ *e, int do_next_address)
 			   "for %s", e->addr->domain_and_port);
 		event_delete(e);
 		s->last_event_failed = 1;
+		s->num_events_dropped++;
+		sm->num_events_dropped++;
 		if (!dl_list_empty(&s->event_queue))
-			event_send_all_later(s->sm);
+			event_delivery_queue(s);
 		return;
 	}
 	dl_list_add(&s->event_queue, &e->list);
-	event_send_all_later(sm);
+	event_delivery_queue(s);
 }
 
 
+/* event_build_message -- build NOTIFY header; the body is sent separately */
 static struct wpabuf * event_build_message(struct wps_event_ *e)
 {
 	struct wpabuf *buf;
 	char *b;
 
-	buf = wpabuf_alloc(1000 + wpabuf_len(e->data));
+	buf = wpabuf_alloc(1000);
 	if (buf == NULL)
 		return NULL;
 	wpabuf_printf(buf, "NOTIFY %s HTTP/1.1\r\n", e->addr->path);
@@ -163,9 +265,8 @@ static struct wpabuf * event_build_message(struct wps_event_ *e)
 	wpabuf_put_str(buf, "\r\n");
 	wpabuf_printf(buf, "SEQ: %u\r\n", e->subscriber_sequence);
 	wpabuf_printf(buf, "CONTENT-LENGTH: %d\r\n",
-		      (int) wpabuf_len(e->data));
+		      (int) wpabuf_len(e->data->body));
 	wpabuf_put_str(buf, "\r\n"); /* terminating empty line */
-	wpabuf_put_buf(buf, e->data);
 	return buf;
 }
 
@@ -174,6 +275,18 @@ static void event_addr_failure(struct wps_event_ *e)
 {
 	struct subscription *s = e->s;
 
+	if (e->conn_reused) {
+		/*
+		 * The subscriber may have closed the persistent connection
+		 * while it was idle; try again with a new connection before
+		 * considering this a failure.
+		 */
+		wpa_printf(MSG_DEBUG, "WPS UPnP: Persistent connection to %s "
+			   "failed - reconnect", e->addr->domain_and_port);
+		event_retry(e, 0);
+		return;
+	}
+
 	e->addr->num_failures++;
 	wpa_printf(MSG_DEBUG, "WPS UPnP: Failed to send event %p to %s "
 		   "(num_failures=%u)",
@@ -224,10 +337,22 @@ static void event_http_cb(void *ctx, struct http_client *c,
 			   e, e->addr->domain_and_port);
 		e->addr->num_failures = 0;
 		s->last_event_failed = 0;
+		s->sm->num_events_delivered++;
+		if (http_client_keep_alive(c)) {
+			/* Keep the connection for the following events */
+			event_addr_conn_close(e->addr);
+			e->addr->conn = c;
+			e->http_event = NULL;
+			eloop_register_timeout(EVENT_CONN_IDLE_SEC, 0,
+					       event_conn_idle_timeout,
+					       e->addr, NULL);
+		}
 		event_delete(e);
 
 		/* Schedule sending more if there is more to send */
 		if (!dl_list_empty(&s->event_queue))
+			event_delivery_queue(s);
+		else
 			event_send_all_later(s->sm);
 		break;
 	case HTTP_CLIENT_FAILED:
@@ -269,6 +394,7 @@ static void event_http_cb(void *ctx, struct http_client *c,
 static int event_send_start(struct subscription *s)
 {
 	struct wps_event_ *e;
+	struct subscr_addr *addr;
 	unsigned int itry;
 	struct wpabuf *buf;
 
@@ -284,14 +410,22 @@ static int event_send_start(struct subscription *s)
 		return -1;
 
 	s->current_event = e = event_dequeue(s);
+	s->sm->num_event_deliveries++;
 
 	/* Use address according to number of retries */
 	itry = 0;
-	dl_list_for_each(e->addr, &s->addr_list, struct subscr_addr, list)
-		if (itry++ == e->retry)
+	dl_list_for_each(addr, &s->addr_list, struct subscr_addr, list) {
+		if (itry++ == e->retry) {
+			e->addr = addr;
 			break;
-	if (itry < e->retry)
+		}
+	}
+	if (itry <= e->retry) {
+		event_delete(e);
+		s->num_events_dropped++;
+		s->sm->num_events_dropped++;
 		return -1;
+	}
 
 	buf = event_build_message(e);
 	if (buf == NULL) {
@@ -299,28 +433,64 @@ static int event_send_start(struct subscription *s)
 		return -1;
 	}
 
-	e->http_event = http_client_addr(&e->addr->saddr, buf, 0,
-					 event_http_cb, e);
+	if (e->addr->conn) {
+		/* Reuse the idle persistent connection */
+		eloop_cancel_timeout(event_conn_idle_timeout, e->addr, NULL);
+		e->http_event = e->addr->conn;
+		e->addr->conn = NULL;
+		if (http_client_reuse(e->http_event, buf, 0, event_http_cb,
+				      e) == 0) {
+			e->conn_reused = 1;
+			s->sm->num_event_conns_reused++;
+		} else {
+			http_client_free(e->http_event);
+			e->http_event = NULL;
+			buf = event_build_message(e);
+			if (buf == NULL) {
+				event_retry(e, 0);
+				return -1;
+			}
+		}
+	}
+
 	if (e->http_event == NULL) {
-		wpabuf_free(buf);
-		event_retry(e, 0);
-		return -1;
+		e->http_event = http_client_addr(&e->addr->saddr, buf, 0,
+						 event_http_cb, e);
+		if (e->http_event == NULL) {
+			wpabuf_free(buf);
+			event_retry(e, 0);
+			return -1;
+		}
+		s->sm->num_event_conns++;
 	}
+	http_client_set_req_body(e->http_event, e->data->body);
 
 	return 0;
 }
 
 
-/* event_send_all_later_handler -- actually send events as needed */
+/* event_send_all_later_handler -- actually send events as needed
+ *
+ * Subscriptions are served from the delivery queue in FIFO order as long as
+ * there are free delivery slots. Only the subscriptions that were queued when
+ * the handler started are served; a subscription whose delivery fails right
+ * away is queued again and will be retried on the next run.
+ */
 static void event_send_all_later_handler(void *eloop_data, void *user_ctx)
 {
 	struct upnp_wps_device_sm *sm = user_ctx;
-	struct subscription *s, *tmp;
+	struct subscription *s;
+	unsigned int num;
 	int nerrors = 0;
 
 	sm->event_send_all_queued = 0;
-	dl_list_for_each_safe(s, tmp, &sm->subscriptions, struct subscription,
-			      list) {
+	num = dl_list_len(&sm->event_delivery_queue);
+	while (num-- > 0 && sm->num_event_deliveries < MAX_EVENT_DELIVERIES) {
+		s = dl_list_first(&sm->event_delivery_queue,
+				  struct subscription, delivery_list);
+		if (s == NULL)
+			break;
+		event_delivery_dequeue(s);
 		if (s->current_event == NULL /* not busy */ &&
 		    !dl_list_empty(&s->event_queue) /* more to do */) {
 			if (event_send_start(s))
@@ -328,6 +498,12 @@ static void event_send_all_later_handler(void *eloop_data, void *user_ctx)
 		}
 	}
 
+	if (!dl_list_empty(&sm->event_delivery_queue))
+		wpa_printf(MSG_DEBUG, "WPS UPnP: %u subscriptions waiting for "
+			   "event delivery (%u in progress)",
+			   dl_list_len(&sm->event_delivery_queue),
+			   sm->num_event_deliveries);
+
 	if (nerrors) {
 		/* Try again later */
 		event_send_all_later(sm);
@@ -362,25 +538,34 @@ void event_send_stop_all(struct upnp_wps_device_sm *sm)
 	if (sm->event_send_all_queued)
 		eloop_cancel_timeout(event_send_all_later_handler, NULL, sm);
 	sm->event_send_all_queued = 0;
+	wpa_printf(MSG_DEBUG, "WPS UPnP: Events delivered=%u dropped=%u "
+		   "connections=%u reused=%u",
+		   sm->num_events_delivered, sm->num_events_dropped,
+		   sm->num_event_conns, sm->num_event_conns_reused);
 }
 
 
 /**
- * event_add - Add a new event to a queue
+ * event_add_shared - Add a new event with shared data to a queue
  * @s: Subscription
- * @data: Event data (is copied; caller retains ownership)
+ * @data: Event data from event_data_alloc(); a new reference is taken
  * @probereq: Whether this is a Probe Request event
  * Returns: 0 on success, -1 on error, 1 on max event queue limit reached
  */
-int event_add(struct subscription *s, const struct wpabuf *data, int probereq)
+int event_add_shared(struct subscription *s, struct upnp_event_data *data,
+		     int probereq)
 {
+	struct upnp_wps_device_sm *sm = s->sm;
 	struct wps_event_ *e;
 	unsigned int len;
 
 	len = dl_list_len(&s->event_queue);
 	if (len >= MAX_EVENTS_QUEUED) {
 		wpa_printf(MSG_DEBUG, "WPS UPnP: Too many events queued for "
-			   "subscriber %p", s);
+			   "subscriber %p (%u dropped)", s,
+			   s->num_events_dropped + 1);
+		s->num_events_dropped++;
+		sm->num_events_dropped++;
 		if (probereq)
 			return 1;
 
@@ -399,6 +584,8 @@ int event_add(struct subscription *s, const struct wpabuf *data, int probereq)
 		wpa_printf(MSG_DEBUG, "WPS UPnP: Do not queue more Probe "
 			   "Request frames for subscription %p since last "
 			   "delivery failed", s);
+		s->num_events_dropped++;
+		sm->num_events_dropped++;
 		return -1;
 	}
 
@@ -407,17 +594,35 @@ int event_add(struct subscription *s, const struct wpabuf *data, int probereq)
 		return -1;
 	dl_list_init(&e->list);
 	e->s = s;
-	e->data = wpabuf_dup(data);
-	if (e->data == NULL) {
-		os_free(e);
-		return -1;
-	}
+	e->data = data;
+	data->refcnt++;
 	e->subscriber_sequence = s->next_subscriber_sequence++;
 	if (s->next_subscriber_sequence == 0)
 		s->next_subscriber_sequence++;
 	wpa_printf(MSG_DEBUG, "WPS UPnP: Queue event %p for subscriber %p "
 		   "(queue len %u)", e, s, len + 1);
 	dl_list_add_tail(&s->event_queue, &e->list);
-	event_send_all_later(s->sm);
+	event_delivery_queue(s);
 	return 0;
 }
+
+
+/**
+ * event_add - Add a new event to a queue
+ * @s: Subscription
+ * @data: Event data (is copied; caller retains ownership)
+ * @probereq: Whether this is a Probe Request event
+ * Returns: 0 on success, -1 on error, 1 on max event queue limit reached
+ */
+int event_add(struct subscription *s, const struct wpabuf *data, int probereq)
+{
+	struct upnp_event_data *d;
+	int ret;
+
+	d = event_data_alloc(wpabuf_dup(data));
+	if (d == NULL)
+		return -1;
+	ret = event_add_shared(s, d, probereq);
+	event_data_unref(d);
+	return ret;
+}
@@ -33,6 +33,7 @@
 
 struct upnp_wps_device_sm;
 struct wps_registrar;
+struct http_client;
 
 
 enum advertisement_type_enum {
@@ -68,6 +69,7 @@ struct subscr_addr {
 	char *path; /* "filepath" part of url (from "mem") */
 	struct sockaddr_in saddr; /* address for doing connect */
 	unsigned num_failures;
+	struct http_client *conn; /* idle persistent connection or NULL */
 };
 
 
@@ -93,6 +95,9 @@ struct subscription {
 	struct wps_event_ *current_event; /* non-NULL if being sent (not in q)
 					   */
 	int last_event_failed; /* Whether delivery of last event failed */
+	struct dl_list delivery_list; /* entry in sm->event_delivery_queue */
+	int delivery_queued; /* nonzero if in sm->event_delivery_queue */
+	unsigned int num_events_dropped; /* events not queued or given up */
 
 	/* Information from SetSelectedRegistrar action */
 	u8 selected_registrar;
@@ -113,6 +118,15 @@ struct upnp_wps_device_interface {
 	struct upnp_wps_peer peer;
 };
 
+/*
+ * Pre-rendered response for one of the "files" served over HTTP: the headers
+ * that do not change (hdr_len octets) followed by the body.
+ */
+struct upnp_web_file {
+	struct wpabuf *buf;
+	size_t hdr_len;
+};
+
 /*
  * Our instance data corresponding to the AP device. Note that there may be
  * multiple wireless interfaces sharing the same UPnP device instance. Each
@@ -137,10 +151,22 @@ struct upnp_wps_device_sm {
 	struct dl_list msearch_replies;
 	int web_port; /* our port that others get xml files from */
 	struct http_server *web_srv;
+	struct upnp_web_file web_device_xml; /* UPNP_WPS_DEVICE_XML_FILE */
+	struct upnp_web_file web_scpd_xml; /* UPNP_WPS_SCPD_XML_FILE */
+	char web_date[50]; /* Date header for web_date_time */
+	time_t web_date_time;
 	/* Note: subscriptions are kept in expiry order */
 	struct dl_list subscriptions;
 	int event_send_all_queued; /* if we are scheduled to send events soon
 				    */
+	/* Subscriptions waiting for a free event delivery slot */
+	struct dl_list event_delivery_queue;
+	unsigned int num_event_deliveries; /* NOTIFY transactions in progress */
+	/* Event delivery statistics */
+	unsigned int num_events_delivered;
+	unsigned int num_events_dropped;
+	unsigned int num_event_conns; /* new connections */
+	unsigned int num_event_conns_reused; /* persistent connections reused */
 
 	char *wlanevent; /* the last WLANEvent data */
 	enum upnp_wps_wlanevent_type wlanevent_type;
@@ -150,6 +176,7 @@ struct upnp_wps_device_sm {
 
 /* wps_upnp.c */
 void format_date(struct wpabuf *buf);
+void format_date_str(char *buf, size_t len);
 struct subscription * subscription_start(struct upnp_wps_device_sm *sm,
 					 const char *callback_urls);
 struct subscription * subscription_renew(struct upnp_wps_device_sm *sm,
@@ -177,9 +204,16 @@ int ssdp_open_multicast(struct upnp_wps_device_sm *sm);
 /* wps_upnp_web.c */
 int web_listener_start(struct upnp_wps_device_sm *sm);
 void web_listener_stop(struct upnp_wps_device_sm *sm);
+int web_files_update(struct upnp_wps_device_sm *sm);
 
 /* wps_upnp_event.c */
+struct upnp_event_data;
+struct upnp_event_data * event_data_alloc(struct wpabuf *body);
+void event_data_unref(struct upnp_event_data *data);
+int event_add_shared(struct subscription *s, struct upnp_event_data *data,
+		     int probereq);
 int event_add(struct subscription *s, const struct wpabuf *data, int probereq);
+void event_addr_conn_close(struct subscr_addr *a);
 void event_delete_all(struct subscription *s);
 void event_send_all_later(struct upnp_wps_device_sm *sm);
 void event_send_stop_all(struct upnp_wps_device_sm *sm);
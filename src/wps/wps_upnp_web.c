@@ -284,6 +284,118 @@ static void http_put_empty(struct wpabuf *buf, enum http_reply_code code)
 }
 
 
+/* web_file_render -- pre-render the response for one of the "files" that we
+ * serve. The response is stored as the HTTP headers that do not change (i.e.,
+ * everything but the Date header) followed by the body so that a GET can be
+ * answered without formatting anything but the current date.
+ */
+static int web_file_render(struct upnp_wps_device_sm *sm,
+			   struct upnp_web_file *file, int device_xml)
+{
+	struct wpabuf *body, *buf;
+	size_t len;
+
+	len = 3000;
+	if (device_xml) {
+		struct upnp_wps_device_interface *iface;
+		iface = dl_list_first(&sm->interfaces,
+				      struct upnp_wps_device_interface, list);
+		if (iface->wps->friendly_name)
+			len += os_strlen(iface->wps->friendly_name);
+		if (iface->wps->manufacturer_url)
+			len += os_strlen(iface->wps->manufacturer_url);
+		if (iface->wps->model_description)
+			len += os_strlen(iface->wps->model_description);
+		if (iface->wps->model_url)
+			len += os_strlen(iface->wps->model_url);
+		if (iface->wps->upc)
+			len += os_strlen(iface->wps->upc);
+	} else
+		len += os_strlen(wps_scpd_xml);
+
+	body = wpabuf_alloc(len);
+	if (body == NULL)
+		return -1;
+	if (device_xml)
+		format_wps_device_xml(sm, body);
+	else
+		wpabuf_put_str(body, wps_scpd_xml);
+
+	buf = wpabuf_alloc(200 + wpabuf_len(body));
+	if (buf == NULL) {
+		wpabuf_free(body);
+		return -1;
+	}
+	wpabuf_put_str(buf,
+		       "HTTP/1.1 200 OK\r\n"
+		       "Content-Type: text/xml; charset=\"utf-8\"\r\n");
+	wpabuf_put_str(buf, "Server: Unspecified, UPnP/1.0, Unspecified\r\n");
+	wpabuf_put_str(buf, "Connection: close\r\n");
+	wpabuf_printf(buf, "Content-Length: %lu\r\n",
+		      (unsigned long) wpabuf_len(body));
+	file->hdr_len = wpabuf_len(buf);
+	wpabuf_put_buf(buf, body);
+	wpabuf_free(body);
+
+	wpabuf_free(file->buf);
+	file->buf = buf;
+	return 0;
+}
+
+
+/**
+ * web_files_update - Pre-render the device description and SCPD responses
+ * @sm: WPS UPnP state machine from upnp_wps_device_init()
+ * Returns: 0 on success, -1 on failure
+ *
+ * This needs to be called whenever the device description may have changed,
+ * i.e., when the first interface instance or its WPS configuration changes.
+ */
+int web_files_update(struct upnp_wps_device_sm *sm)
+{
+	if (dl_list_empty(&sm->interfaces))
+		return -1;
+	if (web_file_render(sm, &sm->web_device_xml, 1) ||
+	    web_file_render(sm, &sm->web_scpd_xml, 0)) {
+		wpa_printf(MSG_INFO, "WPS UPnP: Failed to render device "
+			   "description");
+		return -1;
+	}
+	wpa_printf(MSG_DEBUG, "WPS UPnP: Rendered device description (%lu "
+		   "bytes) and SCPD (%lu bytes)",
+		   (unsigned long) wpabuf_len(sm->web_device_xml.buf),
+		   (unsigned long) wpabuf_len(sm->web_scpd_xml.buf));
+	return 0;
+}
+
+
+static void web_files_free(struct upnp_wps_device_sm *sm)
+{
+	wpabuf_free(sm->web_device_xml.buf);
+	sm->web_device_xml.buf = NULL;
+	wpabuf_free(sm->web_scpd_xml.buf);
+	sm->web_scpd_xml.buf = NULL;
+}
+
+
+/* web_date_hdr -- Date header line (and the terminating empty line) for the
+ * current second; reformatted only when the time has changed
+ */
+static const char * web_date_hdr(struct upnp_wps_device_sm *sm)
+{
+	time_t t = time(NULL);
+
+	if (t != sm->web_date_time || sm->web_date[0] == '\0') {
+		char date[40];
+		format_date_str(date, sizeof(date));
+		os_snprintf(sm->web_date, sizeof(sm->web_date),
+			    "Date: %s\r\n\r\n", date);
+		sm->web_date_time = t;
+	}
+	return sm->web_date;
+}
+
+
 /* Given that we have received a header w/ GET, act upon it
  *
  * Format of GET (case-insensitive):
@@ -301,24 +413,17 @@ static void http_put_empty(struct wpabuf *buf, enum http_reply_code code)
  * Header lines must end with \r\n
  * Per RFC 2616, content-length: is not required but connection:close
  * would appear to be required (given that we will be closing it!).
+ *
+ * The responses are pre-rendered in web_files_update(), so only the Date
+ * header is added here and the response is sent with a single writev().
  */
 static void web_connection_parse_get(struct upnp_wps_device_sm *sm,
 				     struct http_request *hreq, char *filename)
 {
 	struct wpabuf *buf; /* output buffer, allocated */
-	char *put_length_here;
-	char *body_start;
-	enum {
-		GET_DEVICE_XML_FILE,
-		GET_SCPD_XML_FILE
-	} req;
-	size_t extra_len = 0;
-	int body_length;
-	char len_buf[10];
-	struct upnp_wps_device_interface *iface;
-
-	iface = dl_list_first(&sm->interfaces,
-			      struct upnp_wps_device_interface, list);
+	struct upnp_web_file *file;
+	struct iovec iov[3];
+	const char *date;
 
 	/*
 	 * It is not required that filenames be case insensitive but it is
@@ -328,22 +433,10 @@ static void web_connection_parse_get(struct upnp_wps_device_sm *sm,
 		filename = "(null)"; /* just in case */
 	if (os_strcasecmp(filename, UPNP_WPS_DEVICE_XML_FILE) == 0) {
 		wpa_printf(MSG_DEBUG, "WPS UPnP: HTTP GET for device XML");
-		req = GET_DEVICE_XML_FILE;
-		extra_len = 3000;
-		if (iface->wps->friendly_name)
-			extra_len += os_strlen(iface->wps->friendly_name);
-		if (iface->wps->manufacturer_url)
-			extra_len += os_strlen(iface->wps->manufacturer_url);
-		if (iface->wps->model_description)
-			extra_len += os_strlen(iface->wps->model_description);
-		if (iface->wps->model_url)
-			extra_len += os_strlen(iface->wps->model_url);
-		if (iface->wps->upc)
-			extra_len += os_strlen(iface->wps->upc);
+		file = &sm->web_device_xml;
 	} else if (!os_strcasecmp(filename, UPNP_WPS_SCPD_XML_FILE)) {
 		wpa_printf(MSG_DEBUG, "WPS UPnP: HTTP GET for SCPD XML");
-		req = GET_SCPD_XML_FILE;
-		extra_len = os_strlen(wps_scpd_xml);
+		file = &sm->web_scpd_xml;
 	} else {
 		/* File not found */
 		wpa_printf(MSG_DEBUG, "WPS UPnP: HTTP GET file not found: %s",
@@ -362,51 +455,29 @@ static void web_connection_parse_get(struct upnp_wps_device_sm *sm,
 		/* terminating empty line */
 		wpabuf_put_str(buf, "\r\n");
 
-		goto send_buf;
-	}
-
-	buf = wpabuf_alloc(1000 + extra_len);
-	if (buf == NULL) {
-		http_request_deinit(hreq);
+		http_request_send_and_deinit(hreq, buf);
 		return;
 	}
 
-	wpabuf_put_str(buf,
-		       "HTTP/1.1 200 OK\r\n"
-		       "Content-Type: text/xml; charset=\"utf-8\"\r\n");
-	wpabuf_put_str(buf, "Server: Unspecified, UPnP/1.0, Unspecified\r\n");
-	wpabuf_put_str(buf, "Connection: close\r\n");
-	wpabuf_put_str(buf, "Content-Length: ");
-	/*
-	 * We will paste the length in later, leaving some extra whitespace.
-	 * HTTP code is supposed to be tolerant of extra whitespace.
-	 */
-	put_length_here = wpabuf_put(buf, 0);
-	wpabuf_put_str(buf, "        \r\n");
-
-	http_put_date(buf);
-
-	/* terminating empty line */
-	wpabuf_put_str(buf, "\r\n");
-
-	body_start = wpabuf_put(buf, 0);
-
-	switch (req) {
-	case GET_DEVICE_XML_FILE:
-		format_wps_device_xml(sm, buf);
-		break;
-	case GET_SCPD_XML_FILE:
-		wpabuf_put_str(buf, wps_scpd_xml);
-		break;
+	if (file->buf == NULL && web_files_update(sm) < 0) {
+		buf = wpabuf_alloc(200);
+		if (buf == NULL) {
+			http_request_deinit(hreq);
+			return;
+		}
+		http_put_empty(buf, HTTP_INTERNAL_SERVER_ERROR);
+		http_request_send_and_deinit(hreq, buf);
+		return;
 	}
 
-	/* Now patch in the content length at the end */
-	body_length = (char *) wpabuf_put(buf, 0) - body_start;
-	os_snprintf(len_buf, 10, "%d", body_length);
-	os_memcpy(put_length_here, len_buf, os_strlen(len_buf));
-
-send_buf:
-	http_request_send_and_deinit(hreq, buf);
+	date = web_date_hdr(sm);
+	iov[0].iov_base = (void *) wpabuf_head(file->buf);
+	iov[0].iov_len = file->hdr_len;
+	iov[1].iov_base = (void *) date;
+	iov[1].iov_len = os_strlen(date);
+	iov[2].iov_base = (void *) (wpabuf_head_u8(file->buf) + file->hdr_len);
+	iov[2].iov_len = wpabuf_len(file->buf) - file->hdr_len;
+	http_request_sendv_and_deinit(hreq, iov, 3);
 }
 
 
@@ -1305,6 +1376,7 @@ void web_listener_stop(struct upnp_wps_device_sm *sm)
 {
 	http_server_deinit(sm->web_srv);
 	sm->web_srv = NULL;
+	web_files_free(sm);
 }
 
 
@@ -1320,5 +1392,10 @@ int web_listener_start(struct upnp_wps_device_sm *sm)
 	}
 	sm->web_port = http_server_get_port(sm->web_srv);
 
+	if (web_files_update(sm)) {
+		web_listener_stop(sm);
+		return -1;
+	}
+
 	return 0;
 }
@@ -0,0 +1,333 @@
+/*
+ * ACS channel scoring algorithms - offline evaluator and test program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ *
+ * Runs all ACS scoring algorithms over recorded survey data and reports the
+ * selected channel and the airtime that was available on it according to the
+ * surveys, together with the best available airtime of any channel.
+ *
+ * Usage: test-acs [hostapd debug log or trace file...]
+ *
+ * Survey data is read from "ACS: survey freq=.. nf=.. time=.. busy=.. rx=..
+ * tx=.. bss=.." lines (as written to hostapd debug log during ACS). A line
+ * with "ACS: using survey" (start of a new ACS run in hostapd debug log)
+ * starts a new run. Without arguments, a built-in trace is evaluated and the
+ * selections are verified.
+ */
+
+#include "utils/includes.h"
+
+#include "utils/common.h"
+#include "drivers/driver.h"
+#include "ap/acs_score.h"
+
+#define MAX_CHANNELS 64
+
+struct acs_run {
+	struct hostapd_channel_data chan[MAX_CHANNELS];
+	int num_bss[MAX_CHANNELS];
+	int num_chan;
+	s8 lowest_nf;
+};
+
+struct acs_eval {
+	int runs;
+	int best[NUM_ACS_ALGO]; /* runs where the best channel was selected */
+	double airtime[NUM_ACS_ALGO];
+	double best_airtime;
+};
+
+static void run_init(struct acs_run *run)
+{
+	int i;
+
+	os_memset(run, 0, sizeof(*run));
+	for (i = 0; i < MAX_CHANNELS; i++)
+		dl_list_init(&run->chan[i].survey_list);
+}
+
+static void run_deinit(struct acs_run *run)
+{
+	struct freq_survey *survey, *tmp;
+	int i;
+
+	for (i = 0; i < run->num_chan; i++) {
+		dl_list_for_each_safe(survey, tmp, &run->chan[i].survey_list,
+				      struct freq_survey, list_member) {
+			dl_list_del(&survey->list_member);
+			os_free(survey);
+		}
+	}
+	run_init(run);
+}
+
+static int run_add_survey(struct acs_run *run, const char *pos)
+{
+	struct freq_survey *survey;
+	unsigned int freq;
+	int nf, bss, i;
+	unsigned long long time, busy, rx, tx;
+
+	if (sscanf(pos, "freq=%u nf=%d time=%llu busy=%llu rx=%llu tx=%llu "
+		   "bss=%d", &freq, &nf, &time, &busy, &rx, &tx, &bss) != 7)
+		return -1;
+
+	for (i = 0; i < run->num_chan; i++) {
+		if (run->chan[i].freq == (int) freq)
+			break;
+	}
+	if (i == run->num_chan) {
+		if (run->num_chan == MAX_CHANNELS)
+			return -1;
+		run->chan[i].freq = freq;
+		run->num_chan++;
+	}
+
+	survey = os_zalloc(sizeof(*survey));
+	if (survey == NULL)
+		return -1;
+	survey->freq = freq;
+	survey->nf = nf;
+	survey->channel_time = time;
+	survey->channel_time_busy = busy;
+	survey->channel_time_rx = rx;
+	survey->channel_time_tx = tx;
+	dl_list_add_tail(&run->chan[i].survey_list, &survey->list_member);
+	run->chan[i].survey_count++;
+	run->num_bss[i] = bss;
+	if (run->num_chan == 1 && run->chan[i].survey_count == 1)
+		run->lowest_nf = nf;
+	else if (nf < run->lowest_nf)
+		run->lowest_nf = nf;
+
+	return 0;
+}
+
+static int run_select(struct acs_run *run, enum acs_algo algo)
+{
+	long double score, best_score = 0;
+	int i, best = -1;
+
+	for (i = 0; i < run->num_chan; i++) {
+		score = acs_chan_score(algo, &run->chan[i], run->lowest_nf,
+				       run->num_bss[i]);
+		if (best < 0 || score < best_score) {
+			best = i;
+			best_score = score;
+		}
+	}
+
+	return best;
+}
+
+static void run_evaluate(struct acs_run *run, struct acs_eval *eval,
+			 int *selected)
+{
+	double airtime, best_airtime = 0;
+	int i, algo;
+
+	if (run->num_chan == 0)
+		return;
+
+	for (i = 0; i < run->num_chan; i++) {
+		airtime = acs_chan_airtime(&run->chan[i]);
+		if (airtime > best_airtime)
+			best_airtime = airtime;
+	}
+
+	eval->runs++;
+	eval->best_airtime += best_airtime;
+	printf("run %d: %d channels, best available airtime %.1f%%\n",
+	       eval->runs, run->num_chan, 100.0 * best_airtime);
+
+	for (algo = 0; algo < NUM_ACS_ALGO; algo++) {
+		i = run_select(run, algo);
+		airtime = acs_chan_airtime(&run->chan[i]);
+		eval->airtime[algo] += airtime;
+		if (airtime >= best_airtime)
+			eval->best[algo]++;
+		if (selected)
+			selected[algo] = run->chan[i].freq;
+		printf("  %-12s -> %d MHz, airtime %.1f%%\n",
+		       acs_algo_txt(algo), run->chan[i].freq, 100.0 * airtime);
+	}
+}
+
+static int eval_file(const char *fname, struct acs_eval *eval)
+{
+	FILE *f;
+	char buf[512], *pos;
+	struct acs_run run;
+
+	f = fopen(fname, "r");
+	if (f == NULL) {
+		printf("Could not open '%s'\n", fname);
+		return -1;
+	}
+
+	run_init(&run);
+	while (fgets(buf, sizeof(buf), f)) {
+		if (os_strstr(buf, "ACS: using survey")) {
+			run_evaluate(&run, eval, NULL);
+			run_deinit(&run);
+			continue;
+		}
+		pos = os_strstr(buf, "ACS: survey ");
+		if (pos == NULL)
+			continue;
+		if (run_add_survey(&run, pos + 12) < 0)
+			printf("Invalid survey line: %s", buf);
+	}
+	run_evaluate(&run, eval, NULL);
+	run_deinit(&run);
+	fclose(f);
+
+	return 0;
+}
+
+static void eval_summary(struct acs_eval *eval)
+{
+	int algo;
+
+	if (eval->runs == 0) {
+		printf("No survey data found\n");
+		return;
+	}
+
+	printf("summary over %d run(s): best available airtime %.1f%%\n",
+	       eval->runs, 100.0 * eval->best_airtime / eval->runs);
+	for (algo = 0; algo < NUM_ACS_ALGO; algo++)
+		printf("  %-12s airtime %.1f%%, best channel in %d run(s)\n",
+		       acs_algo_txt(algo),
+		       100.0 * eval->airtime[algo] / eval->runs,
+		       eval->best[algo]);
+}
+
+/*
+ * 2412 MHz: 50% busy; 2437 MHz: 20% busy, mostly receiving frames from three
+ * other BSSes; 2462 MHz: 25% busy without other BSSes
+ */
+static const char *builtin_trace[] = {
+	"freq=2412 nf=-95 time=1000 busy=500 rx=0 tx=0 bss=0",
+	"freq=2437 nf=-95 time=1000 busy=200 rx=150 tx=0 bss=3",
+	"freq=2462 nf=-95 time=1000 busy=250 rx=0 tx=0 bss=0",
+	"freq=2412 nf=-95 time=1000 busy=500 rx=0 tx=10 bss=0",
+	"freq=2437 nf=-95 time=1000 busy=200 rx=150 tx=0 bss=3",
+	"freq=2462 nf=-95 time=1000 busy=250 rx=0 tx=0 bss=0",
+};
+
+static const int builtin_expected[NUM_ACS_ALGO] = { 2437, 2462, 2462 };
+
+static int test_ci(void)
+{
+	struct acs_run run;
+	long double score, ci;
+	int ret = 0;
+
+	/* Identical surveys: no uncertainty */
+	run_init(&run);
+	run_add_survey(&run, builtin_trace[2]);
+	run_add_survey(&run, builtin_trace[5]);
+	if (acs_chan_score_ci(ACS_ALGO_INTERFERENCE, &run.chan[0],
+			      run.lowest_nf, 0, &score, &ci) < 0 ||
+	    score != -2 || ci != 0) {
+		printf("confidence interval for identical surveys failed\n");
+		ret = -1;
+	}
+
+	/* 20% and 40% busy: mean -1.82, t(1) * 0.5 = 6.35 */
+	run_add_survey(&run, "freq=2417 nf=-95 time=1000 busy=200 rx=0 tx=0 "
+		       "bss=0");
+	run_add_survey(&run, "freq=2417 nf=-95 time=1000 busy=400 rx=0 tx=0 "
+		       "bss=0");
+	if (acs_chan_score_ci(ACS_ALGO_INTERFERENCE, &run.chan[1],
+			      run.lowest_nf, 0, &score, &ci) < 0 ||
+	    score > -1.82 || score < -1.83 || ci < 6.35 || ci > 6.36) {
+		printf("confidence interval for varying surveys failed\n");
+		ret = -1;
+	}
+
+	/* A single survey is not enough */
+	run_deinit(&run);
+	run_add_survey(&run, builtin_trace[0]);
+	if (acs_chan_score_ci(ACS_ALGO_INTERFERENCE, &run.chan[0],
+			      run.lowest_nf, 0, &score, &ci) == 0) {
+		printf("confidence interval with one survey did not fail\n");
+		ret = -1;
+	}
+	run_deinit(&run);
+
+	return ret;
+}
+
+static int test_builtin(void)
+{
+	struct acs_run run;
+	struct acs_eval eval;
+	int selected[NUM_ACS_ALGO];
+	size_t i;
+	int errors = 0;
+
+	os_memset(&eval, 0, sizeof(eval));
+	run_init(&run);
+	for (i = 0; i < sizeof(builtin_trace) / sizeof(builtin_trace[0]); i++) {
+		if (run_add_survey(&run, builtin_trace[i]) < 0) {
+			printf("Invalid built-in survey %u\n", (unsigned int) i);
+			errors++;
+		}
+	}
+	run_evaluate(&run, &eval, selected);
+	run_deinit(&run);
+
+	for (i = 0; i < NUM_ACS_ALGO; i++) {
+		if (selected[i] != builtin_expected[i]) {
+			printf("%s: selected %d MHz, expected %d MHz\n",
+			       acs_algo_txt(i), selected[i],
+			       builtin_expected[i]);
+			errors++;
+		}
+	}
+
+	if (test_ci())
+		errors++;
+
+	if (acs_algo_parse("bss_count") != ACS_ALGO_BSS_COUNT ||
+	    acs_algo_parse("foo") != -1) {
+		printf("acs_algo_parse failed\n");
+		errors++;
+	}
+
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	struct acs_eval eval;
+	int i, errors = 0;
+
+	if (argc < 2) {
+		errors = test_builtin();
+		if (errors) {
+			printf("%d test(s) failed\n", errors);
+			return -1;
+		}
+		return 0;
+	}
+
+	os_memset(&eval, 0, sizeof(eval));
+	for (i = 1; i < argc; i++) {
+		if (eval_file(argv[i], &eval) < 0)
+			errors++;
+	}
+	eval_summary(&eval);
+
+	return errors ? -1 : 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * httpread - test program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ */
+
+#include "utils/includes.h"
+#include "utils/common.h"
+#include "utils/eloop.h"
+#include "wps/httpread.h"
+
+struct test_ctx {
+	int sd[2];
+	const char *data;
+	size_t len;
+	size_t pos;
+	size_t piece;
+	enum httpread_event event;
+	int done;
+	char *body;
+	int body_len;
+};
+
+static void test_write_piece(void *eloop_ctx, void *timeout_ctx)
+{
+	struct test_ctx *t = eloop_ctx;
+	size_t len = t->len - t->pos;
+
+	if (t->piece && len > t->piece)
+		len = t->piece;
+	if (write(t->sd[1], t->data + t->pos, len) != (ssize_t) len) {
+		perror("write");
+		return;
+	}
+	t->pos += len;
+	if (t->pos < t->len)
+		eloop_register_timeout(0, 0, test_write_piece, t, NULL);
+	else {
+		/* end of data; also allows EOF terminated bodies */
+		close(t->sd[1]);
+		t->sd[1] = -1;
+	}
+}
+
+static void test_cb(struct httpread *handle, void *cookie,
+		    enum httpread_event e)
+{
+	struct test_ctx *t = cookie;
+	t->event = e;
+	t->done = 1;
+	if (e == HTTPREAD_EVENT_FILE_READY) {
+		t->body_len = httpread_length_get(handle);
+		t->body = os_malloc(t->body_len + 1);
+		if (t->body)
+			os_memcpy(t->body, httpread_data_get(handle),
+				  t->body_len + 1);
+	}
+	/* eloop_run() returns once nothing is registered anymore */
+	httpread_destroy(handle);
+}
+
+static int test_read(const char *title, const char *data, size_t piece,
+		     int max_bytes, int expect_ok, const char *expect_body)
+{
+	struct test_ctx t;
+	struct httpread *h;
+	int ret = 0;
+
+	os_memset(&t, 0, sizeof(t));
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, t.sd) < 0) {
+		perror("socketpair");
+		return -1;
+	}
+	t.data = data;
+	t.len = os_strlen(data);
+	t.piece = piece;
+
+	h = httpread_create(t.sd[0], test_cb, &t, max_bytes, 5);
+	if (h == NULL) {
+		close(t.sd[0]);
+		close(t.sd[1]);
+		return -1;
+	}
+	eloop_register_timeout(0, 0, test_write_piece, &t, NULL);
+	eloop_run();
+	if (!t.done)
+		httpread_destroy(h);
+
+	if (!t.done) {
+		printf("%s: no result\n", title);
+		ret = -1;
+	} else if (!expect_ok) {
+		if (t.event == HTTPREAD_EVENT_FILE_READY) {
+			printf("%s: unexpected success\n", title);
+			ret = -1;
+		}
+	} else if (t.event != HTTPREAD_EVENT_FILE_READY) {
+		printf("%s: read failed (event %d)\n", title, t.event);
+		ret = -1;
+	} else if (t.body == NULL ||
+		   t.body_len != (int) os_strlen(expect_body) ||
+		   os_strcmp(t.body, expect_body) != 0) {
+		printf("%s: body mismatch (len %d)\n", title, t.body_len);
+		ret = -1;
+	}
+
+	os_free(t.body);
+	close(t.sd[0]);
+	if (t.sd[1] >= 0)
+		close(t.sd[1]);
+	if (ret == 0)
+		printf("%s: OK\n", title);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int errors = 0;
+	size_t piece;
+	char long_req[5000];
+	const char *body = "<?xml version=\"1.0\"?>\n<test>body</test>\n";
+	const char *post =
+		"POST /wps_control HTTP/1.1\r\n"
+		"HOST: 127.0.0.1:49152\r\n"
+		"CONTENT-LENGTH: 40\r\n"
+		"\r\n"
+		"<?xml version=\"1.0\"?>\n<test>body</test>\n";
+	const char *chunked =
+		"HTTP/1.1 200 OK\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"\r\n"
+		"10\r\n<?xml version=\"1\r\n"
+		"18\r\n.0\"?>\n<test>body</test>\n\r\n"
+		"0\r\n"
+		"Trailer: ignored\r\n"
+		"\r\n";
+	const char *eof =
+		"HTTP/1.0 200 OK\r\n"
+		"\r\n"
+		"<?xml version=\"1.0\"?>\n<test>body</test>\n";
+
+	if (os_program_init())
+		return -1;
+	if (eloop_init()) {
+		printf("Failed to initialize event loop\n");
+		return -1;
+	}
+
+	for (piece = 0; piece <= 5; piece++) {
+		char title[50];
+		os_snprintf(title, sizeof(title), "GET (piece %u)",
+			    (unsigned int) piece);
+		if (test_read(title, "GET /wps_device.xml HTTP/1.1\r\n"
+			      "HOST: 127.0.0.1\r\n\r\n", piece, 8000, 1, ""))
+			errors++;
+		os_snprintf(title, sizeof(title), "Content-Length (piece %u)",
+			    (unsigned int) piece);
+		if (test_read(title, post, piece, 8000, 1, body))
+			errors++;
+		os_snprintf(title, sizeof(title), "chunked (piece %u)",
+			    (unsigned int) piece);
+		if (test_read(title, chunked, piece, 8000, 1, body))
+			errors++;
+		os_snprintf(title, sizeof(title), "EOF terminated (piece %u)",
+			    (unsigned int) piece);
+		if (test_read(title, eof, piece, 8000, 1, body))
+			errors++;
+	}
+
+	if (test_read("Content-Length over max_bytes", post, 0, 20, 0, NULL))
+		errors++;
+	if (test_read("no body with max_bytes=0",
+		      "HTTP/1.1 200 OK\r\nContent-Length: 39\r\n\r\n", 0, 0, 1,
+		      ""))
+		errors++;
+
+	/* Header that does not fit in the header buffer */
+	os_memset(long_req, 'a', sizeof(long_req));
+	os_memcpy(long_req, "GET / HTTP/1.1\r\nX: ", 19);
+	os_memcpy(long_req + sizeof(long_req) - 3, "\r\n", 3);
+	if (test_read("too long header", long_req, 0, 8000, 0, NULL))
+		errors++;
+
+	eloop_destroy();
+	os_program_deinit();
+
+	if (errors) {
+		printf("%d test(s) failed\n", errors);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * hostapd - frequency/channel lookup test program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ *
+ * Verifies that frequency and channel number lookups with the tables built
+ * in hostapd_get_hw_features() return the same results as searching the
+ * channel list, including frequencies that are not on any channel.
+ */
+
+#include "utils/includes.h"
+
+#include "utils/common.h"
+#include "drivers/driver.h"
+#include "ap/hostapd.h"
+#include "ap/ap_config.h"
+#include "ap/ap_drv_ops.h"
+#include "ap/hw_features.h"
+
+extern int wpa_debug_level;
+
+
+/* Functions used by hw_features.c that are not needed in this test */
+
+int hostapd_drv_none(struct hostapd_data *hapd)
+{
+	return 0;
+}
+
+
+int hostapd_rate_found(int *list, int rate)
+{
+	return 0;
+}
+
+
+int hostapd_set_rate_sets(struct hostapd_data *hapd, int *supp_rates,
+			  int *basic_rates, int mode)
+{
+	return 0;
+}
+
+
+int hostapd_setup_interface_complete(struct hostapd_iface *iface, int err)
+{
+	return 0;
+}
+
+
+static int add_channels(struct hostapd_hw_modes *mode, int first_chan,
+			int first_freq, int step, int num)
+{
+	struct hostapd_channel_data *chan;
+	int i;
+
+	chan = os_realloc(mode->channels, (mode->num_channels + num) *
+			  sizeof(*chan));
+	if (chan == NULL)
+		return -1;
+	mode->channels = chan;
+	chan += mode->num_channels;
+	os_memset(chan, 0, num * sizeof(*chan));
+	for (i = 0; i < num; i++) {
+		chan[i].chan = first_chan + i * step;
+		chan[i].freq = first_freq + i * step * 5;
+	}
+	mode->num_channels += num;
+
+	return 0;
+}
+
+
+struct hostapd_hw_modes *
+hostapd_get_hw_feature_data(struct hostapd_data *hapd, u16 *num_modes,
+			    u16 *flags)
+{
+	struct hostapd_hw_modes *modes;
+
+	modes = os_zalloc(2 * sizeof(*modes));
+	if (modes == NULL)
+		return NULL;
+
+	/* 2.4 GHz channels 1..14 (channel 14 is not 5 MHz from channel 13) */
+	modes[0].mode = HOSTAPD_MODE_IEEE80211G;
+	if (add_channels(&modes[0], 1, 2412, 1, 13) < 0 ||
+	    add_channels(&modes[0], 14, 2484, 1, 1) < 0)
+		goto fail;
+
+	/* 5 GHz channels 36..64 and 149..165 */
+	modes[1].mode = HOSTAPD_MODE_IEEE80211A;
+	if (add_channels(&modes[1], 36, 5180, 4, 8) < 0 ||
+	    add_channels(&modes[1], 149, 5745, 4, 5) < 0)
+		goto fail;
+
+	*num_modes = 2;
+	*flags = 0;
+	return modes;
+
+fail:
+	hostapd_free_hw_features(modes, 2);
+	return NULL;
+}
+
+
+static struct hostapd_channel_data *
+search_freq(struct hostapd_hw_modes *mode, int freq)
+{
+	int i;
+
+	for (i = 0; i < mode->num_channels; i++) {
+		if (mode->channels[i].freq == freq)
+			return &mode->channels[i];
+	}
+
+	return NULL;
+}
+
+
+static struct hostapd_channel_data *
+search_chan(struct hostapd_hw_modes *mode, int chan)
+{
+	int i;
+
+	for (i = 0; i < mode->num_channels; i++) {
+		if (mode->channels[i].chan == chan)
+			return &mode->channels[i];
+	}
+
+	return NULL;
+}
+
+
+static int test_mode(struct hostapd_iface *iface,
+		     struct hostapd_hw_modes *mode)
+{
+	struct hostapd_channel_data *chan;
+	int freq, i, errors = 0;
+
+	for (freq = 2300; freq <= 6100; freq++) {
+		chan = hostapd_hw_freq_to_chan_data(iface, mode, freq);
+		if (chan != search_freq(mode, freq)) {
+			printf("mode %d: wrong channel for %d MHz: %d\n",
+			       mode->mode, freq, chan ? chan->chan : -1);
+			errors++;
+		}
+	}
+
+	for (i = -1; i <= 256; i++) {
+		chan = hostapd_hw_chan_to_chan_data(iface, mode, i);
+		if (chan != search_chan(mode, i)) {
+			printf("mode %d: wrong channel for channel %d: %d\n",
+			       mode->mode, i, chan ? chan->freq : -1);
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct hostapd_iface iface;
+	struct hostapd_data hapd, *bss[1];
+	int i, errors = 0;
+
+	wpa_debug_level = MSG_ERROR;
+	if (os_program_init())
+		return -1;
+
+	os_memset(&iface, 0, sizeof(iface));
+	os_memset(&hapd, 0, sizeof(hapd));
+	bss[0] = &hapd;
+	hapd.iface = &iface;
+	iface.bss = bss;
+	iface.num_bss = 1;
+
+	if (hostapd_get_hw_features(&iface) < 0 || iface.chan_map == NULL) {
+		printf("Failed to set up hw features\n");
+		return -1;
+	}
+
+	for (i = 0; i < iface.num_hw_features; i++)
+		errors += test_mode(&iface, &iface.hw_features[i]);
+
+	/* Frequencies next to a channel must not match it */
+	iface.current_mode = &iface.hw_features[0];
+	if (hostapd_hw_get_channel(&hapd, 2412) != 1 ||
+	    hostapd_hw_get_channel(&hapd, 2413) != 0 ||
+	    hostapd_hw_get_channel(&hapd, 2411) != 0 ||
+	    hostapd_hw_get_channel(&hapd, 2484) != 14 ||
+	    hostapd_hw_get_channel(&hapd, 2485) != 0 ||
+	    hostapd_hw_get_freq(&hapd, 14) != 2484 ||
+	    hostapd_hw_get_freq(&hapd, 15) != 0) {
+		printf("2.4 GHz channel lookup failed\n");
+		errors++;
+	}
+	iface.current_mode = &iface.hw_features[1];
+	if (hostapd_hw_get_channel(&hapd, 5180) != 36 ||
+	    hostapd_hw_get_channel(&hapd, 5181) != 0 ||
+	    hostapd_hw_get_channel(&hapd, 5185) != 0 ||
+	    hostapd_hw_get_freq(&hapd, 38) != 0) {
+		printf("5 GHz channel lookup failed\n");
+		errors++;
+	}
+
+	/* Without the tables, the channel list is searched */
+	os_free(iface.chan_map);
+	iface.chan_map = NULL;
+	for (i = 0; i < iface.num_hw_features; i++)
+		errors += test_mode(&iface, &iface.hw_features[i]);
+
+	hostapd_free_hw_features(iface.hw_features, iface.num_hw_features);
+	os_program_deinit();
+
+	if (errors) {
+		printf("%d test(s) failed\n", errors);
+		return -1;
+	}
+
+	return 0;
+}
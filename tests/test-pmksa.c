@@ -0,0 +1,296 @@
+/*
+ * Supplicant PMKSA cache - test program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ *
+ * Verifies the PMKSA cache lookups (AA, PMKID, opportunistic PMKSA caching)
+ * and pmksa_cache_set_current() for a station roaming between the APs of a
+ * large ESS.
+ *
+ * Usage: test-pmksa [-b [APs] [roams]]
+ *
+ * With -b, the given number of roams (10000 by default) between the given
+ * number of APs (500 by default) is simulated and the average time
+ * pmksa_cache_set_current() takes when reassociating with a cached AP and
+ * with a new AP (OKC entry creation) is reported.
+ */
+
+#include "utils/includes.h"
+#include "utils/common.h"
+#include "utils/eloop.h"
+#include "common/defs.h"
+#include "common/wpa_common.h"
+#include "rsn_supp/wpa.h"
+#include "rsn_supp/wpa_i.h"
+#include "rsn_supp/pmksa_cache.h"
+
+extern int wpa_debug_level;
+
+static int ctx_a, ctx_b; /* network contexts */
+
+
+void eapol_sm_request_reauth(struct eapol_sm *sm)
+{
+}
+
+
+static int test_add_pmkid(void *ctx, const u8 *bssid, const u8 *pmkid)
+{
+	return 0;
+}
+
+
+static int test_remove_pmkid(void *ctx, const u8 *bssid, const u8 *pmkid)
+{
+	return 0;
+}
+
+
+static void test_free_cb(struct rsn_pmksa_cache_entry *entry, void *ctx,
+			 int replace)
+{
+}
+
+
+static double time_us(struct os_time *start, struct os_time *end)
+{
+	struct os_time diff;
+	os_time_sub(end, start, &diff);
+	return diff.sec * 1000000.0 + diff.usec;
+}
+
+
+static void test_aa(u8 *aa, int idx)
+{
+	aa[0] = 0x02;
+	aa[1] = 0x00;
+	WPA_PUT_BE32(&aa[2], idx);
+}
+
+
+static int test_lookups(struct wpa_sm *sm)
+{
+	struct rsn_pmksa_cache_entry *e1, *e2, *e;
+	u8 pmk[PMK_LEN], aa[ETH_ALEN], pmkid[PMKID_LEN];
+	char buf[4096], *pos;
+	int i, lines, errors = 0;
+
+	os_memset(pmk, 0x11, sizeof(pmk));
+	test_aa(aa, 1);
+	e1 = pmksa_cache_add(sm->pmksa, pmk, PMK_LEN, aa, sm->own_addr,
+			     &ctx_a, WPA_KEY_MGMT_IEEE8021X);
+	test_aa(aa, 1 + 64); /* same hash bucket */
+	e2 = pmksa_cache_add(sm->pmksa, pmk, PMK_LEN, aa, sm->own_addr,
+			     &ctx_b, WPA_KEY_MGMT_IEEE8021X);
+	if (e1 == NULL || e2 == NULL) {
+		printf("pmksa_cache_add failed\n");
+		return 1;
+	}
+
+	if (pmksa_cache_get(sm->pmksa, e1->aa, NULL) != e1 ||
+	    pmksa_cache_get(sm->pmksa, e2->aa, NULL) != e2 ||
+	    pmksa_cache_get(sm->pmksa, NULL, e2->pmkid) != e2 ||
+	    pmksa_cache_get(sm->pmksa, e1->aa, e1->pmkid) != e1 ||
+	    pmksa_cache_get(sm->pmksa, e1->aa, e2->pmkid) != NULL ||
+	    pmksa_cache_get(sm->pmksa, NULL, NULL) == NULL) {
+		printf("PMKSA cache lookup failed\n");
+		errors++;
+	}
+
+	/* Opportunistic PMKSA caching for a new AP in the first network */
+	test_aa(aa, 2);
+	e = pmksa_cache_get_opportunistic(sm->pmksa, &ctx_a, aa);
+	rsn_pmkid(pmk, PMK_LEN, aa, sm->own_addr, pmkid, 0);
+	if (e == NULL || !e->opportunistic || e->network_ctx != &ctx_a ||
+	    e->expiration != e1->expiration ||
+	    os_memcmp(e->pmkid, pmkid, PMKID_LEN) != 0 ||
+	    pmksa_cache_get(sm->pmksa, NULL, pmkid) != e) {
+		printf("opportunistic PMKSA caching failed\n");
+		errors++;
+	}
+
+	/* Replacing an entry for the same AP */
+	os_memset(pmk, 0x22, sizeof(pmk));
+	e = pmksa_cache_add(sm->pmksa, pmk, PMK_LEN, e2->aa, sm->own_addr,
+			    &ctx_b, WPA_KEY_MGMT_IEEE8021X);
+	if (e == NULL || pmksa_cache_get(sm->pmksa, e->aa, NULL) != e ||
+	    pmksa_cache_get_opportunistic(sm->pmksa, &ctx_b, aa) == NULL) {
+		printf("PMKSA cache entry replacement failed\n");
+		errors++;
+	}
+
+	/* Reconfiguration removes the network context references */
+	pmksa_cache_notify_reconfig(sm->pmksa);
+	test_aa(aa, 3);
+	if (pmksa_cache_get_opportunistic(sm->pmksa, &ctx_a, aa)) {
+		printf("opportunistic PMKSA caching after reconfig\n");
+		errors++;
+	}
+
+	/* Removal of the oldest entries when the cache is full */
+	for (i = 0; i < 100; i++) {
+		test_aa(aa, 1000 + i);
+		if (pmksa_cache_add(sm->pmksa, pmk, PMK_LEN, aa, sm->own_addr,
+				    &ctx_a, WPA_KEY_MGMT_IEEE8021X) == NULL)
+			errors++;
+	}
+	buf[pmksa_cache_list(sm->pmksa, buf, sizeof(buf))] = '\0';
+	lines = 0;
+	for (pos = buf; *pos; pos++) {
+		if (*pos == '\n')
+			lines++;
+	}
+	test_aa(aa, 1000);
+	if (pmksa_cache_get(sm->pmksa, aa, NULL) != NULL || lines != 1 + 32) {
+		printf("PMKSA cache size not limited (%d entries)\n",
+		       lines - 1);
+		errors++;
+	}
+	test_aa(aa, 1099);
+	if (pmksa_cache_get(sm->pmksa, aa, NULL) == NULL) {
+		printf("PMKSA cache lost the newest entry\n");
+		errors++;
+	}
+
+	return errors;
+}
+
+
+/*
+ * Roam between num_ap APs of the same ESS in pseudo-random order, like a
+ * station moving around a large campus would; entries for the APs that have
+ * not been visited recently have been removed from the cache and are
+ * recreated with OKC.
+ */
+static int test_roam(struct wpa_sm *sm, int num_ap, int roams, int bench)
+{
+	struct rsn_pmksa_cache_entry *e;
+	struct os_time start, end;
+	u8 pmk[PMK_LEN], aa[ETH_ALEN];
+	unsigned int seed = 1;
+	double cached_us = 0, okc_us = 0;
+	int i, res, cached = 0, okc = 0, errors = 0;
+
+	os_memset(pmk, 0x33, sizeof(pmk));
+	test_aa(aa, 0);
+	if (pmksa_cache_add(sm->pmksa, pmk, PMK_LEN, aa, sm->own_addr, &ctx_a,
+			    WPA_KEY_MGMT_IEEE8021X) == NULL)
+		return 1;
+
+	for (i = 0; i < roams; i++) {
+		seed = seed * 1103515245 + 12345;
+		test_aa(aa, (seed >> 16) % num_ap);
+		e = pmksa_cache_get(sm->pmksa, aa, NULL);
+
+		os_get_time(&start);
+		res = pmksa_cache_set_current(sm, NULL, aa, &ctx_a, 1);
+		os_get_time(&end);
+		if (res < 0 || sm->cur_pmksa == NULL ||
+		    os_memcmp(sm->cur_pmksa->aa, aa, ETH_ALEN) != 0) {
+			printf("roam %d: no PMKSA for " MACSTR "\n", i,
+			       MAC2STR(aa));
+			return errors + 1;
+		}
+
+		if (e) {
+			cached++;
+			cached_us += time_us(&start, &end);
+			if (sm->cur_pmksa != e) {
+				printf("roam %d: cached PMKSA not used\n", i);
+				errors++;
+			}
+		} else {
+			okc++;
+			okc_us += time_us(&start, &end);
+			if (!sm->cur_pmksa->opportunistic) {
+				printf("roam %d: PMKSA not from OKC\n", i);
+				errors++;
+			}
+		}
+	}
+
+	if (bench)
+		printf("%d APs, %d roams: cached PMKSA %d x %.2f us, "
+		       "OKC %d x %.2f us\n", num_ap, roams,
+		       cached, cached ? cached_us / cached : 0,
+		       okc, okc ? okc_us / okc : 0);
+
+	/* The default run must exercise both cases */
+	if (!bench && (cached == 0 || okc == 0)) {
+		printf("roaming did not use both cached (%d) and OKC (%d) "
+		       "PMKSA\n", cached, okc);
+		errors++;
+	}
+
+	return errors;
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct wpa_sm sm;
+	struct wpa_sm_ctx ctx;
+	int num_ap = 500, roams = 10000, bench = 0, errors = 0;
+
+	if (argc > 1) {
+		if (os_strcmp(argv[1], "-b") != 0) {
+			printf("usage: test-pmksa [-b [APs] [roams]]\n");
+			return -1;
+		}
+		bench = 1;
+		if (argc > 2)
+			num_ap = atoi(argv[2]);
+		if (argc > 3)
+			roams = atoi(argv[3]);
+		if (num_ap < 1)
+			num_ap = 1;
+	}
+
+	wpa_debug_level = MSG_ERROR;
+	if (os_program_init())
+		return -1;
+	if (eloop_init()) {
+		printf("Failed to initialize event loop\n");
+		return -1;
+	}
+
+	os_memset(&ctx, 0, sizeof(ctx));
+	ctx.add_pmkid = test_add_pmkid;
+	ctx.remove_pmkid = test_remove_pmkid;
+	os_memset(&sm, 0, sizeof(sm));
+	sm.ctx = &ctx;
+	sm.own_addr[0] = 0x02;
+	sm.own_addr[5] = 0x01;
+	sm.dot11RSNAConfigPMKLifetime = 43200;
+	sm.dot11RSNAConfigPMKReauthThreshold = 70;
+
+	sm.pmksa = pmksa_cache_init(test_free_cb, &sm, &sm);
+	if (sm.pmksa == NULL)
+		return -1;
+	errors += test_lookups(&sm);
+	pmksa_cache_deinit(sm.pmksa);
+
+	sm.cur_pmksa = NULL;
+	sm.pmksa = pmksa_cache_init(test_free_cb, &sm, &sm);
+	if (sm.pmksa == NULL)
+		return -1;
+	errors += test_roam(&sm, num_ap, roams, bench);
+	pmksa_cache_deinit(sm.pmksa);
+
+	eloop_destroy();
+	os_program_deinit();
+
+	if (errors) {
+		printf("%d test(s) failed\n", errors);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,532 @@
+/*
+ * TDLS - test program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ *
+ * Connects a number of TDLS state machines within one BSS through a loopback
+ * driver (similar to driver_test, which does not support TDLS frames) and
+ * has one station set up direct links with all the others concurrently: all
+ * Setup Requests are sent before any of the responses are processed. The TPK
+ * handshakes are run with CCMP, i.e., with all the key derivation and MIC
+ * operations.
+ *
+ * The TPK handshake retries and TPK lifetime expiration are then verified by
+ * running the event loop with a simulated clock: os_get_time() and select()
+ * are wrapped at link time (see Makefile) so that time advances to the next
+ * timeout instead of waiting for it.
+ *
+ * Usage: test-tdls [-b [peers] [rounds]]
+ *
+ * With -b, only the concurrent setups are run (with 1000 peers and three
+ * rounds by default) and the number of completed setups per second is
+ * reported for each round. The time is not simulated during the setups.
+ */
+
+#include "utils/includes.h"
+#include "utils/common.h"
+#include "utils/eloop.h"
+#include "common/defs.h"
+#include "common/ieee802_11_defs.h"
+#include "drivers/driver.h"
+#include "l2_packet/l2_packet.h"
+#include "rsn_supp/wpa.h"
+#include "rsn_supp/wpa_i.h"
+
+extern int wpa_debug_level;
+
+struct test_sta {
+	struct wpa_sm sm;
+	struct wpa_sm_ctx ctx;
+	void (*rx)(void *ctx, const u8 *src_addr, const u8 *buf, size_t len);
+	int links; /* enabled direct links */
+	int setup_req; /* Setup Request frames sent to this STA */
+	int teardown; /* TDLS_TEARDOWN operations for the link with this STA */
+	int silent; /* frames to this STA are dropped */
+};
+
+struct test_frame {
+	struct dl_list list;
+	struct test_sta *src, *dst;
+	size_t len;
+	u8 buf[];
+};
+
+static struct test_sta **stas;
+static int num_sta;
+static struct dl_list frames; /* frames in flight */
+static int deliver_from_eloop;
+static const u8 test_bssid[ETH_ALEN] = { 0x02, 0xff, 0x00, 0x00, 0x00, 0x00 };
+static os_time_t time_offset; /* simulated time added to the real time */
+static int timer_errors;
+
+
+static double time_us(struct os_time *start, struct os_time *end)
+{
+	struct os_time diff;
+	os_time_sub(end, start, &diff);
+	return diff.sec * 1000000.0 + diff.usec;
+}
+
+
+int __real_os_get_time(struct os_time *t);
+
+int __wrap_os_get_time(struct os_time *t)
+{
+	int res = __real_os_get_time(t);
+	t->sec += time_offset;
+	return res;
+}
+
+
+/* No sockets are registered, so a wait in eloop only advances the time */
+int __wrap_select(int nfds, fd_set *readfds, fd_set *writefds,
+		  fd_set *exceptfds, struct timeval *timeout)
+{
+	if (readfds)
+		FD_ZERO(readfds);
+	if (writefds)
+		FD_ZERO(writefds);
+	if (exceptfds)
+		FD_ZERO(exceptfds);
+	if (timeout)
+		time_offset += timeout->tv_sec + (timeout->tv_usec ? 1 : 0);
+	return 0;
+}
+
+
+struct l2_packet_data {
+	struct test_sta *sta;
+};
+
+
+static struct test_sta * test_get_sta(const u8 *addr)
+{
+	u32 idx = WPA_GET_BE32(&addr[2]);
+
+	if (addr[0] != 0x02 || idx >= (u32) num_sta)
+		return NULL;
+	return stas[idx];
+}
+
+
+struct l2_packet_data * l2_packet_init(
+	const char *ifname, const u8 *own_addr, unsigned short protocol,
+	void (*rx_callback)(void *ctx, const u8 *src_addr,
+			    const u8 *buf, size_t len),
+	void *rx_callback_ctx, int l2_hdr)
+{
+	struct l2_packet_data *l2;
+
+	l2 = os_zalloc(sizeof(*l2));
+	if (l2 == NULL)
+		return NULL;
+	l2->sta = test_get_sta(own_addr);
+	if (l2->sta == NULL) {
+		os_free(l2);
+		return NULL;
+	}
+	l2->sta->rx = rx_callback;
+	return l2;
+}
+
+
+void l2_packet_deinit(struct l2_packet_data *l2)
+{
+	os_free(l2);
+}
+
+
+static int test_set_key(void *ctx, enum wpa_alg alg, const u8 *addr,
+			int key_idx, int set_tx, const u8 *seq, size_t seq_len,
+			const u8 *key, size_t key_len)
+{
+	return 0;
+}
+
+
+static int test_tdls_oper(void *ctx, int oper, const u8 *peer)
+{
+	struct test_sta *sta = ctx, *peer_sta;
+
+	if (oper == TDLS_ENABLE_LINK)
+		sta->links++;
+	else if (oper == TDLS_TEARDOWN) {
+		peer_sta = test_get_sta(peer);
+		if (peer_sta)
+			peer_sta->teardown++;
+	}
+	return 0;
+}
+
+
+static int test_deliver_frames(void);
+
+static void test_deliver_timeout(void *eloop_ctx, void *timeout_ctx)
+{
+	test_deliver_frames();
+}
+
+
+/*
+ * Build the frame as the driver would: fixed fields for the action followed
+ * by the IEs from wpa_supplicant and the Link Identifier.
+ */
+static int test_send_tdls_mgmt(void *ctx, const u8 *dst, u8 action_code,
+			       u8 dialog_token, u16 status_code,
+			       const u8 *buf, size_t len)
+{
+	struct test_sta *sta = ctx, *peer;
+	struct test_frame *frame;
+	u8 *pos;
+	int initiator;
+
+	peer = test_get_sta(dst);
+	if (peer == NULL)
+		return -1;
+	if (action_code == WLAN_TDLS_SETUP_REQUEST)
+		peer->setup_req++;
+	if (peer->silent)
+		return 0;
+
+	frame = os_zalloc(sizeof(*frame) + 3 + 2 + 1 + 2 + len +
+			  2 + 3 * ETH_ALEN);
+	if (frame == NULL)
+		return -1;
+	frame->src = sta;
+	frame->dst = peer;
+	pos = frame->buf;
+	*pos++ = 2; /* TDLS_RFTYPE */
+	*pos++ = WLAN_ACTION_TDLS;
+	*pos++ = action_code;
+	switch (action_code) {
+	case WLAN_TDLS_SETUP_REQUEST:
+		*pos++ = dialog_token;
+		pos += 2; /* capability information */
+		initiator = 1;
+		break;
+	case WLAN_TDLS_SETUP_RESPONSE:
+		WPA_PUT_LE16(pos, status_code);
+		pos += 2;
+		*pos++ = dialog_token;
+		pos += 2; /* capability information */
+		initiator = 0;
+		break;
+	case WLAN_TDLS_SETUP_CONFIRM:
+		WPA_PUT_LE16(pos, status_code);
+		pos += 2;
+		*pos++ = dialog_token;
+		initiator = 1;
+		break;
+	case WLAN_TDLS_TEARDOWN:
+		WPA_PUT_LE16(pos, status_code);
+		pos += 2;
+		initiator = 1;
+		break;
+	default:
+		os_free(frame);
+		return -1;
+	}
+	os_memcpy(pos, buf, len);
+	pos += len;
+	*pos++ = WLAN_EID_LINK_ID;
+	*pos++ = 3 * ETH_ALEN;
+	os_memcpy(pos, test_bssid, ETH_ALEN);
+	pos += ETH_ALEN;
+	os_memcpy(pos, initiator ? sta->sm.own_addr : dst, ETH_ALEN);
+	pos += ETH_ALEN;
+	os_memcpy(pos, initiator ? dst : sta->sm.own_addr, ETH_ALEN);
+	pos += ETH_ALEN;
+	frame->len = pos - frame->buf;
+
+	if (deliver_from_eloop && dl_list_empty(&frames))
+		eloop_register_timeout(0, 0, test_deliver_timeout, NULL, NULL);
+	dl_list_add_tail(&frames, &frame->list);
+	return 0;
+}
+
+
+static int test_deliver_frames(void)
+{
+	struct test_frame *frame;
+	int count = 0;
+
+	while ((frame = dl_list_first(&frames, struct test_frame, list))) {
+		dl_list_del(&frame->list);
+		frame->dst->rx(&frame->dst->sm, frame->src->sm.own_addr,
+			       frame->buf, frame->len);
+		os_free(frame);
+		count++;
+	}
+
+	return count;
+}
+
+
+static struct test_sta * test_sta_init(int idx)
+{
+	struct test_sta *sta;
+
+	sta = os_zalloc(sizeof(*sta));
+	if (sta == NULL)
+		return NULL;
+	sta->ctx.ctx = sta;
+	sta->ctx.set_key = test_set_key;
+	sta->ctx.send_tdls_mgmt = test_send_tdls_mgmt;
+	sta->ctx.tdls_oper = test_tdls_oper;
+	sta->sm.ctx = &sta->ctx;
+	sta->sm.own_addr[0] = 0x02;
+	WPA_PUT_BE32(&sta->sm.own_addr[2], idx);
+	os_memcpy(sta->sm.bssid, test_bssid, ETH_ALEN);
+	sta->sm.pairwise_cipher = WPA_CIPHER_CCMP;
+
+	return sta;
+}
+
+
+static void test_sta_deinit(struct test_sta *sta)
+{
+	if (sta == NULL)
+		return;
+	wpa_tdls_deinit(&sta->sm);
+	os_free(sta);
+}
+
+
+static void test_reset(void)
+{
+	int i;
+
+	for (i = 0; i < num_sta; i++) {
+		wpa_tdls_disassoc(&stas[i]->sm);
+		stas[i]->links = 0;
+		stas[i]->setup_req = 0;
+		stas[i]->teardown = 0;
+		stas[i]->silent = 0;
+	}
+}
+
+
+static int test_round(int round, int bench)
+{
+	struct test_sta *hub = stas[0];
+	struct os_time start, end;
+	int i, frames_sent, errors = 0;
+	double us;
+
+	test_reset();
+
+	os_get_time(&start);
+	for (i = 1; i < num_sta; i++) {
+		if (wpa_tdls_start(&hub->sm, stas[i]->sm.own_addr) < 0)
+			errors++;
+	}
+	frames_sent = test_deliver_frames();
+	os_get_time(&end);
+
+	if (bench) {
+		us = time_us(&start, &end);
+		printf("round %d: %d concurrent TDLS setups (%d frames) in "
+		       "%.0f us: %.0f setups/s\n", round, num_sta - 1,
+		       frames_sent, us,
+		       us > 0 ? (num_sta - 1) * 1000000.0 / us : 0);
+	}
+
+	if (hub->links != num_sta - 1) {
+		printf("round %d: %d/%d links enabled\n", round, hub->links,
+		       num_sta - 1);
+		errors++;
+	}
+	for (i = 0; i < num_sta; i++) {
+		if ((i > 0 && stas[i]->links != 1) || stas[i]->teardown) {
+			printf("round %d: station %d has %d links and %d "
+			       "teardowns\n", round, i, stas[i]->links,
+			       stas[i]->teardown);
+			errors++;
+		}
+		if (!dl_list_empty(&stas[i]->sm.tdls_retry)) {
+			printf("round %d: station %d has pending retries\n",
+			       round, i);
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+
+/*
+ * Timer test: the hub sets up links with stations 1..4 at time 0 and with
+ * stations 5..8 at time 1000 s. The odd stations do not reply, so the Setup
+ * Request to them is retried every TPK_TIMEOUT (5 s) three times before the
+ * link is torn down. The TPK lifetime (43200 s) then expires first for
+ * stations 2 and 4 and only later for stations 6 and 8; the hub renews the
+ * link as the initiator before the TPK of the other station expires.
+ */
+#define TIMER_PEERS 8
+
+static void test_expect(int step, int sta, int setup_req, int teardown,
+			int links)
+{
+	if (stas[sta]->setup_req == setup_req &&
+	    stas[sta]->teardown == teardown && stas[sta]->links == links)
+		return;
+	printf("timers at %d s: station %d: %d Setup Request(s) (expected %d), "
+	       "%d teardown(s) (expected %d), %d link(s) enabled (expected "
+	       "%d)\n", step, sta, stas[sta]->setup_req, setup_req,
+	       stas[sta]->teardown, teardown, stas[sta]->links, links);
+	timer_errors++;
+}
+
+
+static void test_timer_start(int first)
+{
+	int i;
+
+	for (i = first; i < first + TIMER_PEERS / 2; i++) {
+		stas[i]->silent = i & 1;
+		if (wpa_tdls_start(&stas[0]->sm, stas[i]->sm.own_addr) < 0)
+			timer_errors++;
+	}
+}
+
+
+static void test_timer_step(void *eloop_ctx, void *timeout_ctx)
+{
+	int step = (long) timeout_ctx;
+
+	switch (step) {
+	case 0:
+		test_timer_start(1);
+		break;
+	case 12:
+		/* Initial Setup Request and two retries to the silent ones */
+		test_expect(step, 1, 3, 0, 0);
+		test_expect(step, 2, 1, 0, 1);
+		test_expect(step, 3, 3, 0, 0);
+		test_expect(step, 4, 1, 0, 1);
+		break;
+	case 25:
+		/* Third retry and teardown after that */
+		test_expect(step, 1, 4, 1, 0);
+		test_expect(step, 2, 1, 0, 1);
+		test_expect(step, 3, 4, 1, 0);
+		test_expect(step, 4, 1, 0, 1);
+		if (!dl_list_empty(&stas[0]->sm.tdls_retry)) {
+			printf("timers at %d s: pending retries\n", step);
+			timer_errors++;
+		}
+		break;
+	case 1000:
+		test_timer_start(5);
+		break;
+	case 1100:
+		test_expect(step, 5, 4, 1, 0);
+		test_expect(step, 6, 1, 0, 1);
+		test_expect(step, 7, 4, 1, 0);
+		test_expect(step, 8, 1, 0, 1);
+		break;
+	case 43210:
+		/* TPK lifetime expired for stations 2 and 4, but not 6 and 8 */
+		test_expect(step, 2, 2, 0, 2);
+		test_expect(step, 4, 2, 0, 2);
+		test_expect(step, 6, 1, 0, 1);
+		test_expect(step, 8, 1, 0, 1);
+		test_expect(step, 0, 0, 0, 6);
+		break;
+	case 44210:
+		test_expect(step, 1, 4, 1, 0);
+		test_expect(step, 3, 4, 1, 0);
+		test_expect(step, 6, 2, 0, 2);
+		test_expect(step, 8, 2, 0, 2);
+		test_expect(step, 0, 0, 0, 8);
+		eloop_terminate();
+		break;
+	}
+}
+
+
+static int test_timers(void)
+{
+	static const int steps[] = { 0, 12, 25, 1000, 1100, 43210, 44210 };
+	int i;
+
+	if (num_sta <= TIMER_PEERS)
+		return 1;
+	test_reset();
+	deliver_from_eloop = 1;
+
+	for (i = 0; i < (int) (sizeof(steps) / sizeof(steps[0])); i++)
+		eloop_register_timeout(steps[i], 0, test_timer_step, NULL,
+				       (void *) (long) steps[i]);
+	eloop_run();
+
+	deliver_from_eloop = 0;
+	return timer_errors;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int peers = 99, rounds = 2, bench = 0, i, errors = 0;
+
+	if (argc > 1) {
+		if (os_strcmp(argv[1], "-b") != 0) {
+			printf("usage: test-tdls [-b [peers] [rounds]]\n");
+			return -1;
+		}
+		bench = 1;
+		peers = argc > 2 ? atoi(argv[2]) : 1000;
+		rounds = argc > 3 ? atoi(argv[3]) : 3;
+		if (peers < 1)
+			peers = 1;
+	}
+
+	wpa_debug_level = MSG_ERROR;
+	if (os_program_init())
+		return -1;
+	if (eloop_init()) {
+		printf("Failed to initialize event loop\n");
+		return -1;
+	}
+	dl_list_init(&frames);
+
+	num_sta = peers + 1;
+	stas = os_zalloc(num_sta * sizeof(struct test_sta *));
+	if (stas == NULL)
+		return -1;
+	for (i = 0; i < num_sta; i++) {
+		stas[i] = test_sta_init(i);
+		if (stas[i] == NULL || wpa_tdls_init(&stas[i]->sm) < 0) {
+			printf("Failed to initialize station %d\n", i);
+			errors++;
+			goto done;
+		}
+	}
+
+	for (i = 0; i < rounds; i++)
+		errors += test_round(i + 1, bench);
+	if (!bench)
+		errors += test_timers();
+
+done:
+	for (i = 0; i < num_sta; i++)
+		test_sta_deinit(stas[i]);
+	os_free(stas);
+
+	eloop_destroy();
+	os_program_deinit();
+
+	if (errors) {
+		printf("%d test(s) failed\n", errors);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * TLSv1 record layer test program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ *
+ * Sends records of different sizes with one record layer and receives them
+ * with another one that uses the same keys. The payload is written directly
+ * after the reserved record header, as the TLS client and server do, and every
+ * other record is received in place. The received payloads are compared with
+ * the sent ones and a modified record must be rejected.
+ *
+ * Usage: test-tlsv1-record [-b [records]]
+ *
+ * With -b, the given number of records (200 by default) is used and the time
+ * (and on x86, the number of cycles) per record is reported for each cipher
+ * suite and record size.
+ */
+
+#include "utils/includes.h"
+#include "utils/common.h"
+#include "crypto/crypto.h"
+#include "tls/tlsv1_common.h"
+#include "tls/tlsv1_record.h"
+
+extern int wpa_debug_level;
+
+static const struct {
+	u16 suite;
+	const char *name;
+} suites[] = {
+	{ TLS_RSA_WITH_3DES_EDE_CBC_SHA, "3DES-EDE-CBC-SHA" },
+	{ TLS_RSA_WITH_AES_128_CBC_SHA, "AES-128-CBC-SHA" }
+};
+
+static const size_t sizes[] = { 64, 1024, 16384 };
+
+/*
+ * Number of records per cipher suite and size without -b; the records are
+ * received alternately to a separate buffer and in place
+ */
+#define NUM_RECORDS 4
+
+
+static u64 get_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	u32 lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((u64) hi << 32) | lo;
+#else /* __i386__ || __x86_64__ */
+	return 0;
+#endif /* __i386__ || __x86_64__ */
+}
+
+
+static double time_us(struct os_time *start, struct os_time *end)
+{
+	struct os_time diff;
+	os_time_sub(end, start, &diff);
+	return diff.sec * 1000000.0 + diff.usec;
+}
+
+
+static void fill_payload(u8 *buf, size_t len, int idx)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = idx + i;
+}
+
+
+static int setup(struct tlsv1_record_layer *w, struct tlsv1_record_layer *r,
+		 u16 suite)
+{
+	size_t i;
+
+	os_memset(w, 0, sizeof(*w));
+	os_memset(r, 0, sizeof(*r));
+	if (tlsv1_record_set_cipher_suite(w, suite) < 0 ||
+	    tlsv1_record_set_cipher_suite(r, suite) < 0)
+		return -1;
+
+	for (i = 0; i < TLS_MAX_WRITE_MAC_SECRET_LEN; i++)
+		w->write_mac_secret[i] = r->read_mac_secret[i] = i;
+	for (i = 0; i < TLS_MAX_WRITE_KEY_LEN; i++)
+		w->write_key[i] = r->read_key[i] = 0x40 + i;
+	for (i = 0; i < TLS_MAX_IV_LEN; i++)
+		w->write_iv[i] = r->read_iv[i] = 0x80 + i;
+
+	if (tlsv1_record_change_write_cipher(w) < 0 ||
+	    tlsv1_record_change_read_cipher(r) < 0)
+		return -1;
+
+	return 0;
+}
+
+
+static void deinit(struct tlsv1_record_layer *rl)
+{
+	if (rl->write_cbc)
+		crypto_cipher_deinit(rl->write_cbc);
+	if (rl->read_cbc)
+		crypto_cipher_deinit(rl->read_cbc);
+}
+
+
+static int test_suite(int s, size_t size, int records, int bench)
+{
+	struct tlsv1_record_layer w, r;
+	size_t buf_size, *lens, olen;
+	u8 **bufs, *out, *payload, *expected, alert;
+	struct os_time start, end;
+	u64 cycles[2];
+	double us[2];
+	int i, errors = 0;
+
+	if (setup(&w, &r, suites[s].suite) < 0) {
+		printf("%s: Failed to set up record layer\n", suites[s].name);
+		return 1;
+	}
+
+	/* Room for the header, MAC, and maximum padding */
+	buf_size = TLS_RECORD_HEADER_LEN + size + TLS_MAX_WRITE_MAC_SECRET_LEN +
+		256;
+	bufs = os_zalloc(records * sizeof(u8 *));
+	lens = os_zalloc(records * sizeof(size_t));
+	out = os_malloc(buf_size);
+	expected = os_malloc(size);
+	if (bufs == NULL || lens == NULL || out == NULL || expected == NULL) {
+		errors++;
+		goto done;
+	}
+	for (i = 0; i < records; i++) {
+		bufs[i] = os_malloc(buf_size);
+		if (bufs[i] == NULL) {
+			errors++;
+			goto done;
+		}
+	}
+
+	os_get_time(&start);
+	cycles[0] = get_cycles();
+	for (i = 0; i < records; i++) {
+		fill_payload(bufs[i] + TLS_RECORD_HEADER_LEN, size, i);
+		if (tlsv1_record_send(&w, TLS_CONTENT_TYPE_APPLICATION_DATA,
+				      bufs[i], buf_size, size, &lens[i]) < 0) {
+			printf("%s: Failed to send record %d\n",
+			       suites[s].name, i);
+			errors++;
+			goto done;
+		}
+	}
+
+	cycles[0] = get_cycles() - cycles[0];
+	os_get_time(&end);
+	us[0] = time_us(&start, &end);
+
+	os_get_time(&start);
+	cycles[1] = get_cycles();
+	for (i = 0; i < records; i++) {
+		payload = (i & 1) ? bufs[i] + TLS_RECORD_HEADER_LEN : out;
+		olen = buf_size;
+		if (tlsv1_record_receive(&r, bufs[i], lens[i], payload, &olen,
+					 &alert) < 0) {
+			printf("%s: Failed to receive record %d (alert %d)\n",
+			       suites[s].name, i, alert);
+			errors++;
+			goto done;
+		}
+		fill_payload(expected, size, i);
+		if (olen != size || os_memcmp(payload, expected, size) != 0) {
+			printf("%s: Record %d payload mismatch\n",
+			       suites[s].name, i);
+			errors++;
+		}
+	}
+	cycles[1] = get_cycles() - cycles[1];
+	os_get_time(&end);
+	us[1] = time_us(&start, &end);
+
+	if (bench) {
+		printf("%s %5lu bytes: send %8.2f us", suites[s].name,
+		       (unsigned long) size, us[0] / records);
+		if (cycles[0])
+			printf(" (%8.0f cycles)", (double) cycles[0] / records);
+		printf(", receive %8.2f us", us[1] / records);
+		if (cycles[1])
+			printf(" (%8.0f cycles)", (double) cycles[1] / records);
+		printf(" per record\n");
+	}
+
+	/* A modified record must not be accepted */
+	fill_payload(bufs[0] + TLS_RECORD_HEADER_LEN, size, 0);
+	if (tlsv1_record_send(&w, TLS_CONTENT_TYPE_APPLICATION_DATA, bufs[0],
+			      buf_size, size, &lens[0]) < 0) {
+		errors++;
+		goto done;
+	}
+	bufs[0][TLS_RECORD_HEADER_LEN + size / 2] ^= 0x01;
+	olen = buf_size;
+	if (tlsv1_record_receive(&r, bufs[0], lens[0], out, &olen, &alert) ==
+	    0) {
+		printf("%s: Modified record accepted\n", suites[s].name);
+		errors++;
+	}
+
+done:
+	if (bufs) {
+		for (i = 0; i < records; i++)
+			os_free(bufs[i]);
+	}
+	os_free(bufs);
+	os_free(lens);
+	os_free(out);
+	os_free(expected);
+	deinit(&w);
+	deinit(&r);
+
+	return errors;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int records = NUM_RECORDS, bench = 0, errors = 0;
+	size_t s, i;
+
+	if (argc > 1) {
+		if (os_strcmp(argv[1], "-b") != 0) {
+			printf("usage: test-tlsv1-record [-b [records]]\n");
+			return -1;
+		}
+		bench = 1;
+		records = argc > 2 ? atoi(argv[2]) : 200;
+		if (records < 1)
+			records = 1;
+	}
+
+	wpa_debug_level = MSG_ERROR;
+	if (os_program_init())
+		return -1;
+
+	for (s = 0; s < sizeof(suites) / sizeof(suites[0]); s++) {
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+			errors += test_suite(s, sizes[i], records, bench);
+	}
+
+	os_program_deinit();
+
+	if (errors) {
+		printf("%d test(s) failed\n", errors);
+		return -1;
+	}
+
+	return 0;
+}
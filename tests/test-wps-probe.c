@@ -0,0 +1,253 @@
+/*
+ * WPS Probe Request attribute parsing - test program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ */
+
+#include "utils/includes.h"
+#include "utils/common.h"
+#include "common/ieee802_11_defs.h"
+#include "wps/wps_i.h"
+
+static const u8 uuid_e[WPS_UUID_LEN] = {
+	0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0,
+	0x0f, 0xed, 0xcb, 0xa9, 0x87, 0x65, 0x43, 0x21
+};
+static const u8 pri_dev_type[WPS_DEV_TYPE_LEN] = {
+	0x00, 0x01, 0x00, 0x50, 0xf2, 0x04, 0x00, 0x01
+};
+static const char *dev_name = "Test Device";
+
+static void add_attr(struct wpabuf *buf, u16 type, const void *data,
+		     size_t len)
+{
+	wpabuf_put_be16(buf, type);
+	wpabuf_put_be16(buf, len);
+	wpabuf_put_data(buf, data, len);
+}
+
+static struct wpabuf * build_attrs(int num_req_dev_type)
+{
+	struct wpabuf *buf;
+	u8 val[WPS_DEV_TYPE_LEN];
+	int i;
+
+	buf = wpabuf_alloc(500);
+	if (buf == NULL)
+		return NULL;
+	val[0] = 0x10;
+	add_attr(buf, ATTR_VERSION, val, 1);
+	val[0] = WPS_REQ_ENROLLEE;
+	add_attr(buf, ATTR_REQUEST_TYPE, val, 1);
+	WPA_PUT_BE16(val, WPS_CONFIG_PUSHBUTTON | WPS_CONFIG_DISPLAY);
+	add_attr(buf, ATTR_CONFIG_METHODS, val, 2);
+	add_attr(buf, ATTR_UUID_E, uuid_e, WPS_UUID_LEN);
+	add_attr(buf, ATTR_PRIMARY_DEV_TYPE, pri_dev_type, WPS_DEV_TYPE_LEN);
+	val[0] = 0x03;
+	add_attr(buf, ATTR_RF_BANDS, val, 1);
+	WPA_PUT_BE16(val, DEV_PW_PUSHBUTTON);
+	add_attr(buf, ATTR_DEV_PASSWORD_ID, val, 2);
+	add_attr(buf, ATTR_DEV_NAME, dev_name, os_strlen(dev_name));
+	for (i = 0; i < num_req_dev_type; i++) {
+		os_memcpy(val, pri_dev_type, WPS_DEV_TYPE_LEN);
+		val[1] = i;
+		add_attr(buf, ATTR_REQUESTED_DEV_TYPE, val, WPS_DEV_TYPE_LEN);
+	}
+	add_attr(buf, ATTR_VENDOR_EXT, "\x00\x37\x2a\x00\x01\x20", 6);
+
+	return buf;
+}
+
+/* Split WPS attributes into WPS IEs with at most frag octets of data each */
+static struct wpabuf * build_ies(const struct wpabuf *attrs, size_t frag)
+{
+	struct wpabuf *ies;
+	const u8 *pos = wpabuf_head(attrs);
+	size_t left = wpabuf_len(attrs), len;
+
+	ies = wpabuf_alloc(14 * wpabuf_len(attrs) + 20);
+	if (ies == NULL)
+		return NULL;
+	wpabuf_put_u8(ies, WLAN_EID_SSID);
+	wpabuf_put_u8(ies, 4);
+	wpabuf_put_str(ies, "test");
+	do {
+		len = left > frag ? frag : left;
+		wpabuf_put_u8(ies, WLAN_EID_VENDOR_SPECIFIC);
+		wpabuf_put_u8(ies, 4 + len);
+		wpabuf_put_be32(ies, WPS_DEV_OUI_WFA);
+		wpabuf_put_data(ies, pos, len);
+		pos += len;
+		left -= len;
+		/* Unrelated vendor IE between WPS IE fragments */
+		wpabuf_put_u8(ies, WLAN_EID_VENDOR_SPECIFIC);
+		wpabuf_put_u8(ies, 5);
+		wpabuf_put_be32(ies, 0x506f9a09);
+		wpabuf_put_u8(ies, 0);
+	} while (left > 0);
+
+	return ies;
+}
+
+static int check_attr(const char *title, struct wps_probe_req_attr *attr,
+		      size_t attrs_len, int num_req_dev_type)
+{
+	int i;
+
+	if (attr->len != attrs_len ||
+	    attr->uuid_e == NULL ||
+	    os_memcmp(attr->uuid_e, uuid_e, WPS_UUID_LEN) != 0 ||
+	    attr->config_methods == NULL ||
+	    WPA_GET_BE16(attr->config_methods) !=
+	    (WPS_CONFIG_PUSHBUTTON | WPS_CONFIG_DISPLAY) ||
+	    attr->dev_password_id == NULL ||
+	    WPA_GET_BE16(attr->dev_password_id) != DEV_PW_PUSHBUTTON ||
+	    attr->request_type == NULL ||
+	    *attr->request_type != WPS_REQ_ENROLLEE ||
+	    attr->primary_dev_type == NULL ||
+	    os_memcmp(attr->primary_dev_type, pri_dev_type,
+		      WPS_DEV_TYPE_LEN) != 0 ||
+	    attr->dev_name == NULL ||
+	    attr->dev_name_len != os_strlen(dev_name) ||
+	    os_memcmp(attr->dev_name, dev_name, attr->dev_name_len) != 0) {
+		printf("%s: attribute mismatch\n", title);
+		return -1;
+	}
+
+	if (num_req_dev_type > MAX_REQ_DEV_TYPE_COUNT)
+		num_req_dev_type = MAX_REQ_DEV_TYPE_COUNT;
+	if ((int) attr->num_req_dev_type != num_req_dev_type) {
+		printf("%s: %u Requested Device Types (expected %d)\n", title,
+		       (unsigned int) attr->num_req_dev_type,
+		       num_req_dev_type);
+		return -1;
+	}
+	for (i = 0; i < num_req_dev_type; i++) {
+		if (attr->req_dev_type[i][1] != i ||
+		    os_memcmp(attr->req_dev_type[i] + 2, pri_dev_type + 2,
+			      WPS_DEV_TYPE_LEN - 2) != 0) {
+			printf("%s: Requested Device Type %d mismatch\n",
+			       title, i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int test_frag(int num_req_dev_type)
+{
+	struct wpabuf *attrs, *ies;
+	struct wps_probe_req_attr attr;
+	size_t frag;
+	int errors = 0;
+	char title[80];
+
+	attrs = build_attrs(num_req_dev_type);
+	if (attrs == NULL)
+		return 1;
+
+	os_snprintf(title, sizeof(title), "TLVs (%d req dev types)",
+		    num_req_dev_type);
+	if (wps_parse_probe_req_msg(attrs, &attr) < 0 ||
+	    check_attr(title, &attr, wpabuf_len(attrs), num_req_dev_type))
+		errors++;
+
+	for (frag = 1; frag <= 251; frag++) {
+		ies = build_ies(attrs, frag);
+		if (ies == NULL) {
+			errors++;
+			break;
+		}
+		os_snprintf(title, sizeof(title), "IEs (%d req dev types, "
+			    "fragment %u)", num_req_dev_type,
+			    (unsigned int) frag);
+		if (wps_parse_probe_req_ies(wpabuf_head(ies), wpabuf_len(ies),
+					    &attr) < 0) {
+			printf("%s: parsing failed\n", title);
+			errors++;
+		} else if (check_attr(title, &attr, wpabuf_len(attrs),
+				      num_req_dev_type))
+			errors++;
+		wpabuf_free(ies);
+	}
+
+	wpabuf_free(attrs);
+	return errors;
+}
+
+static int test_invalid(void)
+{
+	struct wps_probe_req_attr attr;
+	struct wpabuf *buf;
+	int errors = 0;
+	const u8 no_wps[] = { WLAN_EID_SSID, 0, WLAN_EID_VENDOR_SPECIFIC, 5,
+			      0x00, 0x50, 0xf2, 0x05, 0x00 };
+	const u8 empty_wps[] = { WLAN_EID_VENDOR_SPECIFIC, 4,
+				 0x00, 0x50, 0xf2, 0x04 };
+	const u8 padding[] = { 0x10, 0x3a, 0x00, 0x01, 0x00,
+			       0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+	if (wps_parse_probe_req_ies(no_wps, sizeof(no_wps), &attr) == 0) {
+		printf("No WPS IE: unexpected success\n");
+		errors++;
+	}
+	if (wps_parse_probe_req_ies(empty_wps, sizeof(empty_wps), &attr) < 0
+	    || attr.len != 0) {
+		printf("Empty WPS IE: unexpected result\n");
+		errors++;
+	}
+
+	buf = wpabuf_alloc(100);
+	if (buf == NULL)
+		return errors + 1;
+
+	add_attr(buf, ATTR_UUID_E, uuid_e, WPS_UUID_LEN - 1);
+	if (wps_parse_probe_req_msg(buf, &attr) == 0) {
+		printf("Invalid UUID-E length: unexpected success\n");
+		errors++;
+	}
+
+	wpabuf_free(buf);
+	buf = wpabuf_alloc_copy("\x10\x08\x00\x02\x00", 5);
+	if (buf == NULL || wps_parse_probe_req_msg(buf, &attr) == 0) {
+		printf("Truncated attribute: unexpected success\n");
+		errors++;
+	}
+
+	wpabuf_free(buf);
+	buf = wpabuf_alloc_copy(padding, sizeof(padding));
+	if (buf == NULL || wps_parse_probe_req_msg(buf, &attr) < 0 ||
+	    attr.request_type == NULL) {
+		printf("Trailing padding: unexpected result\n");
+		errors++;
+	}
+
+	wpabuf_free(buf);
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	int errors = 0;
+
+	errors += test_frag(0);
+	errors += test_frag(3);
+	errors += test_frag(MAX_REQ_DEV_TYPE_COUNT + 2);
+	errors += test_invalid();
+
+	if (errors) {
+		printf("%d test(s) failed\n", errors);
+		return -1;
+	}
+
+	printf("All tests passed\n");
+	return 0;
+}
@@ -0,0 +1,290 @@
+/*
+ * WPS registration protocol - test program
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ *
+ * Runs a number of simultaneous PIN registrations between in-process
+ * Enrollees and the Registrar of an AP with and without pre-generated
+ * Registrar DH keys (dh_key_pool) and verifies that all of them complete.
+ *
+ * Usage: test-wps-reg [-b <enrollees> <rounds>]
+ *
+ * With -b, the given number of simultaneous registrations is run the given
+ * number of times and registrations per second and the average time the
+ * Registrar spent processing M1 and building M2 are reported.
+ */
+
+#include "utils/includes.h"
+#include "utils/common.h"
+#include "utils/eloop.h"
+#include "wps/wps.h"
+
+extern int wpa_debug_level;
+
+static const u8 pin[] = "12345670";
+
+/* Number of simultaneous registrations in the pass/fail test */
+#define NUM_ENROLLEES 4
+
+/* A registration (M1..M8 and Done) takes five message exchanges */
+#define MAX_STEPS 10
+
+struct enrollee {
+	struct wps_context wps;
+	struct wps_data *enrollee;
+	struct wps_data *registrar;
+	int steps;
+	int done;
+};
+
+struct reg_test {
+	struct wps_context ap;
+	struct enrollee *sta;
+	int num_sta;
+	int active;
+	int failed;
+	int m2_count;
+	struct os_time m2_time;
+	struct os_time end;
+};
+
+
+static void time_add_diff(struct os_time *sum, struct os_time *start,
+			  struct os_time *end)
+{
+	struct os_time diff;
+
+	os_time_sub(end, start, &diff);
+	sum->sec += diff.sec;
+	sum->usec += diff.usec;
+	if (sum->usec >= 1000000) {
+		sum->sec++;
+		sum->usec -= 1000000;
+	}
+}
+
+
+static void init_dev(struct wps_context *wps, int ap, int idx)
+{
+	wps->ap = ap;
+	wps->wps_state = WPS_STATE_CONFIGURED;
+	wps->uuid[0] = ap ? 0xaa : 0x55;
+	WPA_PUT_BE32(&wps->uuid[12], idx);
+	wps->dev.mac_addr[0] = 0x02;
+	WPA_PUT_BE32(&wps->dev.mac_addr[2], idx);
+	wps->dev.device_name = ap ? "Test AP" : "Test Enrollee";
+	wps->dev.manufacturer = "Test";
+	wps->dev.model_name = "Test";
+	wps->dev.model_number = "1";
+	wps->dev.serial_number = "1";
+	WPA_PUT_BE16(wps->dev.pri_dev_type, ap ? 6 : 1);
+	WPA_PUT_BE32(&wps->dev.pri_dev_type[2], WPS_DEV_OUI_WFA);
+	WPA_PUT_BE16(&wps->dev.pri_dev_type[6], 1);
+	wps->dev.rf_bands = WPS_RF_24GHZ;
+	wps->config_methods = WPS_CONFIG_DISPLAY | WPS_CONFIG_KEYPAD;
+	wps->auth_types = WPS_AUTH_WPA2PSK;
+	wps->encr_types = WPS_ENCR_AES;
+}
+
+
+/* Run one message exchange for each active registration */
+static void reg_test_step(void *eloop_ctx, void *timeout_ctx)
+{
+	struct reg_test *t = eloop_ctx;
+	struct enrollee *sta;
+	struct wpabuf *msg;
+	enum wsc_op_code op_code;
+	enum wps_process_res res;
+	struct os_time start, end;
+	int i;
+
+	for (i = 0; i < t->num_sta; i++) {
+		sta = &t->sta[i];
+		if (sta->done)
+			continue;
+		if (++sta->steps > MAX_STEPS)
+			goto failed;
+
+		msg = wps_get_msg(sta->enrollee, &op_code);
+		if (msg == NULL)
+			goto failed;
+		os_get_time(&start);
+		res = wps_process_msg(sta->registrar, op_code, msg);
+		wpabuf_free(msg);
+		if (res == WPS_DONE) {
+			sta->done = 1;
+			t->active--;
+			continue;
+		}
+		if (res != WPS_CONTINUE)
+			goto failed;
+
+		msg = wps_get_msg(sta->registrar, &op_code);
+		if (msg == NULL)
+			goto failed;
+		if (sta->steps == 1) {
+			/* M1 processed and M2 built */
+			os_get_time(&end);
+			time_add_diff(&t->m2_time, &start, &end);
+			t->m2_count++;
+		}
+		res = wps_process_msg(sta->enrollee, op_code, msg);
+		wpabuf_free(msg);
+		if (res != WPS_CONTINUE)
+			goto failed;
+		continue;
+
+	failed:
+		sta->done = 1;
+		t->active--;
+		t->failed++;
+	}
+
+	if (t->active > 0) {
+		eloop_register_timeout(0, 0, reg_test_step, t, NULL);
+	} else {
+		os_get_time(&t->end);
+		/* Stop the PIN walk time timeout so that eloop_run() returns */
+		wps_registrar_wps_cancel(t->ap.registrar);
+	}
+}
+
+
+static int reg_test_run(int num_sta, unsigned int dh_key_pool, int bench)
+{
+	struct reg_test t;
+	struct wps_registrar_config cfg;
+	struct wps_config wcfg;
+	struct os_time start, diff;
+	double secs;
+	int i, ret = 0;
+
+	os_memset(&t, 0, sizeof(t));
+	init_dev(&t.ap, 1, 0);
+	t.ap.network_key = (u8 *) os_strdup("12345678");
+	t.ap.network_key_len = 8;
+	t.ap.ssid_len = 4;
+	os_memcpy(t.ap.ssid, "test", 4);
+
+	os_memset(&cfg, 0, sizeof(cfg));
+	cfg.dh_key_pool = dh_key_pool;
+	t.ap.registrar = wps_registrar_init(&t.ap, &cfg);
+	t.sta = os_zalloc(num_sta * sizeof(struct enrollee));
+	if (t.ap.registrar == NULL || t.sta == NULL) {
+		ret = -1;
+		goto out;
+	}
+
+	if (dh_key_pool) {
+		/* Let the pool fill up before the Enrollees show up */
+		eloop_run();
+	}
+
+	t.num_sta = num_sta;
+	for (i = 0; i < num_sta; i++) {
+		struct enrollee *sta = &t.sta[i];
+
+		init_dev(&sta->wps, 0, i + 1);
+		wps_registrar_add_pin(t.ap.registrar, NULL, sta->wps.uuid,
+				      pin, 8, 0);
+
+		os_memset(&wcfg, 0, sizeof(wcfg));
+		wcfg.wps = &sta->wps;
+		wcfg.pin = pin;
+		wcfg.pin_len = 8;
+		sta->enrollee = wps_init(&wcfg);
+
+		os_memset(&wcfg, 0, sizeof(wcfg));
+		wcfg.wps = &t.ap;
+		wcfg.registrar = 1;
+		sta->registrar = wps_init(&wcfg);
+		if (sta->enrollee == NULL || sta->registrar == NULL) {
+			ret = -1;
+			goto out;
+		}
+		t.active++;
+	}
+
+	os_get_time(&start);
+	eloop_register_timeout(0, 0, reg_test_step, &t, NULL);
+	eloop_run();
+
+	if (bench) {
+		os_time_sub(&t.end, &start, &diff);
+		secs = diff.sec + diff.usec / 1000000.0;
+		printf("dh_key_pool=%u: %d registrations (%d failed) in "
+		       "%.3f s: %.1f registrations/s, M1->M2 %.1f ms\n",
+		       dh_key_pool, num_sta, t.failed, secs,
+		       secs > 0 ? (num_sta - t.failed) / secs : 0,
+		       t.m2_count ? (t.m2_time.sec * 1000.0 +
+				     t.m2_time.usec / 1000.0) / t.m2_count :
+		       0);
+	}
+	if (t.failed) {
+		printf("dh_key_pool=%u: %d of %d registrations failed\n",
+		       dh_key_pool, t.failed, num_sta);
+		ret = -1;
+	}
+
+out:
+	for (i = 0; t.sta && i < t.num_sta; i++) {
+		wps_deinit(t.sta[i].enrollee);
+		wps_deinit(t.sta[i].registrar);
+	}
+	os_free(t.sta);
+	wps_registrar_deinit(t.ap.registrar);
+	os_free(t.ap.network_key);
+	return ret;
+}
+
+
+int main(int argc, char *argv[])
+{
+	int num_sta = NUM_ENROLLEES, rounds = 1, bench = 0, i, errors = 0;
+	unsigned int pool;
+
+	if (argc > 1) {
+		if (argc != 4 || os_strcmp(argv[1], "-b") != 0) {
+			printf("usage: test-wps-reg [-b <enrollees> <rounds>]\n");
+			return -1;
+		}
+		bench = 1;
+		num_sta = atoi(argv[2]);
+		rounds = atoi(argv[3]);
+		if (num_sta < 1)
+			num_sta = 1;
+	}
+	pool = num_sta < WPS_MAX_DH_KEY_POOL ? num_sta : WPS_MAX_DH_KEY_POOL;
+
+	wpa_debug_level = MSG_ERROR;
+	if (os_program_init())
+		return -1;
+	if (eloop_init()) {
+		printf("Failed to initialize event loop\n");
+		return -1;
+	}
+
+	for (i = 0; i < rounds; i++) {
+		if (reg_test_run(num_sta, 0, bench) < 0)
+			errors++;
+		if (reg_test_run(num_sta, pool, bench) < 0)
+			errors++;
+	}
+
+	eloop_destroy();
+	os_program_deinit();
+
+	if (errors) {
+		printf("%d test(s) failed\n", errors);
+		return -1;
+	}
+
+	return 0;
+}
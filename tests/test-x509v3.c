@@ -21,6 +21,114 @@
 extern int wpa_debug_level;
 
 
+/*
+ * Parse and validate the chain the way the TLS handshake does it for each
+ * received Certificate message. The last certificate is used as the trusted
+ * CA unless another one is given.
+ */
+static int validate_chain(char **bufs, size_t *lens, int count,
+			  struct x509_certificate *trusted, int cached)
+{
+	struct x509_certificate *chain = NULL, *last = NULL, *cert;
+	int i, reason, ret;
+
+	for (i = 0; i < count; i++) {
+		if (cached)
+			cert = x509_certificate_parse_cached((u8 *) bufs[i],
+							     lens[i]);
+		else
+			cert = x509_certificate_parse((u8 *) bufs[i], lens[i]);
+		if (cert == NULL) {
+			x509_certificate_chain_free(chain);
+			return -1;
+		}
+		if (chain == NULL)
+			chain = cert;
+		else
+			last->next = cert;
+		last = cert;
+	}
+
+	ret = x509_certificate_chain_validate(trusted ? trusted : last, chain,
+					      &reason, 0);
+	x509_certificate_chain_free(chain);
+	return ret;
+}
+
+
+static int cache_test(const char *untrusted_file, char **files, int count)
+{
+	char **bufs;
+	size_t *lens, len;
+	struct x509_certificate *untrusted = NULL;
+	int i, errors = 0;
+	char *buf;
+
+	bufs = os_zalloc(count * sizeof(char *));
+	lens = os_zalloc(count * sizeof(size_t));
+	if (bufs == NULL || lens == NULL)
+		return -1;
+	for (i = 0; i < count; i++) {
+		bufs[i] = os_readfile(files[i], &lens[i]);
+		if (bufs[i] == NULL) {
+			printf("Failed to read '%s'\n", files[i]);
+			errors++;
+			goto done;
+		}
+	}
+
+	if (untrusted_file) {
+		buf = os_readfile(untrusted_file, &len);
+		if (buf == NULL) {
+			printf("Failed to read '%s'\n", untrusted_file);
+			errors++;
+			goto done;
+		}
+		untrusted = x509_certificate_parse((u8 *) buf, len);
+		os_free(buf);
+		if (untrusted == NULL) {
+			printf("Failed to parse '%s'\n", untrusted_file);
+			errors++;
+			goto done;
+		}
+	}
+
+	/*
+	 * Validate without the cache, then twice with it: the first round
+	 * parses the certificates and verifies the signatures, the second one
+	 * uses the cached results.
+	 */
+	for (i = 0; i < 3; i++) {
+		if (validate_chain(bufs, lens, count, NULL, i > 0) < 0) {
+			printf("Certificate chain validation failed (round %d)\n",
+			       i);
+			errors++;
+			goto done;
+		}
+	}
+
+	/*
+	 * A CA with the same name, but a different key must not be accepted
+	 * based on the cached signature verification results.
+	 */
+	if (untrusted &&
+	    validate_chain(bufs, lens, count, untrusted, 1) == 0) {
+		printf("Certificate chain accepted with an untrusted CA\n");
+		errors++;
+	}
+
+done:
+	for (i = 0; i < count; i++)
+		os_free(bufs[i]);
+	os_free(bufs);
+	os_free(lens);
+	x509_certificate_free(untrusted);
+	x509_certificate_cache_flush();
+
+	return errors ? -1 : 0;
+}
+
+
 int main(int argc, char *argv[])
 {
 	char *buf;
@@ -30,8 +138,17 @@ int main(int argc, char *argv[])
 
 	wpa_debug_level = 0;
 
+	if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+		wpa_debug_level = MSG_ERROR;
+		if (argc > 4 && strcmp(argv[2], "-u") == 0)
+			return cache_test(argv[3], &argv[4], argc - 4);
+		return cache_test(NULL, &argv[2], argc - 2);
+	}
+
 	if (argc < 3 || strcmp(argv[1], "-v") != 0) {
-		printf("usage: test_x509v3 -v <cert1.der> <cert2.der> ..\n");
+		printf("usage: test_x509v3 -v <cert1.der> <cert2.der> ..\n"
+		       "       test_x509v3 -c [-u <untrusted CA.der>] "
+		       "<cert1.der> <cert2.der> ..\n");
 		return -1;
 	}
 
@@ -59,7 +176,7 @@ int main(int argc, char *argv[])
 	}
 
 	printf("\n\nValidating certificate chain\n");
-	if (x509_certificate_chain_validate(last, certs, &reason) < 0) {
+	if (x509_certificate_chain_validate(last, certs, &reason, 0) < 0) {
 		printf("\nCertificate chain validation failed: %d\n", reason);
 		return -1;
 	}
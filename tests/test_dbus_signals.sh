@@ -0,0 +1,160 @@
+#!/bin/bash
+
+# D-Bus signal count measurement with driver_test
+#
+# Starts a private dbus-daemon and wpa_supplicant with the new D-Bus interface
+# and runs a number of scans against a set of simulated APs that change their
+# IEs in every scan and are not seen in every scan (so BSS entries are added,
+# updated, and removed). The number of signals seen on the bus is reported
+# with per-BSS signals (dbus_bss_aggregate=0) and with aggregated
+# BSSesChanged signals (dbus_bss_aggregate=1).
+#
+# wpa_supplicant needs to be built with CONFIG_DRIVER_TEST=y and
+# CONFIG_CTRL_IFACE_DBUS_NEW=y (and without CONFIG_TDLS since there is no real
+# network interface). dbus-daemon, dbus-monitor, and python3 are used for the
+# test setup.
+
+if [ -z "$1" ]; then
+    echo "usage: $0 <path to wpa_supplicant directory> [APs] [scans]"
+    exit 1
+fi
+
+WPAS=$1/wpa_supplicant
+WPACLI=$1/wpa_cli
+APS=${2:-30}
+SCANS=${3:-5}
+DIR=`pwd`/test_dbus_signals.tmp
+BUS=unix:path=$DIR/bus
+
+if [ ! -x $WPAS -o ! -x $WPACLI ]; then
+    echo "wpa_supplicant/wpa_cli not found in $1"
+    exit 1
+fi
+
+for p in dbus-daemon dbus-monitor python3; do
+    if ! which $p > /dev/null; then
+	echo "$p not found"
+	exit 1
+    fi
+done
+
+function start_bus
+{
+    cat > $DIR/bus.conf <<EOF
+<!DOCTYPE busconfig PUBLIC "-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN"
+ "http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd">
+<busconfig>
+  <listen>$BUS</listen>
+  <auth>EXTERNAL</auth>
+  <policy context="default">
+    <allow user="*"/>
+    <allow own="*"/>
+    <allow send_destination="*" eavesdrop="true"/>
+    <allow eavesdrop="true"/>
+  </policy>
+</busconfig>
+EOF
+    dbus-daemon --config-file=$DIR/bus.conf --fork --print-pid > $DIR/bus.pid
+    sleep 0.5
+}
+
+# Simulated APs: reply to driver_test SCAN commands. AP i is not seen in every
+# fourth scan and includes the scan number in a vendor specific IE.
+function start_aps
+{
+    python3 - $DIR/test $APS > /dev/null 2>&1 <<EOF &
+import os, select, socket, sys
+d, n = sys.argv[1], int(sys.argv[2])
+socks = {}
+for i in range(n):
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+    bssid = "02:00:00:00:%02x:%02x" % (i >> 8, i & 0xff)
+    s.bind(os.path.join(d, "AP-" + bssid))
+    socks[s] = [i, bssid, 0]
+while True:
+    for s in select.select(list(socks), [], [])[0]:
+        data, addr = s.recvfrom(4096)
+        if not data.startswith(b"SCAN"):
+            continue
+        i, bssid, count = socks[s]
+        socks[s][2] = count + 1
+        if (count + i) % 4 == 3:
+            continue
+        ies = "010882848b960c121824" + "030101" + "dd04aabbcc%02x" % (count & 0xff)
+        ssid = ("ap-%d" % i).encode().hex()
+        s.sendto(("SCANRESP %s %s %s" % (bssid, ssid, ies)).encode(), addr)
+EOF
+    echo $! > $DIR/aps.pid
+    sleep 0.5
+}
+
+function stop_all
+{
+    [ -f $DIR/wpas.pid ] && kill `cat $DIR/wpas.pid` 2>/dev/null
+    sleep 1
+    for p in $DIR/*.pid; do
+	[ -f $p ] && kill `cat $p` 2>/dev/null
+    done
+    sleep 0.5
+}
+
+# run <dbus_bss_aggregate>
+function run
+{
+    rm -rf $DIR
+    mkdir -p $DIR/test
+    start_bus
+    start_aps
+
+    dbus-monitor --address $BUS type=signal > $DIR/monitor.log 2>&1 &
+    echo $! > $DIR/monitor.pid
+    sleep 0.5
+
+    cat > $DIR/wpas.conf <<EOF
+ctrl_interface=$DIR/ctrl
+bss_expiration_scan_count=1
+dbus_bss_aggregate=$1
+EOF
+    DBUS_SYSTEM_BUS_ADDRESS=$BUS $WPAS -u -Dtest -iwlan0 -c$DIR/wpas.conf \
+	-ptest_dir=$DIR/test -dd -B -f $DIR/wpas.log \
+	-P $DIR/wpas.pid
+    sleep 1
+
+    for s in `seq 1 $SCANS`; do
+	$WPACLI -p $DIR/ctrl -i wlan0 scan > /dev/null
+	sleep 2
+    done
+    stop_all
+
+    SIGNALS=`grep -c "^signal .*path=/fi/w1/wpa_supplicant1" $DIR/monitor.log`
+    SCAN_DONE=`grep -c "member=ScanDone" $DIR/monitor.log`
+    STATS=`grep "dbus: Sent [0-9]* signals" $DIR/wpas.log | sed "s/.*dbus: //"`
+    echo "dbus_bss_aggregate=$1: $SIGNALS signals on the bus for $SCAN_DONE" \
+	"scans; $STATS"
+    for m in BSSAdded BSSRemoved BSSesChanged PropertiesChanged; do
+	echo "  $m: `grep -c "member=$m\$" $DIR/monitor.log`"
+    done
+}
+
+run 0
+PER_BSS=$SIGNALS
+PER_BSS_SCANS=$SCAN_DONE
+run 1
+AGGREGATED=$SIGNALS
+AGGREGATED_SCANS=$SCAN_DONE
+
+rm -rf $DIR
+
+if [ $PER_BSS_SCANS -eq 0 -o $AGGREGATED_SCANS -eq 0 ]; then
+    echo "No scans completed"
+    exit 1
+fi
+
+if [ $AGGREGATED -ge $PER_BSS ]; then
+    echo "Aggregated BSS signals did not reduce the number of signals"
+    exit 1
+fi
+
+echo "signals per scan: $((PER_BSS / PER_BSS_SCANS)) per-BSS," \
+    "$((AGGREGATED / AGGREGATED_SCANS)) aggregated"
+exit 0
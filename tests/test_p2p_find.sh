@@ -0,0 +1,95 @@
+#!/bin/bash
+
+# P2P device discovery time measurement with driver_test
+#
+# Starts a number of P2P Devices and one measuring device, all running
+# P2P_FIND using driver_test with internal P2P management, and reports how long
+# it took for the measuring device to discover each peer.
+#
+# wpa_supplicant needs to be built with CONFIG_DRIVER_TEST=y and CONFIG_P2P=y
+# (and without CONFIG_TDLS since there is no real network interface).
+
+if [ -z "$1" ]; then
+    echo "usage: $0 <path to wpa_supplicant directory> [peers] [rounds]"
+    exit 1
+fi
+
+WPAS=$1/wpa_supplicant
+WPACLI=$1/wpa_cli
+PEERS=${2:-3}
+ROUNDS=${3:-3}
+DIR=`pwd`/test_p2p_find.tmp
+FIND_TIME=10
+
+if [ ! -x $WPAS -o ! -x $WPACLI ]; then
+    echo "wpa_supplicant/wpa_cli not found in $1"
+    exit 1
+fi
+
+function start_dev
+{
+    cat > $DIR/p2p$1.conf <<EOF
+ctrl_interface=$DIR/ctrl
+device_name=p2p-dev-$1
+driver_param=test_dir=$DIR/test p2p_mgmt=1
+EOF
+    $WPAS -Dtest -iwlan$1 -c$DIR/p2p$1.conf -dd -B -f $DIR/p2p$1.log \
+	-P $DIR/p2p$1.pid
+}
+
+function stop_all
+{
+    for p in $DIR/*.pid; do
+	[ -f $p ] && kill `cat $p` 2>/dev/null
+    done
+    sleep 1
+}
+
+TOTAL=0
+FOUND=0
+MISSED=0
+MIN=
+MAX=0
+
+for r in `seq 1 $ROUNDS`; do
+    rm -rf $DIR
+    mkdir -p $DIR/test
+
+    for i in `seq 1 $PEERS`; do
+	start_dev $i
+    done
+    start_dev 0
+    sleep 1
+
+    for i in `seq 1 $PEERS`; do
+	$WPACLI -p $DIR/ctrl -i wlan$i p2p_find > /dev/null
+    done
+    $WPACLI -p $DIR/ctrl -i wlan0 p2p_find $FIND_TIME > /dev/null
+    sleep $((FIND_TIME + 1))
+    stop_all
+
+    # P2P: Discovered peer <addr> on <freq> MHz <ms> ms after start of find
+    TIMES=`grep "Discovered peer" $DIR/p2p0.log | sed "s/.* MHz \([0-9]*\) ms.*/\1/"`
+    n=0
+    for t in $TIMES; do
+	n=$((n + 1))
+	TOTAL=$((TOTAL + t))
+	[ -z "$MIN" ] && MIN=$t
+	[ $t -lt $MIN ] && MIN=$t
+	[ $t -gt $MAX ] && MAX=$t
+    done
+    FOUND=$((FOUND + n))
+    MISSED=$((MISSED + PEERS - n))
+    echo "round $r: discovered $n/$PEERS peers:" $TIMES "ms"
+done
+
+rm -rf $DIR
+
+if [ $FOUND -eq 0 ]; then
+    echo "No peers discovered"
+    exit 1
+fi
+
+echo "time-to-discover: min $MIN ms, avg $((TOTAL / FOUND)) ms, max $MAX ms" \
+    "($FOUND found, $MISSED missed)"
+exit 0
@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# X.509 certificate cache test
+#
+# Generates a root CA, an intermediate CA, a server certificate, and another
+# root CA with the same name but a different key with openssl and validates
+# the chain with and without the parsed certificate cache. The chain must
+# not be accepted with the other root CA after the signatures have been
+# cached.
+
+DIR=`pwd`/test_x509_cache.tmp
+X509TEST="`pwd`/test-x509v3"
+
+if [ ! -x $X509TEST ]; then
+    echo "test-x509v3 not found"
+    exit 1
+fi
+
+if ! which openssl > /dev/null; then
+    echo "openssl not found"
+    exit 1
+fi
+
+rm -rf $DIR
+mkdir -p $DIR
+cd $DIR
+
+cat > ext.cnf <<EOF2
+[ca]
+basicConstraints=critical,CA:TRUE
+keyUsage=critical,keyCertSign,cRLSign
+subjectKeyIdentifier=hash
+
+[server]
+basicConstraints=CA:FALSE
+keyUsage=digitalSignature,keyEncipherment
+EOF2
+
+# cert <name> <subject> <issuer name or "self"> <extensions>
+function cert
+{
+    openssl req -new -newkey rsa:2048 -nodes -keyout $1.key -out $1.csr \
+	-subj "$2" 2> /dev/null || exit 1
+    if [ "$3" = "self" ]; then
+	SIGN="-signkey $1.key"
+    else
+	SIGN="-CA $3.pem -CAkey $3.key -CAcreateserial"
+    fi
+    openssl x509 -req -in $1.csr $SIGN -days 30 -sha256 -extfile ext.cnf \
+	-extensions $4 -out $1.pem 2> /dev/null || exit 1
+    openssl x509 -in $1.pem -outform DER -out $1.der || exit 1
+}
+
+cert root "/CN=Test Root CA" self ca
+cert other "/CN=Test Root CA" self ca
+cert inter "/CN=Test Intermediate CA" root ca
+cert server "/CN=server.example.com" inter server
+
+$X509TEST -c -u other.der server.der inter.der root.der
+RES=$?
+
+cd ..
+rm -rf $DIR
+
+if [ $RES -ne 0 ]; then
+    echo "X.509 certificate cache test failed"
+    exit 1
+fi
+exit 0
@@ -167,6 +167,7 @@ static void wpa_bss_add(struct wpa_supplicant *wpa_s,
 		" SSID '%s'",
 		bss->id, MAC2STR(bss->bssid), wpa_ssid_txt(ssid, ssid_len));
 	wpas_notify_bss_added(wpa_s, bss->bssid, bss->id);
+	wpa_supplicant_rsn_preauth_bss(wpa_s, bss);
 	if (wpa_s->num_bss > wpa_s->conf->bss_max_count)
 		wpa_bss_remove_oldest(wpa_s);
 }
@@ -269,7 +270,7 @@ static u32 wpa_bss_compare_res(const struct wpa_bss *old,
 
 
 static void notify_bss_changes(struct wpa_supplicant *wpa_s, u32 changes,
-			       const struct wpa_bss *bss)
+			       struct wpa_bss *bss)
 {
 	if (changes & WPA_BSS_FREQ_CHANGED_FLAG)
 		wpas_notify_bss_freq_changed(wpa_s, bss->id);
@@ -286,8 +287,10 @@ static void notify_bss_changes(struct wpa_supplicant *wpa_s, u32 changes,
 	if (changes & WPA_BSS_WPAIE_CHANGED_FLAG)
 		wpas_notify_bss_wpaie_changed(wpa_s, bss->id);
 
-	if (changes & WPA_BSS_RSNIE_CHANGED_FLAG)
+	if (changes & WPA_BSS_RSNIE_CHANGED_FLAG) {
 		wpas_notify_bss_rsnie_changed(wpa_s, bss->id);
+		wpa_supplicant_rsn_preauth_bss(wpa_s, bss);
+	}
 
 	if (changes & WPA_BSS_WPS_CHANGED_FLAG)
 		wpas_notify_bss_wps_changed(wpa_s, bss->id);
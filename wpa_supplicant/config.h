@@ -412,6 +412,16 @@ struct wpa_config {
 	 */
 	int filter_ssids;
 
+	/**
+	 * dbus_bss_aggregate - Aggregate D-Bus BSS signals
+	 *
+	 *   0 = send BSSAdded, BSSRemoved, and PropertiesChanged signals for
+	 *       each BSS (default)
+	 *   1 = send a single BSSesChanged signal for all BSS changes in a
+	 *       scan or event
+	 */
+	int dbus_bss_aggregate;
+
 	/**
 	 * max_num_sta - Maximum number of STAs in an AP/P2P GO
 	 */
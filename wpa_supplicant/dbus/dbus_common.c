@@ -325,6 +325,7 @@ struct wpas_dbus_priv * wpas_dbus_init(struct wpa_global *global)
 	if (priv == NULL)
 		return NULL;
 	priv->global = global;
+	dl_list_init(&priv->changed_objs);
 
 	if (wpas_dbus_init_common(priv) < 0) {
 		wpas_dbus_deinit(priv);
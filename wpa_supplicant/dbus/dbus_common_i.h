@@ -19,12 +19,22 @@
 
 #include <dbus/dbus.h>
 
+#include "utils/list.h"
+
 struct wpas_dbus_priv {
 	DBusConnection *con;
 	int should_dispatch;
 	struct wpa_global *global;
 	u32 next_objid;
 	int dbus_new_initialized;
+
+	/* objects with properties waiting for PropertiesChanged signal */
+	struct dl_list changed_objs;
+
+	/* statistics */
+	unsigned int signals_sent;
+	unsigned int prop_changed_signals;
+	unsigned int prop_changes;
 };
 
 #endif /* DBUS_COMMON_I_H */
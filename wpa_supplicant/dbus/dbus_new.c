@@ -17,6 +17,7 @@
 #include "includes.h"
 
 #include "common.h"
+#include "eloop.h"
 #include "common/ieee802_11_defs.h"
 #include "wps/wps.h"
 #include "../config.h"
@@ -75,7 +76,7 @@ static void wpas_dbus_signal_interface(struct wpa_supplicant *wpa_s,
 			goto err;
 	}
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 	dbus_message_unref(msg);
 	return;
 
@@ -110,6 +111,303 @@ static void wpas_dbus_signal_interface_removed(struct wpa_supplicant *wpa_s)
 }
 
 
+struct wpas_dbus_id_list {
+	unsigned int *ids;
+	size_t num;
+	size_t size;
+};
+
+/*
+ * BSS changes waiting for BSSesChanged signal. BSS ids are allocated in
+ * increasing order, so the added list is sorted.
+ */
+struct wpas_dbus_bss_changes {
+	struct wpas_dbus_id_list added;
+	struct wpas_dbus_id_list changed;
+	struct wpas_dbus_id_list removed;
+	int pending;
+};
+
+
+static int wpas_dbus_id_list_add(struct wpas_dbus_id_list *list,
+				 unsigned int id)
+{
+	unsigned int *ids;
+	size_t size;
+
+	if (list->num == list->size) {
+		size = list->size ? 2 * list->size : 16;
+		ids = os_realloc(list->ids, size * sizeof(*ids));
+		if (ids == NULL)
+			return -1;
+		list->ids = ids;
+		list->size = size;
+	}
+	list->ids[list->num++] = id;
+	return 0;
+}
+
+
+static int wpas_dbus_id_list_del(struct wpas_dbus_id_list *list,
+				 unsigned int id, int sorted)
+{
+	size_t i, left = 0, right = list->num;
+
+	if (sorted) {
+		while (left < right) {
+			i = left + (right - left) / 2;
+			if (list->ids[i] < id)
+				left = i + 1;
+			else
+				right = i;
+		}
+	} else {
+		while (left < list->num && list->ids[left] != id)
+			left++;
+	}
+	if (left >= list->num || list->ids[left] != id)
+		return -1;
+
+	os_memmove(&list->ids[left], &list->ids[left + 1],
+		   (list->num - left - 1) * sizeof(list->ids[0]));
+	list->num--;
+	return 0;
+}
+
+
+static int wpas_dbus_id_list_find(struct wpas_dbus_id_list *list,
+				  unsigned int id)
+{
+	size_t i, left = 0, right = list->num;
+
+	/* sorted list */
+	while (left < right) {
+		i = left + (right - left) / 2;
+		if (list->ids[i] < id)
+			left = i + 1;
+		else if (list->ids[i] > id)
+			right = i;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+
+static int wpas_dbus_bss_aggregate(struct wpa_supplicant *wpa_s)
+{
+	if (wpa_s->dbus_new_path == NULL)
+		return 0;
+	if (wpa_s->conf == NULL) {
+		/* Configuration has already been freed on interface removal */
+		return wpa_s->dbus_bss_changes != NULL;
+	}
+	return wpa_s->conf->dbus_bss_aggregate;
+}
+
+
+static void wpas_dbus_signal_bsses_changed(struct wpa_supplicant *wpa_s);
+
+
+static void wpas_dbus_bss_changes_timeout(void *eloop_ctx, void *timeout_ctx)
+{
+	struct wpa_supplicant *wpa_s = eloop_ctx;
+
+	wpas_dbus_signal_bsses_changed(wpa_s);
+}
+
+
+static struct wpas_dbus_bss_changes *
+wpas_dbus_bss_changes_get(struct wpa_supplicant *wpa_s)
+{
+	struct wpas_dbus_bss_changes *changes = wpa_s->dbus_bss_changes;
+
+	if (changes == NULL) {
+		changes = os_zalloc(sizeof(*changes));
+		if (changes == NULL)
+			return NULL;
+		wpa_s->dbus_bss_changes = changes;
+	}
+
+	if (!changes->pending) {
+		/* Send the changes once the current event has been processed */
+		changes->pending = 1;
+		eloop_register_timeout(0, 0, wpas_dbus_bss_changes_timeout,
+				       wpa_s, NULL);
+	}
+
+	return changes;
+}
+
+
+static void wpas_dbus_bss_changes_free(struct wpa_supplicant *wpa_s)
+{
+	struct wpas_dbus_bss_changes *changes = wpa_s->dbus_bss_changes;
+
+	if (changes == NULL)
+		return;
+	eloop_cancel_timeout(wpas_dbus_bss_changes_timeout, wpa_s, NULL);
+	os_free(changes->added.ids);
+	os_free(changes->changed.ids);
+	os_free(changes->removed.ids);
+	os_free(changes);
+	wpa_s->dbus_bss_changes = NULL;
+}
+
+
+static int wpas_dbus_bss_changes_added(struct wpa_supplicant *wpa_s,
+				       unsigned int id)
+{
+	struct wpas_dbus_bss_changes *changes;
+
+	changes = wpas_dbus_bss_changes_get(wpa_s);
+	if (changes == NULL)
+		return -1;
+	return wpas_dbus_id_list_add(&changes->added, id);
+}
+
+
+static int wpas_dbus_bss_changes_removed(struct wpa_supplicant *wpa_s,
+					 unsigned int id)
+{
+	struct wpas_dbus_bss_changes *changes;
+
+	changes = wpas_dbus_bss_changes_get(wpa_s);
+	if (changes == NULL)
+		return -1;
+	if (wpas_dbus_id_list_del(&changes->added, id, 1) == 0)
+		return 0; /* listeners have not been notified of this BSS */
+	wpas_dbus_id_list_del(&changes->changed, id, 0);
+	return wpas_dbus_id_list_add(&changes->removed, id);
+}
+
+
+static int wpas_dbus_bss_changes_changed(struct wpa_supplicant *wpa_s,
+					 unsigned int id, const char *path,
+					 const char *property)
+{
+	struct wpas_dbus_bss_changes *changes;
+	int res;
+
+	changes = wpas_dbus_bss_changes_get(wpa_s);
+	if (changes == NULL)
+		return -1;
+	if (wpas_dbus_id_list_find(&changes->added, id))
+		return 0; /* all properties will be included */
+	res = wpa_dbus_mark_property_pending(wpa_s->global->dbus, path,
+					     WPAS_DBUS_NEW_IFACE_BSS,
+					     property);
+	if (res < 0)
+		return -1;
+	if (res == 0)
+		return 0; /* already in the changed list */
+	return wpas_dbus_id_list_add(&changes->changed, id);
+}
+
+
+static int wpas_dbus_append_bss_list(struct wpa_supplicant *wpa_s,
+				     DBusMessageIter *iter,
+				     struct wpas_dbus_id_list *list,
+				     int properties, int changed_only)
+{
+	struct wpas_dbus_priv *iface = wpa_s->global->dbus;
+	DBusMessageIter array_iter, entry_iter, dict_iter;
+	char path[WPAS_DBUS_OBJECT_PATH_MAX], *pos = path;
+	size_t i;
+
+	if (!dbus_message_iter_open_container(
+		    iter, DBUS_TYPE_ARRAY,
+		    properties ? "{oa{sv}}" : DBUS_TYPE_OBJECT_PATH_AS_STRING,
+		    &array_iter))
+		return -1;
+
+	for (i = 0; i < list->num; i++) {
+		os_snprintf(path, WPAS_DBUS_OBJECT_PATH_MAX,
+			    "%s/" WPAS_DBUS_NEW_BSSIDS_PART "/%u",
+			    wpa_s->dbus_new_path, list->ids[i]);
+		if (!properties) {
+			if (!dbus_message_iter_append_basic(
+				    &array_iter, DBUS_TYPE_OBJECT_PATH, &pos))
+				return -1;
+			continue;
+		}
+
+		if (!dbus_message_iter_open_container(&array_iter,
+						      DBUS_TYPE_DICT_ENTRY,
+						      NULL, &entry_iter) ||
+		    !dbus_message_iter_append_basic(&entry_iter,
+						    DBUS_TYPE_OBJECT_PATH,
+						    &pos) ||
+		    !wpa_dbus_dict_open_write(&entry_iter, &dict_iter))
+			return -1;
+		if (changed_only)
+			wpa_dbus_get_changed_properties(iface, path,
+							WPAS_DBUS_NEW_IFACE_BSS,
+							&dict_iter);
+		else
+			wpa_dbus_get_object_properties(iface, path,
+						       WPAS_DBUS_NEW_IFACE_BSS,
+						       &dict_iter);
+		if (!wpa_dbus_dict_close_write(&entry_iter, &dict_iter) ||
+		    !dbus_message_iter_close_container(&array_iter,
+						       &entry_iter))
+			return -1;
+	}
+
+	if (!dbus_message_iter_close_container(iter, &array_iter))
+		return -1;
+	return 0;
+}
+
+
+/**
+ * wpas_dbus_signal_bsses_changed - Send pending BSS changes in one signal
+ * @wpa_s: %wpa_supplicant network interface data
+ *
+ * Notify listeners about the BSSs that have been added, changed, or removed
+ * since the previous BSSesChanged signal. This is used instead of BSSAdded,
+ * BSSRemoved, and BSS PropertiesChanged signals when dbus_bss_aggregate=1.
+ */
+static void wpas_dbus_signal_bsses_changed(struct wpa_supplicant *wpa_s)
+{
+	struct wpas_dbus_bss_changes *changes = wpa_s->dbus_bss_changes;
+	struct wpas_dbus_priv *iface = wpa_s->global->dbus;
+	DBusMessage *msg;
+	DBusMessageIter iter;
+
+	if (changes == NULL || !changes->pending)
+		return;
+	eloop_cancel_timeout(wpas_dbus_bss_changes_timeout, wpa_s, NULL);
+	changes->pending = 0;
+
+	if (iface == NULL || wpa_s->dbus_new_path == NULL ||
+	    changes->added.num + changes->changed.num +
+	    changes->removed.num == 0)
+		goto out;
+
+	msg = dbus_message_new_signal(wpa_s->dbus_new_path,
+				      WPAS_DBUS_NEW_IFACE_INTERFACE,
+				      "BSSesChanged");
+	if (msg == NULL)
+		goto out;
+
+	dbus_message_iter_init_append(msg, &iter);
+	if (wpas_dbus_append_bss_list(wpa_s, &iter, &changes->added, 1, 0) ||
+	    wpas_dbus_append_bss_list(wpa_s, &iter, &changes->changed, 1,
+				      1) ||
+	    wpas_dbus_append_bss_list(wpa_s, &iter, &changes->removed, 0, 0))
+		wpa_printf(MSG_ERROR, "dbus: Failed to construct signal");
+	else
+		wpa_dbus_send_signal(iface, msg);
+	dbus_message_unref(msg);
+
+out:
+	changes->added.num = 0;
+	changes->changed.num = 0;
+	changes->removed.num = 0;
+}
+
+
 /**
  * wpas_dbus_signal_scan_done - send scan done signal
  * @wpa_s: %wpa_supplicant network interface data
@@ -129,6 +427,9 @@ void wpas_dbus_signal_scan_done(struct wpa_supplicant *wpa_s, int success)
 	if (iface == NULL)
 		return;
 
+	/* Report the BSS table changes from this scan before ScanDone */
+	wpas_dbus_signal_bsses_changed(wpa_s);
+
 	msg = dbus_message_new_signal(wpa_s->dbus_new_path,
 				      WPAS_DBUS_NEW_IFACE_INTERFACE,
 				      "ScanDone");
@@ -138,7 +439,7 @@ void wpas_dbus_signal_scan_done(struct wpa_supplicant *wpa_s, int success)
 	succ = success ? TRUE : FALSE;
 	if (dbus_message_append_args(msg, DBUS_TYPE_BOOLEAN, &succ,
 				     DBUS_TYPE_INVALID))
-		dbus_connection_send(iface->con, msg, NULL);
+		wpa_dbus_send_signal(iface, msg);
 	else
 		wpa_printf(MSG_ERROR, "dbus: Failed to construct signal");
 	dbus_message_unref(msg);
@@ -191,7 +492,7 @@ static void wpas_dbus_signal_bss(struct wpa_supplicant *wpa_s,
 			goto err;
 	}
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 	dbus_message_unref(msg);
 	return;
 
@@ -257,7 +558,7 @@ static void wpas_dbus_signal_blob(struct wpa_supplicant *wpa_s,
 
 	if (dbus_message_append_args(msg, DBUS_TYPE_STRING, &name,
 				     DBUS_TYPE_INVALID))
-		dbus_connection_send(iface->con, msg, NULL);
+		wpa_dbus_send_signal(iface, msg);
 	else
 		wpa_printf(MSG_ERROR, "dbus: Failed to construct signal");
 	dbus_message_unref(msg);
@@ -344,7 +645,7 @@ static void wpas_dbus_signal_network(struct wpa_supplicant *wpa_s,
 			goto err;
 	}
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 	return;
@@ -452,7 +753,7 @@ void wpas_dbus_signal_wps_event_success(struct wpa_supplicant *wpa_s)
 	    !wpa_dbus_dict_close_write(&iter, &dict_iter))
 		wpa_printf(MSG_ERROR, "dbus: Failed to construct signal");
 	else
-		dbus_connection_send(iface->con, msg, NULL);
+		wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 }
@@ -493,7 +794,7 @@ void wpas_dbus_signal_wps_event_fail(struct wpa_supplicant *wpa_s,
 	    !wpa_dbus_dict_close_write(&iter, &dict_iter))
 		wpa_printf(MSG_ERROR, "dbus: Failed to construct signal");
 	else
-		dbus_connection_send(iface->con, msg, NULL);
+		wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 }
@@ -558,7 +859,7 @@ void wpas_dbus_signal_wps_event_m2d(struct wpa_supplicant *wpa_s,
 	    !wpa_dbus_dict_close_write(&iter, &dict_iter))
 		wpa_printf(MSG_ERROR, "dbus: Failed to construct signal");
 	else
-		dbus_connection_send(iface->con, msg, NULL);
+		wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 }
@@ -645,7 +946,7 @@ void wpas_dbus_signal_wps_cred(struct wpa_supplicant *wpa_s,
 	    !wpa_dbus_dict_close_write(&iter, &dict_iter))
 		goto nomem;
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 
 nomem:
 	dbus_message_unref(msg);
@@ -695,7 +996,7 @@ void wpas_dbus_signal_certification(struct wpa_supplicant *wpa_s,
 	if (!wpa_dbus_dict_close_write(&iter, &dict_iter))
 		goto nomem;
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 
 nomem:
 	dbus_message_unref(msg);
@@ -740,7 +1041,7 @@ void wpas_dbus_signal_p2p_group_removed(struct wpa_supplicant *wpa_s,
 		wpa_printf(MSG_ERROR, "dbus: Failed to construct GroupFinished"
 				      "signal -not enough memory for role ");
 	else
-		dbus_connection_send(iface->con, msg, NULL);
+		wpa_dbus_send_signal(iface, msg);
 
 err:
 	dbus_message_unref(msg);
@@ -851,7 +1152,7 @@ void wpas_dbus_signal_p2p_provision_discovery(struct wpa_supplicant *wpa_s,
 
 error:
 	if (!error_ret)
-		dbus_connection_send(iface->con, msg, NULL);
+		wpa_dbus_send_signal(iface, msg);
 	else
 		wpa_printf(MSG_ERROR, "dbus: Failed to construct signal");
 
@@ -892,7 +1193,7 @@ void wpas_dbus_signal_p2p_go_neg_req(struct wpa_supplicant *wpa_s,
 					    &dev_passwd_id))
 		wpa_printf(MSG_ERROR, "dbus: Failed to construct signal");
 	else
-		dbus_connection_send(iface->con, msg, NULL);
+		wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 }
@@ -985,7 +1286,7 @@ void wpas_dbus_signal_p2p_group_started(struct wpa_supplicant *wpa_s,
 	   !wpa_dbus_dict_close_write(&iter, &dict_iter))
 		goto nomem;
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 
 nomem:
 	dbus_message_unref(msg);
@@ -1027,7 +1328,7 @@ void wpas_dbus_signal_p2p_go_neg_resp(struct wpa_supplicant *wpa_s, int status)
 		}
 	}
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 err:
 	dbus_message_unref(msg);
 }
@@ -1077,7 +1378,7 @@ void wpas_dbus_signal_p2p_invitation_result(struct wpa_supplicant *wpa_s,
 	if (!wpa_dbus_dict_close_write(&iter, &dict_iter))
 		goto nomem;
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 
 nomem:
 	dbus_message_unref(msg);
@@ -1127,7 +1428,7 @@ void wpas_dbus_signal_p2p_peer_joined(struct wpa_supplicant *wpa_s,
 					    &path))
 		goto err;
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 	return;
@@ -1181,7 +1482,7 @@ void wpas_dbus_signal_p2p_peer_disconnected(struct wpa_supplicant *wpa_s,
 					    &path))
 		goto err;
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 	return;
@@ -1255,7 +1556,7 @@ void wpas_dbus_signal_p2p_sd_request(struct wpa_supplicant *wpa_s,
 	    !wpa_dbus_dict_close_write(&iter, &dict_iter))
 		goto error;
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 	dbus_message_unref(msg);
 	return;
 error:
@@ -1321,7 +1622,7 @@ void wpas_dbus_signal_p2p_sd_response(struct wpa_supplicant *wpa_s,
 		goto error;
 
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 	dbus_message_unref(msg);
 	return;
 error:
@@ -1383,7 +1684,7 @@ static void wpas_dbus_signal_persistent_group(struct wpa_supplicant *wpa_s,
 			goto err;
 	}
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 	return;
@@ -1464,7 +1765,7 @@ void wpas_dbus_signal_p2p_wps_failed(struct wpa_supplicant *wpa_s,
 	    !wpa_dbus_dict_close_write(&iter, &dict_iter))
 		wpa_printf(MSG_ERROR, "dbus: Failed to construct signal");
 	else
-		dbus_connection_send(iface->con, msg, NULL);
+		wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 }
@@ -1584,6 +1885,10 @@ void wpas_dbus_bss_signal_prop_changed(struct wpa_supplicant *wpa_s,
 		    "%s/" WPAS_DBUS_NEW_BSSIDS_PART "/%u",
 		    wpa_s->dbus_new_path, id);
 
+	if (wpas_dbus_bss_aggregate(wpa_s) &&
+	    wpas_dbus_bss_changes_changed(wpa_s, id, path, prop) == 0)
+		return;
+
 	wpa_dbus_mark_property_changed(wpa_s->global->dbus, path,
 				       WPAS_DBUS_NEW_IFACE_BSS, prop);
 }
@@ -1787,6 +2092,10 @@ void wpas_dbus_ctrl_iface_deinit(struct wpas_dbus_priv *iface)
 {
 	if (!iface->dbus_new_initialized)
 		return;
+	wpa_dbus_flush_all_changed_properties(iface);
+	wpa_printf(MSG_DEBUG, "dbus: Sent %u signals (%u PropertiesChanged "
+		   "signals for %u property changes)", iface->signals_sent,
+		   iface->prop_changed_signals, iface->prop_changes);
 	wpa_printf(MSG_DEBUG, "dbus: Unregister D-Bus object '%s'",
 		   WPAS_DBUS_NEW_PATH);
 	dbus_connection_unregister_object_path(iface->con,
@@ -2047,7 +2356,9 @@ int wpas_dbus_unregister_bss(struct wpa_supplicant *wpa_s,
 		return -1;
 	}
 
-	wpas_dbus_signal_bss_removed(wpa_s, bss_obj_path);
+	if (!wpas_dbus_bss_aggregate(wpa_s) ||
+	    wpas_dbus_bss_changes_removed(wpa_s, id) < 0)
+		wpas_dbus_signal_bss_removed(wpa_s, bss_obj_path);
 	wpas_dbus_signal_prop_changed(wpa_s, WPAS_DBUS_PROP_BSSS);
 
 	return 0;
@@ -2112,7 +2423,9 @@ int wpas_dbus_register_bss(struct wpa_supplicant *wpa_s,
 		goto err;
 	}
 
-	wpas_dbus_signal_bss_added(wpa_s, bss_obj_path);
+	if (!wpas_dbus_bss_aggregate(wpa_s) ||
+	    wpas_dbus_bss_changes_added(wpa_s, id) < 0)
+		wpas_dbus_signal_bss_added(wpa_s, bss_obj_path);
 	wpas_dbus_signal_prop_changed(wpa_s, WPAS_DBUS_PROP_BSSS);
 
 	return 0;
@@ -2502,6 +2815,14 @@ static const struct wpa_dbus_signal_desc wpas_dbus_interface_signals[] = {
 		  END_ARGS
 	  }
 	},
+	{ "BSSesChanged", WPAS_DBUS_NEW_IFACE_INTERFACE,
+	  {
+		  { "added", "a{oa{sv}}", ARG_OUT },
+		  { "changed", "a{oa{sv}}", ARG_OUT },
+		  { "removed", "ao", ARG_OUT },
+		  END_ARGS
+	  }
+	},
 	{ "BlobAdded", WPAS_DBUS_NEW_IFACE_INTERFACE,
 	  {
 		  { "name", "s", ARG_OUT },
@@ -2766,6 +3087,13 @@ int wpas_dbus_unregister_interface(struct wpa_supplicant *wpa_s)
 	if (ctrl_iface == NULL)
 		return 0;
 
+	/*
+	 * Send the pending BSS changes and free them before unregistering so
+	 * that the timeout cannot be left behind if unregistration fails.
+	 */
+	wpas_dbus_signal_bsses_changed(wpa_s);
+	wpas_dbus_bss_changes_free(wpa_s);
+
 	wpa_printf(MSG_DEBUG, "dbus: Unregister interface object '%s'",
 		   wpa_s->dbus_new_path);
 	if (wpa_dbus_unregister_object_per_iface(ctrl_iface,
@@ -2840,7 +3168,7 @@ static void wpas_dbus_signal_peer(struct wpa_supplicant *wpa_s,
 					    &path))
 		goto err;
 
-	dbus_connection_send(iface->con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
 
 	dbus_message_unref(msg);
 	return;
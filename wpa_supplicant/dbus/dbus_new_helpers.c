@@ -438,7 +438,7 @@ static DBusHandlerResult message_handler(DBusConnection *connection,
 		dbus_message_unref(reply);
 	}
 
-	wpa_dbus_flush_all_changed_properties(connection);
+	wpa_dbus_flush_all_changed_properties(obj_dsc->ctrl_iface);
 
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
@@ -457,6 +457,9 @@ void free_dbus_object_desc(struct wpa_dbus_object_desc *obj_dsc)
 	if (!obj_dsc)
 		return;
 
+	if (obj_dsc->changed_list.next)
+		dl_list_del(&obj_dsc->changed_list);
+
 	/* free handler's argument */
 	if (obj_dsc->user_data_free_func)
 		obj_dsc->user_data_free_func(obj_dsc->user_data);
@@ -496,6 +499,7 @@ int wpa_dbus_ctrl_iface_init(struct wpas_dbus_priv *iface,
 	};
 
 	obj_desc->connection = iface->con;
+	obj_desc->ctrl_iface = iface;
 	obj_desc->path = os_strdup(dbus_path);
 
 	/* Register the message handler for the global dbus interface */
@@ -565,6 +569,7 @@ int wpa_dbus_register_object_per_iface(
 
 	con = ctrl_iface->con;
 	obj_desc->connection = con;
+	obj_desc->ctrl_iface = ctrl_iface;
 	obj_desc->path = os_strdup(path);
 
 	dbus_error_init(&error);
@@ -589,9 +594,6 @@ int wpa_dbus_register_object_per_iface(
 }
 
 
-static void flush_object_timeout_handler(void *eloop_ctx, void *timeout_ctx);
-
-
 /**
  * wpa_dbus_unregister_object_per_iface - Unregisters DBus object
  * @ctrl_iface: Pointer to dbus private data
@@ -610,9 +612,9 @@ int wpa_dbus_unregister_object_per_iface(
 	if (!obj_desc) {
 		wpa_printf(MSG_ERROR, "dbus: %s: Could not obtain object's "
 			   "private data: %s", __func__, path);
-	} else {
-		eloop_cancel_timeout(flush_object_timeout_handler, con,
-				     obj_desc);
+	} else if (obj_desc->changed_list.next) {
+		/* Drop the pending PropertiesChanged signals */
+		dl_list_del(&obj_desc->changed_list);
 	}
 
 	if (!dbus_connection_unregister_object_path(con, path))
@@ -647,6 +649,8 @@ static void put_changed_properties(const struct wpa_dbus_object_desc *obj_dsc,
 			wpa_printf(MSG_ERROR, "dbus: %s: Cannot get new value "
 				   "of property %s", __func__,
 				   dsc->dbus_property);
+			if (getter_reply)
+				dbus_message_unref(getter_reply);
 			continue;
 		}
 
@@ -670,12 +674,13 @@ static void put_changed_properties(const struct wpa_dbus_object_desc *obj_dsc,
 	return;
 
 err:
+	dbus_message_unref(getter_reply);
 	wpa_printf(MSG_ERROR, "dbus: %s: Cannot construct signal", __func__);
 }
 
 
 static void send_prop_changed_signal(
-	DBusConnection *con, const char *path, const char *interface,
+	struct wpas_dbus_priv *iface, const char *path, const char *interface,
 	const struct wpa_dbus_object_desc *obj_dsc)
 {
 	DBusMessage *msg;
@@ -696,7 +701,8 @@ static void send_prop_changed_signal(
 	if (!dbus_message_iter_close_container(&signal_iter, &dict_iter))
 		goto err;
 
-	dbus_connection_send(con, msg, NULL);
+	wpa_dbus_send_signal(iface, msg);
+	iface->prop_changed_signals++;
 
 out:
 	dbus_message_unref(msg);
@@ -709,56 +715,72 @@ err:
 }
 
 
-static void flush_object_timeout_handler(void *eloop_ctx, void *timeout_ctx)
+static void send_object_changed_properties(
+	struct wpas_dbus_priv *iface, struct wpa_dbus_object_desc *obj_desc)
 {
-	DBusConnection *con = eloop_ctx;
-	struct wpa_dbus_object_desc *obj_desc = timeout_ctx;
+	const struct wpa_dbus_property_desc *dsc;
+	int i;
 
-	wpa_printf(MSG_DEBUG, "dbus: %s: Timeout - sending changed properties "
-		   "of object %s", __func__, obj_desc->path);
-	wpa_dbus_flush_object_changed_properties(con, obj_desc->path);
+	for (dsc = obj_desc->properties, i = 0; dsc && dsc->dbus_property;
+	     dsc++, i++) {
+		if (obj_desc->prop_changed_flags == NULL ||
+		    !obj_desc->prop_changed_flags[i])
+			continue;
+		send_prop_changed_signal(iface, obj_desc->path,
+					 dsc->dbus_interface, obj_desc);
+	}
 }
 
 
-static void recursive_flush_changed_properties(DBusConnection *con,
-					       const char *path)
+static void flush_changed_timeout_handler(void *eloop_ctx, void *timeout_ctx)
 {
-	char **objects = NULL;
-	char subobj_path[WPAS_DBUS_OBJECT_PATH_MAX];
-	int i;
-
-	wpa_dbus_flush_object_changed_properties(con, path);
+	struct wpas_dbus_priv *iface = eloop_ctx;
 
-	if (!dbus_connection_list_registered(con, path, &objects))
-		goto out;
+	wpa_dbus_flush_all_changed_properties(iface);
+}
 
-	for (i = 0; objects[i]; i++) {
-		os_snprintf(subobj_path, WPAS_DBUS_OBJECT_PATH_MAX,
-			    "%s/%s", path, objects[i]);
-		recursive_flush_changed_properties(con, subobj_path);
-	}
 
-out:
-	dbus_free_string_array(objects);
+/**
+ * wpa_dbus_send_signal - Send a signal
+ * @iface: dbus priv struct
+ * @msg: signal message
+ *
+ * Sends a signal on the connection and updates the signal statistics.
+ */
+void wpa_dbus_send_signal(struct wpas_dbus_priv *iface, DBusMessage *msg)
+{
+	dbus_connection_send(iface->con, msg, NULL);
+	iface->signals_sent++;
 }
 
 
 /**
  * wpa_dbus_flush_all_changed_properties - Send all PropertiesChanged signals
- * @con: DBus connection
+ * @iface: dbus priv struct
  *
- * Traverses through all registered objects and sends PropertiesChanged for
- * each properties.
+ * Sends PropertiesChanged signals for all objects that have properties marked
+ * as changed.
  */
-void wpa_dbus_flush_all_changed_properties(DBusConnection *con)
+void wpa_dbus_flush_all_changed_properties(struct wpas_dbus_priv *iface)
 {
-	recursive_flush_changed_properties(con, WPAS_DBUS_NEW_PATH);
+	struct wpa_dbus_object_desc *obj_desc;
+
+	if (iface == NULL)
+		return;
+
+	eloop_cancel_timeout(flush_changed_timeout_handler, iface, NULL);
+	while ((obj_desc = dl_list_first(&iface->changed_objs,
+					 struct wpa_dbus_object_desc,
+					 changed_list))) {
+		dl_list_del(&obj_desc->changed_list);
+		send_object_changed_properties(iface, obj_desc);
+	}
 }
 
 
 /**
  * wpa_dbus_flush_object_changed_properties - Send PropertiesChanged for object
- * @con: DBus connection
+ * @iface: dbus priv struct
  * @path: path to a DBus object for which PropertiesChanged will be sent.
  *
  * Iterates over all properties registered with object and for each interface
@@ -767,37 +789,73 @@ void wpa_dbus_flush_all_changed_properties(DBusConnection *con)
  *
  * You need to call this function after wpa_dbus_mark_property_changed()
  * if you want to send PropertiesChanged signal immediately (i.e., without
- * waiting timeout to expire). PropertiesChanged signal for an object is sent
- * automatically short time after first marking property as changed. All
- * PropertiesChanged signals are sent automatically after responding on DBus
- * message, so if you marked a property changed as a result of DBus call
+ * waiting for the current eloop iteration to complete). PropertiesChanged
+ * signals are sent automatically for all objects once the event that marked
+ * the properties changed has been processed and also after responding on
+ * DBus message, so if you marked a property changed as a result of DBus call
  * (e.g., param setter), you usually do not need to call this function.
  */
-void wpa_dbus_flush_object_changed_properties(DBusConnection *con,
+void wpa_dbus_flush_object_changed_properties(struct wpas_dbus_priv *iface,
 					      const char *path)
 {
 	struct wpa_dbus_object_desc *obj_desc = NULL;
-	const struct wpa_dbus_property_desc *dsc;
-	int i;
 
-	dbus_connection_get_object_path_data(con, path, (void **) &obj_desc);
+	dbus_connection_get_object_path_data(iface->con, path,
+					     (void **) &obj_desc);
 	if (!obj_desc)
 		return;
-	eloop_cancel_timeout(flush_object_timeout_handler, con, obj_desc);
+	if (obj_desc->changed_list.next)
+		dl_list_del(&obj_desc->changed_list);
+	send_object_changed_properties(iface, obj_desc);
+}
+
+
+/*
+ * Set the changed flag of a property. Returns 1 if no other property of the
+ * object was marked as changed, 0 if there was one, and -1 if the object does
+ * not have the property.
+ */
+static int set_prop_changed_flag(struct wpa_dbus_object_desc *obj_desc,
+				 const char *interface, const char *property)
+{
+	const struct wpa_dbus_property_desc *dsc;
+	int i, idx = -1, pending = 0;
 
-	dsc = obj_desc->properties;
 	for (dsc = obj_desc->properties, i = 0; dsc && dsc->dbus_property;
 	     dsc++, i++) {
-		if (obj_desc->prop_changed_flags == NULL ||
-		    !obj_desc->prop_changed_flags[i])
-			continue;
-		send_prop_changed_signal(con, path, dsc->dbus_interface,
-					 obj_desc);
+		if (obj_desc->prop_changed_flags &&
+		    obj_desc->prop_changed_flags[i])
+			pending = 1;
+		if (idx < 0 && os_strcmp(property, dsc->dbus_property) == 0 &&
+		    os_strcmp(interface, dsc->dbus_interface) == 0)
+			idx = i;
 	}
+
+	if (idx < 0) {
+		wpa_printf(MSG_ERROR, "dbus: wpa_dbus_property_changed: "
+			   "no property %s in object %s", property,
+			   obj_desc->path);
+		return -1;
+	}
+
+	if (obj_desc->prop_changed_flags)
+		obj_desc->prop_changed_flags[idx] = 1;
+	return !pending;
 }
 
 
-#define WPA_DBUS_SEND_PROP_CHANGED_TIMEOUT 5000
+static struct wpa_dbus_object_desc *
+get_object_desc(struct wpas_dbus_priv *iface, const char *path)
+{
+	struct wpa_dbus_object_desc *obj_desc = NULL;
+
+	dbus_connection_get_object_path_data(iface->con, path,
+					     (void **) &obj_desc);
+	if (!obj_desc)
+		wpa_printf(MSG_ERROR, "dbus: wpa_dbus_property_changed: "
+			   "could not obtain object's private data: %s", path);
+	return obj_desc;
+}
 
 
 /**
@@ -810,48 +868,92 @@ void wpa_dbus_flush_object_changed_properties(DBusConnection *con,
  * Iterates over all properties registered with an object and marks the one
  * given in parameters as changed. All parameters registered for an object
  * within a single interface will be aggregated together and sent in one
- * PropertiesChanged signal when function
- * wpa_dbus_flush_object_changed_properties() is called.
+ * PropertiesChanged signal when the current eloop iteration has been
+ * completed or when function wpa_dbus_flush_object_changed_properties() is
+ * called.
  */
 void wpa_dbus_mark_property_changed(struct wpas_dbus_priv *iface,
 				    const char *path, const char *interface,
 				    const char *property)
 {
-	struct wpa_dbus_object_desc *obj_desc = NULL;
-	const struct wpa_dbus_property_desc *dsc;
-	int i = 0;
+	struct wpa_dbus_object_desc *obj_desc;
 
 	if (iface == NULL)
 		return;
 
-	dbus_connection_get_object_path_data(iface->con, path,
-					     (void **) &obj_desc);
-	if (!obj_desc) {
-		wpa_printf(MSG_ERROR, "dbus: wpa_dbus_property_changed: "
-			   "could not obtain object's private data: %s", path);
+	obj_desc = get_object_desc(iface, path);
+	if (!obj_desc || set_prop_changed_flag(obj_desc, interface,
+					       property) < 0)
 		return;
-	}
+	iface->prop_changes++;
+
+	if (obj_desc->changed_list.next)
+		return; /* flush already pending */
+	dl_list_add_tail(&iface->changed_objs, &obj_desc->changed_list);
+	if (!eloop_is_timeout_registered(flush_changed_timeout_handler,
+					 iface, NULL))
+		eloop_register_timeout(0, 0, flush_changed_timeout_handler,
+				       iface, NULL);
+}
 
-	for (dsc = obj_desc->properties; dsc && dsc->dbus_property; dsc++, i++)
-		if (os_strcmp(property, dsc->dbus_property) == 0 &&
-		    os_strcmp(interface, dsc->dbus_interface) == 0) {
-			if (obj_desc->prop_changed_flags)
-				obj_desc->prop_changed_flags[i] = 1;
-			break;
-		}
 
-	if (!dsc || !dsc->dbus_property) {
-		wpa_printf(MSG_ERROR, "dbus: wpa_dbus_property_changed: "
-			   "no property %s in object %s", property, path);
-		return;
-	}
+/**
+ * wpa_dbus_mark_property_pending - Mark a property as changed without signal
+ * @iface: dbus priv struct
+ * @path: path to DBus object which property has changed
+ * @interface: interface containing changed property
+ * @property: property name which has changed
+ * Returns: 1 if this is the only changed property of the object, 0 if other
+ * properties were already marked changed, or -1 on failure
+ *
+ * Marks the property as changed like wpa_dbus_mark_property_changed(), but
+ * does not schedule a PropertiesChanged signal. The caller is responsible for
+ * reporting the changed properties with wpa_dbus_get_changed_properties().
+ */
+int wpa_dbus_mark_property_pending(struct wpas_dbus_priv *iface,
+				   const char *path, const char *interface,
+				   const char *property)
+{
+	struct wpa_dbus_object_desc *obj_desc;
+	int ret;
 
-	if (!eloop_is_timeout_registered(flush_object_timeout_handler,
-					 iface->con, obj_desc->path)) {
-		eloop_register_timeout(0, WPA_DBUS_SEND_PROP_CHANGED_TIMEOUT,
-				       flush_object_timeout_handler,
-				       iface->con, obj_desc);
-	}
+	if (iface == NULL)
+		return -1;
+
+	obj_desc = get_object_desc(iface, path);
+	if (!obj_desc)
+		return -1;
+	ret = set_prop_changed_flag(obj_desc, interface, property);
+	if (ret >= 0)
+		iface->prop_changes++;
+	return ret;
+}
+
+
+/**
+ * wpa_dbus_get_changed_properties - Put changed properties into dictionary
+ * @iface: dbus priv struct
+ * @path: path to DBus object which changed properties will be obtained
+ * @interface: interface name which properties will be obtained
+ * @dict_iter: correct, open DBus dictionary iterator
+ * Returns: 0 on success, -1 if the object does not exist
+ *
+ * Stores the current values of the properties of the object that have been
+ * marked as changed into dict_iter dictionary and clears the changed flags.
+ */
+int wpa_dbus_get_changed_properties(struct wpas_dbus_priv *iface,
+				    const char *path, const char *interface,
+				    DBusMessageIter *dict_iter)
+{
+	struct wpa_dbus_object_desc *obj_desc = NULL;
+
+	dbus_connection_get_object_path_data(iface->con, path,
+					     (void **) &obj_desc);
+	if (!obj_desc)
+		return -1;
+
+	put_changed_properties(obj_desc, interface, dict_iter);
+	return 0;
 }
 
 
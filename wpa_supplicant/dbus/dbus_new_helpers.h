@@ -18,6 +18,8 @@
 
 #include <dbus/dbus.h>
 
+#include "utils/list.h"
+
 typedef DBusMessage * (* WPADBusMethodHandler)(DBusMessage *message,
 					       void *user_data);
 typedef void (* WPADBusArgumentFreeFunction)(void *handler_arg);
@@ -27,6 +29,7 @@ typedef DBusMessage * (* WPADBusPropertyAccessor)(DBusMessage *message,
 
 struct wpa_dbus_object_desc {
 	DBusConnection *connection;
+	struct wpas_dbus_priv *ctrl_iface;
 	char *path;
 
 	/* list of methods, properties and signals registered with object */
@@ -36,6 +39,8 @@ struct wpa_dbus_object_desc {
 
 	/* property changed flags */
 	u8 *prop_changed_flags;
+	/* entry in ctrl_iface->changed_objs while a flush is pending */
+	struct dl_list changed_list;
 
 	/* argument for method handlers and properties
 	 * getter and setter functions */
@@ -79,7 +84,7 @@ struct wpa_dbus_signal_desc {
 	/* signal interface */
 	const char *dbus_interface;
 	/* array of arguments */
-	struct wpa_dbus_argument args[3];
+	struct wpa_dbus_argument args[4];
 };
 
 /**
@@ -132,16 +137,25 @@ void wpa_dbus_get_object_properties(struct wpas_dbus_priv *iface,
 				    const char *path, const char *interface,
 				    DBusMessageIter *dict_iter);
 
+void wpa_dbus_send_signal(struct wpas_dbus_priv *iface, DBusMessage *msg);
 
-void wpa_dbus_flush_all_changed_properties(DBusConnection *con);
+void wpa_dbus_flush_all_changed_properties(struct wpas_dbus_priv *iface);
 
-void wpa_dbus_flush_object_changed_properties(DBusConnection *con,
+void wpa_dbus_flush_object_changed_properties(struct wpas_dbus_priv *iface,
 					      const char *path);
 
 void wpa_dbus_mark_property_changed(struct wpas_dbus_priv *iface,
 				    const char *path, const char *interface,
 				    const char *property);
 
+int wpa_dbus_mark_property_pending(struct wpas_dbus_priv *iface,
+				   const char *path, const char *interface,
+				   const char *property);
+
+int wpa_dbus_get_changed_properties(struct wpas_dbus_priv *iface,
+				    const char *path, const char *interface,
+				    DBusMessageIter *dict_iter);
+
 DBusMessage * wpa_dbus_introspect(DBusMessage *message,
 				  struct wpa_dbus_object_desc *obj_dsc);
 
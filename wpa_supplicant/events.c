@@ -286,6 +286,31 @@ int wpa_supplicant_scard_init(struct wpa_supplicant *wpa_s,
 }
 
 
+/**
+ * wpa_supplicant_rsn_preauth_bss - Update PMKSA candidate for a BSS
+ * @wpa_s: Pointer to wpa_supplicant data
+ * @bss: BSS that was added or whose RSN IE changed
+ */
+void wpa_supplicant_rsn_preauth_bss(struct wpa_supplicant *wpa_s,
+				    struct wpa_bss *bss)
+{
+	const u8 *ssid, *rsn;
+
+	if (wpa_s->wpa == NULL)
+		return;
+
+	ssid = wpa_bss_get_ie(bss, WLAN_EID_SSID);
+	if (ssid == NULL)
+		return;
+
+	rsn = wpa_bss_get_ie(bss, WLAN_EID_RSN);
+	if (rsn == NULL)
+		return;
+
+	rsn_preauth_scan_result(wpa_s->wpa, bss->bssid, ssid, rsn);
+}
+
+
 #ifndef CONFIG_NO_SCAN_PROCESSING
 static int wpa_supplicant_match_privacy(struct wpa_scan_res *bss,
 					struct wpa_ssid *ssid)
@@ -767,8 +792,10 @@ wpa_supplicant_pick_new_network(struct wpa_supplicant *wpa_s)
 }
 
 
-/* TODO: move the rsn_preauth_scan_result*() to be called from notify.c based
- * on BSS added and BSS changed events */
+/*
+ * PMKSA candidates are updated based on BSS added, changed, and removed events
+ * (see bss.c and notify.c); all BSSes are processed only when the ESS changes.
+ */
 static void wpa_supplicant_rsn_preauth_scan_results(
 	struct wpa_supplicant *wpa_s)
 {
@@ -777,20 +804,8 @@ static void wpa_supplicant_rsn_preauth_scan_results(
 	if (rsn_preauth_scan_results(wpa_s->wpa) < 0)
 		return;
 
-	dl_list_for_each(bss, &wpa_s->bss, struct wpa_bss, list) {
-		const u8 *ssid, *rsn;
-
-		ssid = wpa_bss_get_ie(bss, WLAN_EID_SSID);
-		if (ssid == NULL)
-			continue;
-
-		rsn = wpa_bss_get_ie(bss, WLAN_EID_RSN);
-		if (rsn == NULL)
-			continue;
-
-		rsn_preauth_scan_result(wpa_s->wpa, bss->bssid, ssid, rsn);
-	}
-
+	dl_list_for_each(bss, &wpa_s->bss, struct wpa_bss, list)
+		wpa_supplicant_rsn_preauth_bss(wpa_s, bss);
 }
 
 
@@ -49,6 +49,9 @@
 
 #define IEEE80211_IBSS_MAX_STA_ENTRIES 128
 
+#define IEEE80211_MAX_BSS 200
+#define IEEE80211_BSS_HASH_MIN_SIZE 16
+
 
 #define IEEE80211_FC(type, stype) host_to_le16((type << 2) | (stype << 4))
 
@@ -67,6 +70,10 @@ struct ieee80211_sta_bss {
 	int rssi;
 	u8 *ie;
 	size_t ie_len;
+	size_t ie_alloc; /* allocated length of ie */
+	u32 ie_hash; /* ieee80211_ie_hash() of ie */
+	int ds_channel; /* channel from DS Parameter Set or 0 */
+	/* the following point to the elements within ie */
 	u8 *wpa_ie;
 	size_t wpa_ie_len;
 	u8 *rsn_ie;
@@ -1217,34 +1224,127 @@ static void ieee80211_rx_mgmt_assoc_resp(struct wpa_supplicant *wpa_s,
 }
 
 
-/* Caller must hold local->sta_bss_lock */
+static unsigned int ieee80211_bss_hash(const u8 *bssid, unsigned int size)
+{
+	u32 hash = WPA_GET_BE16(bssid) ^ WPA_GET_BE32(&bssid[2]);
+
+	hash ^= hash >> 16;
+	hash *= 0x45d9f3b;
+	hash ^= hash >> 16;
+	return hash & (size - 1);
+}
+
+
 static void __ieee80211_bss_hash_add(struct wpa_supplicant *wpa_s,
 				     struct ieee80211_sta_bss *bss)
 {
-	bss->hnext = wpa_s->mlme.sta_bss_hash[STA_HASH(bss->bssid)];
-	wpa_s->mlme.sta_bss_hash[STA_HASH(bss->bssid)] = bss;
+	unsigned int idx = ieee80211_bss_hash(bss->bssid,
+					      wpa_s->mlme.sta_bss_hash_size);
+	bss->hnext = wpa_s->mlme.sta_bss_hash[idx];
+	wpa_s->mlme.sta_bss_hash[idx] = bss;
 }
 
 
-/* Caller must hold local->sta_bss_lock */
 static void __ieee80211_bss_hash_del(struct wpa_supplicant *wpa_s,
 				     struct ieee80211_sta_bss *bss)
 {
-	struct ieee80211_sta_bss *b, *prev = NULL;
-	b = wpa_s->mlme.sta_bss_hash[STA_HASH(bss->bssid)];
-	while (b) {
-		if (b == bss) {
-			if (prev == NULL) {
-				wpa_s->mlme.sta_bss_hash[STA_HASH(bss->bssid)]
-					= bss->hnext;
-			} else {
-				prev->hnext = bss->hnext;
-			}
+	struct ieee80211_sta_bss **b;
+
+	if (wpa_s->mlme.sta_bss_hash == NULL)
+		return;
+	b = &wpa_s->mlme.sta_bss_hash[
+		ieee80211_bss_hash(bss->bssid, wpa_s->mlme.sta_bss_hash_size)];
+	while (*b) {
+		if (*b == bss) {
+			*b = bss->hnext;
 			break;
 		}
-		prev = b;
-		b = b->hnext;
+		b = &(*b)->hnext;
+	}
+}
+
+
+/*
+ * Resize the BSS hash table to keep the average chain length at or below one
+ * entry. A failed allocation is not fatal; the old table remains in use.
+ */
+static void ieee80211_bss_hash_resize(struct wpa_supplicant *wpa_s,
+				      unsigned int size)
+{
+	struct ieee80211_sta_bss **hash, *bss;
+
+	if (size < IEEE80211_BSS_HASH_MIN_SIZE)
+		size = IEEE80211_BSS_HASH_MIN_SIZE;
+	if (size == wpa_s->mlme.sta_bss_hash_size)
+		return;
+
+	hash = os_zalloc(size * sizeof(*hash));
+	if (hash == NULL)
+		return;
+
+	os_free(wpa_s->mlme.sta_bss_hash);
+	wpa_s->mlme.sta_bss_hash = hash;
+	wpa_s->mlme.sta_bss_hash_size = size;
+	for (bss = wpa_s->mlme.sta_bss_list; bss; bss = bss->next)
+		__ieee80211_bss_hash_add(wpa_s, bss);
+}
+
+
+static void ieee80211_bss_free(struct wpa_supplicant *wpa_s,
+			       struct ieee80211_sta_bss *bss)
+{
+	__ieee80211_bss_hash_del(wpa_s, bss);
+	wpa_s->mlme.num_sta_bss--;
+	os_free(bss->ie);
+	os_free(bss);
+}
+
+
+/*
+ * Make room for a new BSS entry when the table is full. All entries that have
+ * not been seen within IEEE80211_SCAN_RESULT_EXPIRE are removed; if there are
+ * none, the least recently updated entry is. The current BSS is never removed.
+ */
+static void ieee80211_bss_prune(struct wpa_supplicant *wpa_s)
+{
+	struct ieee80211_sta_bss *bss, **prev, **oldest = NULL;
+	struct os_time now, age;
+	unsigned int removed = 0;
+
+	os_get_time(&now);
+	prev = &wpa_s->mlme.sta_bss_list;
+	while ((bss = *prev) != NULL) {
+		if (os_memcmp(bss->bssid, wpa_s->bssid, ETH_ALEN) == 0) {
+			prev = &bss->next;
+			continue;
+		}
+		os_time_sub(&now, &bss->last_update, &age);
+		if (age.sec * 1000 + age.usec / 1000 >=
+		    IEEE80211_SCAN_RESULT_EXPIRE) {
+			*prev = bss->next;
+			ieee80211_bss_free(wpa_s, bss);
+			removed++;
+			continue;
+		}
+		if (oldest == NULL ||
+		    os_time_before(&bss->last_update, &(*oldest)->last_update))
+			oldest = prev;
+		prev = &bss->next;
+	}
+
+	if (removed == 0 && oldest) {
+		bss = *oldest;
+		*oldest = bss->next;
+		ieee80211_bss_free(wpa_s, bss);
+		removed++;
 	}
+
+	wpa_printf(MSG_DEBUG, "MLME: Removed %u BSS entries (%u remaining)",
+		   removed, wpa_s->mlme.num_sta_bss);
+
+	if (wpa_s->mlme.num_sta_bss < wpa_s->mlme.sta_bss_hash_size / 4)
+		ieee80211_bss_hash_resize(wpa_s,
+					  wpa_s->mlme.sta_bss_hash_size / 2);
 }
 
 
@@ -1253,6 +1353,14 @@ ieee80211_bss_add(struct wpa_supplicant *wpa_s, const u8 *bssid)
 {
 	struct ieee80211_sta_bss *bss;
 
+	if (wpa_s->mlme.num_sta_bss >= IEEE80211_MAX_BSS)
+		ieee80211_bss_prune(wpa_s);
+	if (wpa_s->mlme.num_sta_bss >= wpa_s->mlme.sta_bss_hash_size)
+		ieee80211_bss_hash_resize(wpa_s,
+					  2 * wpa_s->mlme.sta_bss_hash_size);
+	if (wpa_s->mlme.sta_bss_hash == NULL)
+		return NULL;
+
 	bss = os_zalloc(sizeof(*bss));
 	if (bss == NULL)
 		return NULL;
@@ -1262,6 +1370,7 @@ ieee80211_bss_add(struct wpa_supplicant *wpa_s, const u8 *bssid)
 	bss->next = wpa_s->mlme.sta_bss_list;
 	wpa_s->mlme.sta_bss_list = bss;
 	__ieee80211_bss_hash_add(wpa_s, bss);
+	wpa_s->mlme.num_sta_bss++;
 	return bss;
 }
 
@@ -1271,7 +1380,11 @@ ieee80211_bss_get(struct wpa_supplicant *wpa_s, const u8 *bssid)
 {
 	struct ieee80211_sta_bss *bss;
 
-	bss = wpa_s->mlme.sta_bss_hash[STA_HASH(bssid)];
+	if (wpa_s->mlme.sta_bss_hash == NULL)
+		return NULL;
+
+	bss = wpa_s->mlme.sta_bss_hash[
+		ieee80211_bss_hash(bssid, wpa_s->mlme.sta_bss_hash_size)];
 	while (bss) {
 		if (os_memcmp(bss->bssid, bssid, ETH_ALEN) == 0)
 			break;
@@ -1281,19 +1394,6 @@ ieee80211_bss_get(struct wpa_supplicant *wpa_s, const u8 *bssid)
 }
 
 
-static void ieee80211_bss_free(struct wpa_supplicant *wpa_s,
-			       struct ieee80211_sta_bss *bss)
-{
-	__ieee80211_bss_hash_del(wpa_s, bss);
-	os_free(bss->ie);
-	os_free(bss->wpa_ie);
-	os_free(bss->rsn_ie);
-	os_free(bss->wmm_ie);
-	os_free(bss->mdie);
-	os_free(bss);
-}
-
-
 static void ieee80211_bss_list_deinit(struct wpa_supplicant *wpa_s)
 {
 	struct ieee80211_sta_bss *bss, *prev;
@@ -1305,6 +1405,149 @@ static void ieee80211_bss_list_deinit(struct wpa_supplicant *wpa_s)
 		bss = bss->next;
 		ieee80211_bss_free(wpa_s, prev);
 	}
+	os_free(wpa_s->mlme.sta_bss_hash);
+	wpa_s->mlme.sta_bss_hash = NULL;
+	wpa_s->mlme.sta_bss_hash_size = 0;
+}
+
+
+/* End of the element at pos; a truncated element extends to the end */
+static const u8 * ieee80211_ie_elem_end(const u8 *pos, const u8 *end)
+{
+	if (end - pos >= 2 && 2 + pos[1] <= end - pos)
+		return pos + 2 + pos[1];
+	return end;
+}
+
+
+/*
+ * Hash of the IEs used to detect unchanged Beacon and Probe Response frame
+ * contents. The TIM element is skipped since its DTIM Count field changes
+ * from one Beacon frame to the next.
+ */
+static u32 ieee80211_ie_hash(const u8 *ies, size_t len)
+{
+	const u8 *pos = ies, *end = ies + len, *elem_end;
+	u32 hash = 2166136261U; /* FNV-1a */
+
+	while (pos < end) {
+		elem_end = ieee80211_ie_elem_end(pos, end);
+		if (pos[0] == WLAN_EID_TIM) {
+			pos = elem_end;
+			continue;
+		}
+		while (pos < elem_end) {
+			hash ^= *pos++;
+			hash *= 16777619;
+		}
+	}
+
+	return hash;
+}
+
+
+/*
+ * Compare IEs the same way ieee80211_ie_hash() hashes them, i.e., without the
+ * TIM element. Returns 1 if the IEs are the same.
+ */
+static int ieee80211_ie_equal(const u8 *a, size_t a_len,
+			      const u8 *b, size_t b_len)
+{
+	const u8 *a_end = a + a_len, *b_end = b + b_len, *a_elem, *b_elem;
+
+	for (;;) {
+		while (a < a_end && a[0] == WLAN_EID_TIM)
+			a = ieee80211_ie_elem_end(a, a_end);
+		while (b < b_end && b[0] == WLAN_EID_TIM)
+			b = ieee80211_ie_elem_end(b, b_end);
+		if (a == a_end || b == b_end)
+			return a == a_end && b == b_end;
+
+		a_elem = ieee80211_ie_elem_end(a, a_end);
+		b_elem = ieee80211_ie_elem_end(b, b_end);
+		if (a_elem - a != b_elem - b ||
+		    os_memcmp(a, b, a_elem - a) != 0)
+			return 0;
+		a = a_elem;
+		b = b_elem;
+	}
+}
+
+
+static u8 * ieee80211_bss_elem(struct ieee80211_sta_bss *bss,
+			       const u8 *ie_pos, const u8 *elem,
+			       size_t elem_len, size_t *len)
+{
+	if (elem == NULL || bss->ie == NULL) {
+		*len = 0;
+		return NULL;
+	}
+	*len = elem_len + 2;
+	return bss->ie + (elem - 2 - ie_pos);
+}
+
+
+/*
+ * Store the IEs from a Beacon or Probe Response frame. The allocated buffer is
+ * reused if the new IEs fit in it and the elements used by MLME are referenced
+ * within it instead of being copied separately.
+ */
+static void ieee80211_bss_set_ies(struct ieee80211_sta_bss *bss,
+				  const u8 *ie_pos, size_t ie_len, u32 ie_hash,
+				  struct ieee802_11_elems *elems)
+{
+	size_t clen;
+
+	if (bss->ie == NULL || bss->ie_alloc < ie_len) {
+		os_free(bss->ie);
+		bss->ie = os_malloc(ie_len);
+		bss->ie_alloc = bss->ie ? ie_len : 0;
+	}
+	if (bss->ie) {
+		os_memcpy(bss->ie, ie_pos, ie_len);
+		bss->ie_len = ie_len;
+		bss->ie_hash = ie_hash;
+	} else
+		bss->ie_len = 0;
+
+	if (elems->ssid && elems->ssid_len <= MAX_SSID_LEN) {
+		os_memcpy(bss->ssid, elems->ssid, elems->ssid_len);
+		bss->ssid_len = elems->ssid_len;
+	}
+
+	bss->supp_rates_len = 0;
+	if (elems->supp_rates) {
+		clen = IEEE80211_MAX_SUPP_RATES - bss->supp_rates_len;
+		if (clen > elems->supp_rates_len)
+			clen = elems->supp_rates_len;
+		os_memcpy(&bss->supp_rates[bss->supp_rates_len],
+			  elems->supp_rates, clen);
+		bss->supp_rates_len += clen;
+	}
+	if (elems->ext_supp_rates) {
+		clen = IEEE80211_MAX_SUPP_RATES - bss->supp_rates_len;
+		if (clen > elems->ext_supp_rates_len)
+			clen = elems->ext_supp_rates_len;
+		os_memcpy(&bss->supp_rates[bss->supp_rates_len],
+			  elems->ext_supp_rates, clen);
+		bss->supp_rates_len += clen;
+	}
+
+	bss->wpa_ie = ieee80211_bss_elem(bss, ie_pos, elems->wpa_ie,
+					 elems->wpa_ie_len, &bss->wpa_ie_len);
+	bss->rsn_ie = ieee80211_bss_elem(bss, ie_pos, elems->rsn_ie,
+					 elems->rsn_ie_len, &bss->rsn_ie_len);
+	bss->wmm_ie = ieee80211_bss_elem(bss, ie_pos, elems->wmm,
+					 elems->wmm_len, &bss->wmm_ie_len);
+#ifdef CONFIG_IEEE80211R
+	bss->mdie = ieee80211_bss_elem(bss, ie_pos, elems->mdie,
+				       elems->mdie_len, &bss->mdie_len);
+#endif /* CONFIG_IEEE80211R */
+
+	if (elems->ds_params && elems->ds_params_len == 1)
+		bss->ds_channel = elems->ds_params[0];
+	else
+		bss->ds_channel = 0;
 }
 
 
@@ -1316,11 +1559,12 @@ static void ieee80211_bss_info(struct wpa_supplicant *wpa_s,
 {
 	struct ieee802_11_elems elems;
 	size_t baselen;
-	int channel, invalid = 0, clen;
+	int channel, invalid = 0;
 	struct ieee80211_sta_bss *bss;
 	u64 timestamp;
 	u8 *pos, *ie_pos;
 	size_t ie_len;
+	u32 ie_hash;
 
 	if (!beacon && os_memcmp(mgmt->da, wpa_s->own_addr, ETH_ALEN))
 		return; /* ignore ProbeResp to foreign address */
@@ -1362,6 +1606,21 @@ static void ieee80211_bss_info(struct wpa_supplicant *wpa_s,
 
 	ie_pos = mgmt->u.beacon.variable;
 	ie_len = len - baselen;
+	ie_hash = ieee80211_ie_hash(ie_pos, ie_len);
+
+	bss = ieee80211_bss_get(wpa_s, mgmt->bssid);
+	if (bss && bss->probe_resp && beacon) {
+		/* Do not allow beacon to override data from Probe Response. */
+		return;
+	}
+
+	if (bss && bss->ie && bss->ie_len == ie_len &&
+	    bss->ie_hash == ie_hash &&
+	    ieee80211_ie_equal(bss->ie, bss->ie_len, ie_pos, ie_len)) {
+		/* Same IEs as in the previous frame - skip parsing */
+		goto update;
+	}
+
 	if (ieee802_11_parse_elems(ie_pos, ie_len, &elems, 0) == ParseFailed)
 		invalid = 1;
 
@@ -1427,135 +1686,22 @@ static void ieee80211_bss_info(struct wpa_supplicant *wpa_s,
 	if (elems.ssid == NULL)
 		return;
 
-	if (elems.ds_params && elems.ds_params_len == 1)
-		channel = elems.ds_params[0];
-	else
-		channel = rx_status->channel;
-
-	bss = ieee80211_bss_get(wpa_s, mgmt->bssid);
 	if (bss == NULL) {
 		bss = ieee80211_bss_add(wpa_s, mgmt->bssid);
 		if (bss == NULL)
 			return;
-	} else {
-#if 0
-		/* TODO: order by RSSI? */
-		spin_lock_bh(&local->sta_bss_lock);
-		list_move_tail(&bss->list, &local->sta_bss_list);
-		spin_unlock_bh(&local->sta_bss_lock);
-#endif
 	}
+	ieee80211_bss_set_ies(bss, ie_pos, ie_len, ie_hash, &elems);
 
-	if (bss->probe_resp && beacon) {
-		/* Do not allow beacon to override data from Probe Response. */
-		return;
-	}
+update:
+	if (bss->ds_channel)
+		channel = bss->ds_channel;
+	else
+		channel = rx_status->channel;
 
 	bss->beacon_int = le_to_host16(mgmt->u.beacon.beacon_int);
 	bss->capability = le_to_host16(mgmt->u.beacon.capab_info);
 
-	if (bss->ie == NULL || bss->ie_len < ie_len) {
-		os_free(bss->ie);
-		bss->ie = os_malloc(ie_len);
-	}
-	if (bss->ie) {
-		os_memcpy(bss->ie, ie_pos, ie_len);
-		bss->ie_len = ie_len;
-	}
-
-	if (elems.ssid && elems.ssid_len <= MAX_SSID_LEN) {
-		os_memcpy(bss->ssid, elems.ssid, elems.ssid_len);
-		bss->ssid_len = elems.ssid_len;
-	}
-
-	bss->supp_rates_len = 0;
-	if (elems.supp_rates) {
-		clen = IEEE80211_MAX_SUPP_RATES - bss->supp_rates_len;
-		if (clen > elems.supp_rates_len)
-			clen = elems.supp_rates_len;
-		os_memcpy(&bss->supp_rates[bss->supp_rates_len],
-			  elems.supp_rates, clen);
-		bss->supp_rates_len += clen;
-	}
-	if (elems.ext_supp_rates) {
-		clen = IEEE80211_MAX_SUPP_RATES - bss->supp_rates_len;
-		if (clen > elems.ext_supp_rates_len)
-			clen = elems.ext_supp_rates_len;
-		os_memcpy(&bss->supp_rates[bss->supp_rates_len],
-			  elems.ext_supp_rates, clen);
-		bss->supp_rates_len += clen;
-	}
-
-	if (elems.wpa_ie &&
-	    (bss->wpa_ie == NULL || bss->wpa_ie_len != elems.wpa_ie_len ||
-	     os_memcmp(bss->wpa_ie, elems.wpa_ie, elems.wpa_ie_len))) {
-		os_free(bss->wpa_ie);
-		bss->wpa_ie = os_malloc(elems.wpa_ie_len + 2);
-		if (bss->wpa_ie) {
-			os_memcpy(bss->wpa_ie, elems.wpa_ie - 2,
-				  elems.wpa_ie_len + 2);
-			bss->wpa_ie_len = elems.wpa_ie_len + 2;
-		} else
-			bss->wpa_ie_len = 0;
-	} else if (!elems.wpa_ie && bss->wpa_ie) {
-		os_free(bss->wpa_ie);
-		bss->wpa_ie = NULL;
-		bss->wpa_ie_len = 0;
-	}
-
-	if (elems.rsn_ie &&
-	    (bss->rsn_ie == NULL || bss->rsn_ie_len != elems.rsn_ie_len ||
-	     os_memcmp(bss->rsn_ie, elems.rsn_ie, elems.rsn_ie_len))) {
-		os_free(bss->rsn_ie);
-		bss->rsn_ie = os_malloc(elems.rsn_ie_len + 2);
-		if (bss->rsn_ie) {
-			os_memcpy(bss->rsn_ie, elems.rsn_ie - 2,
-				  elems.rsn_ie_len + 2);
-			bss->rsn_ie_len = elems.rsn_ie_len + 2;
-		} else
-			bss->rsn_ie_len = 0;
-	} else if (!elems.rsn_ie && bss->rsn_ie) {
-		os_free(bss->rsn_ie);
-		bss->rsn_ie = NULL;
-		bss->rsn_ie_len = 0;
-	}
-
-	if (elems.wmm &&
-	    (bss->wmm_ie == NULL || bss->wmm_ie_len != elems.wmm_len ||
-	     os_memcmp(bss->wmm_ie, elems.wmm, elems.wmm_len))) {
-		os_free(bss->wmm_ie);
-		bss->wmm_ie = os_malloc(elems.wmm_len + 2);
-		if (bss->wmm_ie) {
-			os_memcpy(bss->wmm_ie, elems.wmm - 2,
-				  elems.wmm_len + 2);
-			bss->wmm_ie_len = elems.wmm_len + 2;
-		} else
-			bss->wmm_ie_len = 0;
-	} else if (!elems.wmm && bss->wmm_ie) {
-		os_free(bss->wmm_ie);
-		bss->wmm_ie = NULL;
-		bss->wmm_ie_len = 0;
-	}
-
-#ifdef CONFIG_IEEE80211R
-	if (elems.mdie &&
-	    (bss->mdie == NULL || bss->mdie_len != elems.mdie_len ||
-	     os_memcmp(bss->mdie, elems.mdie, elems.mdie_len))) {
-		os_free(bss->mdie);
-		bss->mdie = os_malloc(elems.mdie_len + 2);
-		if (bss->mdie) {
-			os_memcpy(bss->mdie, elems.mdie - 2,
-				  elems.mdie_len + 2);
-			bss->mdie_len = elems.mdie_len + 2;
-		} else
-			bss->mdie_len = 0;
-	} else if (!elems.mdie && bss->mdie) {
-		os_free(bss->mdie);
-		bss->mdie = NULL;
-		bss->mdie_len = 0;
-	}
-#endif /* CONFIG_IEEE80211R */
-
 	bss->hw_mode = wpa_s->mlme.phymode;
 	bss->channel = channel;
 	bss->freq = wpa_s->mlme.freq;
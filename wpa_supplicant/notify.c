@@ -18,6 +18,8 @@
 #include "common/wpa_ctrl.h"
 #include "config.h"
 #include "wpa_supplicant_i.h"
+#include "rsn_supp/wpa.h"
+#include "rsn_supp/preauth.h"
 #include "wps_supplicant.h"
 #include "dbus/dbus_common.h"
 #include "dbus/dbus_old.h"
@@ -258,6 +260,7 @@ void wpas_notify_bss_removed(struct wpa_supplicant *wpa_s,
 	wpas_dbus_unregister_bss(wpa_s, bssid, id);
 	wpa_msg_ctrl(wpa_s, MSG_INFO, WPA_EVENT_BSS_REMOVED "%u " MACSTR,
 		     id, MAC2STR(bssid));
+	pmksa_candidate_remove(wpa_s->wpa, bssid);
 }
 
 
@@ -1537,6 +1537,7 @@ void wpas_sd_request(void *ctx, int freq, const u8 *sa, u8 dialog_token,
 	u8 srv_proto, srv_trans_id;
 	size_t buf_len;
 	char *buf;
+	int use_cache;
 
 	wpa_hexdump(MSG_MSGDUMP, "P2P: Service Discovery Request TLVs",
 		    tlvs, tlvs_len);
@@ -1554,6 +1555,21 @@ void wpas_sd_request(void *ctx, int freq, const u8 *sa, u8 dialog_token,
 	if (wpa_s->p2p_sd_over_ctrl_iface)
 		return; /* to be processed by an external program */
 
+	/*
+	 * Responses depend only on the query and the local services, so they
+	 * can be cached in the P2P module until the next service update.
+	 */
+	use_cache = !wpa_s->force_long_sd &&
+		!(wpa_s->drv_flags & WPA_DRIVER_FLAGS_P2P_MGMT) &&
+		!wpa_s->global->p2p_disabled && wpa_s->global->p2p;
+	if (use_cache &&
+	    p2p_sd_response_cached(wpa_s->global->p2p, freq, sa, dialog_token,
+				   tlvs, tlvs_len) == 0) {
+		wpas_notify_p2p_sd_request(wpa_s, freq, sa, dialog_token,
+					   update_indic, tlvs, tlvs_len);
+		return;
+	}
+
 	resp = wpabuf_alloc(10000);
 	if (resp == NULL)
 		return;
@@ -1628,7 +1644,11 @@ done:
 	wpas_notify_p2p_sd_request(wpa_s, freq, sa, dialog_token,
 				   update_indic, tlvs, tlvs_len);
 
-	wpas_p2p_sd_response(wpa_s, freq, sa, dialog_token, resp);
+	if (use_cache)
+		p2p_sd_response_cache(wpa_s->global->p2p, freq, sa,
+				       dialog_token, tlvs, tlvs_len, resp);
+	else
+		wpas_p2p_sd_response(wpa_s, freq, sa, dialog_token, resp);
 
 	wpabuf_free(resp);
 }
@@ -45,6 +45,7 @@ struct hostapd_hw_modes;
 struct ctrl_iface_priv;
 struct ctrl_iface_global_priv;
 struct wpas_dbus_priv;
+struct wpas_dbus_bss_changes;
 
 /**
  * struct wpa_interface - Parameters for wpa_supplicant_add_iface()
@@ -291,9 +292,9 @@ struct wpa_client_mlme {
 	int *scan_freqs;
 
 	struct ieee80211_sta_bss *sta_bss_list;
-#define STA_HASH_SIZE 256
-#define STA_HASH(sta) (sta[5])
-	struct ieee80211_sta_bss *sta_bss_hash[STA_HASH_SIZE];
+	struct ieee80211_sta_bss **sta_bss_hash;
+	unsigned int sta_bss_hash_size; /* power of two */
+	unsigned int num_sta_bss;
 
 	int cts_protect_erp_frames;
 
@@ -344,6 +345,7 @@ struct wpa_supplicant {
 #ifdef CONFIG_CTRL_IFACE_DBUS_NEW
 	char *dbus_new_path;
 	char *dbus_groupobj_path;
+	struct wpas_dbus_bss_changes *dbus_bss_changes;
 #endif /* CONFIG_CTRL_IFACE_DBUS_NEW */
 	char bridge_ifname[16];
 
@@ -639,6 +641,8 @@ void wpa_supplicant_mark_disassoc(struct wpa_supplicant *wpa_s);
 void wpa_supplicant_connect(struct wpa_supplicant *wpa_s,
 			    struct wpa_bss *selected,
 			    struct wpa_ssid *ssid);
+void wpa_supplicant_rsn_preauth_bss(struct wpa_supplicant *wpa_s,
+				    struct wpa_bss *bss);
 
 /* eap_register.c */
 int eap_register_methods(void);